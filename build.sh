@@ -31,6 +31,7 @@ if [ ! -f "$CORE_DIR/lib/lib$RUNTIME_LIBRARY.so" ] || true; then
     sudo cp "$WASMER_LIBRARY_DIR/lib$RUNTIME_LIBRARY.so" "$CORE_DIR/lib/lib$RUNTIME_LIBRARY.so"
 
     sudo cp "shared/include/onyx_library.h" "$CORE_DIR/include/onyx_library.h"
+    sudo cp "shared/include/ovm_extensions.h" "$CORE_DIR/include/ovm_extensions.h"
     sudo cp "$WASMER_INCLUDE_DIR/wasm.h" "$CORE_DIR/include/wasm.h"
 fi
 
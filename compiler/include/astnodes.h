@@ -1079,15 +1079,25 @@ struct OverloadOption {
     AstTyped* option;
 };
 
+// NOTE: Caches the work done to match a set of overloads. This is invalidated
+// whenever an option is added to any set of overloads, because an overloaded
+// function can be an option of another overloaded function.
+typedef struct OverloadCache OverloadCache;
+struct OverloadCache {
+    u32 generation;
+
+    // Every option that is reachable, in the order they are tried.
+    bh_arr(AstTyped *) options;
+
+    // The option that was matched for a list of argument types.
+    Table(AstTyped *) matches;
+};
+
 struct AstOverloadedFunction {
     AstTyped_base;
 
     bh_arr(OverloadOption) overloads;
-
-    // CLEANUP: This is unused right now, but should be used to cache
-    // the complete set of overloads that can be used by an overloaded
-    // function.
-    bh_imap            all_overloads;
+    OverloadCache          cache;
 
     AstType *expected_return_node;
     Type    *expected_return_type;
@@ -1276,6 +1286,7 @@ struct AstFunction {
     b32 is_exported  : 1;
     b32 is_foreign   : 1;
     b32 is_intrinsic : 1;
+    b32 is_inline    : 1;
 };
 
 struct AstPolyQuery {
@@ -1529,8 +1540,13 @@ typedef struct EntityHeap {
 
 void entity_heap_init(EntityHeap* entities);
 void entity_heap_insert_existing(EntityHeap* entities, Entity* e);
+void entity_heap_reset_entity(EntityHeap* entities, Entity* e, EntityState state);
+void entity_heap_reorder(EntityHeap* entities);
+u32 entity_heap_reserve_ids(u32 count);
+void entity_heap_use_reserved_ids(u32 first);
 Entity* entity_heap_insert(EntityHeap* entities, Entity e);
 Entity* entity_heap_top(EntityHeap* entities);
+b32 entity_heap_top_comes_before(EntityHeap* entities, Entity* e);
 void entity_heap_change_top(EntityHeap* entities, Entity* new_top);
 void entity_heap_remove_top(EntityHeap* entities);
 void entity_change_type(EntityHeap* entities, Entity *ent, EntityType new_type);
@@ -1543,6 +1559,29 @@ void symres_entity(Entity* ent);
 void check_entity(Entity* ent);
 void emit_entity(Entity* ent);
 
+// Type checks the bodies of a batch of function entities across the worker
+// threads. The results are used when check_entity is called on each entity.
+void check_entity_batch(Entity** ents, i32 count);
+
+// Drops the result from check_entity_batch for an entity that was not
+// processed with its batch, because it could be out of date by the time
+// the entity is processed.
+void check_entity_batch_discard(Entity* ent);
+
+// Checking on a worker thread cannot change anything shared with the rest of
+// the program. check_requires_main_thread() abandons a check on a worker, so it
+// is done again on the main thread, and does nothing otherwise.
+// check_writes_to_node() does the same when `node` does not belong to the
+// function that is being checked.
+b32  checking_on_worker_thread();
+void check_requires_main_thread();
+void check_writes_to_node(AstNode* node);
+
+// Emits the bodies of a batch of function entities across the worker threads.
+// The results are merged into the module when emit_entity is called on each
+// entity, which has to happen in the order of the batch.
+void emit_entity_batch(Entity** ents, i32 count);
+
 struct Package {
     char *name;
 
@@ -1562,6 +1601,7 @@ enum CompileAction {
     ONYX_COMPILE_ACTION_COMPILE,
     ONYX_COMPILE_ACTION_CHECK,
     ONYX_COMPILE_ACTION_RUN,
+    ONYX_COMPILE_ACTION_WATCH,
     ONYX_COMPILE_ACTION_DOCUMENT,
     ONYX_COMPILE_ACTION_PRINT_HELP,
 };
@@ -1593,18 +1633,28 @@ struct CompileOptions {
     b32 use_post_mvp_features : 1;
     b32 use_multi_threading   : 1;
     b32 generate_foreign_info : 1;
+    b32 full_type_table       : 1;
     b32 no_std                : 1;
 
     b32 generate_tag_file         : 1;
     b32 generate_symbol_info_file : 1;
+    b32 generate_debug_info       : 1; // Set by --debug and --profile.
+
+    b32 incremental : 1;
+    b32 optimize    : 1;
 
     Runtime runtime;
 
+    // 0 means one thread per CPU.
+    i32 thread_count;
+
     bh_arr(const char *) included_folders;
     bh_arr(const char *) files;
     const char* target_file;
     const char* documentation_file;
     const char* symbol_info_file;
+    const char* profile_file;
+    const char* watch_socket;
 
     b32 debug_enabled;
 
@@ -1719,6 +1769,7 @@ typedef Table(OnyxIntrinsic) IntrinsicTable;
 extern IntrinsicTable intrinsic_table;
 
 extern bh_arr(OverloadOption) operator_overloads[Binary_Op_Count];
+extern OverloadCache operator_overload_caches[Binary_Op_Count];
 
 void initialize_builtins(bh_allocator a);
 void initalize_special_globals();
@@ -1811,9 +1862,9 @@ typedef struct OverloadReturnTypeCheck {
 } OverloadReturnTypeCheck;
 
 void add_overload_option(bh_arr(OverloadOption)* poverloads, u64 order, AstTyped* overload);
-AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads, Arguments* args);
-AstTyped* find_matching_overload_by_type(bh_arr(OverloadOption) overloads, Type* type);
-void report_unable_to_match_overload(AstCall* call, bh_arr(OverloadOption) overloads);
+AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads, OverloadCache* cache, Arguments* args);
+AstTyped* find_matching_overload_by_type(bh_arr(OverloadOption) overloads, OverloadCache* cache, Type* type);
+void report_unable_to_match_overload(AstCall* call, bh_arr(OverloadOption) overloads, OverloadCache* cache);
 void report_incorrect_overload_expected_type(Type *given, Type *expected, OnyxToken *overload, OnyxToken *group);
 void ensure_overload_returns_correct_type(AstTyped *overload, AstOverloadedFunction *group);
 
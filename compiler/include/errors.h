@@ -41,6 +41,7 @@ void onyx_report_error(OnyxFilePos pos, OnyxErrorRank rank, char * format, ...);
 void onyx_submit_warning(OnyxError error);
 void onyx_report_warning(OnyxFilePos pos, char* format, ...);
 void onyx_errors_print();
+void onyx_errors_capture(bh_arr(OnyxError)* target);
 b32  onyx_has_errors();
 void onyx_clear_errors();
 
@@ -12,6 +12,14 @@ typedef struct PolymorphicContext {
     bh_arr(AstPolyParam)* poly_params;
 } PolymorphicContext;
 
+// An entity that was parsed but not yet added to the entity heap.
+typedef struct ParsedEntity {
+    bh_arr(Entity *) *target_arr;
+    AstNode *node;
+    Scope   *scope;
+    Package *package;
+} ParsedEntity;
+
 typedef struct OnyxParser {
     bh_allocator allocator;
 
@@ -40,6 +48,11 @@ typedef struct OnyxParser {
     // onto this node.
     AstTyped *injection_point;
 
+    // NOTE: When this is non-NULL, entities are collected here instead of
+    // being added to the entity heap, so the file can be parsed off of the
+    // main thread. onyx_parser_submit_deferred_entities adds them later.
+    bh_arr(ParsedEntity) deferred_entities;
+
     // Used to set default precedence of #overload options.
     // This way, the precedence order of multiple #overload
     // options in the same file is given to be the lexical
@@ -59,4 +72,11 @@ OnyxParser onyx_parser_create(bh_allocator alloc, OnyxTokenizer *tokenizer);
 void onyx_parser_free(OnyxParser* parser);
 void onyx_parse(OnyxParser *parser);
 
+// onyx_parse is split into these two steps for parsing on worker threads.
+// The header declares the file's package, which touches global state and
+// has to happen on the main thread. The body only touches the parser.
+void onyx_parse_file_header(OnyxParser *parser);
+void onyx_parse_file_body(OnyxParser *parser);
+void onyx_parser_submit_deferred_entities(OnyxParser *parser);
+
 #endif // #ifndef ONYXPARSER_H
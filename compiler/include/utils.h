@@ -2,8 +2,9 @@
 
 #include "astnodes.h"
 
-extern bh_scratch global_scratch;
-extern bh_allocator global_scratch_allocator;
+// NOTE: Every worker thread has its own scratch allocator.
+extern BH_THREAD_LOCAL bh_scratch global_scratch;
+extern BH_THREAD_LOCAL bh_allocator global_scratch_allocator;
 
 extern bh_managed_heap global_heap;
 extern bh_allocator global_heap_allocator;
@@ -29,6 +30,31 @@ AstNode* try_symbol_raw_resolve_from_type(Type *type, char* symbol);
 Scope *get_scope_from_node(AstNode *node);
 Scope *get_scope_from_node_or_create(AstNode *node);
 
+// Worker threads
+//
+// Work that can be split into independent jobs is handed to worker_pool_run,
+// which calls `job` once for every index in [0, job_count) across all workers.
+// The main thread is worker 0 and takes part in every run. worker_pool_run
+// returns once every job has finished.
+//
+// Threads do not survive fork(). worker_pool_suspend stops the threads, but
+// keeps the arenas of the workers, since nodes made on them are still in use.
+// worker_pool_resume starts them again, in the parent or in the forked child.
+typedef void (*WorkerJob)(void *data, i32 index);
+
+void worker_pool_init(i32 thread_count);
+void worker_pool_free();
+void worker_pool_suspend();
+void worker_pool_resume();
+void worker_pool_run(i32 job_count, WorkerJob job, void *data);
+i32  worker_pool_thread_count();
+i32  worker_index();
+
+// An allocator that allocates from the calling worker's own arena, so it can
+// be used from any thread. The main thread allocates from `main_arena`.
+// context.ast_alloc is one of these.
+bh_allocator worker_ast_allocator(bh_arena* main_arena);
+
 void build_all_overload_options(bh_arr(OverloadOption) overloads, bh_imap* all_overloads);
 
 u32 char_to_base16_value(char x);
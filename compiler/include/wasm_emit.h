@@ -544,6 +544,9 @@ typedef struct WasmFunc {
     LocalAllocator locals;
     bh_arr(WasmInstruction) code;
     OnyxToken *location;
+
+    // Set for procedures marked #inline.
+    b32 always_inline;
 } WasmFunc;
 
 typedef struct WasmGlobal {
@@ -587,16 +590,18 @@ typedef enum DatumPatchInfoKind {
     Datum_Patch_Instruction,
     Datum_Patch_Data,
     Datum_Patch_Relative,
+    Datum_Patch_Length,
 } DatumPatchInfoKind;
 
 //
 // This represents a pointer that should be filled in
 // later when the corresponding data element is placed.
 //
-// There are three kinds of patches:
+// There are four kinds of patches:
 //   - Instruction
 //   - Data
 //   - Relative
+//   - Length
 //
 // In all cases, the `data_id` member is set to the id
 // of the WasmDatum entry that will be the base address,
@@ -622,6 +627,10 @@ typedef enum DatumPatchInfoKind {
 // convenience, if the value is 0 (null), it will remain as
 // 0.
 //
+// Length patches are like instruction patches, but the
+// instruction is given the length of the WasmDatum entry,
+// for entries whose data is only filled in when linking.
+//
 typedef struct DatumPatchInfo {
     DatumPatchInfoKind kind;
     u32 data_id;
@@ -711,6 +720,12 @@ typedef struct OnyxWasmModule {
 
     bh_arr(AstFunction *) procedures_with_tags;
 
+    // NOTE: The types whose information is written to the runtime type table,
+    // and the ones of them that have not been written yet.
+    bh_imap     type_table_used;
+    bh_arr(u32) type_table_pending;
+    u32         type_table_data_id;
+
     // NOTE: Used internally as a map from strings that represent function types,
     // 0x7f 0x7f : 0x7f ( (i32, i32) -> i32 )
     // to the function type index if it has been created.
@@ -757,6 +772,9 @@ typedef struct OnyxWasmModule {
     struct DebugContext *debug_context;
 #endif
 
+    // NOTE: Set when this is the copy of the module that a
+    // function is being emitted into on a worker thread.
+    struct FunctionEmission *emission;
 } OnyxWasmModule;
 
 typedef struct OnyxWasmLinkOptions {
@@ -789,7 +807,7 @@ void onyx_wasm_module_write_to_buffer(OnyxWasmModule* module, bh_buffer* buffer)
 void onyx_wasm_module_write_to_file(OnyxWasmModule* module, bh_file file);
 
 #ifdef ENABLE_RUN_WITH_WASMER
-void onyx_run_initialize(b32 debug_enabled);
+void onyx_run_initialize(b32 debug_enabled, char *program_cache_dir, char *profile_output);
 b32 onyx_run_wasm(bh_buffer code_buffer, int argc, char *argv[]);
 #endif
 
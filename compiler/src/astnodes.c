@@ -433,13 +433,17 @@ void promote_numlit_to_larger(AstNumLit* num) {
 
 // NOTE: Returns 1 if the conversion was successful.
 b32 convert_numlit_to_type(AstNumLit* num, Type* to_type) {
-    if (num->type == NULL)
+    if (num->type == NULL) {
+        check_writes_to_node((AstNode *) num);
         num->type = type_build_from_ast(context.ast_alloc, num->type_node);
+    }
     assert(num->type);
 
     if (types_are_compatible(num->type, to_type)) return 1;
     if (!type_is_numeric(to_type)) return 0;
 
+    check_writes_to_node((AstNode *) num);
+
     Type *type = to_type;
     if (type->kind == Type_Kind_Enum) type = type->Enum.backing;
     if (type->kind == Type_Kind_Distinct) type = type->Distinct.base_type;
@@ -564,6 +568,23 @@ TypeMatch unify_node_and_type_(AstTyped** pnode, Type* type, b32 permanent) {
     if (type == NULL) return TYPE_MATCH_FAILED;
     if (node == NULL) return TYPE_MATCH_FAILED;
 
+    if (checking_on_worker_thread()) {
+        switch (node->kind) {
+            case Ast_Kind_Struct_Literal:
+            case Ast_Kind_Array_Literal:
+            case Ast_Kind_Unary_Field_Access:
+            case Ast_Kind_Overloaded_Function:
+            case Ast_Kind_Polymorphic_Proc:
+            case Ast_Kind_Compound:
+            case Ast_Kind_If_Expression:
+            case Ast_Kind_Alias:
+                check_requires_main_thread();
+                break;
+
+            default: break;
+        }
+    }
+
     if (node->kind == Ast_Kind_Struct_Literal && (node->type_node == NULL && node->type == NULL)) {
         if (node->entity != NULL) return TYPE_MATCH_SUCCESS;
         if (type->kind == Type_Kind_VarArgs) type = type->VarArgs.elem;
@@ -663,7 +684,7 @@ TypeMatch unify_node_and_type_(AstTyped** pnode, Type* type, b32 permanent) {
     }
 
     if (node->kind == Ast_Kind_Overloaded_Function) {
-        AstTyped* func = find_matching_overload_by_type(((AstOverloadedFunction *) node)->overloads, type);
+        AstTyped* func = find_matching_overload_by_type(((AstOverloadedFunction *) node)->overloads, &((AstOverloadedFunction *) node)->cache, type);
         if (func == NULL) return TYPE_MATCH_FAILED;
         if (func == (AstTyped *) &node_that_signals_a_yield) return TYPE_MATCH_YIELD;
 
@@ -713,6 +734,7 @@ TypeMatch unify_node_and_type_(AstTyped** pnode, Type* type, b32 permanent) {
         && node_type->Function.return_type == &type_auto_return
         && type->kind == Type_Kind_Function) {
 
+        check_requires_main_thread();
         node_type->Function.return_type = type->Function.return_type;
         return TYPE_MATCH_SUCCESS;
     }
@@ -726,7 +748,10 @@ TypeMatch unify_node_and_type_(AstTyped** pnode, Type* type, b32 permanent) {
             return TYPE_MATCH_FAILED;
 
         } else {
-            if (permanent) ((AstUnaryOp *) node)->type = type;
+            if (permanent) {
+                check_writes_to_node((AstNode *) node);
+                ((AstUnaryOp *) node)->type = type;
+            }
             return TYPE_MATCH_SUCCESS;
         }
     }
@@ -815,6 +840,7 @@ TypeMatch unify_node_and_type_(AstTyped** pnode, Type* type, b32 permanent) {
 
     else if (node->kind == Ast_Kind_Zero_Value) {
         if (node_type == NULL) {
+            check_writes_to_node((AstNode *) node);
             node->type = type;
             return TYPE_MATCH_SUCCESS; // Shouldn't this be on the next line? And have node_type == node->type checked?
         }
@@ -977,6 +1003,24 @@ Type* query_expression_type(AstTyped *node) {
 Type* resolve_expression_type(AstTyped* node) {
     if (node == NULL) return NULL;
 
+    if (checking_on_worker_thread()) {
+        switch (node->kind) {
+            case Ast_Kind_Compound:
+            case Ast_Kind_If_Expression:
+            case Ast_Kind_Polymorphic_Proc:
+            case Ast_Kind_Package:
+                check_requires_main_thread();
+                break;
+
+            case Ast_Kind_Array_Literal:
+            case Ast_Kind_Struct_Literal:
+                if (node->type == NULL) check_requires_main_thread();
+                break;
+
+            default: break;
+        }
+    }
+
     if (node->kind == Ast_Kind_Compound) {
         bh_arr_each(AstTyped *, expr, ((AstCompound *) node)->exprs) {
             resolve_expression_type(*expr);
@@ -1001,7 +1045,14 @@ Type* resolve_expression_type(AstTyped* node) {
 
     if (node->kind == Ast_Kind_Alias) {
         AstAlias* alias = (AstAlias *) node;
-        alias->type = resolve_expression_type(alias->alias);
+        Type* alias_type = resolve_expression_type(alias->alias);
+
+        // Aliases are shared between functions that are emitted in parallel,
+        // so they are only written until their type is known.
+        if (alias->type != alias_type) {
+            check_requires_main_thread();
+            alias->type = alias_type;
+        }
     }
 
     if (node_is_type((AstNode *) node)) {
@@ -1061,8 +1112,10 @@ Type* resolve_expression_type(AstTyped* node) {
         node->type = type_build_from_ast(context.ast_alloc, node->type_node);
     }
 
-    if (node->type == NULL)
+    if (node->type == NULL) {
+        check_writes_to_node((AstNode *) node);
         node->type = type_build_from_ast(context.ast_alloc, node->type_node);
+    }
 
     if (node->kind == Ast_Kind_NumLit && node->type->kind == Type_Kind_Basic) {
         if (node->type->Basic.kind == Basic_Kind_Int_Unsized) {
@@ -1369,6 +1422,8 @@ TypeMatch implicit_cast_to_bool(AstTyped **pnode) {
         return TYPE_MATCH_SUCCESS;
     }
     
+    check_requires_main_thread();
+
     if (implicit_cast_to_bool_cache.entries == NULL) {
         bh_imap_init(&implicit_cast_to_bool_cache, global_heap_allocator, 8);
     }
@@ -1384,7 +1439,7 @@ TypeMatch implicit_cast_to_bool(AstTyped **pnode) {
     }
     
     Arguments *args = (Arguments *) bh_imap_get(&implicit_cast_to_bool_cache, (u64) node);
-    AstFunction *overload = (AstFunction *) find_matching_overload_by_arguments(builtin_implicit_bool_cast->overloads, args);
+    AstFunction *overload = (AstFunction *) find_matching_overload_by_arguments(builtin_implicit_bool_cast->overloads, &builtin_implicit_bool_cast->cache, args);
 
     if (overload == NULL)                                       return TYPE_MATCH_FAILED;
     if (overload == (AstFunction *) &node_that_signals_a_yield) return TYPE_MATCH_YIELD;
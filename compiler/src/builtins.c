@@ -368,6 +368,7 @@ static IntrinsicMap builtin_intrinsics[] = {
 };
 
 bh_arr(OverloadOption) operator_overloads[Binary_Op_Count] = { 0 };
+OverloadCache operator_overload_caches[Binary_Op_Count] = { 0 };
 
 void initialize_builtins(bh_allocator a) {
     // HACK
@@ -519,7 +520,17 @@ void introduce_build_options(bh_allocator a) {
     multi_threaded->type_node = (AstType *) &basic_type_bool;
     symbol_builtin_introduce(p->scope, "Multi_Threading_Enabled", (AstNode *) multi_threaded);
 
-    AstNumLit* wait_notify_available = make_int_literal(a, context.options->use_multi_threading && context.options->runtime == Runtime_Js);
+    //
+    // Of the runtimes 'onyx run' can use, only OVM is known to implement
+    // memory.atomic.wait and memory.atomic.notify.
+    b32 onyx_runtime_has_wait_notify = 0;
+    #ifdef USE_OVM_DEBUGGER
+        onyx_runtime_has_wait_notify = 1;
+    #endif
+
+    AstNumLit* wait_notify_available = make_int_literal(a, context.options->use_multi_threading
+        && (context.options->runtime == Runtime_Js
+            || (context.options->runtime == Runtime_Onyx && onyx_runtime_has_wait_notify)));
     wait_notify_available->type_node = (AstType *) &basic_type_bool;
     symbol_builtin_introduce(p->scope, "Wait_Notify_Available", (AstNode *) wait_notify_available);
 
@@ -2,6 +2,8 @@
 #include "parser.h"
 #include "utils.h"
 
+#include <setjmp.h>
+
 // All of the `check` functions return a boolean that signals if an issue
 // was reached while processing the node. These error booleans propagate
 // up the call stack until they reach `check_entity`.
@@ -112,29 +114,106 @@ CheckStatus check_directive_first(AstDirectiveFirst *first);
 CheckStatus check_directive_export_name(AstDirectiveExportName *ename);
 
 // HACK HACK HACK
-b32 expression_types_must_be_known = 0;
-b32 all_checks_are_final           = 1;
-b32 inside_for_iterator            = 0;
-bh_arr(AstFor *) for_node_stack    = NULL;
+// NOTE: These are thread local because function bodies are checked on the worker threads.
+BH_THREAD_LOCAL b32 expression_types_must_be_known = 0;
+BH_THREAD_LOCAL b32 all_checks_are_final           = 1;
+BH_THREAD_LOCAL b32 inside_for_iterator            = 0;
+BH_THREAD_LOCAL bh_arr(AstFor *) for_node_stack    = NULL;
 static bh_imap __binop_impossible_cache[Binary_Op_Count];
 static AstCall __binop_maybe_overloaded;
 
 
 #define STATEMENT_LEVEL 1
 #define EXPRESSION_LEVEL 2
-u32 current_checking_level=0;
+BH_THREAD_LOCAL u32 current_checking_level=0;
+
+// HACK: This should be baked into a structure, not a global variable.
+static BH_THREAD_LOCAL bh_arr(Type **) expected_return_type_stack = NULL;
+
+//
+// Function bodies that are taken off of the entity heap together are type checked
+// across the worker threads first (see check_entity_batch). A worker cannot change
+// anything that is shared with the rest of the program: shared nodes, the type
+// tables, the overload and polymorph caches, or the entity heap. Before doing any
+// of that, check_requires_main_thread() is called, which abandons the check on the
+// worker. Whatever progress was made on the function's own nodes is kept, the same
+// as when a check yields, and the entity is checked on the main thread when it is
+// processed. Nodes with an entity are the ones that are shared between functions.
+//
+// The results are used when check_entity is called on each entity, in the order
+// that the entities come off of the heap, so the output does not depend on the
+// number of threads.
+//
+typedef struct CheckedFunction {
+    Entity* entity;
+    CheckStatus status;
+    b32 on_main_thread;
+    bh_arr(OnyxError) errors;
+
+    // Functions marked as used while checking on the worker. They are
+    // marked on the main thread once the whole batch has been checked.
+    bh_arr(AstTyped *) used_functions;
+} CheckedFunction;
+
+static bh_arr(CheckedFunction *) checked_function_batch = NULL;
+static bh_imap checked_function_map;
+
+static BH_THREAD_LOCAL CheckedFunction* current_checked_function = NULL;
+static BH_THREAD_LOCAL jmp_buf* worker_check_abort = NULL;
+
+b32 checking_on_worker_thread() {
+    return current_checked_function != NULL;
+}
+
+void check_requires_main_thread() {
+    if (worker_check_abort) longjmp(*worker_check_abort, 1);
+}
+
+void check_writes_to_node(AstNode* node) {
+    if (!worker_check_abort || node == NULL) return;
+    if (node->entity != NULL) check_requires_main_thread();
+
+    switch (node->kind) {
+        case Ast_Kind_Global:
+        case Ast_Kind_Function:
+        case Ast_Kind_Polymorphic_Proc:
+        case Ast_Kind_Overloaded_Function:
+        case Ast_Kind_Macro:
+        case Ast_Kind_Memres:
+        case Ast_Kind_StrLit:
+        case Ast_Kind_Enum_Value:
+        case Ast_Kind_Package:
+        case Ast_Kind_Alias:
+            check_requires_main_thread();
+            break;
+
+        default:
+            // Type nodes in an expression are almost always a resolved symbol,
+            // like the builtin basic types.
+            if (node_is_type(node)) check_requires_main_thread();
+            break;
+    }
+}
+
+static void mark_function_used(AstTyped* func) {
+    if (current_checked_function) {
+        bh_arr_push(current_checked_function->used_functions, func);
+        return;
+    }
+
+    func->flags |= Ast_Flag_Function_Used;
+}
 
 static inline void fill_in_type(AstTyped* node) {
-    if (node->type == NULL) {
+    if (node->type == NULL && node->type_node != NULL) {
+        check_writes_to_node((AstNode *) node);
+
         if (check_type(&node->type_node) > Check_Errors_Start) return;
 
         node->type = type_build_from_ast(context.ast_alloc, node->type_node);
     }
 }
 
-// HACK: This should be baked into a structure, not a global variable.
-static bh_arr(Type **) expected_return_type_stack = NULL;
-
 CheckStatus check_return(AstReturn* retnode) {
     Type ** expected_return_type;
     
@@ -261,6 +340,7 @@ CheckStatus check_for(AstFor* fornode) {
     b32 old_inside_for_iterator;
     if (fornode->flags & Ast_Flag_Has_Been_Checked) goto fornode_expr_checked;
 
+    check_writes_to_node((AstNode *) fornode);
     CHECK(expression, &fornode->iter);
     resolve_expression_type(fornode->iter);
 
@@ -273,7 +353,11 @@ CheckStatus check_for(AstFor* fornode) {
     }
 
     // @HACK This should be built elsewhere...
-    builtin_range_type_type = type_build_from_ast(context.ast_alloc, builtin_range_type);
+    if (checking_on_worker_thread()) {
+        if (builtin_range_type_type == NULL) check_requires_main_thread();
+    } else {
+        builtin_range_type_type = type_build_from_ast(context.ast_alloc, builtin_range_type);
+    }
     if (builtin_range_type_type == NULL) YIELD(fornode->token->pos, "Waiting for 'range' structure to be built.");
 
     fornode->loop_type = For_Loop_Invalid;
@@ -282,6 +366,9 @@ CheckStatus check_for(AstFor* fornode) {
             ERROR(error_loc, "Cannot iterate by pointer over a range.");
         }
 
+        // Checking the range literal made here checks the default step of the 'range' structure.
+        check_requires_main_thread();
+
         AstNumLit* low_0    = make_int_literal(context.ast_alloc, 0);
         AstRangeLiteral* rl = make_range_literal(context.ast_alloc, (AstTyped *) low_0, fornode->iter);
         CHECK(range_literal, &rl);
@@ -600,6 +687,7 @@ static CheckStatus check_resolve_callee(AstCall* call, AstTyped** effective_call
     if (callee->kind == Ast_Kind_Overloaded_Function) {
         AstTyped* new_callee = find_matching_overload_by_arguments(
             ((AstOverloadedFunction *) callee)->overloads,
+            &((AstOverloadedFunction *) callee)->cache,
             &call->args);
 
         if (new_callee == NULL) {
@@ -607,7 +695,7 @@ static CheckStatus check_resolve_callee(AstCall* call, AstTyped** effective_call
                 YIELD(call->token->pos, "Waiting to know all options for overloaded function");
             }
  
-            report_unable_to_match_overload(call, ((AstOverloadedFunction *) callee)->overloads);
+            report_unable_to_match_overload(call, ((AstOverloadedFunction *) callee)->overloads, &((AstOverloadedFunction *) callee)->cache);
             return Check_Error;
         }
 
@@ -621,6 +709,8 @@ static CheckStatus check_resolve_callee(AstCall* call, AstTyped** effective_call
     }
 
     if (callee->kind == Ast_Kind_Macro) {
+        // Resolving macros and polymorphic procedures builds new nodes that are shared.
+        check_requires_main_thread();
         calling_a_macro = 1;
         call->callee = callee;
 
@@ -634,6 +724,8 @@ static CheckStatus check_resolve_callee(AstCall* call, AstTyped** effective_call
         callee = new_callee;
 
     } else while (callee->kind == Ast_Kind_Polymorphic_Proc) {
+        check_requires_main_thread();
+
         AstTyped* new_callee = (AstTyped *) polymorphic_proc_lookup((AstFunction *) callee, PPLM_By_Arguments, &call->args, call->token);
         if (new_callee == NULL) return Check_Error;
         if (new_callee == (AstTyped *) &node_that_signals_a_yield) {
@@ -645,6 +737,7 @@ static CheckStatus check_resolve_callee(AstCall* call, AstTyped** effective_call
     }
 
     // NOTE: Build callee's type
+    if (callee->type == NULL) check_writes_to_node((AstNode *) callee);
     fill_in_type((AstTyped *) callee);
     if (callee->type == NULL) {
         YIELD(call->token->pos, "Trying to resolve function type for callee.");
@@ -666,6 +759,37 @@ static CheckStatus check_resolve_callee(AstCall* call, AstTyped** effective_call
     return Check_Success;
 }
 
+// The default values belong to the callee, so they can only be used on a
+// worker thread once they have their final type. This is checked before
+// the arguments are changed, so the main thread can check the call again.
+static void check_default_values_on_worker(AstFunction* callee, Arguments* args) {
+    if (callee->kind != Ast_Kind_Function) return;
+
+    i32 given = bh_arr_length(args->values);
+    fori (idx, given, bh_arr_length(callee->params)) {
+        AstTyped* default_value = callee->params[idx].default_value;
+        if (default_value == NULL) continue;
+
+        switch (default_value->kind) {
+            case Ast_Kind_NumLit:
+            case Ast_Kind_StrLit:
+            case Ast_Kind_Function:
+            case Ast_Kind_Enum_Value:
+            case Ast_Kind_Global:
+            case Ast_Kind_Memres:
+                break;
+
+            default: check_requires_main_thread();
+        }
+
+        if (default_value->type == NULL
+            || idx >= (i32) callee->type->Function.param_count
+            || !types_are_compatible(default_value->type, callee->type->Function.params[idx])) {
+            check_requires_main_thread();
+        }
+    }
+}
+
 CheckStatus check_call(AstCall** pcall) {
     // All the things that need to be done when checking a call node.
     //      1. Ensure the callee is not a symbol
@@ -682,6 +806,8 @@ CheckStatus check_call(AstCall** pcall) {
     if (call->kind == Ast_Kind_Call) {
         AstNode* callee = strip_aliases((AstNode *) call->callee);
         if (callee->kind == Ast_Kind_Poly_Struct_Type) {
+            check_requires_main_thread();
+
             *pcall = (AstCall *) convert_call_to_polycall(call);
             CHECK(expression, (AstTyped **) pcall);
             return Check_Success;
@@ -702,8 +828,13 @@ CheckStatus check_call(AstCall** pcall) {
         if (callee->constraints.constraints != NULL && callee->constraints.constraints_met == 0) {
             YIELD(call->token->pos, "Waiting for constraints to be checked on callee.");
         }
+
+        // The warning below is only reported on the main thread.
+        if (callee->deprecated_warning) check_requires_main_thread();
     }
 
+    if (checking_on_worker_thread()) check_default_values_on_worker(callee, &call->args);
+
     i32 arg_count = get_argument_buffer_size(&callee->type->Function, &call->args);
     arguments_ensure_length(&call->args, arg_count);
 
@@ -724,6 +855,8 @@ CheckStatus check_call(AstCall** pcall) {
         AstTyped** arg_value = &(*arg)->value;
 
         if ((*arg_value)->kind == Ast_Kind_Call_Site) {
+            check_requires_main_thread();
+
             AstCallSite* callsite = (AstCallSite *) ast_clone(context.ast_alloc, *arg_value);
             callsite->callsite_token = call->token;
 
@@ -760,19 +893,17 @@ CheckStatus check_call(AstCall** pcall) {
         call->kind = Ast_Kind_Intrinsic_Call;
         call->callee = NULL;
 
-        token_toggle_end(callee->intrinsic_name);
-        char* intr_name = callee->intrinsic_name->text;
+        // The name is copied because the token can be shared with other threads.
+        char* intr_name = bh_aprintf(global_scratch_allocator, "%b",
+            callee->intrinsic_name->text, callee->intrinsic_name->length);
 
-        i32 index;
-        if ((index = shgeti(intrinsic_table, intr_name)) == -1) {
+        ptrdiff_t index;
+        if (shgeti_ts(intrinsic_table, intr_name, index) == -1) {
             onyx_report_error(callee->token->pos, Error_Critical, "Intrinsic not supported, '%s'.", intr_name);
-            token_toggle_end(callee->intrinsic_name);
             return Check_Error;
         }
 
         call->intrinsic = intrinsic_table[index].value;
-
-        token_toggle_end(callee->intrinsic_name);
     }
 
     call->va_kind = VA_Kind_Not_VA;
@@ -791,8 +922,8 @@ CheckStatus check_call(AstCall** pcall) {
 
     if (tm == TYPE_MATCH_YIELD) YIELD(call->token->pos, "Waiting on argument type checking.");
 
-    call->flags   |= Ast_Flag_Has_Been_Checked;
-    callee->flags |= Ast_Flag_Function_Used;
+    call->flags |= Ast_Flag_Has_Been_Checked;
+    mark_function_used((AstTyped *) callee);
 
     if (call->kind == Ast_Kind_Call && call->callee->kind == Ast_Kind_Macro) {
         expand_macro(pcall, callee);
@@ -850,7 +981,7 @@ static AstCall* binaryop_try_operator_overload(AstBinaryOp* binop, AstTyped* thi
         if (third_argument != NULL) binop->overload_args->values[2] = (AstTyped *) make_argument(context.ast_alloc, third_argument);
     }
 
-    AstTyped* overload = find_matching_overload_by_arguments(operator_overloads[binop->operation], binop->overload_args);
+    AstTyped* overload = find_matching_overload_by_arguments(operator_overloads[binop->operation], &operator_overload_caches[binop->operation], binop->overload_args);
     if (overload == NULL || overload == (AstTyped *) &node_that_signals_a_yield) return (AstCall *) overload;
 
     AstCall* implicit_call = onyx_ast_node_new(context.ast_alloc, sizeof(AstCall), Ast_Kind_Call);
@@ -865,6 +996,7 @@ static AstCall* binaryop_try_operator_overload(AstBinaryOp* binop, AstTyped* thi
 
 static CheckStatus assign_type_or_check(AstTyped **node, Type *type, OnyxToken *report_loc) {
     if (node && (*node)->type == NULL) {
+        check_writes_to_node((AstNode *) *node);
         (*node)->type = type;
 
     } else {
@@ -907,6 +1039,8 @@ CheckStatus check_binaryop_assignment(AstBinaryOp** pbinop) {
         // If a left operand has an unknown type, fill it in with the type of
         // the right hand side.
         if (binop->left->type == NULL) {
+            check_writes_to_node((AstNode *) binop->left);
+
             if (binop->left->type_node != NULL && binop->left->entity && binop->left->entity->state <= Entity_State_Check_Types) {
                 YIELD(binop->token->pos, "Waiting for type to be constructed on left hand side.");
             }
@@ -1154,6 +1288,8 @@ CheckStatus check_binaryop(AstBinaryOp** pbinop) {
     if (binop->flags & Ast_Flag_Has_Been_Checked) return Check_Success;
 
     if (binop->operation == Binary_Op_Assign && binop->left->kind == Ast_Kind_Subscript && bh_arr_length(operator_overloads[Binary_Op_Subscript_Equals]) > 0) {
+        check_requires_main_thread();
+
         AstSubscript* sub = (AstSubscript *) binop->left;
 
         if (binop->potential_substitute == NULL) {
@@ -1217,6 +1353,7 @@ CheckStatus check_binaryop(AstBinaryOp** pbinop) {
         u64 cache_key = 0;
         if (binop->left->type && binop->right->type) {
             if (!__binop_impossible_cache[binop->operation].hashes) {
+                check_requires_main_thread();
                 bh_imap_init(&__binop_impossible_cache[binop->operation], global_heap_allocator, 256);
             }
 
@@ -1227,6 +1364,8 @@ CheckStatus check_binaryop(AstBinaryOp** pbinop) {
             }
         }
 
+        check_requires_main_thread();
+
         AstCall *implicit_call = binaryop_try_operator_overload(binop, NULL);
 
         if (implicit_call == (AstCall *) &node_that_signals_a_yield)
@@ -1662,6 +1801,8 @@ CheckStatus check_address_of(AstAddressOf** paof) {
 
     AstTyped* expr = (AstTyped *) strip_aliases((AstNode *) aof->expr);
     if (expr->kind == Ast_Kind_Subscript && bh_arr_length(operator_overloads[Binary_Op_Ptr_Subscript]) > 0) {
+        check_requires_main_thread();
+
         if (aof->potential_substitute == NULL) {
             CHECK(expression, &((AstSubscript *) expr)->addr);
             CHECK(expression, &((AstSubscript *) expr)->expr);
@@ -1723,7 +1864,10 @@ CheckStatus check_address_of(AstAddressOf** paof) {
         ERROR_(aof->token->pos, "Cannot take the address of something that is not an l-value. %s", onyx_ast_node_kind_string(expr->kind));
     }
 
-    expr->flags |= Ast_Flag_Address_Taken;
+    if ((expr->flags & Ast_Flag_Address_Taken) == 0) {
+        check_writes_to_node((AstNode *) expr);
+        expr->flags |= Ast_Flag_Address_Taken;
+    }
 
     aof->type = type_make_pointer(context.ast_alloc, expr->type);
 
@@ -1759,6 +1903,8 @@ CheckStatus check_subscript(AstSubscript** psub) {
     if (sub->expr->type != NULL &&
         (sub->addr->type->kind != Type_Kind_Basic || sub->expr->type->kind != Type_Kind_Basic)
         && !(type_is_array_accessible(sub->addr->type))) {
+        check_requires_main_thread();
+
         // AstSubscript is the same as AstBinaryOp for the first sizeof(AstBinaryOp) bytes
         AstBinaryOp* binop = (AstBinaryOp *) sub;
         AstCall *implicit_call = binaryop_try_operator_overload(binop, NULL);
@@ -1840,9 +1986,7 @@ CheckStatus check_field_access(AstFieldAccess** pfield) {
     }
 
     if (field->token != NULL && field->field == NULL) {
-        token_toggle_end(field->token);
-        field->field = bh_strdup(context.ast_alloc, field->token->text);
-        token_toggle_end(field->token);
+        field->field = bh_aprintf(context.ast_alloc, "%b", field->token->text, field->token->length);
     }
 
     if (!type_is_structlike(field->expr->type)) {
@@ -1911,6 +2055,8 @@ CheckStatus check_field_access(AstFieldAccess** pfield) {
     AstNode *n;
     AstType *type_node;
   try_resolve_from_type:
+    check_requires_main_thread();
+
     n = try_symbol_raw_resolve_from_type(field->expr->type, field->field);
 
     type_node = field->expr->type->ast_type;
@@ -2015,6 +2161,47 @@ CheckStatus check_align_of(AstAlignOf* ao) {
     return Check_Success;
 }
 
+static void check_expression_on_worker(AstTyped* expr) {
+    switch (expr->kind) {
+        // These are never written to, so they can be shared.
+        case Ast_Kind_Global:
+        case Ast_Kind_NumLit:
+        case Ast_Kind_Function:
+        case Ast_Kind_StrLit:
+        case Ast_Kind_Enum_Value:
+        case Ast_Kind_Memres:
+        case Ast_Kind_Overloaded_Function:
+        case Ast_Kind_Package:
+            return;
+
+        case Ast_Kind_Binary_Op:
+        case Ast_Kind_Unary_Op:
+        case Ast_Kind_Intrinsic_Call:
+        case Ast_Kind_Call:
+        case Ast_Kind_Argument:
+        case Ast_Kind_Block:
+        case Ast_Kind_Param:
+        case Ast_Kind_Local:
+        case Ast_Kind_Address_Of:
+        case Ast_Kind_Dereference:
+        case Ast_Kind_Subscript:
+        case Ast_Kind_Field_Access:
+        case Ast_Kind_Method_Call:
+        case Ast_Kind_Size_Of:
+        case Ast_Kind_Align_Of:
+        case Ast_Kind_Symbol:
+        case Ast_Kind_Directive_Defined:
+        case Ast_Kind_Zero_Value:
+        case Ast_Kind_Error:
+            if (expr->entity == NULL) return;
+            break;
+
+        default: break;
+    }
+
+    check_requires_main_thread();
+}
+
 CheckStatus check_expression(AstTyped** pexpr) {
     AstTyped* expr = *pexpr;
     if (expr->kind > Ast_Kind_Type_Start && expr->kind < Ast_Kind_Type_End) {
@@ -2033,7 +2220,10 @@ CheckStatus check_expression(AstTyped** pexpr) {
             type_build_from_ast(context.ast_alloc, (AstType*) expr);
         }
 
-        expr->type = &basic_types[Basic_Kind_Type_Index];
+        if (expr->type != &basic_types[Basic_Kind_Type_Index]) {
+            check_writes_to_node((AstNode *) expr);
+            expr->type = &basic_types[Basic_Kind_Type_Index];
+        }
         return Check_Success;
     }
 
@@ -2051,6 +2241,8 @@ CheckStatus check_expression(AstTyped** pexpr) {
         ERROR(expr->token->pos, "#init declarations are not in normal expressions, only in #after clauses.");
     }
 
+    if (checking_on_worker_thread()) check_expression_on_worker(expr);
+
     fill_in_type(expr);
     current_checking_level = EXPRESSION_LEVEL;
 
@@ -2120,7 +2312,7 @@ CheckStatus check_expression(AstTyped** pexpr) {
             if (expr->type == NULL)
                 YIELD(expr->token->pos, "Waiting for function type to be resolved.");
 
-            expr->flags |= Ast_Flag_Function_Used;
+            mark_function_used(expr);
             break;
 
         case Ast_Kind_Directive_Solidify:
@@ -2189,7 +2381,10 @@ CheckStatus check_expression(AstTyped** pexpr) {
             YIELD(expr->token->pos, "Waiting to resolve #this_package.");
             break;
 
-        case Ast_Kind_File_Contents: break;
+        case Ast_Kind_File_Contents:
+            if (expr->type == NULL) expr->type = type_make_slice(context.ast_alloc, &basic_types[Basic_Kind_U8]);
+            break;
+
         case Ast_Kind_Overloaded_Function: break;
         case Ast_Kind_Enum_Value: break;
         case Ast_Kind_Polymorphic_Proc: break;
@@ -2372,6 +2567,18 @@ CheckStatus check_statement(AstNode** pstmt) {
 
     current_checking_level = STATEMENT_LEVEL;
 
+    if (checking_on_worker_thread()) {
+        switch (stmt->kind) {
+            case Ast_Kind_Static_If:
+            case Ast_Kind_Switch:
+            case Ast_Kind_Directive_Remove:
+                check_requires_main_thread();
+                break;
+
+            default: break;
+        }
+    }
+
     switch (stmt->kind) {
         case Ast_Kind_Jump:       return Check_Success;
 
@@ -2510,7 +2717,8 @@ CheckStatus check_function(AstFunction* func) {
         *bh_arr_last(expected_return_type_stack) = &basic_types[Basic_Kind_Void];
     }
 
-    func->flags |= Ast_Flag_Has_Been_Checked;
+    // NOTE: When checked on a worker, this is set when the result is used.
+    if (!checking_on_worker_thread()) func->flags |= Ast_Flag_Has_Been_Checked;
     return Check_Success;
 }
 
@@ -2939,6 +3147,27 @@ CheckStatus check_type(AstType** ptype) {
 
     if (type->flags & Ast_Flag_Has_Been_Checked) return Check_Success;
 
+    if (checking_on_worker_thread()) {
+        // Only the type expressions written inside of the function are checked on a worker.
+        b32 owned_by_function = original_type == type && type->entity == NULL;
+
+        switch (type->kind) {
+            case Ast_Kind_Pointer_Type:
+            case Ast_Kind_Slice_Type:
+            case Ast_Kind_DynArr_Type:
+            case Ast_Kind_VarArg_Type:
+            case Ast_Kind_Function_Type:
+            case Ast_Kind_Array_Type:
+                break;
+
+            default:
+                owned_by_function = 0;
+                break;
+        }
+
+        if (!owned_by_function) check_requires_main_thread();
+    }
+
     switch (type->kind) {
         case Ast_Kind_Poly_Call_Type: {
             AstPolyCallType* pc_node = (AstPolyCallType *) type;
@@ -2967,10 +3196,10 @@ CheckStatus check_type(AstType** ptype) {
             break;
         }
 
-        case Ast_Kind_Pointer_Type: ((AstPointerType *) type)->elem->flags |= type->flags & Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstPointerType *) type)->elem); break;
-        case Ast_Kind_Slice_Type:   ((AstSliceType *) type)->elem->flags |= type->flags & Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstSliceType *) type)->elem); break;
-        case Ast_Kind_DynArr_Type:  ((AstDynArrType *) type)->elem->flags |= type->flags & Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstDynArrType *) type)->elem); break;
-        case Ast_Kind_VarArg_Type:  ((AstVarArgType *) type)->elem->flags |= type->flags & Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstVarArgType *) type)->elem); break;
+        case Ast_Kind_Pointer_Type: if (type->flags & Ast_Flag_Header_Check_No_Error) ((AstPointerType *) type)->elem->flags |= Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstPointerType *) type)->elem); break;
+        case Ast_Kind_Slice_Type:   if (type->flags & Ast_Flag_Header_Check_No_Error) ((AstSliceType *) type)->elem->flags |= Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstSliceType *) type)->elem); break;
+        case Ast_Kind_DynArr_Type:  if (type->flags & Ast_Flag_Header_Check_No_Error) ((AstDynArrType *) type)->elem->flags |= Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstDynArrType *) type)->elem); break;
+        case Ast_Kind_VarArg_Type:  if (type->flags & Ast_Flag_Header_Check_No_Error) ((AstVarArgType *) type)->elem->flags |= Ast_Flag_Header_Check_No_Error; CHECK(type, &((AstVarArgType *) type)->elem); break;
 
         case Ast_Kind_Function_Type: {
             AstFunctionType* ftype = (AstFunctionType *) type;
@@ -3449,6 +3678,117 @@ CheckStatus check_arbitrary_job(EntityJobData *job) {
     return Check_Error;
 }
 
+static void check_function_job(void* data, i32 index) {
+    CheckedFunction* checked = ((CheckedFunction **) data)[index];
+    if (checked->on_main_thread) return;
+
+    // When this runs on the main thread, its state has to be left as it was.
+    b32 errors_enabled       = onyx_errors_are_enabled();
+    b32 types_must_be_known  = expression_types_must_be_known;
+    b32 checks_are_final     = all_checks_are_final;
+    b32 in_for_iterator      = inside_for_iterator;
+    u32 checking_level       = current_checking_level;
+
+    expression_types_must_be_known = 0;
+    all_checks_are_final = 1;
+    current_checking_level = 0;
+
+    jmp_buf abort;
+    current_checked_function = checked;
+    onyx_errors_capture(&checked->errors);
+
+    if (setjmp(abort) == 0) {
+        worker_check_abort = &abort;
+        checked->status = check_function(checked->entity->function);
+    } else {
+        checked->on_main_thread = 1;
+    }
+
+    worker_check_abort = NULL;
+    current_checked_function = NULL;
+    onyx_errors_capture(NULL);
+
+    expression_types_must_be_known = types_must_be_known;
+    all_checks_are_final   = checks_are_final;
+    inside_for_iterator    = in_for_iterator;
+    current_checking_level = checking_level;
+
+    if (errors_enabled) onyx_errors_enable();
+    else                onyx_errors_disable();
+}
+
+void check_entity_batch(Entity** ents, i32 count) {
+    if (checked_function_map.hashes == NULL) {
+        bh_imap_init(&checked_function_map, global_heap_allocator, 64);
+    }
+
+    bh_arr_clear(checked_function_batch);
+
+    fori (i, 0, count) {
+        assert(ents[i]->type == Entity_Type_Function);
+
+        AstFunction* func = ents[i]->function;
+
+        CheckedFunction* checked = bh_alloc_item(global_heap_allocator, CheckedFunction);
+        memset(checked, 0, sizeof(*checked));
+        checked->entity = ents[i];
+
+        // Tags and automatic return types change nodes that are shared.
+        checked->on_main_thread = func->tags != NULL
+                               || func->type == NULL
+                               || func->type->Function.return_type == &type_auto_return;
+
+        bh_arr_push(checked_function_batch, checked);
+        bh_imap_put(&checked_function_map, (u64) ents[i], (u64) checked);
+    }
+
+    worker_pool_run(bh_arr_length(checked_function_batch), check_function_job, checked_function_batch);
+
+    bh_arr_each(CheckedFunction *, checked, checked_function_batch) {
+        bh_arr_each(AstTyped *, func, (*checked)->used_functions) {
+            (*func)->flags |= Ast_Flag_Function_Used;
+        }
+
+        bh_arr_free((*checked)->used_functions);
+    }
+}
+
+void check_entity_batch_discard(Entity* ent) {
+    if (checked_function_map.hashes == NULL || !bh_imap_has(&checked_function_map, (u64) ent)) return;
+
+    CheckedFunction* checked = (CheckedFunction *) bh_imap_get(&checked_function_map, (u64) ent);
+    bh_imap_delete(&checked_function_map, (u64) ent);
+
+    bh_arr_free(checked->errors);
+    bh_free(global_heap_allocator, checked);
+}
+
+static CheckStatus check_function_entity(Entity* ent) {
+    if (checked_function_map.hashes == NULL || !bh_imap_has(&checked_function_map, (u64) ent)) {
+        return check_function(ent->function);
+    }
+
+    CheckedFunction* checked = (CheckedFunction *) bh_imap_get(&checked_function_map, (u64) ent);
+    bh_imap_delete(&checked_function_map, (u64) ent);
+
+    // Yielding on the worker could have been caused by something that
+    // changed since, so those are checked again here as well.
+    b32 use_result = !checked->on_main_thread && checked->status != Check_Yield_Macro;
+    CheckStatus status = checked->status;
+
+    if (use_result) {
+        bh_arr_each(OnyxError, err, checked->errors) onyx_submit_error(*err);
+
+        if (status == Check_Success) ent->function->flags |= Ast_Flag_Has_Been_Checked;
+    }
+
+    bh_arr_free(checked->errors);
+    bh_free(global_heap_allocator, checked);
+
+    if (use_result) return status;
+    return check_function(ent->function);
+}
+
 void check_entity(Entity* ent) {
     CheckStatus cs = Check_Success;
 
@@ -3456,7 +3796,7 @@ void check_entity(Entity* ent) {
         case Entity_Type_Foreign_Function_Header:
         case Entity_Type_Function_Header:          cs = check_function_header(ent->function); break;
         case Entity_Type_Temp_Function_Header:     cs = check_temp_function_header(ent->function); break;
-        case Entity_Type_Function:                 cs = check_function(ent->function); break;
+        case Entity_Type_Function:                 cs = check_function_entity(ent); break;
         case Entity_Type_Overloaded_Function:      cs = check_overloaded_function(ent->overloaded_function); break;
         case Entity_Type_Global:                   cs = check_global(ent->global); break;
         case Entity_Type_Struct_Member_Default:    cs = check_struct_defaults((AstStructType *) ent->type_alias); break;
@@ -76,6 +76,19 @@ void entity_heap_init(EntityHeap* entities) {
 
 static u32 next_entity_id = 0;
 
+// Entities that are otherwise equal are ordered by their ids. Setting aside a
+// range of ids lets entities that are registered later come before ones that
+// already exist, as if they had been registered first.
+u32 entity_heap_reserve_ids(u32 count) {
+    u32 first = next_entity_id;
+    next_entity_id += count;
+    return first;
+}
+
+void entity_heap_use_reserved_ids(u32 first) {
+    next_entity_id = first;
+}
+
 // Allocates the entity in the entity heap. Don't quite feel this is necessary...
 Entity* entity_heap_register(EntityHeap* entities, Entity e) {
     bh_allocator alloc = bh_arena_allocator(&entities->entity_arena);
@@ -105,6 +118,41 @@ void entity_heap_insert_existing(EntityHeap* entities, Entity* e) {
     entities->all_count[e->state][e->type]++;
 }
 
+// Moves an entity back to an earlier state. If the entity is already in the
+// heap, it is moved to its new place, so the heap stays in order.
+void entity_heap_reset_entity(EntityHeap* entities, Entity* e, EntityState state) {
+    if (!e->entered_in_queue) {
+        e->state = state;
+        e->macro_attempts = 0;
+        entity_heap_insert_existing(entities, e);
+        return;
+    }
+
+    if (e->state == state && e->macro_attempts == 0) return;
+
+    i32 index = 0;
+    while (entities->entities[index] != e) index++;
+
+    entities->state_count[e->state]--;
+    entities->all_count[e->state][e->type]--;
+
+    e->state = state;
+    e->macro_attempts = 0;
+
+    entities->state_count[e->state]++;
+    entities->all_count[e->state][e->type]++;
+
+    eh_shift_up(entities, index);
+    eh_shift_down(entities, index);
+}
+
+// Puts the heap back in order after the entities in it have been changed.
+void entity_heap_reorder(EntityHeap* entities) {
+    for (i32 i = bh_arr_length(entities->entities) / 2 - 1; i >= 0; i--) {
+        eh_shift_down(entities, i);
+    }
+}
+
 Entity* entity_heap_insert(EntityHeap* entities, Entity e) {
     Entity* entity = entity_heap_register(entities, e);
     entity_heap_insert_existing(entities, entity);
@@ -115,6 +163,12 @@ Entity* entity_heap_top(EntityHeap* entities) {
     return entities->entities[0];
 }
 
+b32 entity_heap_top_comes_before(EntityHeap* entities, Entity* e) {
+    if (bh_arr_is_empty(entities->entities)) return 0;
+
+    return entity_compare(entities->entities[0], e) < 0;
+}
+
 void entity_heap_change_top(EntityHeap* entities, Entity* new_top) {
     entities->state_count[entities->entities[0]->state]--;
     entities->state_count[new_top->state]++;
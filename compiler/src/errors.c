@@ -2,7 +2,12 @@
 #include "utils.h"
 
 OnyxErrors errors;
-static b32 errors_enabled = 1;
+static BH_THREAD_LOCAL b32 errors_enabled = 1;
+
+// NOTE: When set, errors reported on this thread are collected here
+// instead of in the global list. Worker threads use this so their
+// errors can be submitted in a consistent order afterwards.
+static BH_THREAD_LOCAL bh_arr(OnyxError)* captured_errors = NULL;
 
 void onyx_errors_init(bh_arr(bh_file_contents)* files) {
     errors.file_contents = files;
@@ -103,6 +108,12 @@ b32 onyx_errors_are_enabled() {
 }
 
 b32 onyx_has_errors() {
+    if (captured_errors) {
+        bh_arr_each(OnyxError, err, *captured_errors) {
+            if (err->rank >= Error_Waiting_On) return 1;
+        }
+    }
+
     bh_arr_each(OnyxError, err, errors.errors) {
         if (err->rank >= Error_Waiting_On) return 1;
     }
@@ -116,10 +127,28 @@ void onyx_clear_errors() {
     bh_arr_set_length(errors.errors, 0);
 }
 
+static void push_error(OnyxError error) {
+    if (captured_errors) {
+        bh_arr(OnyxError) captured = *captured_errors;
+        bh_arr_push(captured, error);
+        *captured_errors = captured;
+        return;
+    }
+
+    bh_arr_push(errors.errors, error);
+}
+
+// NOTE: errors.msg_alloc is not thread-safe, so captured messages are
+// copied to the heap instead.
+static char* copy_error_message(char* msg) {
+    if (captured_errors) return bh_strdup(global_heap_allocator, msg);
+    return bh_strdup(errors.msg_alloc, msg);
+}
+
 void onyx_submit_error(OnyxError error) {
     if (!errors_enabled) return;
 
-    bh_arr_push(errors.errors, error);
+    push_error(error);
 }
 
 void onyx_report_error(OnyxFilePos pos, OnyxErrorRank rank, char * format, ...) {
@@ -133,10 +162,14 @@ void onyx_report_error(OnyxFilePos pos, OnyxErrorRank rank, char * format, ...)
     OnyxError err = {
         .pos = pos,
         .rank = rank,
-        .text = bh_strdup(errors.msg_alloc, msg),
+        .text = copy_error_message(msg),
     };
 
-    bh_arr_push(errors.errors, err);
+    push_error(err);
+}
+
+void onyx_errors_capture(bh_arr(OnyxError)* target) {
+    captured_errors = target;
 }
 
 void onyx_submit_warning(OnyxError error) {
@@ -165,10 +198,10 @@ void onyx_report_warning(OnyxFilePos pos, char* format, ...) {
     OnyxError err = {
         .pos = pos,
         .rank = Error_Warning,
-        .text = bh_strdup(errors.msg_alloc, msg),
+        .text = copy_error_message(msg),
     };
 
-    bh_arr_push(errors.errors, err);
+    push_error(err);
 
     /*
 
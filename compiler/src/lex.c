@@ -127,7 +127,7 @@ const char* token_name(TokenType tkn_type) {
 }
 
 void token_toggle_end(OnyxToken* tkn) {
-    static char backup = 0;
+    static BH_THREAD_LOCAL char backup = 0;
     char tmp = tkn->text[tkn->length];
     tkn->text[tkn->length] = backup;
     backup = tmp;
@@ -502,9 +502,6 @@ void onyx_lex_tokens(OnyxTokenizer* tokenizer) {
     do {
         tk = onyx_get_token(tokenizer);
     } while (tk->type != Token_Type_End_Stream);
-
-    lexer_lines_processed += tokenizer->line_number - 1;
-    lexer_tokens_processed += bh_arr_length(tokenizer->tokens);
 }
 
 b32 token_equals(OnyxToken* tkn1, OnyxToken* tkn2) {
@@ -4,6 +4,9 @@
 #define STB_DS_IMPLEMENTATION
 #include "bh.h"
 
+// NOTE: Hash tables are created while parsing on worker threads.
+#define STBDS_THREAD_LOCAL BH_THREAD_LOCAL
+
 #include "lex.h"
 #include "errors.h"
 #include "parser.h"
@@ -11,6 +14,16 @@
 #include "wasm_emit.h"
 #include "doc.h"
 
+#if defined(_BH_LINUX)
+    #include <sys/inotify.h>
+    #include <sys/wait.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <poll.h>
+    #include <signal.h>
+#endif
+
 #define VERSION "v0.1.0"
 
 
@@ -35,6 +48,9 @@ static const char* docstring = "Onyx compiler version " VERSION "\n"
     "Usage:\n"
     "\tonyx compile [-o <target file>] [--verbose] <input files>\n"
     "\tonyx check [--verbose] <input files>\n"
+#if defined(_BH_LINUX)
+    "\tonyx watch [-o <target file>] [--socket <path>] <input files>\n"
+#endif
 #ifdef ENABLE_RUN_WITH_WASMER
     "\tonyx run <input files> -- <args>\n"
 #endif
@@ -49,11 +65,22 @@ static const char* docstring = "Onyx compiler version " VERSION "\n"
     "\t           -VV          Very verbose output.\n"
     "\t           -VVV         Very very verbose output (to be used by compiler developers).\n"
     "\t--wasm-mvp              Use only WebAssembly MVP features.\n"
+    "\t--optimize, -O          Runs optimization passes over the generated code.\n"
     "\t--multi-threaded        Enables multi-threading for this compilation.\n"
+    "\t--threads <n>           Number of threads the compiler uses (default: number of CPUs).\n"
+    "\t--incremental           Reuses the previous output when none of its inputs have changed.\n"
     "\t--tag                   Generates a C-Tag file.\n"
     "\t--syminfo <target_file> Generates a symbol resolution information file. Used by onyx-lsp.\n"
     // "\t--doc <doc_file>\n"
     "\t--generate-foreign-info\n"
+    "\t--full-type-table       Includes every type in the runtime type table, not only the ones used at runtime.\n"
+#ifdef ENABLE_RUN_WITH_WASMER
+    "\t--profile <file>        With 'run', samples the running program and writes its call stacks\n"
+    "\t                        to <file>, in the collapsed format used by flame graph tools.\n"
+#endif
+#if defined(_BH_LINUX)
+    "\t--socket <path>         With 'watch', also accepts 'build' and 'check' requests on a Unix socket.\n"
+#endif
     "\n"
     "Developer flags:\n"
     "\t--print-function-mappings Prints a mapping from WASM function index to source location.\n"
@@ -76,6 +103,7 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
         .use_post_mvp_features   = 1,
         .use_multi_threading     = 0,
         .no_std                  = 0,
+        .thread_count            = 0,
 
         .runtime = Runtime_Onyx,
 
@@ -84,6 +112,8 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
 
         .documentation_file = NULL,
 
+        .watch_socket = NULL,
+
         .debug_enabled = 0,
 
         .passthrough_argument_count = 0,
@@ -91,6 +121,12 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
 
         .generate_tag_file = 0,
         .generate_symbol_info_file = 0,
+        .generate_debug_info = 0,
+
+        .incremental = 0,
+        .optimize    = 0,
+
+        .full_type_table = 0,
     };
 
     bh_arr_new(alloc, options.files, 2);
@@ -121,6 +157,12 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
         options.action = ONYX_COMPILE_ACTION_CHECK;
         arg_parse_start = 2;
     }
+    #if defined(_BH_LINUX)
+    else if (!strcmp(argv[1], "watch")) {
+        options.action = ONYX_COMPILE_ACTION_WATCH;
+        arg_parse_start = 2;
+    }
+    #endif
     #ifdef ENABLE_RUN_WITH_WASMER
     else if (!strcmp(argv[1], "run")) {
         options.action = ONYX_COMPILE_ACTION_RUN;
@@ -155,15 +197,27 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
             else if (!strcmp(argv[i], "--no-file-contents")) {
                 options.no_file_contents = 1;
             }
+            else if (!strcmp(argv[i], "--optimize") || !strcmp(argv[i], "-O")) {
+                options.optimize = 1;
+            }
             else if (!strcmp(argv[i], "--wasm-mvp")) {
                 options.use_post_mvp_features = 0;
             }
             else if (!strcmp(argv[i], "--multi-threaded")) {
                 options.use_multi_threading = 1;
             }
+            else if (!strcmp(argv[i], "--threads")) {
+                options.thread_count = atoi(argv[++i]);
+            }
+            else if (!strcmp(argv[i], "--incremental")) {
+                options.incremental = 1;
+            }
             else if (!strcmp(argv[i], "--generate-foreign-info")) {
                 options.generate_foreign_info = 1;
             }
+            else if (!strcmp(argv[i], "--full-type-table")) {
+                options.full_type_table = 1;
+            }
             else if (!strcmp(argv[i], "--no-std")) {
                 options.no_std = 1;
             }
@@ -193,6 +247,11 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
             }
             else if (!strcmp(argv[i], "--debug")) {
                 options.debug_enabled = 1;
+                options.generate_debug_info = 1;
+            }
+            else if (!strcmp(argv[i], "--profile")) {
+                options.profile_file = argv[++i];
+                options.generate_debug_info = 1;
             }
             else if (!strcmp(argv[i], "--")) {
                 options.passthrough_argument_count = argc - i - 1;
@@ -206,6 +265,9 @@ static CompileOptions compile_opts_parse(bh_allocator alloc, int argc, char *arg
             else if (!strcmp(argv[i], "--fun") || !strcmp(argv[i], "-F")) {
                 options.fun_output = 1;
             }
+            else if (!strcmp(argv[i], "--socket")) {
+                options.watch_socket = argv[++i];
+            }
 #endif
             else {
                 bh_arr_push(options.files, argv[i]);
@@ -251,6 +313,16 @@ static Entity *runtime_info_types_entity;
 static Entity *runtime_info_foreign_entity;
 static Entity *runtime_info_proc_tags_entity;
 
+static u32 program_entity_ids;
+
+static void context_add_files() {
+    // NOTE: Add all files passed by command line to the queue
+    bh_arr_each(const char *, filename, context.options->files) {
+        AstInclude* load_node = create_load(context.ast_alloc, (char *) *filename);
+        add_entities_for_node(NULL, (AstNode *) load_node, context.global_scope, NULL);
+    }
+}
+
 static void context_init(CompileOptions* opts) {
     types_init();
 
@@ -276,12 +348,13 @@ static void context_init(CompileOptions* opts) {
     // NOTE: Create the arena where tokens and AST nodes will exist
     // Prevents nodes from being scattered across memory due to fragmentation
     bh_arena_init(&context.ast_arena, global_heap_allocator, 16 * 1024 * 1024); // 16MB
-    context.ast_alloc = bh_arena_allocator(&context.ast_arena);
+    context.ast_alloc = worker_ast_allocator(&context.ast_arena);
 
     context.wasm_module = bh_alloc_item(global_heap_allocator, OnyxWasmModule);
     *context.wasm_module = onyx_wasm_module_create(global_heap_allocator);
 
     entity_heap_init(&context.entities);
+    worker_pool_init(context.options->thread_count);
 
     // NOTE: Add builtin entities to pipeline.
     entity_heap_insert(&context.entities, ((Entity) {
@@ -324,10 +397,13 @@ static void context_init(CompileOptions* opts) {
     add_entities_for_node(NULL, (AstNode *) &builtin_tls_base, context.global_scope, NULL);
     add_entities_for_node(NULL, (AstNode *) &builtin_tls_size, context.global_scope, NULL);
 
-    // NOTE: Add all files passed by command line to the queue
-    bh_arr_each(const char *, filename, opts->files) {
-        AstInclude* load_node = create_load(context.ast_alloc, (char *) *filename);
-        add_entities_for_node(NULL, (AstNode *) load_node, context.global_scope, NULL);
+    // NOTE: In watch mode, every build adds these itself (see onyx_watch). The
+    // ids of their entities are set aside here, so they still come before the
+    // entities of core/std.
+    if (opts->action != ONYX_COMPILE_ACTION_WATCH) {
+        context_add_files();
+    } else {
+        program_entity_ids = entity_heap_reserve_ids(1 << 24);
     }
 
     if (!context.options->no_std) {
@@ -349,22 +425,96 @@ static void context_init(CompileOptions* opts) {
 }
 
 static void context_free() {
+    worker_pool_free();
     bh_arena_free(&context.ast_arena);
     bh_arr_free(context.loaded_files);
 
     compile_opts_free(context.options);
 }
 
-static void parse_source_file(bh_file_contents* file_contents) {
-    // :Remove passing the allocators as parameters
-    OnyxTokenizer tokenizer = onyx_tokenizer_create(context.token_alloc, file_contents);
-    onyx_lex_tokens(&tokenizer);
+//
+// Source files are parsed in batches. Processing a #load only opens the file
+// and queues it. Once there are no more loads at the top of the entity heap,
+// every queued file is lexed and parsed across the worker threads. The
+// entities and errors from each file are then submitted on the main thread in
+// the order the files were queued, so the result does not depend on how the
+// threads were scheduled.
+//
+typedef struct QueuedSourceFile {
+    i32 file_index; // Into context.loaded_files
+    bh_file file;
+
+    OnyxTokenizer tokenizer;
+    OnyxParser parser;
+    bh_file_contents contents;
+    bh_arr(OnyxError) errors;
+} QueuedSourceFile;
+
+static bh_arr(QueuedSourceFile) queued_source_files = NULL;
+
+// Folders loaded with #load_all. The incremental build cache has to know
+// about these, because adding a file to one of them changes the program.
+static bh_arr(char *) loaded_folders = NULL;
+
+static b32 entity_can_queue_source_file(Entity* ent) {
+    return ent->state == Entity_State_Parse
+        && ent->macro_attempts == 0
+        && (ent->type == Entity_Type_Load_File || ent->type == Entity_Type_Load_Path);
+}
+
+static void lex_queued_source_file(void* data, i32 index) {
+    QueuedSourceFile* qsf = &((QueuedSourceFile *) data)[index];
+
+    qsf->contents = bh_file_read_contents(context.token_alloc, &qsf->file);
+    bh_file_close(&qsf->file);
+
+    qsf->tokenizer = onyx_tokenizer_create(context.token_alloc, &qsf->contents);
+    onyx_lex_tokens(&qsf->tokenizer);
+}
+
+static void parse_queued_source_file(void* data, i32 index) {
+    QueuedSourceFile* qsf = &((QueuedSourceFile *) data)[index];
+
+    bh_arr_new(global_heap_allocator, qsf->errors, 4);
+    onyx_errors_capture(&qsf->errors);
 
-    file_contents->line_count = tokenizer.line_number;
+    qsf->parser.allocator = context.ast_alloc;
+    onyx_parse_file_body(&qsf->parser);
 
-    OnyxParser parser = onyx_parser_create(context.ast_alloc, &tokenizer);
-    onyx_parse(&parser);
-    onyx_parser_free(&parser);
+    onyx_errors_capture(NULL);
+}
+
+static void parse_queued_source_files() {
+    if (bh_arr_is_empty(queued_source_files)) return;
+
+    i32 count = bh_arr_length(queued_source_files);
+    worker_pool_run(count, lex_queued_source_file, queued_source_files);
+
+    // The package declaration at the top of each file creates packages,
+    // so it is parsed here in order to keep package ids stable.
+    bh_arr_each(QueuedSourceFile, qsf, queued_source_files) {
+        qsf->contents.line_count = qsf->tokenizer.line_number;
+        context.loaded_files[qsf->file_index] = qsf->contents;
+
+        lexer_lines_processed  += qsf->tokenizer.line_number - 1;
+        lexer_tokens_processed += bh_arr_length(qsf->tokenizer.tokens);
+
+        qsf->parser = onyx_parser_create(context.ast_alloc, &qsf->tokenizer);
+        onyx_parse_file_header(&qsf->parser);
+        bh_arr_new(global_heap_allocator, qsf->parser.deferred_entities, 32);
+    }
+
+    worker_pool_run(count, parse_queued_source_file, queued_source_files);
+
+    bh_arr_each(QueuedSourceFile, qsf, queued_source_files) {
+        bh_arr_each(OnyxError, err, qsf->errors) onyx_submit_error(*err);
+        bh_arr_free(qsf->errors);
+
+        onyx_parser_submit_deferred_entities(&qsf->parser);
+        onyx_parser_free(&qsf->parser);
+    }
+
+    bh_arr_set_length(queued_source_files, 0);
 }
 
 static b32 process_source_file(char* filename, OnyxFilePos error_pos) {
@@ -383,15 +533,20 @@ static b32 process_source_file(char* filename, OnyxFilePos error_pos) {
         return 0;
     }
 
-    bh_file_contents fc = bh_file_read_contents(context.token_alloc, &file);
-    bh_file_close(&file);
+    if (context.options->verbose_output == 2)
+        bh_printf("Processing source file:    %s (%l bytes)\n", file.filename, bh_file_size(&file));
 
+    // NOTE: The contents are filled in once the file is parsed. Until then,
+    // only the filename is needed for detecting duplicates.
+    bh_file_contents fc = { 0 };
+    fc.filename = filename;
     bh_arr_push(context.loaded_files, fc);
 
-    if (context.options->verbose_output == 2)
-        bh_printf("Processing source file:    %s (%d bytes)\n", file.filename, fc.length);
+    QueuedSourceFile qsf = { 0 };
+    qsf.file_index = bh_arr_length(context.loaded_files) - 1;
+    qsf.file = file;
+    bh_arr_push(queued_source_files, qsf);
 
-    parse_source_file(&bh_arr_last(context.loaded_files));
     return 1;
 }
 
@@ -432,6 +587,8 @@ static b32 process_load_entity(Entity* ent) {
             return 0;
         }
 
+        bh_arr_push(loaded_folders, bh_strdup(global_heap_allocator, folder));
+
         bh_dirent entry;
         b32 success = 1;
         char fullpath[512];
@@ -458,6 +615,16 @@ static b32 process_load_entity(Entity* ent) {
     return 1;
 }
 
+static void initialize_special_globals_when_ready(Entity* ent) {
+    // GROSS
+    if (special_global_entities_remaining == 0
+        && ent->state >= Entity_State_Parse
+        && bh_arr_is_empty(queued_source_files)) {
+        special_global_entities_remaining--;
+        initalize_special_globals();
+    }
+}
+
 static b32 process_entity(Entity* ent) {
     static char verbose_output_buffer[512];
     if (context.options->verbose_output == 3) {
@@ -485,6 +652,8 @@ static b32 process_entity(Entity* ent) {
     // already been initialized.
     static b32 builtins_initialized = 0;
 
+    initialize_special_globals_when_ready(ent);
+
     EntityState before_state = ent->state;
     switch (before_state) {
         case Entity_State_Error:
@@ -497,6 +666,7 @@ static b32 process_entity(Entity* ent) {
 
         case Entity_State_Parse_Builtin:
             process_load_entity(ent);
+            parse_queued_source_files();
             ent->state = Entity_State_Finalized;
             break;
 
@@ -513,12 +683,6 @@ static b32 process_entity(Entity* ent) {
                 introduce_build_options(context.ast_alloc);
             }
 
-            // GROSS
-            if (special_global_entities_remaining == 0) {
-                special_global_entities_remaining--;
-                initalize_special_globals();
-            }
-
             if (process_load_entity(ent)) {
                 // GROSS
                 if (ent == runtime_info_types_entity
@@ -609,102 +773,200 @@ static void dump_cycles() {
         if (ent->state < Entity_State_Code_Gen) process_entity(ent);
         else break;
 
+        parse_queued_source_files();
+
         if (bh_arr_length(context.entities.entities) == 0) {
             break;
         }
     }
 }
 
+//
+// Function entities at the top of the heap that are waiting on the same state
+// are taken off of the heap together. Their type checking or code generation is
+// done across the worker threads first (see check_entity_batch and
+// emit_entity_batch). Then each of them is processed in order as usual, which
+// only merges the result from the worker threads, so the output does not depend
+// on the number of threads.
+//
+// Type checking an entity can add new entities, or change the entity so it has
+// to be processed again. When one of those comes before the rest of the batch,
+// the rest of the batch is put back in the heap to keep the order the same as
+// without batching.
+//
+static bh_arr(Entity *) entity_batch = NULL;
+static EntityState entity_batch_state;
+
+static b32 entity_can_be_batched(Entity* ent) {
+    if (ent->type != Entity_Type_Function) return 0;
+
+    if (ent->state == Entity_State_Check_Types) {
+        // These change how entities are checked, or need every node to be
+        // checked on the main thread.
+        return !context.cycle_detected
+            && context.cycle_almost_detected == 0
+            && !context.options->generate_symbol_info_file;
+    }
+
+    if (ent->state == Entity_State_Code_Gen) {
+        return context.options->action != ONYX_COMPILE_ACTION_CHECK;
+    }
+
+    return 0;
+}
+
+static void return_rest_of_entity_batch(Entity** pent) {
+    Entity** end = entity_batch + bh_arr_length(entity_batch);
+    for (Entity** rest = pent + 1; rest < end; rest++) {
+        if (entity_batch_state == Entity_State_Check_Types) check_entity_batch_discard(*rest);
+        entity_heap_insert_existing(&context.entities, *rest);
+    }
+
+    bh_arr_set_length(entity_batch, pent - entity_batch + 1);
+}
+
+static void take_entity_batch() {
+    bh_arr_clear(entity_batch);
+
+    Entity* first = entity_heap_top(&context.entities);
+    entity_heap_remove_top(&context.entities);
+    bh_arr_push(entity_batch, first);
+
+    entity_batch_state = first->state;
+    if (!entity_can_be_batched(first)) return;
+
+    while (!bh_arr_is_empty(context.entities.entities)) {
+        Entity* ent = entity_heap_top(&context.entities);
+        if (ent->type != first->type || ent->state != first->state) break;
+
+        entity_heap_remove_top(&context.entities);
+        bh_arr_push(entity_batch, ent);
+    }
+
+    if (first->state == Entity_State_Check_Types) {
+        check_entity_batch(entity_batch, bh_arr_length(entity_batch));
+        return;
+    }
+
+    initialize_special_globals_when_ready(first);
+
+    emit_entity_batch(entity_batch, bh_arr_length(entity_batch));
+}
+
 static i32 onyx_compile() {
     u64 start_time = bh_time_curr();
 
     if (context.options->fun_output)
         printf("\e[2J");
 
-    while (!bh_arr_is_empty(context.entities.entities)) {
-        Entity* ent = entity_heap_top(&context.entities);
+    while (1) {
+        if (!bh_arr_is_empty(queued_source_files)) {
+            if (bh_arr_is_empty(context.entities.entities)
+                || !entity_can_queue_source_file(entity_heap_top(&context.entities))) {
+                parse_queued_source_files();
+
+                if (onyx_has_errors()) {
+                    onyx_errors_print();
+                    return ONYX_COMPILER_PROGRESS_ERROR;
+                }
+            }
+        }
+
+        if (bh_arr_is_empty(context.entities.entities)) break;
+
+        take_entity_batch();
+
+        bh_arr_each(Entity *, pent, entity_batch) {
+            Entity* ent = *pent;
 
 #if defined(_BH_LINUX)
-        if (context.options->fun_output) {
-            output_dummy_progress_bar();
+            if (context.options->fun_output) {
+                output_dummy_progress_bar();
 
-            if (ent->expr->token) {
-                OnyxFilePos pos = ent->expr->token->pos;
-                printf("\e[0K%s on %s in %s:%d:%d\n", entity_state_strings[ent->state], entity_type_strings[ent->type], pos.filename, pos.line, pos.column);
-            }
+                if (ent->expr->token) {
+                    OnyxFilePos pos = ent->expr->token->pos;
+                    printf("\e[0K%s on %s in %s:%d:%d\n", entity_state_strings[ent->state], entity_type_strings[ent->type], pos.filename, pos.line, pos.column);
+                }
 
-            // Slowing things down for the effect
-            usleep(1000);
-        }
+                // Slowing things down for the effect
+                usleep(1000);
+            }
 #endif
 
-        /*
-        struct timespec spec;
-        clock_gettime(CLOCK_REALTIME, &spec);
-        u64 nano_time = spec.tv_nsec + 1000000000 * (spec.tv_sec % 100);
-        printf("%lu %d %d %d %d %d %d %d\n",
-                nano_time,
-                bh_arr_length(context.entities.entities),
-                context.entities.state_count[Entity_State_Introduce_Symbols],
-                context.entities.state_count[Entity_State_Parse],
-                context.entities.state_count[Entity_State_Resolve_Symbols],
-                context.entities.state_count[Entity_State_Check_Types],
-                context.entities.state_count[Entity_State_Code_Gen],
-                context.entities.state_count[Entity_State_Finalized]);
-        */
-
-        // Mostly a preventative thing to ensure that even if somehow
-        // errors were left disabled, they are re-enabled in this cycle.
-        onyx_errors_enable();
-
-        entity_heap_remove_top(&context.entities);
-        b32 changed = process_entity(ent);
-
-        // NOTE: VERY VERY dumb cycle breaking. Basically, remember the first entity that did
-        // not change (i.e. did not make any progress). Then everytime an entity doesn't change,
-        // check if it is the same entity. If it is, it means all other entities that were processed
-        // between the two occurences didn't make any progress either, and there must be a cycle.
-        //                                                              - brendanfh 2021/02/06
-        //
-        // Because of the recent changes to the compiler architecture (again), this condition
-        // does not always hold anymore. There can be nodes that get scheduled multiple times
-        // before the "key" node that will unblock the progress. This means a more sophisticated
-        // cycle detection algorithm must be used.
-        //
-        static Entity* watermarked_node = NULL;
-        static u32 highest_watermark = 0;
-        if (!changed) {
-            if (!watermarked_node) {
-                watermarked_node = ent;
-                highest_watermark = bh_max(highest_watermark, ent->macro_attempts);
-            }
-            else if (watermarked_node == ent) {
-                if (ent->macro_attempts > highest_watermark) {
-                    entity_heap_insert_existing(&context.entities, ent);
-
-                    if (context.cycle_almost_detected == 3) {
-                        dump_cycles();
-                    } else {
-                        context.cycle_almost_detected += 1;
+            /*
+            struct timespec spec;
+            clock_gettime(CLOCK_REALTIME, &spec);
+            u64 nano_time = spec.tv_nsec + 1000000000 * (spec.tv_sec % 100);
+            printf("%lu %d %d %d %d %d %d %d\n",
+                    nano_time,
+                    bh_arr_length(context.entities.entities),
+                    context.entities.state_count[Entity_State_Introduce_Symbols],
+                    context.entities.state_count[Entity_State_Parse],
+                    context.entities.state_count[Entity_State_Resolve_Symbols],
+                    context.entities.state_count[Entity_State_Check_Types],
+                    context.entities.state_count[Entity_State_Code_Gen],
+                    context.entities.state_count[Entity_State_Finalized]);
+            */
+
+            // Mostly a preventative thing to ensure that even if somehow
+            // errors were left disabled, they are re-enabled in this cycle.
+            onyx_errors_enable();
+
+            b32 changed = process_entity(ent);
+
+            // NOTE: VERY VERY dumb cycle breaking. Basically, remember the first entity that did
+            // not change (i.e. did not make any progress). Then everytime an entity doesn't change,
+            // check if it is the same entity. If it is, it means all other entities that were processed
+            // between the two occurences didn't make any progress either, and there must be a cycle.
+            //                                                              - brendanfh 2021/02/06
+            //
+            // Because of the recent changes to the compiler architecture (again), this condition
+            // does not always hold anymore. There can be nodes that get scheduled multiple times
+            // before the "key" node that will unblock the progress. This means a more sophisticated
+            // cycle detection algorithm must be used.
+            //
+            static Entity* watermarked_node = NULL;
+            static u32 highest_watermark = 0;
+            if (!changed) {
+                if (!watermarked_node) {
+                    watermarked_node = ent;
+                    highest_watermark = bh_max(highest_watermark, ent->macro_attempts);
+                }
+                else if (watermarked_node == ent) {
+                    if (ent->macro_attempts > highest_watermark) {
+                        return_rest_of_entity_batch(pent);
+                        entity_heap_insert_existing(&context.entities, ent);
+
+                        if (context.cycle_almost_detected == 3) {
+                            dump_cycles();
+                        } else {
+                            context.cycle_almost_detected += 1;
+                        }
                     }
                 }
+                else if (watermarked_node->macro_attempts < ent->macro_attempts) {
+                    watermarked_node = ent;
+                    highest_watermark = bh_max(highest_watermark, ent->macro_attempts);
+                }
+            } else {
+                watermarked_node = NULL;
+                context.cycle_almost_detected = 0;
             }
-            else if (watermarked_node->macro_attempts < ent->macro_attempts) {
-                watermarked_node = ent;
-                highest_watermark = bh_max(highest_watermark, ent->macro_attempts);
+
+            if (onyx_has_errors()) {
+                onyx_errors_print();
+                return ONYX_COMPILER_PROGRESS_ERROR;
             }
-        } else {
-            watermarked_node = NULL;
-            context.cycle_almost_detected = 0;
-        }
 
-        if (onyx_has_errors()) {
-            onyx_errors_print();
-            return ONYX_COMPILER_PROGRESS_ERROR;
-        }
+            if (ent->state != Entity_State_Finalized && ent->state != Entity_State_Failed)
+                entity_heap_insert_existing(&context.entities, ent);
 
-        if (ent->state != Entity_State_Finalized && ent->state != Entity_State_Failed)
-            entity_heap_insert_existing(&context.entities, ent);
+            if (entity_batch_state == Entity_State_Check_Types && pent + 1 < entity_batch + bh_arr_length(entity_batch)) {
+                if (!bh_arr_is_empty(queued_source_files) || entity_heap_top_comes_before(&context.entities, pent[1])) {
+                    return_rest_of_entity_batch(pent);
+                }
+            }
+        }
     }
 
     //
@@ -733,6 +995,255 @@ static i32 onyx_compile() {
     return ONYX_COMPILER_PROGRESS_SUCCESS;
 }
 
+//
+// Incremental builds
+//
+// With --incremental, the output of a compilation is saved in the cache
+// directory, next to a manifest of everything that was read to produce it:
+// every source file, every #file_contents file and the listing of every
+// #load_all folder, each with a hash of its contents. When the same command
+// is run again and none of those inputs changed, the saved output is used
+// without compiling anything.
+//
+// The cache is keyed on the compiler build, the working directory and the
+// command line, since those decide which files are loaded and how code is
+// generated. Warnings are not saved, so they are only printed the first time.
+//
+// ROBUSTNESS: A file that was not found while searching the included folders
+// for a #load is not recorded, so creating one that would now be found first
+// is not noticed.
+//
+
+#define BUILD_CACHE_HASH_SEED 0xcbf29ce484222325ull
+
+static char *build_cache_output_path   = NULL;
+static char *build_cache_manifest_path = NULL;
+
+static u64 build_cache_hash(u64 hash, const void *data, i64 length) {
+    // FNV-1a
+    fori (i, 0, length) {
+        hash ^= ((const u8 *) data)[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static b32 build_cache_hash_file(const char *filename, u64 *out) {
+    bh_file file;
+    if (bh_file_open(&file, filename) != BH_FILE_ERROR_NONE) return 0;
+
+    bh_file_contents contents = bh_file_read_contents(global_heap_allocator, &file);
+    bh_file_close(&file);
+
+    *out = build_cache_hash(BUILD_CACHE_HASH_SEED, contents.data, contents.length);
+    bh_file_contents_free(&contents);
+    return 1;
+}
+
+static b32 build_cache_hash_folder(const char *folder, u64 *out) {
+    bh_dir dir = bh_dir_open((char *) folder);
+    if (dir == NULL) return 0;
+
+    // Only the names matter here. The files themselves are in the manifest too.
+    u64 hash = BUILD_CACHE_HASH_SEED;
+    bh_dirent entry;
+    while (bh_dir_read(dir, &entry)) {
+        if (entry.type == BH_DIRENT_FILE && bh_str_ends_with(entry.name, ".onyx")) {
+            hash = build_cache_hash(hash, entry.name, entry.name_length + 1);
+        }
+    }
+
+    bh_dir_close(dir);
+    *out = hash;
+    return 1;
+}
+
+static b32 build_cache_hash_input(char kind, const char *path, u64 *out) {
+    switch (kind) {
+        case 'f': return build_cache_hash_file(path, out);
+        case 'd': return build_cache_hash_folder(path, out);
+        default:  return 0;
+    }
+}
+
+// Reads the line of a manifest at *line, and moves *line to the next one. The
+// line is terminated in place, so the same manifest can be read again later.
+static b32 build_cache_manifest_next(char **line, char *end, char *kind, u64 *hash, char **path) {
+    char *terminator = *line;
+    while (terminator < end && *terminator != '\n' && *terminator != '\0') terminator++;
+    if (terminator == end) return 0;
+    *terminator = '\0';
+
+    unsigned long long value;
+    i32 path_offset = 0;
+    if (sscanf(*line, "%c %llx %n", kind, &value, &path_offset) != 2 || path_offset == 0) return 0;
+
+    *hash = value;
+    *path = *line + path_offset;
+    *line = terminator + 1;
+    return 1;
+}
+
+static char *build_cache_dir() {
+#if defined(_BH_LINUX)
+    char *cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home && *cache_home) {
+        return bh_aprintf(global_heap_allocator, "%s/onyx", cache_home);
+    }
+
+    char *home = getenv("HOME");
+    if (home && *home) {
+        return bh_aprintf(global_heap_allocator, "%s/.cache/onyx", home);
+    }
+#endif
+
+    return NULL;
+}
+
+static void build_cache_init(int argc, char *argv[]) {
+    CompileOptions *opts = context.options;
+    if (!opts->incremental) return;
+
+    // These either produce more than the WASM binary, or print while compiling.
+    if (opts->generate_tag_file || opts->generate_symbol_info_file) return;
+    if (opts->print_function_mappings || opts->print_static_if_results) return;
+    if (opts->use_multi_threading && !opts->use_post_mvp_features)    return;
+
+    char *cache_dir = build_cache_dir();
+    if (cache_dir == NULL) return;
+
+    bh_path_create_directories(cache_dir);
+
+    const char *build = __DATE__ " " __TIME__;
+    u64 key = build_cache_hash(BUILD_CACHE_HASH_SEED, build, strlen(build) + 1);
+
+    char *cwd = bh_path_get_full_name(".", global_scratch_allocator);
+    key = build_cache_hash(key, cwd, strlen(cwd) + 1);
+
+    bh_arr_each(const char *, folder, opts->included_folders) {
+        key = build_cache_hash(key, *folder, strlen(*folder) + 1);
+    }
+
+    // Arguments passed through to the program do not change it.
+    fori (i, 1, argc) {
+        if (!strcmp(argv[i], "--")) break;
+        key = build_cache_hash(key, argv[i], strlen(argv[i]) + 1);
+    }
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+    build_cache_output_path   = bh_aprintf(global_heap_allocator, "%s/%s.wasm", cache_dir, name);
+    build_cache_manifest_path = bh_aprintf(global_heap_allocator, "%s/%s.manifest", cache_dir, name);
+}
+
+static b32 build_cache_load(bh_buffer *out) {
+    if (build_cache_manifest_path == NULL) return 0;
+
+    bh_file manifest_file;
+    if (bh_file_open(&manifest_file, build_cache_manifest_path) != BH_FILE_ERROR_NONE) return 0;
+
+    bh_file_contents manifest = bh_file_read_contents(global_heap_allocator, &manifest_file);
+    bh_file_close(&manifest_file);
+
+    b32 valid = manifest.data != NULL;
+    u64 output_hash = 0;
+
+    char *line = manifest.data;
+    char *end  = line + manifest.length;
+    char kind;
+    u64 expected;
+    char *path;
+    while (valid && build_cache_manifest_next(&line, end, &kind, &expected, &path)) {
+        u64 actual = expected;
+        if (kind == 'w') output_hash = expected;
+        else             valid = build_cache_hash_input(kind, path, &actual);
+
+        if (valid && actual != expected) valid = 0;
+    }
+
+    if (line != end) valid = 0;
+
+    bh_file_contents_free(&manifest);
+    if (!valid) return 0;
+
+    bh_file output_file;
+    if (bh_file_open(&output_file, build_cache_output_path) != BH_FILE_ERROR_NONE) return 0;
+
+    bh_file_contents output = bh_file_read_contents(global_heap_allocator, &output_file);
+    bh_file_close(&output_file);
+
+    // Another compilation with the same key could have replaced the output
+    // after this manifest was written.
+    if (output.data == NULL || build_cache_hash(BUILD_CACHE_HASH_SEED, output.data, output.length) != output_hash) {
+        bh_file_contents_free(&output);
+        return 0;
+    }
+
+    out->allocator = global_heap_allocator;
+    out->data      = output.data;
+    out->length    = output.length;
+    out->capacity  = output.length;
+    return 1;
+}
+
+static void build_cache_manifest_add(bh_buffer *manifest, char kind, u64 hash, const char *path) {
+    char prefix[32];
+    i32 length = snprintf(prefix, sizeof(prefix), "%c %016llx ", kind, (unsigned long long) hash);
+    bh_buffer_append(manifest, prefix, length);
+    bh_buffer_append(manifest, path, strlen(path));
+    bh_buffer_write_byte(manifest, '\n');
+}
+
+// Adds every input of the compilation, hashed as it was compiled. Fails when
+// a folder loaded with #load_all can no longer be read.
+static b32 build_cache_manifest_add_inputs(bh_buffer *manifest) {
+    bh_arr_each(bh_file_contents, fc, context.loaded_files) {
+        build_cache_manifest_add(manifest, 'f', build_cache_hash(BUILD_CACHE_HASH_SEED, fc->data, fc->length), fc->filename);
+    }
+
+    OnyxWasmModule *mod = context.wasm_module;
+    fori (i, 0, shlen(mod->loaded_file_info)) {
+        StrLitInfo info = mod->loaded_file_info[i].value;
+        if (info.data_id == 0 || info.data_id > (u32) bh_arr_length(mod->data)) continue;
+
+        WasmDatum *datum = &mod->data[info.data_id - 1];
+        build_cache_manifest_add(manifest, 'f', build_cache_hash(BUILD_CACHE_HASH_SEED, datum->data, info.len), mod->loaded_file_info[i].key);
+    }
+
+    bh_arr_each(char *, folder, loaded_folders) {
+        u64 hash;
+        if (!build_cache_hash_folder(*folder, &hash)) return 0;
+        build_cache_manifest_add(manifest, 'd', hash, *folder);
+    }
+
+    return 1;
+}
+
+static void build_cache_store(bh_buffer output) {
+    if (build_cache_manifest_path == NULL) return;
+
+    bh_buffer manifest;
+    bh_buffer_init(&manifest, global_heap_allocator, 4096);
+
+    build_cache_manifest_add(&manifest, 'w', build_cache_hash(BUILD_CACHE_HASH_SEED, output.data, output.length), "");
+    if (!build_cache_manifest_add_inputs(&manifest)) goto done;
+
+    // The output is written first, so a manifest is never paired with the
+    // output of an older compilation that used different inputs.
+    bh_file file;
+    if (bh_file_create(&file, build_cache_output_path) != BH_FILE_ERROR_NONE) goto done;
+    bh_file_write(&file, output.data, output.length);
+    bh_file_close(&file);
+
+    if (bh_file_create(&file, build_cache_manifest_path) != BH_FILE_ERROR_NONE) goto done;
+    bh_file_write(&file, manifest.data, manifest.length);
+    bh_file_close(&file);
+
+  done:
+    bh_buffer_free(&manifest);
+}
+
 static void link_wasm_module() {
     Package *runtime_var_package = package_lookup("runtime.vars");
     assert(runtime_var_package);
@@ -786,7 +1297,11 @@ static CompilerProgress onyx_flush_module() {
 
         bh_file_close(&data_file);
     } else {
-        onyx_wasm_module_write_to_file(context.wasm_module, output_file);
+        bh_buffer code_buffer;
+        onyx_wasm_module_write_to_buffer(context.wasm_module, &code_buffer);
+        bh_file_write(&output_file, code_buffer.data, code_buffer.length);
+
+        build_cache_store(code_buffer);
     }
 
     bh_file_close(&output_file);
@@ -801,18 +1316,398 @@ static CompilerProgress onyx_flush_module() {
 }
 
 #ifdef ENABLE_RUN_WITH_WASMER
+static b32 onyx_run_buffer(bh_buffer code_buffer) {
+    // When builds are cached, so is the program OVM builds from them.
+    char *program_cache_dir = build_cache_manifest_path ? build_cache_dir() : NULL;
+    onyx_run_initialize(context.options->debug_enabled, program_cache_dir, (char *) context.options->profile_file);
+
+    if (context.options->verbose_output > 0)
+        bh_printf("Running program:\n");
+
+    return onyx_run_wasm(code_buffer, context.options->passthrough_argument_count, context.options->passthrough_argument_data);
+}
+
 static b32 onyx_run() {
     link_wasm_module();
 
     bh_buffer code_buffer;
     onyx_wasm_module_write_to_buffer(context.wasm_module, &code_buffer);
+    build_cache_store(code_buffer);
 
-    onyx_run_initialize(context.options->debug_enabled);
+    return onyx_run_buffer(code_buffer);
+}
+#endif
 
-    if (context.options->verbose_output > 0)
-        bh_printf("Running program:\n");
+#if defined(_BH_LINUX)
+//
+// Watch mode
+//
+// The watch server loads core/builtin and core/std once, and checks them as
+// far as they can be checked without the program. Every build is a forked
+// child of the server, so it starts with the core library already parsed and
+// checked, its types built and its polymorphic procedures solidified. Only the
+// program itself has to be loaded and checked. The compiler keeps too much
+// global state to be reset in place, so forking also keeps the server's state
+// clean for the next build.
+//
+// The child sends back a manifest of the inputs it used, in the format of the
+// incremental build cache. After each build, the server watches those inputs
+// with inotify and compares them against the manifest, so a change made while
+// the build was running starts another build. When one of the files loaded by
+// the server itself changes, the server restarts.
+//
+// With --socket <path>, the server also takes requests on a Unix socket, one
+// per connection. A request is a single line, either 'build' or 'check'. The
+// output of the compiler is sent back on the connection, followed by a last
+// line that is either 'ok' or 'failed'.
+//
+// ROBUSTNESS: The server checks core before the program has added any
+// overloads, #inject's or symbols. Anything in core that depends on those is
+// left for each build, so core is not always checked in the same order as in
+// a normal compilation.
+//
+
+typedef enum WatchRequest {
+    Watch_Request_Build,
+    Watch_Request_Check,
+} WatchRequest;
+
+static CompilerProgress watch_preload() {
+    // The cycle detection of onyx_compile is not used here. Entities waiting
+    // on the program would eventually be reported as a cycle, so this stops
+    // once every entity has been processed without any of them changing.
+    i32 unchanged = 0;
 
-    return onyx_run_wasm(code_buffer, context.options->passthrough_argument_count, context.options->passthrough_argument_data);
+    while (1) {
+        if (!bh_arr_is_empty(queued_source_files)) {
+            if (bh_arr_is_empty(context.entities.entities)
+                || !entity_can_queue_source_file(entity_heap_top(&context.entities))) {
+                parse_queued_source_files();
+            }
+        }
+
+        if (onyx_has_errors()) return ONYX_COMPILER_PROGRESS_ERROR;
+        if (bh_arr_is_empty(context.entities.entities)) break;
+        if (unchanged > bh_arr_length(context.entities.entities)) break;
+
+        // Code generation is left to the builds, since it depends on
+        // everything that is used by the program.
+        Entity* ent = entity_heap_top(&context.entities);
+        if (ent->state >= Entity_State_Code_Gen) break;
+
+        entity_heap_remove_top(&context.entities);
+
+        onyx_errors_enable();
+        if (process_entity(ent)) unchanged = 0;
+        else                     unchanged += 1;
+
+        if (onyx_has_errors()) return ONYX_COMPILER_PROGRESS_ERROR;
+
+        if (ent->state != Entity_State_Finalized && ent->state != Entity_State_Failed)
+            entity_heap_insert_existing(&context.entities, ent);
+    }
+
+    return ONYX_COMPILER_PROGRESS_SUCCESS;
+}
+
+static void watch_write(int fd, const void *data, i64 length) {
+    while (length > 0) {
+        isize wrote = send(fd, data, length, MSG_NOSIGNAL);
+        if (wrote < 0 && errno == ENOTSOCK) wrote = write(fd, data, length);
+        if (wrote <= 0) break;
+
+        data    = (const u8 *) data + wrote;
+        length -= wrote;
+    }
+}
+
+static void watch_build_child(int report_fd, int client_fd, WatchRequest request) {
+    if (client_fd >= 0) {
+        dup2(client_fd, 1);
+        dup2(client_fd, 2);
+        close(client_fd);
+        context.options->no_colors = 1;
+    }
+
+    if (request == Watch_Request_Check) {
+        context.options->action = ONYX_COMPILE_ACTION_CHECK;
+    }
+
+    worker_pool_resume();
+
+    entity_heap_use_reserved_ids(program_entity_ids);
+    context_add_files();
+
+    CompilerProgress progress = onyx_compile();
+
+    // The inputs are reported even when compilation failed, so fixing the
+    // error starts the next build. This is done before the module is written,
+    // since the contents of #file_contents files are taken from the module.
+    bh_buffer inputs;
+    bh_buffer_init(&inputs, global_heap_allocator, 4096);
+    build_cache_manifest_add_inputs(&inputs);
+    watch_write(report_fd, inputs.data, inputs.length);
+    close(report_fd);
+
+    if (progress == ONYX_COMPILER_PROGRESS_SUCCESS && request == Watch_Request_Build) {
+        progress = onyx_flush_module();
+
+        if (progress == ONYX_COMPILER_PROGRESS_FAILED_OUTPUT) {
+            bh_printf_err("Failed to open file for writing: '%s'\n", context.options->target_file);
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    _exit(progress != ONYX_COMPILER_PROGRESS_SUCCESS);
+}
+
+static b32 watch_build(bh_buffer *inputs, int client_fd, WatchRequest request) {
+    bh_buffer_clear(inputs);
+
+    int fds[2];
+    if (pipe(fds) < 0) return 0;
+
+    // Anything still buffered would be printed by the child as well.
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        watch_build_child(fds[1], client_fd, request);
+    }
+
+    close(fds[1]);
+
+    char chunk[4096];
+    isize amount;
+    while ((amount = read(fds[0], chunk, sizeof(chunk))) > 0) {
+        bh_buffer_append(inputs, chunk, amount);
+    }
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static b32 watch_inputs_changed(bh_buffer inputs) {
+    char *line = (char *) inputs.data;
+    char *end  = line + inputs.length;
+    char kind;
+    u64 expected;
+    char *path;
+    while (build_cache_manifest_next(&line, end, &kind, &expected, &path)) {
+        u64 actual;
+        if (!build_cache_hash_input(kind, path, &actual) || actual != expected) return 1;
+    }
+
+    return 0;
+}
+
+static i32 watch_add_inputs(int inotify_fd, bh_buffer inputs) {
+    // IN_DELETE_SELF and IN_MOVE_SELF catch editors that save by replacing
+    // the file. The events on folders catch #load_all.
+    u32 mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF
+             | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+    i32 watch_count = 0;
+    char *line = (char *) inputs.data;
+    char *end  = line + inputs.length;
+    char kind;
+    u64 hash;
+    char *path;
+    while (build_cache_manifest_next(&line, end, &kind, &hash, &path)) {
+        if (inotify_add_watch(inotify_fd, path, mask) >= 0) watch_count++;
+    }
+
+    // Without any inputs, such as when a file given on the command line
+    // does not exist, the files given on the command line are watched.
+    if (inputs.length == 0) {
+        bh_arr_each(const char *, file, context.options->files) {
+            if (inotify_add_watch(inotify_fd, *file, mask) >= 0) watch_count++;
+        }
+    }
+
+    return watch_count;
+}
+
+static int watch_open_socket(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, path);
+
+    // A socket left behind by a server that was killed is replaced.
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode)) unlink(path);
+
+    int server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_fd < 0) return -1;
+
+    if (bind(server_fd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(server_fd, 16) < 0) {
+        close(server_fd);
+        return -1;
+    }
+
+    return server_fd;
+}
+
+static int watch_accept_request(int server_fd, WatchRequest *request) {
+    int client_fd = accept(server_fd, NULL, NULL);
+    if (client_fd < 0) return -1;
+
+    fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+
+    // A client that never sends its request cannot hold up the server.
+    struct timeval timeout = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char line[64];
+    u32 length = 0;
+    while (length < sizeof(line) - 1) {
+        if (read(client_fd, &line[length], 1) != 1 || line[length] == '\n') break;
+        length++;
+    }
+    line[length] = '\0';
+
+    if      (!strcmp(line, "build")) *request = Watch_Request_Build;
+    else if (!strcmp(line, "check")) *request = Watch_Request_Check;
+    else {
+        const char *message = "error: expected 'build' or 'check'\n";
+        watch_write(client_fd, message, strlen(message));
+        close(client_fd);
+        return -1;
+    }
+
+    return client_fd;
+}
+
+static CompilerProgress onyx_watch(char *argv[]) {
+    CompileOptions *opts = context.options;
+
+    if (watch_preload() != ONYX_COMPILER_PROGRESS_SUCCESS) {
+        onyx_errors_print();
+        return ONYX_COMPILER_PROGRESS_ERROR;
+    }
+
+    // The entities that are left have been waiting on the program. In a
+    // normal compilation, most of them would not exist until the program had
+    // been checked, so they are put after everything that has not been tried
+    // yet, as if they had waited once. With all of their attempts, they would
+    // only come up again after cycle detection had given up on the program.
+    bh_arr_each(Entity *, ent, context.entities.entities) {
+        (*ent)->macro_attempts = (*ent)->state < Entity_State_Code_Gen ? 1 : 0;
+        (*ent)->micro_attempts = 0;
+    }
+
+    entity_heap_reorder(&context.entities);
+
+    bh_buffer server_inputs;
+    bh_buffer_init(&server_inputs, global_heap_allocator, 4096);
+    build_cache_manifest_add_inputs(&server_inputs);
+
+    worker_pool_suspend();
+
+    // Clients that close their connection early must not stop the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    int inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0) {
+        bh_printf_err("Failed to start watching files.\n");
+        return ONYX_COMPILER_PROGRESS_ERROR;
+    }
+
+    watch_add_inputs(inotify_fd, server_inputs);
+
+    int server_fd = -1;
+    if (opts->watch_socket) {
+        server_fd = watch_open_socket(opts->watch_socket);
+        if (server_fd < 0) {
+            bh_printf_err("Failed to listen on '%s'.\n", opts->watch_socket);
+            return ONYX_COMPILER_PROGRESS_ERROR;
+        }
+    }
+
+    bh_buffer inputs;
+    bh_buffer_init(&inputs, global_heap_allocator, 4096);
+
+    b32 build = 1;
+    int client_fd = -1;
+    WatchRequest request = Watch_Request_Build;
+
+    while (1) {
+        if (build) {
+            b32 success = watch_build(&inputs, client_fd, request);
+
+            if (success) {
+                if (request == Watch_Request_Build) bh_printf("Compiled '%s'. Watching for changes...\n", opts->target_file);
+                else                                bh_printf("Checked. Watching for changes...\n");
+            } else {
+                bh_printf("Compilation failed. Watching for changes...\n");
+            }
+
+            if (client_fd >= 0) {
+                const char *result = success ? "ok\n" : "failed\n";
+                watch_write(client_fd, result, strlen(result));
+                close(client_fd);
+            }
+
+            if (watch_add_inputs(inotify_fd, inputs) == 0 && server_fd < 0) {
+                bh_printf_err("There are no files to watch.\n");
+                return ONYX_COMPILER_PROGRESS_ERROR;
+            }
+
+            build = 0;
+            client_fd = -1;
+            request = Watch_Request_Build;
+        }
+
+        // Everything is watched at this point, so comparing the inputs now
+        // catches every change made since they were read.
+        if (watch_inputs_changed(server_inputs)) {
+            bh_printf("The core library changed. Restarting...\n");
+            fflush(stdout);
+            if (server_fd >= 0) close(server_fd);
+
+            execv("/proc/self/exe", argv);
+            bh_printf_err("Failed to restart.\n");
+            return ONYX_COMPILER_PROGRESS_ERROR;
+        }
+
+        if (watch_inputs_changed(inputs)) {
+            build = 1;
+            continue;
+        }
+
+        struct pollfd fds[2] = {
+            { .fd = inotify_fd, .events = POLLIN },
+            { .fd = server_fd,  .events = POLLIN },
+        };
+
+        if (poll(fds, server_fd >= 0 ? 2 : 1, -1) < 0) continue;
+
+        if (fds[0].revents & POLLIN) {
+            // A save often comes as several events. Let them settle, then drop them.
+            usleep(50 * 1000);
+
+            char events[4096];
+            while (read(inotify_fd, events, sizeof(events)) > 0);
+
+            // Without a manifest from the last build, any change is worth a build.
+            if (inputs.length == 0) build = 1;
+        }
+
+        if (server_fd >= 0 && (fds[1].revents & POLLIN)) {
+            client_fd = watch_accept_request(server_fd, &request);
+            if (client_fd >= 0) build = 1;
+        }
+    }
 }
 #endif
 
@@ -828,8 +1723,14 @@ int main(int argc, char *argv[]) {
     global_heap_allocator = bh_heap_allocator();
 
     CompileOptions compile_opts = compile_opts_parse(global_heap_allocator, argc, argv);
+
     context_init(&compile_opts);
 
+    bh_buffer cached_output;
+    if (compile_opts.action == ONYX_COMPILE_ACTION_COMPILE || compile_opts.action == ONYX_COMPILE_ACTION_RUN) {
+        build_cache_init(argc, argv);
+    }
+
     CompilerProgress compiler_progress = ONYX_COMPILER_PROGRESS_ERROR;
     switch (compile_opts.action) {
         case ONYX_COMPILE_ACTION_PRINT_HELP: bh_printf(docstring); return 1;
@@ -839,6 +1740,18 @@ int main(int argc, char *argv[]) {
             break;
 
         case ONYX_COMPILE_ACTION_COMPILE:
+            if (build_cache_load(&cached_output)) {
+                compiler_progress = ONYX_COMPILER_PROGRESS_FAILED_OUTPUT;
+
+                bh_file output_file;
+                if (bh_file_create(&output_file, compile_opts.target_file) == BH_FILE_ERROR_NONE) {
+                    bh_file_write(&output_file, cached_output.data, cached_output.length);
+                    bh_file_close(&output_file);
+                    compiler_progress = ONYX_COMPILER_PROGRESS_SUCCESS;
+                }
+                break;
+            }
+
             compiler_progress = onyx_compile();
             if (compiler_progress == ONYX_COMPILER_PROGRESS_SUCCESS) {
                 onyx_flush_module();
@@ -847,6 +1760,14 @@ int main(int argc, char *argv[]) {
 
         #ifdef ENABLE_RUN_WITH_WASMER
         case ONYX_COMPILE_ACTION_RUN:
+            if (build_cache_load(&cached_output)) {
+                compiler_progress = ONYX_COMPILER_PROGRESS_SUCCESS;
+                if (!onyx_run_buffer(cached_output)) {
+                    compiler_progress = ONYX_COMPILER_PROGRESS_ERROR;
+                }
+                break;
+            }
+
             compiler_progress = onyx_compile();
             if (compiler_progress == ONYX_COMPILER_PROGRESS_SUCCESS) {
                 if (!onyx_run()) {
@@ -856,6 +1777,12 @@ int main(int argc, char *argv[]) {
             break;
         #endif
 
+        #if defined(_BH_LINUX)
+        case ONYX_COMPILE_ACTION_WATCH:
+            compiler_progress = onyx_watch(argv);
+            break;
+        #endif
+
         default: break;
     }
 
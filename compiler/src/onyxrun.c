@@ -5,25 +5,49 @@
 
 #include "wasm_emit.h"
 
-int main(int argc, char *argv[]) {
-    i32 wasm_file_idx = 1;
-    if (argc < 2) {
-        fprintf(stderr, "Expected a WASM file to run.\n");
-        return 1;
+//
+// Programs built by OVM are cached here, so running the same
+// WASM file again does not have to build the program again.
+static char *program_cache_dir() {
+    char *cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home && *cache_home) {
+        return bh_aprintf(bh_heap_allocator(), "%s/onyx", cache_home);
+    }
+
+    char *home = getenv("HOME");
+    if (home && *home) {
+        return bh_aprintf(bh_heap_allocator(), "%s/.cache/onyx", home);
     }
 
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    i32 wasm_file_idx = 1;
     b32 debug = 0;
-    if (!strcmp(argv[1], "--debug")) {
-        debug = 1;
-        wasm_file_idx = 2;
+    b32 use_cache = 1;
+    char *profile_output = NULL;
+
+    while (wasm_file_idx < argc) {
+        if (!strcmp(argv[wasm_file_idx], "--debug")) {
+            debug = 1;
+        } else if (!strcmp(argv[wasm_file_idx], "--no-cache")) {
+            use_cache = 0;
+        } else if (!strcmp(argv[wasm_file_idx], "--profile") && wasm_file_idx + 1 < argc) {
+            profile_output = argv[++wasm_file_idx];
+        } else {
+            break;
+        }
+
+        wasm_file_idx++;
     }
 
-    if (debug && argc < 3) {
+    if (wasm_file_idx >= argc) {
         fprintf(stderr, "Expected a WASM file to run.\n");
         return 1;
     }
 
-    onyx_run_initialize(debug);
+    onyx_run_initialize(debug, use_cache ? program_cache_dir() : NULL, profile_output);
 
     bh_file wasm_file;
     bh_file_error err = bh_file_open(&wasm_file, argv[wasm_file_idx]);
@@ -38,5 +62,5 @@ int main(int argc, char *argv[]) {
     bh_buffer data;
     data.data = wasm_data.data;
     data.length = wasm_data.length;
-    return onyx_run_wasm(data, argc - 1 - debug, argv + 1 + debug);
+    return onyx_run_wasm(data, argc - wasm_file_idx, argv + wasm_file_idx);
 }
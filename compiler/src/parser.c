@@ -18,13 +18,18 @@ static AstNode error_node = { Ast_Kind_Error, 0, NULL, NULL };
 #define ENTITY_SUBMIT_IN_SCOPE(node, scope) (submit_entity_in_scope(parser, (AstNode *) (node), scope, parser->package))
 
 void submit_entity_in_scope(OnyxParser* parser, AstNode* node, Scope* scope, Package* package) {
-    if (bh_arr_length(parser->alternate_entity_placement_stack) == 0) {
-        add_entities_for_node(NULL, node, scope, package);
+    bh_arr(Entity *) *entity_array = NULL;
+    if (bh_arr_length(parser->alternate_entity_placement_stack) > 0) {
+        entity_array = bh_arr_last(parser->alternate_entity_placement_stack);
+    }
 
-    } else {
-        bh_arr(Entity *) *entity_array = bh_arr_last(parser->alternate_entity_placement_stack);
-        add_entities_for_node(entity_array, node, scope, package);
+    if (parser->deferred_entities) {
+        ParsedEntity pe = { entity_array, node, scope, package };
+        bh_arr_push(parser->deferred_entities, pe);
+        return;
     }
+
+    add_entities_for_node(entity_array, node, scope, package);
 }
 
 // Parsing Utilities
@@ -585,7 +590,6 @@ static AstTyped* parse_factor(OnyxParser* parser) {
                 AstFileContents* fc = make_node(AstFileContents, Ast_Kind_File_Contents);
                 fc->token = parser->prev - 1;
                 fc->filename_expr = parse_expression(parser, 0);
-                fc->type = type_make_slice(parser->allocator, &basic_types[Basic_Kind_U8]);
 
                 if (parser->current_function_stack && bh_arr_length(parser->current_function_stack) > 0) {
                     bh_arr_push(bh_arr_last(parser->current_function_stack)->nodes_that_need_entities_after_clone, (AstNode *) fc);
@@ -1530,7 +1534,7 @@ static AstNode* parse_statement(OnyxParser* parser) {
                         }
                     }
 
-                    bh_arr_push(dest->args.values, (AstTyped *) make_argument(context.ast_alloc, (AstTyped *) code_block));
+                    bh_arr_push(dest->args.values, (AstTyped *) make_argument(parser->allocator, (AstTyped *) code_block));
                     needs_semicolon = 0;
                 }
             }
@@ -2011,7 +2015,7 @@ static AstTypeOf* parse_typeof(OnyxParser* parser) {
 
 static void struct_type_create_scope(OnyxParser *parser, AstStructType *s_node) {
     if (!s_node->scope) {
-        s_node->scope = scope_create(context.ast_alloc, parser->current_scope, s_node->token->pos);
+        s_node->scope = scope_create(parser->allocator, parser->current_scope, s_node->token->pos);
         parser->current_scope = s_node->scope;
 
         if (bh_arr_length(parser->current_symbol_stack) == 0) {
@@ -2564,6 +2568,10 @@ static AstFunction* parse_function_definition(OnyxParser* parser, OnyxToken* tok
             func_def->is_foreign = 1;
         }
 
+        else if (parse_possible_directive(parser, "inline")) {
+            func_def->is_inline = 1;
+        }
+
         // HACK: NullProcHack
         else if (parse_possible_directive(parser, "null")) {
             func_def->flags |= Ast_Flag_Proc_Is_Null;
@@ -3527,7 +3535,7 @@ static AstPackage* parse_package_expression(OnyxParser* parser) {
         total_package_name_length += (*token)->length + 1;
     }
 
-    char* package_name = bh_alloc_array(context.ast_alloc, char, total_package_name_length);
+    char* package_name = bh_alloc_array(parser->allocator, char, total_package_name_length);
     *package_name = '\0';
 
     bh_arr_each(OnyxToken *, token, package_node->path) {
@@ -3623,6 +3631,7 @@ OnyxParser onyx_parser_create(bh_allocator alloc, OnyxTokenizer *tokenizer) {
     parser.tag_depth = 0;
     parser.overload_count = 0;
     parser.injection_point = NULL;
+    parser.deferred_entities = NULL;
 
     parser.polymorph_context = (PolymorphicContext) {
         .root_node = NULL,
@@ -3641,14 +3650,29 @@ void onyx_parser_free(OnyxParser* parser) {
 }
 
 void onyx_parse(OnyxParser *parser) {
+    onyx_parse_file_header(parser);
+    onyx_parse_file_body(parser);
+}
+
+void onyx_parse_file_header(OnyxParser *parser) {
     // NOTE: Skip comments at the beginning of the file
     while (consume_token_if_next(parser, Token_Type_Comment));
 
     parser->package = parse_file_package(parser);
     parser->file_scope = scope_create(parser->allocator, parser->package->private_scope, parser->tokenizer->tokens[0].pos);
     parser->current_scope = parser->file_scope;
+}
 
+void onyx_parse_file_body(OnyxParser *parser) {
     parse_top_level_statements_until(parser, Token_Type_End_Stream);
 
     parser->current_scope = parser->current_scope->parent;
 }
+
+void onyx_parser_submit_deferred_entities(OnyxParser *parser) {
+    bh_arr_each(ParsedEntity, pe, parser->deferred_entities) {
+        add_entities_for_node(pe->target_arr, pe->node, pe->scope, pe->package);
+    }
+
+    bh_arr_free(parser->deferred_entities);
+}
@@ -869,7 +869,12 @@ static SymresStatus symres_use(AstUse* use) {
 
         if (use_expr->type == NULL)
             use_expr->type = type_build_from_ast(context.ast_alloc, use_expr->type_node);
-        if (use_expr->type == NULL) goto cannot_use;
+
+        if (use_expr->type == NULL) {
+            // The structure may not have been resolved yet.
+            if (context.cycle_detected || context.cycle_almost_detected >= 2) goto cannot_use;
+            return Symres_Yield_Macro;
+        }
 
         Type* st = use_expr->type;
         if (st->kind == Type_Kind_Pointer)
@@ -969,8 +974,10 @@ static SymresStatus symres_statement(AstNode** stmt, b32 *remove) {
             break;
 
         case Ast_Kind_Use:
-            if (remove) *remove = 1;
+            // Only removed once it is done, since the block keeps going
+            // past a statement that is removed.
             SYMRES(use, (AstUse *) *stmt);
+            if (remove) *remove = 1;
             break;
 
         default: SYMRES(expression, (AstTyped **) stmt); break;
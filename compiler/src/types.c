@@ -56,7 +56,23 @@ static Type* type_create(TypeKind kind, bh_allocator a, u32 extra_type_pointer_c
     return type;
 }
 
+// Types are shared by every function, so once a type has a node, a worker
+// thread leaves it be instead of pointing it at a node of its own function.
+static void type_set_ast_type(Type* type, AstType* type_node) {
+    if (type == NULL) return;
+
+    if (checking_on_worker_thread()) {
+        if (type->ast_type != NULL) return;
+        check_requires_main_thread();
+    }
+
+    type->ast_type = type_node;
+}
+
 static void type_register(Type* type) {
+    // New types can only be created on the main thread, see check_entity_batch.
+    check_requires_main_thread();
+
     static u32 next_unique_id = 1;
     type->id = next_unique_id++;
     if (type->ast_type) type->ast_type->type_id = type->id;
@@ -263,7 +279,7 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
         case Ast_Kind_Pointer_Type: {
             Type *inner_type = type_build_from_ast_inner(alloc, ((AstPointerType *) type_node)->elem, 1);
             Type *ptr_type = type_make_pointer(alloc, inner_type);
-            if (ptr_type) ptr_type->ast_type = type_node;
+            type_set_ast_type(ptr_type, type_node);
             return ptr_type;
         }
 
@@ -292,8 +308,8 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
 
             char* name = (char *) type_get_unique_name(func_type);
             if (func_type->Function.return_type != &type_auto_return) {
-                i32 index = shgeti(type_func_map, name);
-                if (index != -1) {
+                ptrdiff_t index;
+                if (shgeti_ts(type_func_map, name, index) != -1) {
                     u64 id = type_func_map[index].value;
                     Type* existing_type = (Type *) bh_imap_get(&type_map, id);
 
@@ -316,10 +332,13 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
 
             u32 count = 0;
             if (a_node->count_expr) {
-                if (a_node->count_expr->type == NULL)
+                if (a_node->count_expr->type == NULL) {
+                    check_writes_to_node((AstNode *) a_node->count_expr);
                     a_node->count_expr->type = type_build_from_ast_inner(alloc, a_node->count_expr->type_node, 1);
+                }
 
                 if (node_is_auto_cast((AstNode *) a_node->count_expr)) {
+                    check_requires_main_thread();
                     a_node->count_expr = ((AstUnaryOp *) a_node)->expr;
                 }
 
@@ -337,7 +356,7 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
             }
 
             Type* array_type = type_make_array(alloc, elem_type, count);
-            if (array_type) array_type->ast_type = type_node;
+            type_set_ast_type(array_type, type_node);
             return array_type;
         }
 
@@ -347,6 +366,8 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
             if (s_node->pending_type != NULL && s_node->pending_type_is_valid) return s_node->pending_type;
             if (!s_node->ready_to_build_type) return NULL;
 
+            check_requires_main_thread();
+
             Type* s_type;
             if (s_node->pending_type == NULL) {
                 s_type = type_create(Type_Kind_Struct, alloc, 0);
@@ -467,6 +488,8 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
             if (enum_node->etcache) return enum_node->etcache;
             if (enum_node->backing_type == NULL) return NULL;
 
+            check_requires_main_thread();
+
             Type* enum_type = type_create(Type_Kind_Enum, alloc, 0);
             enum_node->etcache = enum_type;
 
@@ -481,19 +504,19 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
 
         case Ast_Kind_Slice_Type: {
             Type* slice_type = type_make_slice(alloc, type_build_from_ast_inner(alloc, ((AstSliceType *) type_node)->elem, 1));
-            if (slice_type) slice_type->ast_type = type_node;
+            type_set_ast_type(slice_type, type_node);
             return slice_type;
         }
 
         case Ast_Kind_DynArr_Type: {
             Type* dynarr_type = type_make_dynarray(alloc, type_build_from_ast_inner(alloc, ((AstDynArrType *) type_node)->elem, 1));
-            if (dynarr_type) dynarr_type->ast_type = type_node;
+            type_set_ast_type(dynarr_type, type_node);
             return dynarr_type;
         }
 
         case Ast_Kind_VarArg_Type: {
             Type* va_type = type_make_varargs(alloc, type_build_from_ast_inner(alloc, ((AstVarArgType *) type_node)->elem, 1));
-            if (va_type) va_type->ast_type = type_node;
+            type_set_ast_type(va_type, type_node);
             return va_type;
         }
 
@@ -503,7 +526,10 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
 
         case Ast_Kind_Type_Alias: {
             Type* type = type_build_from_ast_inner(alloc, ((AstTypeAlias *) type_node)->to, 1);
-            if (type && type->ast_type) type_node->type_id = type->id;
+            if (type && type->ast_type && type_node->type_id != type->id) {
+                check_requires_main_thread();
+                type_node->type_id = type->id;
+            }
             return type;
         }
 
@@ -524,6 +550,8 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
 
         case Ast_Kind_Poly_Call_Type: {
             AstPolyCallType* pc_type = (AstPolyCallType *) type_node;
+            check_requires_main_thread();
+
             pc_type->callee = (AstType *) strip_aliases((AstNode *) pc_type->callee);
 
             if (!(pc_type->callee && pc_type->callee->kind == Ast_Kind_Poly_Struct_Type)) {
@@ -622,6 +650,8 @@ static Type* type_build_from_ast_inner(bh_allocator alloc, AstType* type_node, b
             AstDistinctType* distinct = (AstDistinctType *) type_node;
             if (distinct->dtcache) return distinct->dtcache;
 
+            check_requires_main_thread();
+
             Type *base_type = type_build_from_ast(alloc, distinct->base_type);
             if (base_type == NULL) return NULL;
             if (base_type->kind != Type_Kind_Basic && base_type->kind != Type_Kind_Pointer) {
@@ -678,8 +708,8 @@ Type* type_build_function_type(bh_allocator alloc, AstFunction* func) {
     // CopyPaste from above in type_build_from_ast
     char* name = (char *) type_get_unique_name(func_type);
     if (func_type->Function.return_type != &type_auto_return) {
-        i32 index = shgeti(type_func_map, name);
-        if (index != -1) {
+        ptrdiff_t index;
+        if (shgeti_ts(type_func_map, name, index) != -1) {
             u64 id = type_func_map[index].value;
             Type* existing_type = (Type *) bh_imap_get(&type_map, id);
 
@@ -1195,8 +1225,9 @@ b32 type_lookup_member(Type* type, char* member, StructMember* smem) {
         case Type_Kind_Struct: {
             TypeStruct* stype = &type->Struct;
 
-            i32 index = shgeti(stype->members, member);
-            if (index == -1) return 0;
+            // Code generation looks up members from many threads at once.
+            ptrdiff_t index;
+            if (shgeti_ts(stype->members, member, index) == -1) return 0;
             *smem = *stype->members[index].value;
             return 1;
         }
@@ -9,8 +9,8 @@
 #include "errors.h"
 #include "doc.h"
 
-bh_scratch global_scratch;
-bh_allocator global_scratch_allocator;
+BH_THREAD_LOCAL bh_scratch global_scratch;
+BH_THREAD_LOCAL bh_allocator global_scratch_allocator;
 
 bh_managed_heap global_heap;
 bh_allocator global_heap_allocator;
@@ -84,15 +84,188 @@ void package_reinsert_use_packages(Package* package) {
     if (!package->use_package_entities) return;
 
     bh_arr_each(Entity *, use_package, package->use_package_entities) {
-        (*use_package)->state = Entity_State_Resolve_Symbols;
-        (*use_package)->macro_attempts = 0;
-        entity_heap_insert_existing(&context.entities, *use_package);
+        entity_heap_reset_entity(&context.entities, *use_package, Entity_State_Resolve_Symbols);
     } 
 
     bh_arr_set_length(package->use_package_entities, 0);
 }
 
 
+//
+// Worker threads
+//
+static i32 worker_count = 1;
+static BH_THREAD_LOCAL i32 current_worker_index = 0;
+
+// Index 0 is unused, as the main thread allocates from context.ast_arena.
+static bh_arena *worker_arenas = NULL;
+
+#if defined(_BH_LINUX)
+static pthread_t      *worker_threads;
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  worker_wake  = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  worker_done  = PTHREAD_COND_INITIALIZER;
+
+// These are all protected by worker_mutex, except for
+// worker_run_next, which is only ever used atomically.
+static u64       worker_generation = 0;
+static i32       workers_busy = 0;
+static b32       workers_exiting = 0;
+static WorkerJob worker_run_job;
+static void     *worker_run_data;
+static i32       worker_run_count;
+static i32       worker_run_next;
+
+static void worker_run_jobs() {
+    while (1) {
+        i32 index = __atomic_fetch_add(&worker_run_next, 1, __ATOMIC_RELAXED);
+        if (index >= worker_run_count) break;
+
+        worker_run_job(worker_run_data, index);
+    }
+}
+
+static void *worker_thread_main(void *data) {
+    current_worker_index = (i32) (i64) data;
+
+    bh_scratch_init(&global_scratch, bh_heap_allocator(), 256 * 1024);
+    global_scratch_allocator = bh_scratch_allocator(&global_scratch);
+
+    u64 seen_generation = 0;
+
+    pthread_mutex_lock(&worker_mutex);
+    while (1) {
+        while (worker_generation == seen_generation && !workers_exiting) {
+            pthread_cond_wait(&worker_wake, &worker_mutex);
+        }
+
+        if (workers_exiting) break;
+        seen_generation = worker_generation;
+        pthread_mutex_unlock(&worker_mutex);
+
+        worker_run_jobs();
+
+        pthread_mutex_lock(&worker_mutex);
+        workers_busy -= 1;
+        if (workers_busy == 0) pthread_cond_signal(&worker_done);
+    }
+    pthread_mutex_unlock(&worker_mutex);
+
+    bh_scratch_free(&global_scratch);
+    return NULL;
+}
+#endif
+
+void worker_pool_init(i32 thread_count) {
+#if defined(_BH_LINUX)
+    if (thread_count <= 0) thread_count = (i32) sysconf(_SC_NPROCESSORS_ONLN);
+    if (thread_count <= 0) thread_count = 1;
+
+    worker_count = thread_count;
+    worker_arenas = bh_alloc_array(global_heap_allocator, bh_arena, worker_count);
+    worker_threads = bh_alloc_array(global_heap_allocator, pthread_t, worker_count);
+
+    fori (i, 1, worker_count) {
+        bh_arena_init(&worker_arenas[i], global_heap_allocator, 4 * 1024 * 1024);
+    }
+
+    worker_pool_resume();
+#else
+    // Worker threads are only implemented using pthreads for now.
+    worker_count = 1;
+#endif
+}
+
+void worker_pool_free() {
+#if defined(_BH_LINUX)
+    if (worker_count <= 1) return;
+
+    worker_pool_suspend();
+
+    fori (i, 1, worker_count) {
+        bh_arena_free(&worker_arenas[i]);
+    }
+
+    bh_free(global_heap_allocator, worker_threads);
+    bh_free(global_heap_allocator, worker_arenas);
+    worker_count = 1;
+#endif
+}
+
+void worker_pool_suspend() {
+#if defined(_BH_LINUX)
+    if (worker_count <= 1) return;
+
+    pthread_mutex_lock(&worker_mutex);
+    workers_exiting = 1;
+    pthread_cond_broadcast(&worker_wake);
+    pthread_mutex_unlock(&worker_mutex);
+
+    fori (i, 1, worker_count) {
+        pthread_join(worker_threads[i], NULL);
+    }
+
+    // New threads start waiting for generation 1 again.
+    workers_exiting = 0;
+    worker_generation = 0;
+#endif
+}
+
+void worker_pool_resume() {
+#if defined(_BH_LINUX)
+    fori (i, 1, worker_count) {
+        pthread_create(&worker_threads[i], NULL, worker_thread_main, (void *) (i64) i);
+    }
+#endif
+}
+
+void worker_pool_run(i32 job_count, WorkerJob job, void *data) {
+#if defined(_BH_LINUX)
+    if (worker_count > 1 && job_count > 1) {
+        pthread_mutex_lock(&worker_mutex);
+        worker_run_job   = job;
+        worker_run_data  = data;
+        worker_run_count = job_count;
+        worker_run_next  = 0;
+        workers_busy     = worker_count - 1;
+        worker_generation += 1;
+        pthread_cond_broadcast(&worker_wake);
+        pthread_mutex_unlock(&worker_mutex);
+
+        worker_run_jobs();
+
+        pthread_mutex_lock(&worker_mutex);
+        while (workers_busy > 0) pthread_cond_wait(&worker_done, &worker_mutex);
+        pthread_mutex_unlock(&worker_mutex);
+        return;
+    }
+#endif
+
+    fori (i, 0, job_count) job(data, i);
+}
+
+i32 worker_pool_thread_count() {
+    return worker_count;
+}
+
+i32 worker_index() {
+    return current_worker_index;
+}
+
+static BH_ALLOCATOR_PROC(worker_ast_allocator_proc) {
+    bh_arena* arena = (bh_arena *) data;
+    if (current_worker_index != 0) arena = &worker_arenas[current_worker_index];
+
+    return bh_arena_allocator_proc(arena, action, size, alignment, prev_memory, flags);
+}
+
+bh_allocator worker_ast_allocator(bh_arena* main_arena) {
+    return (bh_allocator) {
+        .proc = worker_ast_allocator_proc,
+        .data = main_arena,
+    };
+}
+
 //
 // Scoping
 //
@@ -100,7 +273,12 @@ static u64 next_scope_id = 1;
 
 Scope* scope_create(bh_allocator a, Scope* parent, OnyxFilePos created_at) {
     Scope* scope = bh_alloc_item(a, Scope);
+#if defined(_BH_LINUX)
+    // Scopes are created while parsing, which can happen on any worker thread.
+    scope->id = __atomic_fetch_add(&next_scope_id, 1, __ATOMIC_RELAXED);
+#else
     scope->id = next_scope_id++;
+#endif
     scope->parent = parent;
     scope->created_at = created_at;
     scope->name = NULL;
@@ -381,9 +559,16 @@ void scope_clear(Scope* scope) {
 //  * Resolving an overload from a TypeFunction (so an overloaded procedure can be passed as a parameter)
 //
 
+// Incremented whenever an option is added to a set of overloads, making every
+// OverloadCache out of date. Starts at 1 so zeroed caches are out of date.
+static u32 overload_generation = 1;
+
 void add_overload_option(bh_arr(OverloadOption)* poverloads, u64 order, AstTyped* overload) {
     bh_arr(OverloadOption) overloads = *poverloads;
 
+    // Options are added while parsing, which can happen on worker threads.
+    __atomic_fetch_add(&overload_generation, 1, __ATOMIC_RELAXED);
+
     i32 index = -1;
     fori (i, 0, bh_arr_length(overloads)) {
         if (overloads[i].order > order) {
@@ -438,27 +623,163 @@ void build_all_overload_options(bh_arr(OverloadOption) overloads, bh_imap* all_o
     }
 }
 
-AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads, Arguments* param_args) {
-    Arguments args;
-    arguments_clone(&args, param_args);
-    arguments_ensure_length(&args, bh_arr_length(args.values) + bh_arr_length(args.named_values));
+static bh_arr(AstTyped *) get_all_overload_options(bh_arr(OverloadOption) overloads, OverloadCache* cache) {
+    if (cache->generation == overload_generation) return cache->options;
 
-    // CLEANUP SPEED: This currently rebuilds the complete set of overloads every time one is looked up.
-    // This should be cached in the AstOverloadedFunction or somewhere like that.
     bh_imap all_overloads;
     bh_imap_init(&all_overloads, global_heap_allocator, bh_arr_length(overloads) * 2);
     build_all_overload_options(overloads, &all_overloads);
 
-    AstTyped *matched_overload = NULL;
+    if (cache->options == NULL) bh_arr_new(global_heap_allocator, cache->options, bh_arr_length(all_overloads.entries));
+    bh_arr_clear(cache->options);
 
     bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) entry->key);
+        bh_arr_push(cache->options, (AstTyped *) entry->key);
+    }
+
+    bh_imap_free(&all_overloads);
+
+    // New options could match the arguments that were matched before.
+    if (cache->matches != NULL) shfree(cache->matches);
+    sh_new_arena(cache->matches);
+
+    cache->generation = overload_generation;
+    return cache->options;
+}
+
+//
+// The option that is matched only depends on the types of the arguments, unless an
+// argument needs to be converted to the type of the parameter, or it is used as a
+// compile-time value. Numeric literals are converted based on their value, so their
+// value is part of the key. Other arguments like that are not given a key, and the
+// match is not cached.
+//
+static b32 append_overload_match_key(char* key_buf, u32 key_size, u32* key_length, AstTyped* value) {
+    if (value->kind == Ast_Kind_Argument) {
+        if (((AstArgument *) value)->is_baked) return 0;
+        value = ((AstArgument *) value)->value;
+    }
+
+    if (value == NULL || value->type == NULL) return 0;
+    if ((value->flags & Ast_Flag_Proc_Is_Null) != 0) return 0;
+    if (node_is_type((AstNode *) value) || node_is_auto_cast((AstNode *) value)) return 0;
+
+    Type* type = value->type;
+
+    switch (value->kind) {
+        case Ast_Kind_NumLit: {
+            AstNumLit* num = (AstNumLit *) value;
+            if (*key_length + 32 >= key_size) return 0;
+            *key_length += snprintf(key_buf + *key_length, key_size - *key_length, "%u=%llx%s%s;",
+                    type->id, (unsigned long long) num->value.l,
+                    num->was_hex_literal ? "h" : "", num->was_char_literal ? "c" : "");
+            return 1;
+        }
+
+        // Unifying the function with the type of the parameter fills in the return type.
+        case Ast_Kind_Function:
+            if (type->kind == Type_Kind_Function && type->Function.return_type == &type_auto_return) return 0;
+            break;
+
+        case Ast_Kind_Compound:
+        case Ast_Kind_Struct_Literal:
+        case Ast_Kind_Array_Literal:
+        case Ast_Kind_Unary_Field_Access:
+        case Ast_Kind_Polymorphic_Proc:
+        case Ast_Kind_Overloaded_Function:
+        case Ast_Kind_Macro:
+            return 0;
+
+        default: break;
+    }
+
+    if (type->kind == Type_Kind_Basic
+        && (type->Basic.kind == Basic_Kind_Int_Unsized || type->Basic.kind == Basic_Kind_Float_Unsized)) return 0;
+
+    if (*key_length + 12 >= key_size) return 0;
+    *key_length += snprintf(key_buf + *key_length, key_size - *key_length, "%u;", type->id);
+    return 1;
+}
+
+// NOTE: This returns a volatile string. Do not store it without copying it.
+static char* build_overload_match_key(Arguments* args) {
+    static BH_THREAD_LOCAL char key_buf[1024];
+    u32 key_length = 0;
+
+    bh_arr_each(AstTyped *, value, args->values) {
+        if (!append_overload_match_key(key_buf, sizeof(key_buf), &key_length, *value)) return NULL;
+    }
+
+    bh_arr_each(AstNamedValue *, named_value, args->named_values) {
+        OnyxToken* name = (*named_value)->token;
+        if (key_length + name->length + 2 >= sizeof(key_buf)) return NULL;
+
+        key_length += snprintf(key_buf + key_length, sizeof(key_buf) - key_length, "%.*s:", name->length, name->text);
+        if (!append_overload_match_key(key_buf, sizeof(key_buf), &key_length, (*named_value)->value)) return NULL;
+    }
+
+    key_buf[key_length] = '\0';
+    return key_buf;
+}
+
+static b32 overload_option_uses_baked_values(AstFunction* pp) {
+    bh_arr_each(AstPolyParam, param, pp->poly_params) {
+        if (param->kind == PPK_Baked_Value) return 1;
+    }
+
+    return 0;
+}
+
+AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads, OverloadCache* cache, Arguments* param_args) {
+    if (checking_on_worker_thread()) {
+        // Matching the arguments against the options can build polymorphic procedures,
+        // so a worker thread can only use a match that is already in the cache.
+        char* key = build_overload_match_key(param_args);
+        if (key == NULL || cache->generation != overload_generation) check_requires_main_thread();
+
+        ptrdiff_t index;
+        if (shgeti_ts(cache->matches, key, index) == -1) check_requires_main_thread();
+
+        return cache->matches[index].value;
+    }
+
+    bh_arr(AstTyped *) all_overloads = get_all_overload_options(overloads, cache);
+
+    char* key = build_overload_match_key(param_args);
+    if (key != NULL) {
+        i32 index = shgeti(cache->matches, key);
+        if (index != -1) return cache->matches[index].value;
+    }
+
+    Arguments args;
+    arguments_clone(&args, param_args);
+    arguments_ensure_length(&args, bh_arr_length(args.values) + bh_arr_length(args.named_values));
+
+    AstTyped *matched_overload = NULL;
+
+    // Options that solve baked parameters from the values of the arguments could
+    // match different arguments of the same types.
+    b32 cacheable = key != NULL;
+
+    bh_arr_each(AstTyped *, poption, all_overloads) {
+        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) *poption);
         arguments_copy(&args, param_args);
 
         AstFunction* overload = NULL;
         switch (node->kind) {
-            case Ast_Kind_Macro:            overload = macro_resolve_header((AstMacro *) node, param_args, NULL, 0); break;
-            case Ast_Kind_Polymorphic_Proc: overload = polymorphic_proc_build_only_header((AstFunction *) node, PPLM_By_Arguments, param_args); break;
+            case Ast_Kind_Macro: {
+                overload = macro_resolve_header((AstMacro *) node, param_args, NULL, 0);
+
+                AstFunction* body = (AstFunction *) ((AstMacro *) node)->body;
+                if (body->kind == Ast_Kind_Polymorphic_Proc && overload_option_uses_baked_values(body)) cacheable = 0;
+                break;
+            }
+
+            case Ast_Kind_Polymorphic_Proc:
+                overload = polymorphic_proc_build_only_header((AstFunction *) node, PPLM_By_Arguments, param_args);
+                if (overload_option_uses_baked_values((AstFunction *) node)) cacheable = 0;
+                break;
+
             case Ast_Kind_Function:
                 overload = (AstFunction *) node;
                 arguments_clear_baked_flags(&args);
@@ -474,7 +795,6 @@ AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads,
 
             // return and not continue because if the overload that didn't have a type will
             // work in the future, then it has to take precedence over the other options available.
-            bh_imap_free(&all_overloads);
             bh_arr_free(args.values);
             return (AstTyped *) &node_that_signals_a_yield;
         }
@@ -494,28 +814,30 @@ AstTyped* find_matching_overload_by_arguments(bh_arr(OverloadOption) overloads,
         }
 
         if (tm == TYPE_MATCH_YIELD) {
-            bh_imap_free(&all_overloads);
             bh_arr_free(args.values);
             return (AstTyped *) &node_that_signals_a_yield;
         }
     }
 
-    bh_imap_free(&all_overloads);
+    // Failing to match is not cached, because the caller waits for more options to be
+    // added, and they might not be added to this set of overloads.
+    if (cacheable && matched_overload != NULL) {
+        shput(cache->matches, key, matched_overload);
+    }
+
     bh_arr_free(args.values);
     return matched_overload;
 }
 
-AstTyped* find_matching_overload_by_type(bh_arr(OverloadOption) overloads, Type* type) {
+AstTyped* find_matching_overload_by_type(bh_arr(OverloadOption) overloads, OverloadCache* cache, Type* type) {
     if (type->kind != Type_Kind_Function) return NULL;
 
-    bh_imap all_overloads;
-    bh_imap_init(&all_overloads, global_heap_allocator, bh_arr_length(overloads) * 2);
-    build_all_overload_options(overloads, &all_overloads);
+    bh_arr(AstTyped *) all_overloads = get_all_overload_options(overloads, cache);
 
     AstTyped *matched_overload = NULL;
 
-    bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-        AstTyped* node = (AstTyped *) entry->key;
+    bh_arr_each(AstTyped *, poption, all_overloads) {
+        AstTyped* node = *poption;
         if (node->kind == Ast_Kind_Overloaded_Function) continue;
 
         TypeMatch tm = unify_node_and_type(&node, type);
@@ -529,11 +851,10 @@ AstTyped* find_matching_overload_by_type(bh_arr(OverloadOption) overloads, Type*
         }
     }
     
-    bh_imap_free(&all_overloads);
     return matched_overload;
 }
 
-void report_unable_to_match_overload(AstCall* call, bh_arr(OverloadOption) overloads) {
+void report_unable_to_match_overload(AstCall* call, bh_arr(OverloadOption) overloads, OverloadCache* cache) {
     char* arg_str = bh_alloc(global_scratch_allocator, 1024);
     arg_str[0] = '\0';
 
@@ -566,19 +887,13 @@ void report_unable_to_match_overload(AstCall* call, bh_arr(OverloadOption) overl
 
     bh_free(global_scratch_allocator, arg_str);
 
-    // CLEANUP SPEED: This currently rebuilds the complete set of overloads every time one is looked up.
-    // This should be cached in the AstOverloadedFunction or somewhere like that.
-    bh_imap all_overloads;
-    bh_imap_init(&all_overloads, global_heap_allocator, bh_arr_length(overloads) * 2);
-    build_all_overload_options(overloads, &all_overloads);
+    bh_arr(AstTyped *) all_overloads = get_all_overload_options(overloads, cache);
 
     i32 i = 1;
-    bh_arr_each(bh__imap_entry, entry, all_overloads.entries) {
-        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) entry->key);
-        onyx_report_error(node->token->pos, Error_Critical, "Here is one of the overloads. %d/%d", i++, bh_arr_length(all_overloads.entries));
+    bh_arr_each(AstTyped *, poption, all_overloads) {
+        AstTyped* node = (AstTyped *) strip_aliases((AstNode *) *poption);
+        onyx_report_error(node->token->pos, Error_Critical, "Here is one of the overloads. %d/%d", i++, bh_arr_length(all_overloads));
     }
-
-    bh_imap_free(&all_overloads);
 }
 
 void report_incorrect_overload_expected_type(Type *given, Type *expected, OnyxToken *overload, OnyxToken *group) {
@@ -651,6 +966,8 @@ void ensure_overload_returns_correct_type(AstTyped *overload, AstOverloadedFunct
     // constraint, so this is a cheap way to tell if that is where we are coming from.
     //
     if (group->expected_return_type && onyx_errors_are_enabled()) {
+        check_requires_main_thread();
+
         OverloadReturnTypeCheck *data = bh_alloc_item(context.ast_alloc, OverloadReturnTypeCheck);
         data->expected_type = group->expected_return_type;
         data->node = overload;
@@ -900,29 +1217,27 @@ b32 fill_in_arguments(Arguments* args, AstNode* provider, char** err_msg, b32 in
                 }
             }
 
-            token_toggle_end(named_value->token);
-            i32 idx = lookup_idx_by_name(provider, named_value->token->text);
+            // The name is copied because the token can be shared with other threads.
+            char* name = bh_aprintf(global_scratch_allocator, "%b", named_value->token->text, named_value->token->length);
+
+            i32 idx = lookup_idx_by_name(provider, name);
             if (idx == -1) {
-                if (err_msg) *err_msg = bh_aprintf(global_scratch_allocator, "'%s' is not a valid named parameter here.", named_value->token->text);
-                token_toggle_end(named_value->token);
+                if (err_msg) *err_msg = bh_aprintf(global_scratch_allocator, "'%s' is not a valid named parameter here.", name);
                 return 0;
             }
 
             // assert(idx < bh_arr_length(args->values));
             if (idx >= bh_arr_length(args->values)) {
-                if (err_msg) *err_msg = bh_aprintf(global_scratch_allocator, "Error placing value with name '%s' at index '%d'.", named_value->token->text, idx);
-                token_toggle_end(named_value->token);
+                if (err_msg) *err_msg = bh_aprintf(global_scratch_allocator, "Error placing value with name '%s' at index '%d'.", name, idx);
                 return 0;
             }
 
             if (args->values[idx] != NULL && args->values[idx] != named_value->value) {
-                if (err_msg) *err_msg = bh_aprintf(global_scratch_allocator, "Multiple values given for parameter named '%s'.", named_value->token->text);
-                token_toggle_end(named_value->token);
+                if (err_msg) *err_msg = bh_aprintf(global_scratch_allocator, "Multiple values given for parameter named '%s'.", name);
                 return 0;
             }
 
             args->values[idx] = named_value->value;
-            token_toggle_end(named_value->token);
         }
     }
 
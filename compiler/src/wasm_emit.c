@@ -210,6 +210,51 @@ static inline b32 should_emit_function(AstFunction* fd) {
 }
 
 
+//
+// Function bodies are emitted in batches across the worker threads (see
+// emit_entity_batch). Each function is emitted into a copy of the module that
+// has its own per-function state. Anything that would change the rest of the
+// module is recorded in the FunctionEmission instead, and is merged into the
+// module on the main thread, in the order of the batch.
+//
+// The index of a function type that is not in the module yet depends on the
+// order that types are first used in, so these are given a placeholder index
+// until the merge.
+//
+#define FUNCTION_TYPE_PLACEHOLDER 0x40000000
+
+typedef struct InstructionPatch {
+    u32 instruction_index;
+    void* node;
+} InstructionPatch;
+
+typedef struct FunctionEmission {
+    Entity* entity;
+
+    b32 emitted : 1;
+    b32 on_main_thread : 1;
+    i32 func_idx;
+    WasmFunc func;
+
+    Table(i32)     type_map;
+    bh_arr(Type *) new_types;
+
+    bh_arr(InstructionPatch) element_patches;  // AstFunction *
+    bh_arr(InstructionPatch) type_id_patches;  // AstType *
+
+    // NOTE: Types used in the type table, in order. A negative value -(n + 1)
+    // is the type built by the nth type id patch.
+    bh_arr(i32) type_table_marks;
+
+    bh_arr(DatumPatchInfo) data_patches;
+    bh_arr(OnyxError)      errors;
+
+#ifdef ENABLE_DEBUG_INFO
+    DebugContext debug_context;
+#endif
+} FunctionEmission;
+
+
 //
 // Debug Info Generation
 //
@@ -227,9 +272,9 @@ static u32 debug_introduce_symbol(OnyxWasmModule *mod, OnyxToken *token, DebugSy
     sym_info.type          = type->id;
 
     if (token) {
-        token_toggle_end(token);
-        sym_info.name = bh_strdup(context.ast_alloc, token->text);
-        token_toggle_end(token);
+        // NOTE: The token is not toggled here, because the same token can be
+        // shared by functions that are being emitted on other threads.
+        sym_info.name = bh_aprintf(context.ast_alloc, "%b", token->text, token->length);
     } else {
         sym_info.name = NULL;
     }
@@ -302,7 +347,7 @@ static void debug_set_position(OnyxWasmModule *mod, OnyxToken *token) {
 //    - REP
 //    - SET, REP 0
 static void debug_emit_instruction(OnyxWasmModule *mod, OnyxToken *token) {
-    if (!context.options->debug_enabled) {
+    if (!context.options->generate_debug_info) {
         return;
     }
 
@@ -420,6 +465,102 @@ static void debug_leave_symbol_frame(OnyxWasmModule *mod) {
     mod->debug_context->last_op_was_rep = 0;
 }
 
+static void debug_context_init(DebugContext *ctx) {
+    ctx->allocator = global_heap_allocator;
+    ctx->next_file_id = 0;
+    ctx->next_sym_id = 0;
+    ctx->last_token = NULL;
+    ctx->last_op_was_rep = 0;
+
+    ctx->file_info = NULL;
+    sh_new_arena(ctx->file_info);
+
+    ctx->sym_info = NULL;
+    ctx->sym_patches = NULL;
+    ctx->funcs = NULL;
+    bh_arr_new(global_heap_allocator, ctx->sym_info, 32);
+    bh_arr_new(global_heap_allocator, ctx->sym_patches, 32);
+    bh_arr_new(global_heap_allocator, ctx->funcs, 16);
+
+    bh_buffer_init(&ctx->op_buffer, global_heap_allocator, 1024);
+}
+
+static void debug_context_free(DebugContext *ctx) {
+    shfree(ctx->file_info);
+    bh_arr_free(ctx->sym_info);
+    bh_arr_free(ctx->sym_patches);
+    bh_arr_free(ctx->funcs);
+    bh_buffer_free(&ctx->op_buffer);
+}
+
+static void debug_write_uleb(DebugContext *ctx, u64 value) {
+    u32 leb_len=0;
+    u8 *bytes = uint_to_uleb128(value, &leb_len);
+    bh_buffer_append(&ctx->op_buffer, bytes, leb_len);
+}
+
+//
+// Merges the debug info of a function that was emitted on a worker thread.
+// File and symbol ids in it are local to the function, so they are renumbered
+// as the function's ops are copied over.
+static void debug_merge_function(OnyxWasmModule *mod, DebugContext *func_ctx) {
+    DebugContext *ctx = mod->debug_context;
+
+    // NOTE: Files are numbered in the order they were first used,
+    // which is also the order of file_info.
+    u32 *file_ids = bh_alloc_array(global_scratch_allocator, u32, func_ctx->next_file_id);
+    fori (i, 0, shlen(func_ctx->file_info)) {
+        file_ids[func_ctx->file_info[i].value.file_id] = debug_get_file_id(mod, func_ctx->file_info[i].key);
+    }
+
+    u32 sym_base = ctx->next_sym_id;
+    ctx->next_sym_id += func_ctx->next_sym_id;
+
+    bh_arr_each(DebugSymInfo, sym, func_ctx->sym_info) {
+        DebugSymInfo sym_info = *sym;
+        sym_info.sym_id += sym_base;
+        bh_arr_push(ctx->sym_info, sym_info);
+    }
+
+    bh_arr_each(DebugSymPatch, patch, func_ctx->sym_patches) {
+        DebugSymPatch sym_patch = *patch;
+        sym_patch.sym_id += sym_base;
+        bh_arr_push(ctx->sym_patches, sym_patch);
+    }
+
+    bh_arr_each(DebugFuncContext, func, func_ctx->funcs) {
+        DebugFuncContext func_info = *func;
+        func_info.file_id = file_ids[func_info.file_id];
+        func_info.op_offset += ctx->op_buffer.length;
+        bh_arr_push(ctx->funcs, func_info);
+    }
+
+    u8 *ops = func_ctx->op_buffer.data;
+    i32 i = 0;
+    while (i < func_ctx->op_buffer.length) {
+        u8 op = ops[i++];
+        bh_buffer_write_byte(&ctx->op_buffer, op);
+
+        // INC, DEC and REP do not have any operands.
+        if (op & DOT_REP) continue;
+
+        if (op == DOT_SET) {
+            u32 file_id = (u32) uleb128_to_uint(ops, &i);
+            u32 line    = (u32) uleb128_to_uint(ops, &i);
+            debug_write_uleb(ctx, file_ids[file_id]);
+            debug_write_uleb(ctx, line);
+        }
+
+        if (op == DOT_SYM) {
+            u32 sym_id = (u32) uleb128_to_uint(ops, &i);
+            debug_write_uleb(ctx, sym_base + sym_id);
+        }
+    }
+
+    ctx->last_op_was_rep = 0;
+    ctx->last_token = NULL;
+}
+
 #else
 
 #define debug_introduce_symbol(mod, name, loc, num, type) (void)0
@@ -550,6 +691,7 @@ static b32 emit_constexpr_(ConstExprContext *ctx, AstTyped *node, u32 offset);
 
 #include "wasm_intrinsics.h"
 #include "wasm_type_table.h"
+#include "wasm_optimize.h"
 
 EMIT_FUNC(function_body, AstFunction* fd) {
     if (fd->body == NULL) return;
@@ -1818,7 +1960,13 @@ EMIT_FUNC(binop, AstBinaryOp* binop) {
     // Unsigned instructions are always right after
     // the signed equivalent
     if (is_sign_significant) {
-        if (binop->left->type->Basic.flags & Basic_Flag_Unsigned) {
+        // NOTE: Enums and distinct types are compared like the type they are
+        // stored as. Reading Basic.flags from them directly reads other fields.
+        Type* operand_type = binop->left->type;
+        if (operand_type->kind == Type_Kind_Enum)     operand_type = operand_type->Enum.backing;
+        if (operand_type->kind == Type_Kind_Distinct) operand_type = operand_type->Distinct.base_type;
+
+        if (operand_type->kind == Type_Kind_Basic && (operand_type->Basic.flags & Basic_Flag_Unsigned)) {
             binop_instr = (WasmInstructionType) ((i32) binop_instr + 1);
         }
     }
@@ -2005,6 +2153,7 @@ EMIT_FUNC(call, AstCall* call) {
             if (arg->va_kind == VA_Kind_Any) {
                 vararg_any_offsets[vararg_count - 1] = reserve_size;
                 vararg_any_types[vararg_count - 1] = arg->value->type->id;
+                type_table_mark_used(mod, arg->value->type->id);
             }
 
             reserve_size += type_size_of(arg->value->type);
@@ -2024,6 +2173,7 @@ EMIT_FUNC(call, AstCall* call) {
 
                 WIL(call_token, WI_LOCAL_GET, stack_top_store_local);
                 WID(call_token, WI_I32_CONST, arg->value->type->id);
+                type_table_mark_used(mod, arg->value->type->id);
                 emit_store_instruction(mod, &code, &basic_types[Basic_Kind_Type_Index], reserve_size + 4);
 
                 local_raw_free(mod->local_alloc, WASM_TYPE_PTR);
@@ -3226,9 +3376,18 @@ EMIT_FUNC(expression, AstTyped* expr) {
 
         if (type->type_id != 0) {
             WID(NULL, WI_I32_CONST, ((AstType *) expr)->type_id);
+            type_table_mark_used(mod, type->type_id);
+        } else if (mod->emission) {
+            // Building the type can create new types, so this is done when merging.
+            InstructionPatch patch = { bh_arr_length(code), type };
+            bh_arr_push(mod->emission->type_id_patches, patch);
+            bh_arr_push(mod->emission->type_table_marks, -bh_arr_length(mod->emission->type_id_patches));
+
+            WID(NULL, WI_I32_CONST, 0);
         } else {
             Type* t = type_build_from_ast(context.ast_alloc, type);
             WID(NULL, WI_I32_CONST, t->id);
+            type_table_mark_used(mod, t->id);
         }
 
 
@@ -3349,6 +3508,14 @@ EMIT_FUNC(expression, AstTyped* expr) {
         }
 
         case Ast_Kind_Function: {
+            if (mod->emission) {
+                InstructionPatch patch = { bh_arr_length(code), expr };
+                bh_arr_push(mod->emission->element_patches, patch);
+
+                WID(NULL, WI_I32_CONST, 0);
+                break;
+            }
+
             i32 elemidx = get_element_idx(mod, (AstFunction *) expr);
 
             WID(NULL, WI_I32_CONST, elemidx);
@@ -3920,7 +4087,7 @@ EMIT_FUNC(zero_value_for_type, Type* type, OnyxToken* where, AstTyped *alloc_nod
 static i32 generate_type_idx(OnyxWasmModule* mod, Type* ft) {
     if (ft->kind != Type_Kind_Function) return -1;
 
-    static char type_repr_buf[128];
+    char type_repr_buf[128];
     char* t = type_repr_buf;
 
     Type** param_type = ft->Function.params;
@@ -3956,9 +4123,22 @@ static i32 generate_type_idx(OnyxWasmModule* mod, Type* ft) {
     *t = '\0';
 
     i32 type_idx = 0;
-    i32 index = shgeti(mod->type_map, type_repr_buf);
-    if (index != -1) {
+    ptrdiff_t index;
+    if (shgeti_ts(mod->type_map, type_repr_buf, index) != -1) {
         type_idx = mod->type_map[index].value;
+
+    } else if (mod->emission) {
+        FunctionEmission* emission = mod->emission;
+
+        index = shgeti(emission->type_map, type_repr_buf);
+        if (index != -1) {
+            type_idx = emission->type_map[index].value;
+        } else {
+            type_idx = FUNCTION_TYPE_PLACEHOLDER + bh_arr_length(emission->new_types);
+            bh_arr_push(emission->new_types, ft);
+            shput(emission->type_map, type_repr_buf, type_idx);
+        }
+
     } else {
         // NOTE: Make a new type
         WasmFuncType* type = (WasmFuncType*) bh_alloc(mod->allocator, sizeof(WasmFuncType) + sizeof(WasmType) * param_count);
@@ -3995,6 +4175,17 @@ static i32 get_element_idx(OnyxWasmModule* mod, AstFunction* func) {
     }
 }
 
+static void store_function(OnyxWasmModule* mod, i32 func_idx, WasmFunc wasm_func) {
+    if (mod->emission) {
+        mod->emission->emitted  = 1;
+        mod->emission->func_idx = func_idx;
+        mod->emission->func     = wasm_func;
+        return;
+    }
+
+    bh_arr_set_at(mod->funcs, func_idx - mod->foreign_function_count, wasm_func);
+}
+
 static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
     if (!should_emit_function(fd)) return;
 
@@ -4003,6 +4194,7 @@ static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
     WasmFunc wasm_func = { 0 };
     wasm_func.type_idx = type_idx;
     wasm_func.location = fd->token;
+    wasm_func.always_inline = fd->is_inline;
 
     bh_arr_new(mod->allocator, wasm_func.code, 16);
 
@@ -4017,7 +4209,7 @@ static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
         debug_emit_instruction(mod, NULL);
         bh_arr_push(wasm_func.code, ((WasmInstruction){ WI_BLOCK_END, 0x00 }));
 
-        bh_arr_set_at(mod->funcs, func_idx - mod->foreign_function_count, wasm_func);
+        store_function(mod, func_idx, wasm_func);
         mod->current_func_idx = -1;
 
         debug_end_function(mod);
@@ -4030,7 +4222,7 @@ static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
         debug_emit_instruction(mod, NULL);
         bh_arr_push(wasm_func.code, ((WasmInstruction){ WI_BLOCK_END, 0x00 }));
 
-        bh_arr_set_at(mod->funcs, func_idx - mod->foreign_function_count, wasm_func);
+        store_function(mod, func_idx, wasm_func);
         mod->current_func_idx = -1;
 
         debug_end_function(mod);
@@ -4100,8 +4292,7 @@ static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
         }
     }
 
-    WasmFuncType* ft = mod->types[type_idx];
-    emit_zero_value(mod, &wasm_func.code, ft->return_type);
+    emit_zero_value(mod, &wasm_func.code, onyx_type_to_wasm_type(fd->type->Function.return_type));
 
     if (fd->closing_brace) {
         debug_emit_instruction(mod, fd->closing_brace);
@@ -4113,7 +4304,7 @@ static void emit_function(OnyxWasmModule* mod, AstFunction* fd) {
 
     bh_imap_clear(&mod->local_map);
 
-    bh_arr_set_at(mod->funcs, func_idx - mod->foreign_function_count, wasm_func);
+    store_function(mod, func_idx, wasm_func);
     mod->current_func_idx = -1;
 
     debug_end_function(mod);
@@ -4254,6 +4445,7 @@ static b32 emit_constexpr_(ConstExprContext *ctx, AstTyped *node, u32 offset) {
     if (node_is_type((AstNode *) node)) {
         Type* constructed_type = type_build_from_ast(context.ast_alloc, (AstType *) node);
         CE(i32, 0) = constructed_type->id;
+        type_table_mark_used(ctx->module, constructed_type->id);
         return 1;
     }
 
@@ -4454,7 +4646,7 @@ static void emit_memory_reservation(OnyxWasmModule* mod, AstMemRes* memres) {
     u64 size = type_size_of(effective_type);
 
     if (type_table_node != NULL && (AstMemRes *) type_table_node == memres) {
-        u64 table_location = build_type_table(mod);
+        u64 table_location = reserve_type_table(mod);
         memres->data_id = table_location;
         return;
     }
@@ -4615,7 +4807,10 @@ OnyxWasmModule onyx_wasm_module_create(bh_allocator alloc) {
         .foreign_blocks = NULL,
         .next_foreign_block_idx = 0,
 
-        .procedures_with_tags = NULL
+        .procedures_with_tags = NULL,
+
+        .type_table_pending = NULL,
+        .type_table_data_id = 0,
     };
 
     bh_arena* eid = bh_alloc(global_heap_allocator, sizeof(bh_arena));
@@ -4644,6 +4839,7 @@ OnyxWasmModule onyx_wasm_module_create(bh_allocator alloc) {
     bh_imap_init(&module.index_map, global_heap_allocator, 128);
     bh_imap_init(&module.local_map, global_heap_allocator, 16);
     bh_imap_init(&module.elem_map,  global_heap_allocator, 16);
+    bh_imap_init(&module.type_table_used, global_heap_allocator, 128);
 
     bh_arr_new(global_heap_allocator, module.deferred_stmts, 4);
     bh_arr_new(global_heap_allocator, module.local_allocations, 4);
@@ -4651,28 +4847,168 @@ OnyxWasmModule onyx_wasm_module_create(bh_allocator alloc) {
     bh_arr_new(global_heap_allocator, module.foreign_blocks, 4);
     bh_arr_new(global_heap_allocator, module.procedures_with_tags, 4);
     bh_arr_new(global_heap_allocator, module.data_patches, 4);
+    bh_arr_new(global_heap_allocator, module.type_table_pending, 128);
 
 #ifdef ENABLE_DEBUG_INFO
     module.debug_context = bh_alloc_item(context.ast_alloc, DebugContext);
-    module.debug_context->allocator = global_heap_allocator;
-    module.debug_context->next_file_id = 0;
-    module.debug_context->next_sym_id = 0;
-    module.debug_context->last_token = NULL;
-    module.debug_context->sym_info = NULL;
-    module.debug_context->sym_patches = NULL;
-    module.debug_context->funcs = NULL;
-
-    sh_new_arena(module.debug_context->file_info);
-    bh_arr_new(global_heap_allocator, module.debug_context->sym_info, 32);
-    bh_arr_new(global_heap_allocator, module.debug_context->sym_patches, 32);
-    bh_arr_new(global_heap_allocator, module.debug_context->funcs, 16);
-
-    bh_buffer_init(&module.debug_context->op_buffer, global_heap_allocator, 1024);
+    debug_context_init(module.debug_context);
 #endif
 
     return module;
 }
 
+
+//
+// Batched function emission
+//
+static bh_arr(FunctionEmission) function_emissions = NULL;
+static i32 next_function_emission = 0;
+
+static void function_emission_free(FunctionEmission* emission) {
+    if (emission->on_main_thread) return;
+
+    shfree(emission->type_map);
+    bh_arr_free(emission->new_types);
+    bh_arr_free(emission->element_patches);
+    bh_arr_free(emission->type_id_patches);
+    bh_arr_free(emission->type_table_marks);
+    bh_arr_free(emission->data_patches);
+    bh_arr_free(emission->errors);
+
+#ifdef ENABLE_DEBUG_INFO
+    debug_context_free(&emission->debug_context);
+#endif
+}
+
+static void emit_function_job(void* data, i32 index) {
+    FunctionEmission* emission = &((FunctionEmission *) data)[index];
+    if (emission->on_main_thread) return;
+
+    OnyxWasmModule mod = *context.wasm_module;
+    mod.emission = emission;
+    mod.current_func_idx = -1;
+    mod.local_alloc = NULL;
+    mod.extended_instr_alloc = context.ast_alloc;
+
+    // NOTE: These have to be cleared before bh_arr_new, which
+    // would otherwise grow the module's arrays.
+    mod.deferred_stmts = NULL;
+    mod.local_allocations = NULL;
+    mod.stack_leave_patches = NULL;
+    mod.data_patches = NULL;
+    mod.return_location_stack = NULL;
+    mod.structured_jump_target = NULL;
+    mod.for_remove_info = NULL;
+
+    bh_imap_init(&mod.local_map, global_heap_allocator, 16);
+    bh_arr_new(global_heap_allocator, mod.deferred_stmts, 4);
+    bh_arr_new(global_heap_allocator, mod.local_allocations, 4);
+    bh_arr_new(global_heap_allocator, mod.stack_leave_patches, 4);
+    bh_arr_new(global_heap_allocator, mod.data_patches, 4);
+    bh_arr_new(global_heap_allocator, mod.return_location_stack, 4);
+    bh_arr_new(global_heap_allocator, mod.structured_jump_target, 16);
+
+    sh_new_arena(emission->type_map);
+
+#ifdef ENABLE_DEBUG_INFO
+    debug_context_init(&emission->debug_context);
+    mod.debug_context = &emission->debug_context;
+#endif
+
+    onyx_errors_capture(&emission->errors);
+    emit_function(&mod, emission->entity->function);
+    onyx_errors_capture(NULL);
+
+    emission->data_patches = mod.data_patches;
+
+    bh_imap_free(&mod.local_map);
+    bh_arr_free(mod.deferred_stmts);
+    bh_arr_free(mod.local_allocations);
+    bh_arr_free(mod.stack_leave_patches);
+    bh_arr_free(mod.return_location_stack);
+    bh_arr_free(mod.structured_jump_target);
+    bh_arr_free(mod.for_remove_info);
+}
+
+static void merge_function_emission(OnyxWasmModule* mod, FunctionEmission* emission) {
+    bh_arr_each(OnyxError, err, emission->errors) onyx_submit_error(*err);
+
+    if (emission->emitted) {
+        WasmFunc* func = &emission->func;
+
+        i32 new_type_count = bh_arr_length(emission->new_types);
+        i32* type_indices = bh_alloc_array(global_scratch_allocator, i32, new_type_count);
+        fori (i, 0, new_type_count) {
+            type_indices[i] = generate_type_idx(mod, emission->new_types[i]);
+        }
+
+        if (func->type_idx >= FUNCTION_TYPE_PLACEHOLDER) {
+            func->type_idx = type_indices[func->type_idx - FUNCTION_TYPE_PLACEHOLDER];
+        }
+
+        bh_arr_each(WasmInstruction, instr, func->code) {
+            if (instr->type == WI_CALL_INDIRECT && instr->data.i1 >= FUNCTION_TYPE_PLACEHOLDER) {
+                instr->data.i1 = type_indices[instr->data.i1 - FUNCTION_TYPE_PLACEHOLDER];
+            }
+        }
+
+        i32 type_id_count = bh_arr_length(emission->type_id_patches);
+        i32* type_ids = bh_alloc_array(global_scratch_allocator, i32, type_id_count);
+        fori (i, 0, type_id_count) {
+            InstructionPatch* patch = &emission->type_id_patches[i];
+            type_ids[i] = type_build_from_ast(context.ast_alloc, (AstType *) patch->node)->id;
+            func->code[patch->instruction_index].data.i1 = type_ids[i];
+        }
+
+        bh_arr_each(i32, mark, emission->type_table_marks) {
+            type_table_mark_used(mod, *mark >= 0 ? *mark : type_ids[-*mark - 1]);
+        }
+
+        bh_arr_each(InstructionPatch, patch, emission->element_patches) {
+            func->code[patch->instruction_index].data.i1 = get_element_idx(mod, (AstFunction *) patch->node);
+        }
+
+        bh_arr_each(DatumPatchInfo, patch, emission->data_patches) {
+            bh_arr_push(mod->data_patches, *patch);
+        }
+
+#ifdef ENABLE_DEBUG_INFO
+        debug_merge_function(mod, &emission->debug_context);
+#endif
+
+        bh_arr_set_at(mod->funcs, emission->func_idx - mod->foreign_function_count, *func);
+    }
+
+    function_emission_free(emission);
+}
+
+void emit_entity_batch(Entity** ents, i32 count) {
+    // NOTE: Emissions are left over if the last batch stopped at an error.
+    fori (i, next_function_emission, bh_arr_length(function_emissions)) {
+        function_emission_free(&function_emissions[i]);
+    }
+
+    bh_arr_clear(function_emissions);
+    next_function_emission = 0;
+
+    fori (i, 0, count) {
+        assert(ents[i]->type == Entity_Type_Function);
+        AstFunction* fd = ents[i]->function;
+
+        FunctionEmission emission = { 0 };
+        emission.entity = ents[i];
+
+        // These are generated from the state of the whole module,
+        // so they are emitted in order on the main thread.
+        emission.on_main_thread = fd == builtin_initialize_data_segments
+                               || fd == builtin_run_init_procedures;
+
+        bh_arr_push(function_emissions, emission);
+    }
+
+    worker_pool_run(count, emit_function_job, function_emissions);
+}
+
 void emit_entity(Entity* ent) {
     OnyxWasmModule* module = context.wasm_module;
     module->current_func_idx = -1;
@@ -4743,7 +5079,21 @@ void emit_entity(Entity* ent) {
             break;
         }
 
-        case Entity_Type_Function: emit_function(module, ent->function); break;
+        case Entity_Type_Function: {
+            if (next_function_emission < bh_arr_length(function_emissions)
+                && function_emissions[next_function_emission].entity == ent) {
+                FunctionEmission* emission = &function_emissions[next_function_emission++];
+
+                if (!emission->on_main_thread) {
+                    merge_function_emission(module, emission);
+                    break;
+                }
+            }
+
+            emit_function(module, ent->function);
+            break;
+        }
+
         case Entity_Type_Global:   emit_global(module,   ent->global); break;
 
         default: break;
@@ -4799,6 +5149,12 @@ void onyx_wasm_module_link(OnyxWasmModule *module, OnyxWasmLinkOptions *options)
         module->export_count++;
     }
 
+    // NOTE: The type table is built once all of the code has been emitted,
+    // because that is when every type that is used at runtime is known.
+    if (module->type_table_data_id != 0) {
+        build_type_table(module);
+    }
+
     u32 datum_offset = options->null_reserve_size;
     bh_arr_each(WasmDatum, datum, module->data) {
         assert(datum->id > 0);
@@ -4853,6 +5209,14 @@ void onyx_wasm_module_link(OnyxWasmModule *module, OnyxWasmLinkOptions *options)
                 break;
             }
 
+            case Datum_Patch_Length: {
+                WasmFunc *func = &module->funcs[patch->index - module->foreign_function_count];
+
+                assert(func->code[patch->location].type == WI_I32_CONST);
+                func->code[patch->location].data.i1 = datum->length;
+                break;
+            }
+
             default: assert(0);
         }
     }
@@ -4864,6 +5228,8 @@ void onyx_wasm_module_link(OnyxWasmModule *module, OnyxWasmLinkOptions *options)
 
     *module->heap_start_ptr = *module->stack_top_ptr + options->stack_size;
     bh_align(*module->heap_start_ptr, 16);
+
+    optimize_module(module);
 }
 
 void onyx_wasm_module_free(OnyxWasmModule* module) {
@@ -4874,6 +5240,8 @@ void onyx_wasm_module_free(OnyxWasmModule* module) {
     bh_arr_free(module->funcs);
     bh_imap_free(&module->local_map);
     bh_imap_free(&module->index_map);
+    bh_imap_free(&module->type_table_used);
+    bh_arr_free(module->type_table_pending);
     shfree(module->type_map);
     shfree(module->exports);
 }
@@ -422,7 +422,9 @@ EMIT_FUNC_NO_ARGS(initialize_data_segments_body) {
     // it is assumed that EVERY data entry will be entered by
     // this point. If data section entries can be entered after
     // function body generation starts, this code will have to
-    // move to a link phase thing.
+    // move to a link phase thing. Entries that are only filled
+    // in when linking, like the type table, are already entered,
+    // but their length is patched in when linking.
     i32 index = 0;
     bh_arr_each(WasmDatum, datum, mod->data) {
         assert(datum->id > 0);
@@ -430,6 +432,15 @@ EMIT_FUNC_NO_ARGS(initialize_data_segments_body) {
 
         emit_data_relocation(mod, &code, datum->id);
         WID(NULL, WI_PTR_CONST,   0);
+
+        DatumPatchInfo length_patch;
+        length_patch.kind = Datum_Patch_Length;
+        length_patch.index = mod->current_func_idx;
+        length_patch.location = bh_arr_length(code);
+        length_patch.data_id = datum->id;
+        length_patch.offset = 0;
+        bh_arr_push(mod->data_patches, length_patch);
+
         WID(NULL, WI_I32_CONST,   datum->length);
         WID(NULL, WI_MEMORY_INIT, ((WasmInstructionData) { index, 0 }));
 
@@ -0,0 +1,1350 @@
+// This file is directly included in src/wasm_emit.c.
+// It contains the optimization passes that are run on every function
+// when compiling with --optimize, and the inlining of procedures.
+//
+// The passes run after linking, once every constant in the code (such as the
+// address of a data entry) is known. Instructions are never removed from a
+// function; they are replaced with WI_NOP, which is not output. That way the
+// instruction indices used by patches, and the per-instruction debug info,
+// stay correct. With --debug, NOPs are output and the locals are not touched,
+// so the debugger still sees every variable where it expects it.
+//
+// Passes:
+//   - Unreachable code after br, br_table, return and unreachable is removed.
+//   - Constant operands are folded, and operations by an identity are removed.
+//   - A constant added to an address is moved into the offset of the load or
+//     store using it, the same way member accesses are emitted.
+//   - local.set X; local.get X becomes local.tee X, and a value that is pushed
+//     without side effects and then dropped is removed.
+//   - Copies between locals are propagated within straight-line code.
+//   - Stores to locals that are never read are removed.
+//   - Locals that are no longer used are removed, and the others renumbered.
+//     Locals of the same type that are never live at the same time share one.
+//
+// Procedures are inlined, and functions with identical code are folded together,
+// even without --optimize; both are skipped with --debug. See below.
+//
+
+static inline void opt_nop(WasmInstruction *instr) {
+    instr->type = WI_NOP;
+    instr->data.l = 0;
+}
+
+static inline i32 opt_prev(WasmFunc *func, i32 idx) {
+    while (--idx >= 0) {
+        if (func->code[idx].type != WI_NOP) return idx;
+    }
+
+    return -1;
+}
+
+static inline b32 opt_is_control(WasmInstructionType type) {
+    switch (type) {
+        case WI_UNREACHABLE:
+        case WI_BLOCK_START:
+        case WI_LOOP_START:
+        case WI_IF_START:
+        case WI_ELSE:
+        case WI_BLOCK_END:
+        case WI_JUMP:
+        case WI_COND_JUMP:
+        case WI_JUMP_TABLE:
+        case WI_RETURN:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static inline b32 opt_is_pure_push(WasmInstructionType type) {
+    switch (type) {
+        case WI_LOCAL_GET:
+        case WI_GLOBAL_GET:
+        case WI_I32_CONST:
+        case WI_I64_CONST:
+        case WI_F32_CONST:
+        case WI_F64_CONST:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static b32 opt_remove_unreachable(WasmFunc *func) {
+    b32 changed = 0;
+    i32 count = bh_arr_length(func->code);
+
+    fori (i, 0, count) {
+        WasmInstructionType type = func->code[i].type;
+        if (type != WI_JUMP && type != WI_JUMP_TABLE && type != WI_RETURN && type != WI_UNREACHABLE) continue;
+
+        // Everything up to the end of the enclosing block (or the else of
+        // the enclosing if) can never run. Nested blocks go with it.
+        i32 depth = 0;
+        i32 j = i + 1;
+        for (; j < count; j++) {
+            WasmInstruction *instr = &func->code[j];
+
+            if (instr->type == WI_BLOCK_START || instr->type == WI_LOOP_START || instr->type == WI_IF_START) {
+                depth++;
+            }
+            else if (instr->type == WI_ELSE && depth == 0) {
+                break;
+            }
+            else if (instr->type == WI_BLOCK_END) {
+                if (depth == 0) break;
+                depth--;
+            }
+
+            if (instr->type != WI_NOP) {
+                opt_nop(instr);
+                changed = 1;
+            }
+        }
+
+        i = j - 1;
+    }
+
+    return changed;
+}
+
+static b32 opt_fold_i32(WasmInstructionType type, u32 a, u32 b, u32 *out) {
+    switch (type) {
+        case WI_I32_ADD:   *out = a + b; return 1;
+        case WI_I32_SUB:   *out = a - b; return 1;
+        case WI_I32_MUL:   *out = a * b; return 1;
+        case WI_I32_AND:   *out = a & b; return 1;
+        case WI_I32_OR:    *out = a | b; return 1;
+        case WI_I32_XOR:   *out = a ^ b; return 1;
+        case WI_I32_SHL:   *out = a << (b & 31); return 1;
+        case WI_I32_SHR_S: *out = (u32) (((i32) a) >> (b & 31)); return 1;
+        case WI_I32_SHR_U: *out = a >> (b & 31); return 1;
+        case WI_I32_EQ:    *out = a == b; return 1;
+        case WI_I32_NE:    *out = a != b; return 1;
+        case WI_I32_LT_S:  *out = (i32) a <  (i32) b; return 1;
+        case WI_I32_LT_U:  *out = a <  b; return 1;
+        case WI_I32_GT_S:  *out = (i32) a >  (i32) b; return 1;
+        case WI_I32_GT_U:  *out = a >  b; return 1;
+        case WI_I32_LE_S:  *out = (i32) a <= (i32) b; return 1;
+        case WI_I32_LE_U:  *out = a <= b; return 1;
+        case WI_I32_GE_S:  *out = (i32) a >= (i32) b; return 1;
+        case WI_I32_GE_U:  *out = a >= b; return 1;
+
+        // Division and remainder can trap, so they are left alone.
+        default: return 0;
+    }
+}
+
+static b32 opt_fold_i64(WasmInstructionType type, u64 a, u64 b, u64 *out) {
+    switch (type) {
+        case WI_I64_ADD:   *out = a + b; return 1;
+        case WI_I64_SUB:   *out = a - b; return 1;
+        case WI_I64_MUL:   *out = a * b; return 1;
+        case WI_I64_AND:   *out = a & b; return 1;
+        case WI_I64_OR:    *out = a | b; return 1;
+        case WI_I64_XOR:   *out = a ^ b; return 1;
+        case WI_I64_SHL:   *out = a << (b & 63); return 1;
+        case WI_I64_SHR_S: *out = (u64) (((i64) a) >> (b & 63)); return 1;
+        case WI_I64_SHR_U: *out = a >> (b & 63); return 1;
+        default: return 0;
+    }
+}
+
+static b32 opt_compare_i64(WasmInstructionType type, u64 a, u64 b, u32 *out) {
+    switch (type) {
+        case WI_I64_EQ:    *out = a == b; return 1;
+        case WI_I64_NE:    *out = a != b; return 1;
+        case WI_I64_LT_S:  *out = (i64) a <  (i64) b; return 1;
+        case WI_I64_LT_U:  *out = a <  b; return 1;
+        case WI_I64_GT_S:  *out = (i64) a >  (i64) b; return 1;
+        case WI_I64_GT_U:  *out = a >  b; return 1;
+        case WI_I64_LE_S:  *out = (i64) a <= (i64) b; return 1;
+        case WI_I64_LE_U:  *out = a <= b; return 1;
+        case WI_I64_GE_S:  *out = (i64) a >= (i64) b; return 1;
+        case WI_I64_GE_U:  *out = a >= b; return 1;
+        default: return 0;
+    }
+}
+
+//
+// An operation whose right operand is this constant leaves the left operand as it is.
+static b32 opt_is_identity(WasmInstructionType type, WasmInstruction *operand) {
+    if (operand->type == WI_I32_CONST) {
+        switch (type) {
+            case WI_I32_ADD: case WI_I32_SUB: case WI_I32_OR: case WI_I32_XOR:
+            case WI_I32_SHL: case WI_I32_SHR_S: case WI_I32_SHR_U:
+                return operand->data.i1 == 0;
+
+            case WI_I32_MUL:
+                return operand->data.i1 == 1;
+
+            default: return 0;
+        }
+    }
+
+    if (operand->type == WI_I64_CONST) {
+        switch (type) {
+            case WI_I64_ADD: case WI_I64_SUB: case WI_I64_OR: case WI_I64_XOR:
+            case WI_I64_SHL: case WI_I64_SHR_S: case WI_I64_SHR_U:
+                return operand->data.l == 0;
+
+            case WI_I64_MUL:
+                return operand->data.l == 1;
+
+            default: return 0;
+        }
+    }
+
+    return 0;
+}
+
+static b32 opt_fold_constants(WasmFunc *func, i32 idx) {
+    WasmInstruction *instr = &func->code[idx];
+
+    i32 b_idx = opt_prev(func, idx);
+    if (b_idx < 0) return 0;
+    WasmInstruction *b = &func->code[b_idx];
+
+    //
+    // Unary operations
+    switch (instr->type) {
+        case WI_I32_EQZ:
+            if (b->type != WI_I32_CONST) return 0;
+            b->data.l = b->data.i1 == 0;
+            opt_nop(instr);
+            return 1;
+
+        case WI_I64_EQZ:
+            if (b->type != WI_I64_CONST) return 0;
+            b->type = WI_I32_CONST;
+            b->data.l = b->data.l == 0;
+            opt_nop(instr);
+            return 1;
+
+        case WI_I32_FROM_I64:
+            if (b->type != WI_I64_CONST) return 0;
+            b->type = WI_I32_CONST;
+            b->data.l = (u32) b->data.l;
+            opt_nop(instr);
+            return 1;
+
+        case WI_I64_FROM_I32_S:
+            if (b->type != WI_I32_CONST) return 0;
+            b->type = WI_I64_CONST;
+            b->data.l = (i64) b->data.i1;
+            opt_nop(instr);
+            return 1;
+
+        case WI_I64_FROM_I32_U:
+            if (b->type != WI_I32_CONST) return 0;
+            b->type = WI_I64_CONST;
+            b->data.l = (u64) (u32) b->data.i1;
+            opt_nop(instr);
+            return 1;
+
+        default: break;
+    }
+
+    //
+    // Binary operations
+    if (opt_is_identity(instr->type, b)) {
+        opt_nop(b);
+        opt_nop(instr);
+        return 1;
+    }
+
+    i32 a_idx = opt_prev(func, b_idx);
+    if (a_idx < 0) return 0;
+    WasmInstruction *a = &func->code[a_idx];
+
+    if (a->type == WI_I32_CONST && b->type == WI_I32_CONST) {
+        u32 result;
+        if (!opt_fold_i32(instr->type, (u32) a->data.i1, (u32) b->data.i1, &result)) return 0;
+
+        a->data.l = 0;
+        a->data.i1 = (i32) result;
+        opt_nop(b);
+        opt_nop(instr);
+        return 1;
+    }
+
+    if (a->type == WI_I64_CONST && b->type == WI_I64_CONST) {
+        u64 result;
+        u32 compared;
+        if (opt_fold_i64(instr->type, (u64) a->data.l, (u64) b->data.l, &result)) {
+            a->data.l = (i64) result;
+
+        } else if (opt_compare_i64(instr->type, (u64) a->data.l, (u64) b->data.l, &compared)) {
+            a->type = WI_I32_CONST;
+            a->data.l = compared;
+
+        } else {
+            return 0;
+        }
+
+        opt_nop(b);
+        opt_nop(instr);
+        return 1;
+    }
+
+    return 0;
+}
+
+static inline b32 opt_is_memory_access(WasmInstructionType type) {
+    return type >= WI_I32_LOAD && type <= WI_I64_STORE_32;
+}
+
+static b32 opt_fold_address(WasmFunc *func, i32 idx) {
+    WasmInstruction *instr = &func->code[idx];
+
+    // A store has its value above the address. Only a value
+    // made by a single instruction is looked past.
+    i32 add_idx = opt_prev(func, idx);
+    if (instr->type >= WI_I32_STORE) {
+        if (add_idx < 0 || !opt_is_pure_push(func->code[add_idx].type)) return 0;
+        add_idx = opt_prev(func, add_idx);
+    }
+
+    if (add_idx < 0 || func->code[add_idx].type != WI_I32_ADD) return 0;
+
+    i32 const_idx = opt_prev(func, add_idx);
+    if (const_idx < 0 || func->code[const_idx].type != WI_I32_CONST) return 0;
+
+    i32 addend = func->code[const_idx].data.i1;
+    if (addend < 0 || (u64) (u32) instr->data.i2 + (u64) addend > 0xFFFFFFFF) return 0;
+
+    instr->data.i2 = (i32) ((u32) instr->data.i2 + (u32) addend);
+    opt_nop(&func->code[const_idx]);
+    opt_nop(&func->code[add_idx]);
+    return 1;
+}
+
+static b32 opt_peephole(WasmFunc *func) {
+    b32 changed = 0;
+
+    fori (i, 0, bh_arr_length(func->code)) {
+        WasmInstruction *instr = &func->code[i];
+        if (instr->type == WI_NOP) continue;
+
+        i32 prev_idx = opt_prev(func, i);
+        if (prev_idx < 0) continue;
+        WasmInstruction *prev = &func->code[prev_idx];
+
+        switch (instr->type) {
+            case WI_DROP:
+                if (opt_is_pure_push(prev->type)) {
+                    opt_nop(prev);
+                    opt_nop(instr);
+                    changed = 1;
+                }
+                else if (prev->type == WI_LOCAL_TEE) {
+                    prev->type = WI_LOCAL_SET;
+                    opt_nop(instr);
+                    changed = 1;
+                }
+                break;
+
+            case WI_LOCAL_GET:
+                if (prev->type == WI_LOCAL_SET && prev->data.l == instr->data.l) {
+                    prev->type = WI_LOCAL_TEE;
+                    opt_nop(instr);
+                    changed = 1;
+                }
+                break;
+
+            default:
+                if (opt_is_memory_access(instr->type)) {
+                    if (opt_fold_address(func, i)) changed = 1;
+                }
+                else if (opt_fold_constants(func, i)) {
+                    changed = 1;
+                }
+                break;
+        }
+    }
+
+    return changed;
+}
+
+typedef struct OptLocalCopy {
+    u64 dest, src;
+} OptLocalCopy;
+
+static b32 opt_propagate_copies(WasmFunc *func) {
+    b32 changed = 0;
+
+    // Copies are only tracked within straight-line code,
+    // so only a few are live at the same time.
+    bh_arr(OptLocalCopy) copies = NULL;
+    bh_arr_new(global_heap_allocator, copies, 16);
+
+    fori (i, 0, bh_arr_length(func->code)) {
+        WasmInstruction *instr = &func->code[i];
+
+        if (opt_is_control(instr->type)) {
+            bh_arr_clear(copies);
+            continue;
+        }
+
+        if (instr->type == WI_LOCAL_GET) {
+            bh_arr_each(OptLocalCopy, copy, copies) {
+                if (copy->dest == (u64) instr->data.l) {
+                    instr->data.l = copy->src;
+                    changed = 1;
+                    break;
+                }
+            }
+        }
+
+        if (instr->type == WI_LOCAL_SET || instr->type == WI_LOCAL_TEE) {
+            u64 local = instr->data.l;
+            fori (j, 0, bh_arr_length(copies)) {
+                if (copies[j].dest == local || copies[j].src == local) {
+                    bh_arr_fastdelete(copies, j);
+                    j--;
+                }
+            }
+
+            i32 prev_idx = opt_prev(func, i);
+            if (prev_idx >= 0 && func->code[prev_idx].type == WI_LOCAL_GET && (u64) func->code[prev_idx].data.l != local) {
+                bh_arr_push(copies, ((OptLocalCopy) { local, func->code[prev_idx].data.l }));
+            }
+        }
+    }
+
+    bh_arr_free(copies);
+    return changed;
+}
+
+static inline i32 opt_local_class(u64 value) {
+    switch (value & 0xF00000000) {
+        case LOCAL_I64:  return 1;
+        case LOCAL_F32:  return 2;
+        case LOCAL_F64:  return 3;
+        case LOCAL_V128: return 4;
+        default:         return 0;
+    }
+}
+
+static b32 opt_remove_dead_stores(WasmFunc *func, u32 local_count) {
+    b32 changed = 0;
+
+    u32 *reads = bh_alloc_array(global_heap_allocator, u32, local_count);
+    memset(reads, 0, sizeof(u32) * local_count);
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (instr->type == WI_LOCAL_GET) {
+            reads[local_lookup_idx(&func->locals, instr->data.l)]++;
+        }
+    }
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (instr->type != WI_LOCAL_SET && instr->type != WI_LOCAL_TEE) continue;
+
+        u64 idx = local_lookup_idx(&func->locals, instr->data.l);
+        if (reads[idx] > 0) continue;
+
+        if (instr->type == WI_LOCAL_SET) {
+            instr->type = WI_DROP;
+            instr->data.l = 0;
+        } else {
+            opt_nop(instr);
+        }
+
+        changed = 1;
+    }
+
+    bh_free(global_heap_allocator, reads);
+    return changed;
+}
+
+//
+// Liveness of the locals (other than the parameters) before every instruction,
+// one bit per local. The successors of an instruction follow the structured
+// control flow: a branch to a loop goes back to its start, and a branch to any
+// other block goes to its end. Returns NULL for functions that are too large,
+// or whose blocks do not match up.
+//
+#define OPT_LIVENESS_MAX_WORDS (1 << 22)
+
+typedef struct OptLiveness {
+    i32 words;
+    u64 *live_in;
+
+    // The successors of instruction i are targets[target_start[i] .. target_start[i + 1]].
+    i32 *target_start;
+    bh_arr(i32) targets;
+} OptLiveness;
+
+static inline b32 opt_is_local_access(WasmInstructionType type) {
+    return type == WI_LOCAL_GET || type == WI_LOCAL_SET || type == WI_LOCAL_TEE;
+}
+
+static b32 opt_compute_successors(WasmFunc *func, OptLiveness *lv) {
+    i32 count = bh_arr_length(func->code);
+
+    i32 *block_end   = bh_alloc_array(global_heap_allocator, i32, count);
+    i32 *if_else     = bh_alloc_array(global_heap_allocator, i32, count);
+    i32 *block_stack = bh_alloc_array(global_heap_allocator, i32, count);
+    i32 *enclosing   = bh_alloc_array(global_heap_allocator, i32, count);
+    i32 depth = 0;
+    b32 matched = 1;
+
+    //
+    // enclosing[i] is the innermost block that is open at instruction i. For a
+    // start, that is the block around it; for an else or end, its own block.
+    fori (i, 0, count) {
+        WasmInstructionType type = func->code[i].type;
+        block_end[i] = -1;
+        if_else[i] = -1;
+        enclosing[i] = depth > 0 ? block_stack[depth - 1] : -1;
+
+        if (type == WI_BLOCK_START || type == WI_LOOP_START || type == WI_IF_START) {
+            block_stack[depth++] = i;
+        }
+        else if (type == WI_ELSE) {
+            if (depth == 0) { matched = 0; break; }
+            if_else[block_stack[depth - 1]] = i;
+        }
+        else if (type == WI_BLOCK_END) {
+            if (depth == 0) {
+                if (i != count - 1) matched = 0;
+                continue;
+            }
+
+            block_end[block_stack[--depth]] = i;
+        }
+    }
+
+    if (depth != 0) matched = 0;
+
+    lv->target_start = bh_alloc_array(global_heap_allocator, i32, count + 1);
+    lv->targets = NULL;
+    bh_arr_new(global_heap_allocator, lv->targets, count + 16);
+
+    #define BRANCH_TARGET(from, label) do { \
+        i32 block = (from); \
+        fori (d, 0, (label)) { if (block >= 0) block = enclosing[block]; } \
+        if (block >= 0) { \
+            bh_arr_push(lv->targets, func->code[block].type == WI_LOOP_START ? block : block_end[block]); \
+        } \
+    } while (0)
+
+    fori (i, 0, count) {
+        lv->target_start[i] = bh_arr_length(lv->targets);
+        if (!matched) continue;
+
+        WasmInstruction *instr = &func->code[i];
+        i32 inner = enclosing[i];
+
+        switch (instr->type) {
+            case WI_RETURN:
+            case WI_UNREACHABLE:
+                break;
+
+            case WI_JUMP:
+                BRANCH_TARGET(inner, instr->data.i1);
+                break;
+
+            case WI_COND_JUMP:
+                BRANCH_TARGET(inner, instr->data.i1);
+                bh_arr_push(lv->targets, i + 1);
+                break;
+
+            case WI_JUMP_TABLE: {
+                BranchTable *bt = (BranchTable *) instr->data.p;
+                fori (k, 0, bt->count) BRANCH_TARGET(inner, bt->cases[k]);
+                BRANCH_TARGET(inner, bt->default_case);
+                break;
+            }
+
+            case WI_IF_START:
+                bh_arr_push(lv->targets, i + 1);
+                bh_arr_push(lv->targets, if_else[i] >= 0 ? if_else[i] + 1 : block_end[i]);
+                break;
+
+            // Only reached at the end of the true branch.
+            case WI_ELSE:
+                bh_arr_push(lv->targets, block_end[inner]);
+                break;
+
+            default:
+                if (i + 1 < count) bh_arr_push(lv->targets, i + 1);
+                break;
+        }
+    }
+
+    #undef BRANCH_TARGET
+
+    lv->target_start[count] = bh_arr_length(lv->targets);
+
+    bh_free(global_heap_allocator, block_end);
+    bh_free(global_heap_allocator, if_else);
+    bh_free(global_heap_allocator, block_stack);
+    bh_free(global_heap_allocator, enclosing);
+    return matched;
+}
+static b32 opt_compute_liveness(WasmFunc *func, u32 local_count, OptLiveness *lv) {
+    LocalAllocator *la = &func->locals;
+    i32 count = bh_arr_length(func->code);
+
+    lv->words = (local_count - la->param_count + 63) / 64;
+    lv->live_in = NULL;
+    if ((i64) count * lv->words > OPT_LIVENESS_MAX_WORDS) return 0;
+    if (!opt_compute_successors(func, lv)) return 0;
+
+    lv->live_in = bh_alloc_array(global_heap_allocator, u64, count * lv->words);
+    memset(lv->live_in, 0, sizeof(u64) * count * lv->words);
+
+    u64 *live = bh_alloc_array(global_heap_allocator, u64, lv->words);
+
+    //
+    // Going backwards, most of the information is known after the first round.
+    // Only values that are live around a loop take more rounds.
+    b32 changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (i32 i = count - 1; i >= 0; i--) {
+            memset(live, 0, sizeof(u64) * lv->words);
+            fori (t, lv->target_start[i], lv->target_start[i + 1]) {
+                u64 *succ = &lv->live_in[lv->targets[t] * lv->words];
+                fori (w, 0, lv->words) live[w] |= succ[w];
+            }
+
+            WasmInstruction *instr = &func->code[i];
+            if (opt_is_local_access(instr->type)) {
+                u64 idx = local_lookup_idx(la, instr->data.l);
+                if (idx >= la->param_count) {
+                    idx -= la->param_count;
+                    if (instr->type == WI_LOCAL_GET) live[idx / 64] |=   1ull << (idx % 64);
+                    else                             live[idx / 64] &= ~(1ull << (idx % 64));
+                }
+            }
+
+            u64 *in = &lv->live_in[i * lv->words];
+            if (memcmp(in, live, sizeof(u64) * lv->words)) {
+                memcpy(in, live, sizeof(u64) * lv->words);
+                changed = 1;
+            }
+        }
+    }
+
+    bh_free(global_heap_allocator, live);
+    return 1;
+}
+
+static void opt_free_liveness(OptLiveness *lv) {
+    if (lv->live_in) bh_free(global_heap_allocator, lv->live_in);
+    if (lv->target_start) bh_free(global_heap_allocator, lv->target_start);
+    if (lv->targets) bh_arr_free(lv->targets);
+}
+
+//
+// Two locals interfere when one is written while the other is live. Every local
+// that is written needs its own slot until its value is last read, even when
+// the write is never read, because it would still overwrite the other one.
+//
+static u64 *opt_compute_interference(WasmFunc *func, u32 local_count, OptLiveness *lv) {
+    LocalAllocator *la = &func->locals;
+    u32 count = local_count - la->param_count;
+
+    u64 *interference = bh_alloc_array(global_heap_allocator, u64, count * lv->words);
+    memset(interference, 0, sizeof(u64) * count * lv->words);
+
+    u64 *live = bh_alloc_array(global_heap_allocator, u64, lv->words);
+
+    fori (i, 0, bh_arr_length(func->code)) {
+        WasmInstruction *instr = &func->code[i];
+        if (instr->type != WI_LOCAL_SET && instr->type != WI_LOCAL_TEE) continue;
+
+        u64 idx = local_lookup_idx(la, instr->data.l);
+        if (idx < la->param_count) continue;
+        idx -= la->param_count;
+
+        memset(live, 0, sizeof(u64) * lv->words);
+        fori (t, lv->target_start[i], lv->target_start[i + 1]) {
+            u64 *succ = &lv->live_in[lv->targets[t] * lv->words];
+            fori (w, 0, lv->words) live[w] |= succ[w];
+        }
+
+        fori (w, 0, lv->words) {
+            u64 bits = live[w];
+            while (bits) {
+                u32 other = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if (other == idx) continue;
+
+                interference[idx * lv->words + other / 64]   |= 1ull << (other % 64);
+                interference[other * lv->words + idx / 64]   |= 1ull << (idx % 64);
+            }
+        }
+    }
+
+    bh_free(global_heap_allocator, live);
+    return interference;
+}
+
+//
+// Renumbers the locals of each class, leaving out the ones that are not used.
+// When the liveness of the locals is known, locals of the same class that never
+// interfere are given the same index, so fewer locals are needed in total.
+//
+static void opt_compact_locals(WasmFunc *func, u32 local_count) {
+    LocalAllocator *la = &func->locals;
+
+    b32 *used = bh_alloc_array(global_heap_allocator, b32, local_count);
+    memset(used, 0, sizeof(b32) * local_count);
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (opt_is_local_access(instr->type)) {
+            used[local_lookup_idx(la, instr->data.l)] = 1;
+        }
+    }
+
+    OptLiveness lv = { 0 };
+    u64 *interference = NULL;
+    if (opt_compute_liveness(func, local_count, &lv)) {
+        interference = opt_compute_interference(func, local_count, &lv);
+    }
+
+    //
+    // Locals are numbered by class, so each class is compacted on its own.
+    // new_index maps the index within a class to the new one.
+    u32 *new_index = bh_alloc_array(global_heap_allocator, u32, local_count);
+    u32 new_allocated[5] = { 0 };
+
+    u32 class_start = la->param_count;
+    fori (c, 0, 5) {
+        fori (k, 0, la->allocated[c]) {
+            u32 idx = class_start + k;
+            if (!used[idx]) continue;
+
+            if (interference == NULL) {
+                new_index[idx] = new_allocated[c]++;
+                continue;
+            }
+
+            //
+            // The lowest index that is not taken by an interfering local
+            // of this class that has already been given one.
+            u32 candidate = 0;
+            b32 taken = 1;
+            while (taken) {
+                taken = 0;
+
+                fori (j, 0, k) {
+                    u32 other = class_start + j;
+                    if (!used[other] || new_index[other] != candidate) continue;
+
+                    u32 a = idx - la->param_count, b = other - la->param_count;
+                    if (interference[a * lv.words + b / 64] & (1ull << (b % 64))) {
+                        taken = 1;
+                        candidate++;
+                        break;
+                    }
+                }
+            }
+
+            new_index[idx] = candidate;
+            new_allocated[c] = bh_max(new_allocated[c], candidate + 1);
+        }
+
+        class_start += la->allocated[c];
+    }
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (!opt_is_local_access(instr->type)) continue;
+
+        u64 idx = local_lookup_idx(la, instr->data.l);
+        if (idx < la->param_count) continue;
+
+        u64 flags = instr->data.l & ~0xFFFFFFFFull;
+        instr->data.l = flags | (new_index[idx] + la->param_count);
+    }
+
+    fori (c, 0, 5) la->allocated[c] = new_allocated[c];
+
+    if (interference) bh_free(global_heap_allocator, interference);
+    opt_free_liveness(&lv);
+    bh_free(global_heap_allocator, new_index);
+    bh_free(global_heap_allocator, used);
+}
+
+static void optimize_function(WasmFunc *func) {
+    b32 touch_locals = !context.options->generate_debug_info;
+
+    u32 local_count = func->locals.param_count;
+    fori (c, 0, 5) local_count += func->locals.allocated[c];
+
+    // Each pass can open up more work for the others. In practice, this
+    // settles within a couple of rounds; the limit is only a safeguard.
+    fori (round, 0, 8) {
+        b32 changed = 0;
+
+        changed |= opt_remove_unreachable(func);
+        changed |= opt_peephole(func);
+
+        if (touch_locals) {
+            changed |= opt_propagate_copies(func);
+            changed |= opt_remove_dead_stores(func, local_count);
+        }
+
+        if (!changed) break;
+    }
+
+    if (touch_locals) {
+        opt_compact_locals(func, local_count);
+    }
+}
+
+static void optimize_function_job(void *data, i32 index) {
+    optimize_function(&((WasmFunc *) data)[index]);
+}
+
+
+//
+// Inlining
+//
+// Calls to procedures marked #inline, and with --optimize to procedures of at
+// most INLINE_MAX_INSTRUCTIONS instructions, are replaced with the body of the
+// procedure. The arguments on the stack are stored into new locals of the
+// caller, and every local of the callee is given a new local in the caller.
+//
+// A procedure can only be inlined if control can only leave it by falling off
+// the end, or by a return as its last reachable instruction. Then its result is
+// simply left on the stack. Procedures that call themselves are not inlined,
+// and only one level of calls is inlined.
+//
+// Locals start as zero when a function is called, but the locals an inlined
+// body gets are reused every time the call site runs. So a procedure that might
+// read a local before storing to it is not inlined.
+//
+
+#define INLINE_MAX_INSTRUCTIONS 12
+
+typedef struct InlineCandidate {
+    // The code of the procedure, without the final return and end.
+    bh_arr(WasmInstruction) body;
+    WasmFuncType *type;
+    LocalAllocator locals;
+} InlineCandidate;
+
+static const u64 inline_local_class_flags[5] = { LOCAL_I32, LOCAL_I64, LOCAL_F32, LOCAL_F64, LOCAL_V128 };
+
+static inline i32 inline_wasm_type_class(WasmType type) {
+    switch (type) {
+        case WASM_TYPE_INT64:   return 1;
+        case WASM_TYPE_FLOAT32: return 2;
+        case WASM_TYPE_FLOAT64: return 3;
+        case WASM_TYPE_VAR128:  return 4;
+        default:                return 0;
+    }
+}
+
+static inline u64 inline_new_local(LocalAllocator *la, i32 class) {
+    la->allocated[class]++;
+    return LOCAL_IS_WASM | inline_local_class_flags[class] | (u64) (la->allocated[class] - 1 + la->param_count);
+}
+
+static b32 inline_target_leaves_function(u32 label, i32 depth) {
+    return (i32) label >= depth;
+}
+
+static b32 inline_prepare_candidate(OnyxWasmModule *module, i32 func_idx, InlineCandidate *out) {
+    WasmFunc *func = &module->funcs[func_idx];
+    if (func->code == NULL) return 0;
+    if (!func->always_inline && !context.options->optimize) return 0;
+
+    WasmFuncType *type = module->types[func->type_idx];
+    if (type->param_count != (i32) func->locals.param_count) return 0;
+
+    u32 local_count = func->locals.param_count;
+    fori (c, 0, 5) local_count += func->locals.allocated[c];
+
+    // For every local, one more than the block depth at which it was first
+    // stored to, or 0 if it has not been stored to on every path so far.
+    i32 *stored = bh_alloc_array(global_heap_allocator, i32, local_count);
+    memset(stored, 0, sizeof(i32) * local_count);
+    fori (p, 0, func->locals.param_count) stored[p] = 1;
+
+    bh_arr(WasmInstruction) body = NULL;
+    bh_arr_new(global_heap_allocator, body, 16);
+
+    b32 inlinable = 1;
+    i32 depth = 0;
+    i32 size  = 0;
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        switch (instr->type) {
+            case WI_NOP: continue;
+
+            case WI_BLOCK_START:
+            case WI_LOOP_START:
+            case WI_IF_START:
+                depth++;
+                break;
+
+            case WI_ELSE:
+                // Stores in the true branch do not happen in the false branch.
+                fori (l, 0, local_count) if (stored[l] > depth) stored[l] = 0;
+                break;
+
+            case WI_BLOCK_END:
+                if (depth == 0) goto done;
+                depth--;
+
+                // Stores inside of the block might not have happened.
+                fori (l, 0, local_count) if (stored[l] > depth + 1) stored[l] = 0;
+                break;
+
+            case WI_RETURN:
+                // Everything after a return at the top level is unreachable.
+                if (depth != 0) inlinable = 0;
+                goto done;
+
+            case WI_JUMP:
+            case WI_COND_JUMP:
+                if (inline_target_leaves_function(instr->data.i1, depth)) inlinable = 0;
+                break;
+
+            case WI_JUMP_TABLE: {
+                BranchTable *bt = (BranchTable *) instr->data.p;
+                if (inline_target_leaves_function(bt->default_case, depth)) inlinable = 0;
+                fori (i, 0, bt->count) {
+                    if (inline_target_leaves_function(bt->cases[i], depth)) inlinable = 0;
+                }
+                break;
+            }
+
+            case WI_CALL:
+                if (instr->data.i1 == func_idx + (i32) module->foreign_function_count) inlinable = 0;
+                break;
+
+            case WI_LOCAL_GET: {
+                u64 idx = local_lookup_idx(&func->locals, instr->data.l);
+                if (!stored[idx]) inlinable = 0;
+                break;
+            }
+
+            case WI_LOCAL_SET:
+            case WI_LOCAL_TEE: {
+                u64 idx = local_lookup_idx(&func->locals, instr->data.l);
+                if (!stored[idx]) stored[idx] = depth + 1;
+                break;
+            }
+
+            default: break;
+        }
+
+        if (!inlinable) break;
+
+        bh_arr_push(body, *instr);
+        size++;
+    }
+
+  done:
+    bh_free(global_heap_allocator, stored);
+
+    if (!inlinable || (!func->always_inline && size > INLINE_MAX_INSTRUCTIONS)) {
+        bh_arr_free(body);
+        return 0;
+    }
+
+    out->body   = body;
+    out->type   = type;
+    out->locals = func->locals;
+    return 1;
+}
+
+typedef struct InlineJobs {
+    OnyxWasmModule *module;
+    InlineCandidate *candidates;
+    b32 *changed;
+} InlineJobs;
+
+static InlineCandidate *inline_candidate_for_call(InlineJobs *jobs, i32 caller_idx, WasmInstruction *instr) {
+    if (instr->type != WI_CALL) return NULL;
+
+    i32 callee_idx = instr->data.i1 - (i32) jobs->module->foreign_function_count;
+    if (callee_idx < 0 || callee_idx == caller_idx) return NULL;
+
+    InlineCandidate *candidate = &jobs->candidates[callee_idx];
+    return candidate->body ? candidate : NULL;
+}
+
+static void inline_call(WasmFunc *func, InlineCandidate *callee, bh_arr(WasmInstruction) *pcode) {
+    bh_arr(WasmInstruction) code = *pcode;
+
+    u32 local_count = callee->locals.param_count;
+    fori (c, 0, 5) local_count += callee->locals.allocated[c];
+
+    // 0 means the local has not been given a new local yet. That is never
+    // a valid mapping, because LOCAL_IS_WASM is always set.
+    u64 *local_map = bh_alloc_array(global_heap_allocator, u64, local_count);
+    memset(local_map, 0, sizeof(u64) * local_count);
+
+    fori (p, 0, callee->type->param_count) {
+        local_map[p] = inline_new_local(&func->locals, inline_wasm_type_class(callee->type->param_types[p]));
+    }
+
+    for (i32 p = callee->type->param_count - 1; p >= 0; p--) {
+        bh_arr_push(code, ((WasmInstruction) { WI_LOCAL_SET, { .l = local_map[p] } }));
+    }
+
+    bh_arr_each(WasmInstruction, instr, callee->body) {
+        WasmInstruction copy = *instr;
+
+        if (copy.type == WI_LOCAL_GET || copy.type == WI_LOCAL_SET || copy.type == WI_LOCAL_TEE) {
+            u64 idx = local_lookup_idx(&callee->locals, copy.data.l);
+            if (local_map[idx] == 0) {
+                local_map[idx] = inline_new_local(&func->locals, opt_local_class(copy.data.l));
+            }
+
+            copy.data.l = local_map[idx];
+        }
+
+        bh_arr_push(code, copy);
+    }
+
+    bh_free(global_heap_allocator, local_map);
+    *pcode = code;
+}
+
+static void inline_function_job(void *data, i32 index) {
+    InlineJobs *jobs = (InlineJobs *) data;
+    WasmFunc *func = &jobs->module->funcs[index];
+
+    b32 has_inlinable_call = 0;
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (inline_candidate_for_call(jobs, index, instr)) {
+            has_inlinable_call = 1;
+            break;
+        }
+    }
+
+    if (!has_inlinable_call) return;
+
+    bh_arr(WasmInstruction) code = NULL;
+    bh_arr_new(global_heap_allocator, code, bh_arr_length(func->code) * 2);
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        InlineCandidate *callee = inline_candidate_for_call(jobs, index, instr);
+        if (callee) {
+            inline_call(func, callee, &code);
+        } else {
+            bh_arr_push(code, *instr);
+        }
+    }
+
+    bh_arr_free(func->code);
+    func->code = code;
+    jobs->changed[index] = 1;
+}
+
+static b32 inline_functions(OnyxWasmModule *module, b32 **changed) {
+    i32 func_count = bh_arr_length(module->funcs);
+
+    InlineCandidate *candidates = bh_alloc_array(global_heap_allocator, InlineCandidate, func_count);
+    memset(candidates, 0, sizeof(InlineCandidate) * func_count);
+
+    b32 any_candidates = 0;
+    fori (i, 0, func_count) {
+        if (inline_prepare_candidate(module, i, &candidates[i])) any_candidates = 1;
+    }
+
+    if (any_candidates) {
+        *changed = bh_alloc_array(global_heap_allocator, b32, func_count);
+        memset(*changed, 0, sizeof(b32) * func_count);
+
+        InlineJobs jobs = { module, candidates, *changed };
+        worker_pool_run(func_count, inline_function_job, &jobs);
+    }
+
+    fori (i, 0, func_count) bh_arr_free(candidates[i].body);
+    bh_free(global_heap_allocator, candidates);
+    return any_candidates;
+}
+
+typedef struct OptimizeAgainJobs {
+    WasmFunc *funcs;
+    b32 *changed;
+} OptimizeAgainJobs;
+
+static void optimize_changed_function_job(void *data, i32 index) {
+    OptimizeAgainJobs *jobs = (OptimizeAgainJobs *) data;
+    if (jobs->changed[index]) optimize_function(&jobs->funcs[index]);
+}
+
+//
+// Identical code folding
+//
+// Polymorphic procedures are solidified once for every set of polymorphic
+// arguments, and many of the copies compile to exactly the same code, like
+// array.push for every pointer type. Functions with the same type, locals and
+// code are merged into the first of them. Every call, table element and export
+// of a removed function is then changed to use the function that was kept.
+//
+// Calls are compared by the function that is kept for the callee, and a call of
+// a function to itself matches a call of the other function to itself. Folding
+// some functions can make their callers identical, so this is repeated until
+// nothing else is folded.
+//
+// Each procedure keeps its own entry in the function table, so procedures that
+// are used as values still compare the same way as before.
+//
+
+typedef struct FoldEntry {
+    u64 hash;
+    i32 index;
+} FoldEntry;
+
+typedef struct FoldJobs {
+    OnyxWasmModule *module;
+
+    // For every function, the function it was folded into, or itself.
+    i32 *replacement;
+    u64 *hashes;
+} FoldJobs;
+
+static inline i32 fold_resolve(i32 *replacement, i32 idx) {
+    while (replacement[idx] != idx) idx = replacement[idx];
+    return idx;
+}
+
+static inline u64 fold_mix(u64 hash, u64 value) {
+    hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+// Returns the operand of the call, as the callee that is kept, or -1 when the
+// function calls itself.
+static inline i64 fold_call_target(FoldJobs *jobs, i32 func_idx, WasmInstruction *instr) {
+    i32 foreign_count = (i32) jobs->module->foreign_function_count;
+    if (instr->data.i1 < foreign_count) return instr->data.i1;
+
+    i32 callee = fold_resolve(jobs->replacement, instr->data.i1 - foreign_count);
+    if (callee == func_idx) return -1;
+    return callee + foreign_count;
+}
+
+static u64 fold_hash_instruction(FoldJobs *jobs, i32 func_idx, WasmInstruction *instr) {
+    u64 hash = fold_mix(0, instr->type);
+
+    switch (instr->type) {
+        case WI_CALL:
+            return fold_mix(hash, (u64) fold_call_target(jobs, func_idx, instr));
+
+        case WI_JUMP_TABLE: {
+            BranchTable *bt = (BranchTable *) instr->data.p;
+            hash = fold_mix(hash, bt->default_case);
+            fori (i, 0, bt->count) hash = fold_mix(hash, bt->cases[i]);
+            return hash;
+        }
+
+        case WI_V128_CONST:
+        case WI_I8X16_SHUFFLE:
+            hash = fold_mix(hash, ((u64 *) instr->data.p)[0]);
+            return fold_mix(hash, ((u64 *) instr->data.p)[1]);
+
+        default:
+            return fold_mix(hash, instr->data.l);
+    }
+}
+
+static b32 fold_instructions_equal(FoldJobs *jobs, i32 a_idx, WasmInstruction *a, i32 b_idx, WasmInstruction *b) {
+    if (a->type != b->type) return 0;
+
+    switch (a->type) {
+        case WI_CALL:
+            return fold_call_target(jobs, a_idx, a) == fold_call_target(jobs, b_idx, b);
+
+        case WI_JUMP_TABLE: {
+            BranchTable *bt_a = (BranchTable *) a->data.p;
+            BranchTable *bt_b = (BranchTable *) b->data.p;
+            if (bt_a->count != bt_b->count || bt_a->default_case != bt_b->default_case) return 0;
+            return memcmp(bt_a->cases, bt_b->cases, sizeof(u32) * bt_a->count) == 0;
+        }
+
+        case WI_V128_CONST:
+        case WI_I8X16_SHUFFLE:
+            return memcmp(a->data.p, b->data.p, 16) == 0;
+
+        // Other operands are compared as they are stored, so instructions that
+        // leave part of the operand unused might not be seen as equal.
+        default:
+            return a->data.l == b->data.l;
+    }
+}
+
+static void fold_hash_function_job(void *data, i32 index) {
+    FoldJobs *jobs = (FoldJobs *) data;
+    WasmFunc *func = &jobs->module->funcs[index];
+    if (func->code == NULL || jobs->replacement[index] != index) return;
+
+    u64 hash = fold_mix(0, func->type_idx);
+    hash = fold_mix(hash, func->locals.param_count);
+    fori (c, 0, 5) hash = fold_mix(hash, func->locals.allocated[c]);
+
+    bh_arr_each(WasmInstruction, instr, func->code) {
+        if (instr->type == WI_NOP) continue;
+        hash = fold_mix(hash, fold_hash_instruction(jobs, index, instr));
+    }
+
+    jobs->hashes[index] = hash;
+}
+
+static b32 fold_functions_equal(FoldJobs *jobs, i32 a_idx, i32 b_idx) {
+    WasmFunc *a = &jobs->module->funcs[a_idx];
+    WasmFunc *b = &jobs->module->funcs[b_idx];
+
+    if (a->type_idx != b->type_idx) return 0;
+    if (a->locals.param_count != b->locals.param_count) return 0;
+    fori (c, 0, 5) if (a->locals.allocated[c] != b->locals.allocated[c]) return 0;
+
+    i32 a_len = bh_arr_length(a->code);
+    i32 b_len = bh_arr_length(b->code);
+    i32 i = 0, j = 0;
+
+    while (1) {
+        while (i < a_len && a->code[i].type == WI_NOP) i++;
+        while (j < b_len && b->code[j].type == WI_NOP) j++;
+
+        if (i == a_len || j == b_len) return i == a_len && j == b_len;
+        if (!fold_instructions_equal(jobs, a_idx, &a->code[i], b_idx, &b->code[j])) return 0;
+
+        i++, j++;
+    }
+}
+
+static i32 fold_entry_compare(const void *a, const void *b) {
+    FoldEntry *e1 = (FoldEntry *) a;
+    FoldEntry *e2 = (FoldEntry *) b;
+
+    if (e1->hash != e2->hash) return e1->hash < e2->hash ? -1 : 1;
+    return e1->index - e2->index;
+}
+
+static void fold_identical_functions(OnyxWasmModule *module) {
+    i32 func_count = bh_arr_length(module->funcs);
+    if (func_count == 0) return;
+
+    FoldJobs jobs;
+    jobs.module      = module;
+    jobs.replacement = bh_alloc_array(global_heap_allocator, i32, func_count);
+    jobs.hashes      = bh_alloc_array(global_heap_allocator, u64, func_count);
+    fori (i, 0, func_count) jobs.replacement[i] = i;
+
+    FoldEntry *entries = bh_alloc_array(global_heap_allocator, FoldEntry, func_count);
+
+    b32 folded_any = 0;
+    b32 folded = 1;
+    while (folded) {
+        folded = 0;
+        worker_pool_run(func_count, fold_hash_function_job, &jobs);
+
+        i32 entry_count = 0;
+        fori (i, 0, func_count) {
+            if (module->funcs[i].code == NULL || jobs.replacement[i] != i) continue;
+            entries[entry_count++] = (FoldEntry) { jobs.hashes[i], i };
+        }
+
+        qsort(entries, entry_count, sizeof(FoldEntry), fold_entry_compare);
+
+        i32 run_start = 0;
+        while (run_start < entry_count) {
+            i32 run_end = run_start + 1;
+            while (run_end < entry_count && entries[run_end].hash == entries[run_start].hash) run_end++;
+
+            fori (a, run_start, run_end) {
+                i32 kept = entries[a].index;
+                if (jobs.replacement[kept] != kept) continue;
+
+                fori (b, a + 1, run_end) {
+                    i32 other = entries[b].index;
+                    if (jobs.replacement[other] != other) continue;
+
+                    if (fold_functions_equal(&jobs, kept, other)) {
+                        jobs.replacement[other] = kept;
+                        folded = 1;
+                    }
+                }
+            }
+
+            run_start = run_end;
+        }
+
+        folded_any |= folded;
+    }
+
+    if (folded_any) {
+        // Remove the folded functions, and renumber the ones that are left.
+        i32 foreign_count = (i32) module->foreign_function_count;
+        i32 *new_index = bh_alloc_array(global_heap_allocator, i32, func_count);
+
+        i32 kept_count = 0;
+        fori (i, 0, func_count) {
+            i32 kept = fold_resolve(jobs.replacement, i);
+            if (kept == i) {
+                module->funcs[kept_count] = module->funcs[i];
+                new_index[i] = foreign_count + kept_count++;
+
+            } else {
+                // Functions are always folded into one that comes before them.
+                new_index[i] = new_index[kept];
+                bh_arr_free(module->funcs[i].code);
+            }
+        }
+
+        bh_arr_set_length(module->funcs, kept_count);
+
+        bh_arr_each(WasmFunc, func, module->funcs) {
+            bh_arr_each(WasmInstruction, instr, func->code) {
+                if (instr->type == WI_CALL && instr->data.i1 >= foreign_count) {
+                    instr->data.i1 = new_index[instr->data.i1 - foreign_count];
+                }
+            }
+        }
+
+        bh_arr_each(i32, elem, module->elems) {
+            if (*elem >= foreign_count) *elem = new_index[*elem - foreign_count];
+        }
+
+        fori (i, 0, shlen(module->exports)) {
+            WasmExport *export = &module->exports[i].value;
+            if (export->kind == WASM_FOREIGN_FUNCTION && export->idx >= foreign_count) {
+                export->idx = new_index[export->idx - foreign_count];
+            }
+        }
+
+        bh_free(global_heap_allocator, new_index);
+    }
+
+    bh_free(global_heap_allocator, entries);
+    bh_free(global_heap_allocator, jobs.hashes);
+    bh_free(global_heap_allocator, jobs.replacement);
+}
+
+static void optimize_module(OnyxWasmModule *module) {
+    b32 optimize = context.options->optimize;
+
+    if (optimize) {
+        worker_pool_run(bh_arr_length(module->funcs), optimize_function_job, module->funcs);
+    }
+
+    // Inlining changes the number of instructions in a function,
+    // which would throw off the debug info.
+    if (context.options->generate_debug_info) return;
+
+    b32 *changed = NULL;
+    if (inline_functions(module, &changed) && optimize) {
+        OptimizeAgainJobs jobs = { module->funcs, changed };
+        worker_pool_run(bh_arr_length(module->funcs), optimize_changed_function_job, &jobs);
+    }
+
+    if (changed) bh_free(global_heap_allocator, changed);
+
+    fold_identical_functions(module);
+}
@@ -428,7 +428,7 @@ static void output_instruction(WasmFunc* func, WasmInstruction* instr, bh_buffer
     i32 leb_len;
     u8* leb;
 
-    if (instr->type == WI_NOP && !context.options->debug_enabled) return;
+    if (instr->type == WI_NOP && !context.options->generate_debug_info) return;
 
     if (instr->type & SIMD_INSTR_MASK) {
         bh_buffer_write_byte(buff, 0xFD);
@@ -589,6 +589,18 @@ static i32 output_code(WasmFunc* func, bh_buffer* buff) {
     return 0;
 }
 
+typedef struct CodeOutputJobs {
+    OnyxWasmModule* module;
+    bh_buffer* buffers;
+} CodeOutputJobs;
+
+static void output_code_job(void* data, i32 index) {
+    CodeOutputJobs* jobs = (CodeOutputJobs *) data;
+
+    bh_buffer_init(&jobs->buffers[index], global_heap_allocator, 128);
+    output_code(&jobs->module->funcs[index], &jobs->buffers[index]);
+}
+
 static i32 output_codesection(OnyxWasmModule* module, bh_buffer* buff) {
     i32 prev_len = buff->length;
 
@@ -597,11 +609,25 @@ static i32 output_codesection(OnyxWasmModule* module, bh_buffer* buff) {
     bh_buffer vec_buff;
     bh_buffer_init(&vec_buff, buff->allocator, 128);
 
+    i32 func_count = bh_arr_length(module->funcs);
+
     i32 leb_len;
-    u8* leb = uint_to_uleb128((u64) bh_arr_length(module->funcs), &leb_len);
+    u8* leb = uint_to_uleb128((u64) func_count, &leb_len);
     bh_buffer_append(&vec_buff, leb, leb_len);
 
-    bh_arr_each(WasmFunc, func, module->funcs) output_code(func, &vec_buff);
+    // NOTE: Every function body is encoded independently, so they are spread
+    // across the worker threads and then concatenated in index order.
+    CodeOutputJobs jobs;
+    jobs.module = module;
+    jobs.buffers = bh_alloc_array(global_heap_allocator, bh_buffer, func_count);
+    worker_pool_run(func_count, output_code_job, &jobs);
+
+    fori (i, 0, func_count) {
+        bh_buffer_concat(&vec_buff, jobs.buffers[i]);
+        bh_buffer_free(&jobs.buffers[i]);
+    }
+
+    bh_free(global_heap_allocator, jobs.buffers);
 
     leb = uint_to_uleb128((u64) (vec_buff.length), &leb_len);
     bh_buffer_append(buff, leb, leb_len);
@@ -765,7 +791,7 @@ static i32 output_onyx_func_offset_section(OnyxWasmModule* module, bh_buffer* bu
 
 #ifdef ENABLE_DEBUG_INFO
 static i32 output_ovm_debug_sections(OnyxWasmModule* module, bh_buffer* buff) {
-    if (!module->debug_context || !context.options->debug_enabled) return 0;
+    if (!module->debug_context || !context.options->generate_debug_info) return 0;
 
     DebugContext *ctx = module->debug_context;
 
@@ -1064,7 +1090,7 @@ void onyx_wasm_module_write_to_buffer(OnyxWasmModule* module, bh_buffer* buffer)
     bh_buffer_append(buffer, WASM_VERSION, 4);
 
 #ifdef ENABLE_DEBUG_INFO
-    if (context.options->debug_enabled) {
+    if (context.options->generate_debug_info) {
         output_ovm_debug_sections(module, buffer);
     }
 #endif
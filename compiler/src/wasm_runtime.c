@@ -207,7 +207,10 @@ static void onyx_print_trap(wasm_trap_t* trap) {
     bh_printf("TRACE:\n");
     wasm_frame_vec_t frames;
     wasm_trap_trace(trap, &frames);
-    fori (i, 0, (i32) frames.size) {
+
+    // A trace from a stack overflow can be very deep; only the innermost frames are interesting.
+    i32 frames_to_print = bh_min((i32) frames.size, 64);
+    fori (i, 0, frames_to_print) {
         i32 func_idx   = wasm_frame_func_index(frames.data[i]);
         i32 mod_offset = wasm_frame_module_offset(frames.data[i]);
 
@@ -217,6 +220,10 @@ static void onyx_print_trap(wasm_trap_t* trap) {
 
         bh_printf("    func[%d]:%p at %s\n", func_idx, mod_offset, func_name);
     }
+
+    if (frames_to_print < (i32) frames.size) {
+        bh_printf("    ... %d more frames\n", (i32) frames.size - frames_to_print);
+    }
 }
 
 static void cleanup_wasm_objects() {
@@ -269,7 +276,16 @@ static b32 link_wasm_imports(bh_arr(WasmFuncDefinition **) linkable_functions, w
 
                     wasm_functype_t* wasm_functype = wasm_functype_new(&wasm_params, &wasm_results);
 
-                    wasm_func_t* wasm_func = wasm_func_new(wasm_store, wasm_functype, cf->func);
+                    wasm_func_t* wasm_func = NULL;
+
+#ifdef USE_OVM_DEBUGGER
+                    // OVM can call these with its own values, skipping the conversion to wasm_val_t.
+                    if (cf->direct_func) {
+                        wasm_func = wasm_func_new_direct(wasm_store, wasm_functype, cf->func, cf->direct_func);
+                    }
+#endif
+
+                    if (!wasm_func) wasm_func = wasm_func_new(wasm_store, wasm_functype, cf->func);
                     import = wasm_func_as_extern(wasm_func);
                     goto import_found;
                 }
@@ -293,7 +309,7 @@ static b32 link_wasm_imports(bh_arr(WasmFuncDefinition **) linkable_functions, w
     return 1;
 }
 
-void onyx_run_initialize(b32 debug_enabled) {
+void onyx_run_initialize(b32 debug_enabled, char *program_cache_dir, char *profile_output) {
     wasm_config = wasm_config_new();
     if (!wasm_config) {
         cleanup_wasm_objects();
@@ -303,6 +319,12 @@ void onyx_run_initialize(b32 debug_enabled) {
 #ifdef USE_OVM_DEBUGGER
     void wasm_config_enable_debug(wasm_config_t *config, int value);
     wasm_config_enable_debug(wasm_config, debug_enabled);
+
+    void wasm_config_set_program_cache_dir(wasm_config_t *config, char *program_cache_dir);
+    wasm_config_set_program_cache_dir(wasm_config, program_cache_dir);
+
+    void wasm_config_set_profile_output(wasm_config_t *config, char *profile_output);
+    wasm_config_set_profile_output(wasm_config, profile_output);
 #endif
 
 #ifndef USE_OVM_DEBUGGER
@@ -310,6 +332,10 @@ void onyx_run_initialize(b32 debug_enabled) {
         printf("Warning: --debug does nothing if libovmwasm.so is not being used!\n");
     }
 
+    if (profile_output) {
+        printf("Warning: --profile does nothing if libovmwasm.so is not being used!\n");
+    }
+
     // Prefer the LLVM compile because it is faster. This should be configurable from the command line and/or a top-level directive.
     if (wasmer_is_compiler_available(LLVM)) {
         wasm_config_set_compiler(wasm_config, LLVM);
@@ -343,6 +369,11 @@ void onyx_run_initialize(b32 debug_enabled) {
     wasm_runtime.wasm_store_new = &wasm_store_new;
     wasm_runtime.wasm_store_delete = &wasm_store_delete;
     wasm_runtime.onyx_print_trap = &onyx_print_trap;
+
+#ifdef USE_OVM_DEBUGGER
+    wasm_runtime.wasm_instance_new_thread = &wasm_instance_new_thread;
+    wasm_runtime.wasm_instance_delete = &wasm_instance_delete;
+#endif
 }
 
 b32 onyx_run_wasm(bh_buffer wasm_bytes, int argc, char *argv[]) {
@@ -8,7 +8,139 @@ typedef struct StructMethodData {
     u32 data_loc;
 } StructMethodData;
 
-static u64 build_type_table(OnyxWasmModule* module) {
+// This is the data behind the "type_table" slice in runtime/info/types.onyx
+#if (POINTER_SIZE == 4)
+    #define Table_Info_Type u32
+#else
+    #define Table_Info_Type u64
+#endif
+
+//
+// Only the types that can be reached at runtime are written to the type table.
+// Those are the types used as values, the types of values converted to 'any',
+// and every type that their type information refers to. The entries for all
+// other types are null. With --full-type-table, every type is written.
+//
+// The space for the table is reserved when the "type_table" memory reservation
+// is emitted, but it is only built when linking, after all of the code has been
+// emitted and every type used at runtime is known.
+//
+static void type_table_mark_used(OnyxWasmModule* module, u32 type_id) {
+    if (type_id == 0) return;
+
+    if (module->emission) {
+        bh_arr_push(module->emission->type_table_marks, type_id);
+        return;
+    }
+
+    if (bh_imap_has(&module->type_table_used, type_id)) return;
+
+    bh_imap_put(&module->type_table_used, type_id, 1);
+    bh_arr_push(module->type_table_pending, type_id);
+}
+
+static void type_table_mark_references(OnyxWasmModule* module, Type* type) {
+    switch (type->kind) {
+        case Type_Kind_Pointer:  type_table_mark_used(module, type->Pointer.elem->id);  break;
+        case Type_Kind_Array:    type_table_mark_used(module, type->Array.elem->id);    break;
+        case Type_Kind_Slice:    type_table_mark_used(module, type->Slice.elem->id);    break;
+        case Type_Kind_DynArray: type_table_mark_used(module, type->DynArray.elem->id); break;
+        case Type_Kind_VarArgs:  type_table_mark_used(module, type->VarArgs.elem->id);  break;
+        case Type_Kind_Enum:     type_table_mark_used(module, type->Enum.backing->id);  break;
+        case Type_Kind_Distinct: type_table_mark_used(module, type->Distinct.base_type->id); break;
+
+        case Type_Kind_Compound:
+            fori (i, 0, type->Compound.count) type_table_mark_used(module, type->Compound.types[i]->id);
+            break;
+
+        case Type_Kind_Function:
+            fori (i, 0, type->Function.param_count) type_table_mark_used(module, type->Function.params[i]->id);
+            type_table_mark_used(module, type->Function.return_type->id);
+            break;
+
+        case Type_Kind_Struct: {
+            TypeStruct* s = &type->Struct;
+
+            bh_arr_each(StructMember*, pmem, s->memarr) {
+                type_table_mark_used(module, (*pmem)->type->id);
+
+                bh_arr_each(AstTyped *, tag, (*pmem)->meta_tags) type_table_mark_used(module, (*tag)->type->id);
+            }
+
+            bh_arr_each(AstPolySolution, sln, s->poly_sln) {
+                if (sln->kind == PSK_Type) {
+                    type_table_mark_used(module, basic_types[Basic_Kind_Type_Index].id);
+                    type_table_mark_used(module, sln->type->id);
+                } else {
+                    type_table_mark_used(module, sln->value->type->id);
+                }
+            }
+
+            bh_arr_each(AstTyped *, tag, s->meta_tags) type_table_mark_used(module, (*tag)->type->id);
+
+            if (s->constructed_from != NULL) type_table_mark_used(module, s->constructed_from->type_id);
+
+            AstType *ast_type = type->ast_type;
+            if (ast_type && ast_type->kind == Ast_Kind_Struct_Type) {
+                Scope* struct_scope = ((AstStructType *) ast_type)->scope;
+                if (struct_scope == NULL) break;
+
+                fori (i, 0, shlen(struct_scope->symbols)) {
+                    AstFunction* node = (AstFunction *) strip_aliases(struct_scope->symbols[i].value);
+                    if (node->kind != Ast_Kind_Function) continue;
+
+                    type_table_mark_used(module, node->type->id);
+                }
+            }
+            break;
+        }
+
+        case Type_Kind_PolyStruct:
+            bh_arr_each(AstTyped *, tag, type->PolyStruct.meta_tags) {
+                if ((*tag)->flags & Ast_Flag_Comptime) type_table_mark_used(module, (*tag)->type->id);
+            }
+            break;
+
+        default: break;
+    }
+}
+
+static u64 reserve_type_table(OnyxWasmModule* module) {
+    // The data is replaced when linking. Until then it cannot be NULL, because
+    // entries without data are not initialized by __initialize_data_segments.
+    static u64 placeholder = 0;
+
+    WasmDatum type_info_data = { .alignment = 8, .data = &placeholder };
+    module->type_table_data_id = emit_data_entry(module, &type_info_data);
+
+    WasmDatum type_table_data = { .alignment = POINTER_SIZE, .data = &placeholder };
+    emit_data_entry(module, &type_table_data);
+
+    // The type count is filled in when the table is built.
+    Table_Info_Type* tmp_data = bh_alloc(global_heap_allocator, 2 * POINTER_SIZE);
+    tmp_data[0] = 0;
+    tmp_data[1] = 0;
+    WasmDatum type_table_global_data = {
+        .alignment = POINTER_SIZE,
+        .length = 2 * POINTER_SIZE,
+        .data = tmp_data,
+    };
+    emit_data_entry(module, &type_table_global_data);
+
+    {
+        DatumPatchInfo patch;
+        patch.kind = Datum_Patch_Data;
+        patch.data_id = type_table_data.id;
+        patch.offset = 0;
+        patch.index = type_table_global_data.id;
+        patch.location = 0;
+        bh_arr_push(module->data_patches, patch);
+    }
+
+    return type_table_global_data.id;
+}
+
+static void build_type_table(OnyxWasmModule* module) {
 
     bh_arr(u32) base_patch_locations=NULL;
     bh_arr_new(global_heap_allocator, base_patch_locations, 256);
@@ -24,20 +156,32 @@ static u64 build_type_table(OnyxWasmModule* module) {
     if (POINTER_SIZE == 4) bh_buffer_write_u32(&table_buffer, count); \
     if (POINTER_SIZE == 8) bh_buffer_write_u64(&table_buffer, count); 
 
-    // This is the data behind the "type_table" slice in runtime/info/types.onyx
-    #if (POINTER_SIZE == 4)
-        #define Table_Info_Type u32
-    #else
-        #define Table_Info_Type u64
-    #endif
-    u32 type_count = bh_arr_length(type_map.entries) + 1;
-    Table_Info_Type* table_info = bh_alloc_array(global_heap_allocator, Table_Info_Type, type_count); // HACK
-    memset(table_info, 0, type_count * sizeof(Table_Info_Type));
+    if (context.options->full_type_table) {
+        bh_arr_each(bh__imap_entry, type_entry, type_map.entries) {
+            type_table_mark_used(module, type_entry->key);
+        }
+
+    } else {
+        //
+        // Structures are often only found at runtime by looking for their tags
+        // with for_all_types, without ever being used as a value. Every tagged
+        // structure is kept, so those searches find the same structures as before.
+        bh_arr_each(bh__imap_entry, type_entry, type_map.entries) {
+            Type* type = (Type *) type_entry->value;
+            if (type->kind == Type_Kind_Struct && bh_arr_length(type->Struct.meta_tags) > 0) {
+                type_table_mark_used(module, type_entry->key);
+            }
+        }
+    }
+
+    // Maps the id of every type that is written to the offset of its information.
+    bh_imap entry_offsets;
+    bh_imap_init(&entry_offsets, global_heap_allocator, 256);
 
     bh_buffer table_buffer;
     bh_buffer_init(&table_buffer, global_heap_allocator, 4096);
 
-    u32 type_table_info_data_id = NEXT_DATA_ID(module);
+    u32 type_table_info_data_id = module->type_table_data_id;
 
     ConstExprContext constexpr_ctx;
     constexpr_ctx.module = module;
@@ -46,13 +190,20 @@ static u64 build_type_table(OnyxWasmModule* module) {
     // Write a "NULL" at the beginning so nothing will have to point to the first byte of the buffer.
     bh_buffer_write_u64(&table_buffer, 0);
 
-    bh_arr_each(bh__imap_entry, type_entry, type_map.entries) {
-        u64 type_idx = type_entry->key;
-        Type* type = (Type *) type_entry->value;
+    // NOTE: Writing the information of a type can mark more types as used, so this
+    // cannot be a bh_arr_each.
+    for (i32 pending_idx = 0; pending_idx < bh_arr_length(module->type_table_pending); pending_idx++) {
+        u64 type_idx = module->type_table_pending[pending_idx];
+        Type* type = type_lookup_by_id(type_idx);
+        if (type == NULL) continue;
+
+        type_table_mark_references(module, type);
+
+        u32 entry_offset = 0;
 
         switch (type->kind) {
             case Type_Kind_Basic: {
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -61,7 +212,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
             }
 
             case Type_Kind_Pointer: {
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -70,7 +221,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
             }
 
             case Type_Kind_Array: {
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -80,7 +231,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
             }
 
             case Type_Kind_Slice: {
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -89,7 +240,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
             }
 
             case Type_Kind_DynArray: {
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -98,7 +249,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
             }
 
             case Type_Kind_VarArgs: {
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -116,7 +267,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                 }
 
                 bh_buffer_align(&table_buffer, 8);
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -133,7 +284,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                     bh_buffer_write_u32(&table_buffer, type_idx);
                 }
 
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -176,7 +327,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                 bh_buffer_append(&table_buffer, type->Enum.name, name_length);
                 bh_buffer_align(&table_buffer, 8);
 
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -226,7 +377,10 @@ static u64 build_type_table(OnyxWasmModule* module) {
                             assert(sln->value->type);
                             u32 size = type_size_of(sln->value->type);
 
+                            // NOTE: Zero values are not written by emit_constexpr_, so the
+                            // space is cleared first instead of keeping what was in memory.
                             bh_buffer_grow(&table_buffer, table_buffer.length + size);
+                            memset(table_buffer.data + table_buffer.length, 0, size);
                             constexpr_ctx.data = table_buffer.data;
                             if (emit_constexpr_(&constexpr_ctx, sln->value, table_buffer.length)) {
                                 table_buffer.length += size;
@@ -269,6 +423,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                     bh_buffer_align(&table_buffer, type_alignment_of(value->type));
 
                     bh_buffer_grow(&table_buffer, table_buffer.length + size);
+                    memset(table_buffer.data + table_buffer.length, 0, size);
                     constexpr_ctx.data = table_buffer.data;
                     if (!emit_constexpr_(&constexpr_ctx, value, table_buffer.length)) {
                         // Failed to generate raw data
@@ -309,6 +464,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                         meta_tag_locations[j] = table_buffer.length;
 
                         bh_buffer_grow(&table_buffer, table_buffer.length + size);
+                        memset(table_buffer.data + table_buffer.length, 0, size);
                         constexpr_ctx.data = table_buffer.data;
                         assert(emit_constexpr_(&constexpr_ctx, value, table_buffer.length));
                         table_buffer.length += size;
@@ -373,6 +529,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                     struct_tag_locations[i] = table_buffer.length;
 
                     bh_buffer_grow(&table_buffer, table_buffer.length + size);
+                    memset(table_buffer.data + table_buffer.length, 0, size);
                     constexpr_ctx.data = table_buffer.data;
                     assert(emit_constexpr_(&constexpr_ctx, value, table_buffer.length));
                     table_buffer.length += size;
@@ -445,7 +602,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                 }
 
                 bh_buffer_align(&table_buffer, 8);
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -494,6 +651,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                     tag_locations[i] = table_buffer.length;
 
                     bh_buffer_grow(&table_buffer, table_buffer.length + size);
+                    memset(table_buffer.data + table_buffer.length, 0, size);
 
                     constexpr_ctx.data = table_buffer.data;
                     assert(emit_constexpr_(&constexpr_ctx, value, table_buffer.length));
@@ -510,7 +668,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                 }
 
                 bh_buffer_align(&table_buffer, 8);
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, 0);
                 bh_buffer_write_u32(&table_buffer, 0);
@@ -526,7 +684,7 @@ static u64 build_type_table(OnyxWasmModule* module) {
                 bh_buffer_append(&table_buffer, type->Distinct.name, name_length);
                 bh_buffer_align(&table_buffer, 8);
 
-                table_info[type_idx] = table_buffer.length;
+                entry_offset = table_buffer.length;
                 bh_buffer_write_u32(&table_buffer, type->kind);
                 bh_buffer_write_u32(&table_buffer, type_size_of(type));
                 bh_buffer_write_u32(&table_buffer, type_alignment_of(type));
@@ -535,68 +693,56 @@ static u64 build_type_table(OnyxWasmModule* module) {
                 break;
             }
         }
+
+        bh_imap_put(&entry_offsets, type_idx, entry_offset);
     }
 
     if (context.options->verbose_output == 1) {
-        bh_printf("Type table size: %d bytes.\n", table_buffer.length);
+        bh_printf("Type table size: %d bytes (%d of %d types).\n", table_buffer.length,
+            bh_arr_length(module->type_table_pending), bh_arr_length(type_map.entries));
     }
 
-    WasmDatum type_info_data = {
-        .alignment = 8,
-        .length = table_buffer.length,
-        .data = table_buffer.data,
-    };
-    emit_data_entry(module, &type_info_data);
-    assert(type_info_data.id == type_table_info_data_id);
+    WasmDatum *type_info_data = &module->data[type_table_info_data_id - 1];
+    type_info_data->length = table_buffer.length;
+    type_info_data->data = table_buffer.data;
 
     bh_arr_each(u32, patch_loc, base_patch_locations) {
         DatumPatchInfo patch;
         patch.kind = Datum_Patch_Relative;
-        patch.data_id = type_info_data.id;
+        patch.data_id = type_info_data->id;
         patch.offset = 0;
-        patch.index = type_info_data.id;
+        patch.index = type_info_data->id;
         patch.location = *patch_loc;
         bh_arr_push(module->data_patches, patch);
     }
 
-    WasmDatum type_table_data = {
-        .alignment = POINTER_SIZE,
-        .length = type_count * POINTER_SIZE,
-        .data = table_info,
-    };
-    emit_data_entry(module, &type_table_data);
+    // Every type id indexes the table, so the table covers all of them.
+    u32 type_count = bh_arr_length(type_map.entries) + 1;
+    Table_Info_Type* table_info = bh_alloc_array(global_heap_allocator, Table_Info_Type, type_count); // HACK
+    memset(table_info, 0, type_count * sizeof(Table_Info_Type));
+
+    WasmDatum *type_table_data = &module->data[type_table_info_data_id];
+    type_table_data->length = type_count * POINTER_SIZE;
+    type_table_data->data = table_info;
 
     fori (i, 0, type_count) {
+        // Types that are not written are left as null.
+        if (!bh_imap_has(&entry_offsets, i)) continue;
+
         DatumPatchInfo patch;
         patch.kind = Datum_Patch_Data;
-        patch.data_id = type_info_data.id;
-        patch.offset = table_info[i];
-        patch.index = type_table_data.id;
+        patch.data_id = type_info_data->id;
+        patch.offset = bh_imap_get(&entry_offsets, i);
+        patch.index = type_table_data->id;
         patch.location = i * POINTER_SIZE;
         bh_arr_push(module->data_patches, patch);
     }
 
-    Table_Info_Type* tmp_data = bh_alloc(global_heap_allocator, 2 * POINTER_SIZE);
-    tmp_data[0] = 0;
-    tmp_data[1] = type_count;
-    WasmDatum type_table_global_data = {
-        .alignment = POINTER_SIZE,
-        .length = 2 * POINTER_SIZE,
-        .data = tmp_data,
-    };
-    emit_data_entry(module, &type_table_global_data);
+    WasmDatum *type_table_global_data = &module->data[type_table_info_data_id + 1];
+    ((Table_Info_Type *) type_table_global_data->data)[1] = type_count;
 
-    {
-        DatumPatchInfo patch;
-        patch.kind = Datum_Patch_Data;
-        patch.data_id = type_table_data.id;
-        patch.offset = 0;
-        patch.index = type_table_global_data.id;
-        patch.location = 0;
-        bh_arr_push(module->data_patches, patch);
-    }
-
-    return type_table_global_data.id;
+    bh_imap_free(&entry_offsets);
+    bh_arr_free(base_patch_locations);
 
 #undef WRITE_SLICE
 #undef WRITE_PTR
@@ -661,6 +807,8 @@ static u64 build_foreign_blocks(OnyxWasmModule* module) {
             name_lengths[funcs_length] = func_name_length;
             func_types[funcs_length]   = func->type->id;
             funcs_length++;
+
+            type_table_mark_used(module, func->type->id);
         }
 
         bh_buffer_align(&foreign_buffer, 8);
@@ -809,9 +957,11 @@ static u64 build_tagged_procedures(OnyxWasmModule *module) {
 
             tag_data_offsets[tag_index  ] = tag_proc_buffer.length;
             tag_data_types  [tag_index++] = tag->type->id;
+            type_table_mark_used(module, tag->type->id);
 
             u32 size = type_size_of(tag->type);
             bh_buffer_grow(&tag_proc_buffer, tag_proc_buffer.length + size);
+            memset(tag_proc_buffer.data + tag_proc_buffer.length, 0, size);
 
             constexpr_ctx.data = tag_proc_buffer.data;
             emit_constexpr(&constexpr_ctx, tag, tag_proc_buffer.length);
@@ -833,6 +983,7 @@ static u64 build_tagged_procedures(OnyxWasmModule *module) {
 
         bh_buffer_write_u32(&tag_proc_buffer, get_element_idx(module, func));
         bh_buffer_write_u32(&tag_proc_buffer, func->type->id);
+        type_table_mark_used(module, func->type->id);
         WRITE_SLICE(tag_array_base, tag_count);
         bh_buffer_write_u32(&tag_proc_buffer, func->entity->package->id);
     }    
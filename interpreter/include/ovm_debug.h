@@ -159,6 +159,11 @@ typedef struct debug_info_t {
     // func index -> func info
     bh_arr(debug_func_info_t) funcs;
 
+    // func index -> local index -> value number. This is only filled out
+    // for functions with v128 locals, because every other local takes
+    // exactly one value number, so the local index is the value number.
+    bh_arr(bh_arr(i32)) local_value_numbers;
+
     // reducer output -> line info
     bh_arr(debug_loc_info_t) line_info;
 
@@ -187,11 +192,13 @@ void debug_info_import_file_info(debug_info_t *, u8 *data, u32 len);
 void debug_info_import_func_info(debug_info_t *, u8 *data, u32 len);
 void debug_info_import_sym_info(debug_info_t *, u8 *data, u32 len);
 void debug_info_import_type_info(debug_info_t *, u8 *data, u32 len);
+void debug_info_set_local_value_numbers(debug_info_t *, u32 func_id, u32 local_count, i32 *value_numbers);
 
 bool debug_info_lookup_location(debug_info_t *info, u32 instruction, debug_loc_info_t *out);
 bool debug_info_lookup_file(debug_info_t *info, u32 file_id, debug_file_info_t *out);
 bool debug_info_lookup_file_by_name(debug_info_t *info, char *name, debug_file_info_t *out);
 bool debug_info_lookup_func(debug_info_t *info, u32 func_id, debug_func_info_t *out);
+u32  debug_info_lookup_local_value_number(debug_info_t *info, u32 func_id, u32 local_idx);
 i32  debug_info_lookup_instr_by_file_line(debug_info_t *info, char *filename, u32 line);
 
 char *debug_info_type_enum_find_name(debug_info_t *info, u32 enum_type, u64 value);
@@ -313,6 +320,45 @@ u32  debug_host_register_thread(debug_state_t *debug, struct ovm_state_t *ovm_st
 debug_thread_state_t *debug_host_lookup_thread(debug_state_t *debug, u32 id);
 
 
+//
+// The profiler samples the call stack of every running thread from a
+// separate thread, at a fixed interval. Each sample is symbolized with
+// the debug info right away, and identical stacks are counted together.
+// When the profiler is stopped, the stacks are written in the "collapsed"
+// format used by flame graph tools: one line per stack, with the frames
+// from outermost to innermost separated by ';', followed by the count.
+//
+// The sampled threads are not paused, so a sample can be slightly
+// inconsistent if it is taken while a thread is calling or returning.
+// Nothing is JIT compiled while the profiler is running, so that every
+// frame has a line.
+//
+#define DEBUG_PROFILER_SAMPLE_INTERVAL_US 1000
+
+typedef struct debug_profiler_t {
+    bh_allocator alloc;
+
+    char *output_path;
+    debug_info_t *info;
+
+    pthread_mutex_t threads_lock;
+    bh_arr(struct ovm_state_t *) threads;
+
+    pthread_t sample_thread;
+    bool running;
+
+    // Only used by the sampling thread.
+    bh_buffer stack_buffer;
+    struct { char *key; u64 value; } *stacks;
+} debug_profiler_t;
+
+void debug_profiler_init(debug_profiler_t *profiler, char *output_path);
+void debug_profiler_start(debug_profiler_t *profiler);
+void debug_profiler_stop(debug_profiler_t *profiler);
+void debug_profiler_register_thread(debug_profiler_t *profiler, struct ovm_state_t *ovm_state);
+void debug_profiler_unregister_thread(debug_profiler_t *profiler, struct ovm_state_t *ovm_state);
+
+
 
 typedef struct debug_runtime_value_builder_t {
     debug_state_t *state;
@@ -2,6 +2,7 @@
 #define _OVM_WASM_H
 
 #include "wasm.h"
+#include "ovm_extensions.h"
 #include "vm.h"
 #include "ovm_debug.h"
 
@@ -10,16 +11,39 @@
 struct wasm_config_t {
     bool debug_enabled;
     char *listen_path;
+
+    int max_call_depth;
+    long long value_stack_size;
+
+    int jit_threshold;
+
+    // Built programs are saved here and reused when the same module is loaded again. NULL disables this.
+    char *program_cache_dir;
+
+    // Where the profile is written (see debug_profiler_t). NULL disables the profiler.
+    char *profile_output;
 };
 
 void wasm_config_enable_debug(wasm_config_t *config, bool enabled);
 void wasm_config_set_listen_path(wasm_config_t *config, char *listen_path);
+void wasm_config_set_max_call_depth(wasm_config_t *config, int max_call_depth);
+void wasm_config_set_value_stack_size(wasm_config_t *config, long long value_stack_size);
+void wasm_config_set_jit_threshold(wasm_config_t *config, int jit_threshold);
+void wasm_config_set_program_cache_dir(wasm_config_t *config, char *program_cache_dir);
+void wasm_config_set_profile_output(wasm_config_t *config, char *profile_output);
 
 struct wasm_engine_t {
     wasm_config_t *config;
 
     ovm_store_t  *store;
     ovm_engine_t *engine;
+
+    //
+    // The number of calls into OVM code that have not returned yet, on any
+    // thread, plus the number of live thread instances. Threads are not joined
+    // when the main thread finishes, so this is how deleting the module and
+    // engine knows that they are still in use.
+    i32 running_calls;
 };
 
 struct wasm_store_t {
@@ -30,6 +54,11 @@ struct wasm_store_t {
 
 // Types
 
+//
+// The standard C API header predates the SIMD proposal, so it has
+// no value kind for v128. It can never cross the host boundary.
+#define WASM_V128 ((wasm_valkind_t) 4)
+
 struct wasm_valtype_t {
     wasm_valkind_t kind;
 };
@@ -163,6 +192,7 @@ struct wasm_func_inner_t {
     void *env;
     void (*func_ptr)();
     void (*finalizer)(void *);
+    wasm_func_direct_callback_t direct_func_ptr;
 
     const wasm_functype_t *type;
 };
@@ -219,6 +249,9 @@ struct wasm_instance_t {
     wasm_extern_vec_t exports;
 
     ovm_state_t *state;
+
+    // Set for instances made by wasm_instance_new_thread.
+    const wasm_instance_t *parent;
 };
 
 
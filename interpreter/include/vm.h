@@ -57,8 +57,26 @@ struct ovm_static_integer_array_t {
 #define OVM_TYPE_F64    0x06
 #define OVM_TYPE_V128   0x07
 
+//
+// Values are raw 8-byte slots. The type of every value is known statically
+// from the WASM module, so the type is only reconstructed where it is needed,
+// at the boundary between OVM and the WASM API (see instance.c). Defining
+// OVM_TYPED_VALUES (implied by OVM_DEBUG) stores a type tag next to every
+// value again, so the instruction handlers can assert their operand types.
+#if defined(OVM_DEBUG) && !defined(OVM_TYPED_VALUES)
+    #define OVM_TYPED_VALUES
+#endif
+
+#if defined(OVM_TYPED_VALUES)
+    #define OVM_SET_TYPE(v, t) ((v).type = (t))
+#else
+    #define OVM_SET_TYPE(v, t) ((void) 0)
+#endif
+
 struct ovm_value_t {
+#if defined(OVM_TYPED_VALUES)
     ovm_valtype_t type;
+#endif
     union {
         i8  i8;
         i16 i16;
@@ -109,14 +127,43 @@ void ovm_program_modify_static_int(ovm_program_t *program, int arr, int idx, int
 struct ovm_engine_t {
     ovm_store_t *store;
 
-    pthread_mutex_t atomic_mutex;
-
-    i64   memory_size; // This is probably going to always be 4GiB.
+    i64   memory_size; // The accessible part of `memory`, see OVM_MEMORY_RESERVATION.
     void *memory;
 
     debug_state_t *debug;
+
+    //
+    // When set, the stacks of every state created from this
+    // engine are sampled (see debug_profiler_t).
+    debug_profiler_t *profiler;
+
+    //
+    // Limits for the call stack of every state created from this engine.
+    // They default to OVM_DEFAULT_MAX_CALL_DEPTH and OVM_DEFAULT_VALUE_STACK_SIZE,
+    // and must be set before any state is created.
+    i32 max_call_depth;
+    i64 value_stack_size; // In bytes
+
+    //
+    // Number of calls after which a function is compiled to native code
+    // (see jit.c). Zero disables the JIT. The JIT is never used while a
+    // debugger is attached.
+    i32 jit_threshold;
 };
 
+#define OVM_DEFAULT_MAX_CALL_DEPTH   (1 << 16)
+#define OVM_DEFAULT_VALUE_STACK_SIZE (1ll << 27)
+#define OVM_DEFAULT_JIT_THRESHOLD    1000
+
+//
+// Linear memory never moves. The engine reserves address space for every
+// address an instruction can form (a 32-bit address plus an offset, wrapped
+// to 32 bits) followed by a guard region, but only the first `memory_size`
+// bytes are accessible. Any other access faults, and the fault becomes a
+// trap of the running state, so loads and stores need no bounds checks.
+#define OVM_MEMORY_GUARD_SIZE  (1ll << 16)
+#define OVM_MEMORY_RESERVATION ((1ll << 32) + OVM_MEMORY_GUARD_SIZE)
+
 ovm_engine_t *ovm_engine_new(ovm_store_t *store);
 void          ovm_engine_delete(ovm_engine_t *engine);
 bool          ovm_engine_memory_ensure_capacity(ovm_engine_t *engine, i64 minimum_size);
@@ -124,6 +171,14 @@ void          ovm_engine_memory_copy(ovm_engine_t *engine, i64 target, void *dat
 
 bool ovm_program_load_from_file(ovm_program_t *program, ovm_engine_t *engine, char *filename);
 
+//
+// A built program can be saved to a file, and loaded back much faster than it
+// can be built again. `key` identifies what the program was built from, such
+// as a hash of a WASM binary. Loading fails if the file was saved with another
+// key or by another build of OVM. `program` must be empty when loading.
+bool ovm_program_save_to_cache(ovm_program_t *program, char *filename, u64 key);
+bool ovm_program_load_from_cache(ovm_program_t *program, char *filename, u64 key);
+
 //
 // Represents ephemeral state / execution context.
 // If multiple threads are used, multiple states are needed.
@@ -138,9 +193,20 @@ struct ovm_state_t {
 
     i32 pc;
     i32 value_number_offset;
-    
-    bh_arr(ovm_value_t) numbered_values;
-    bh_arr(ovm_stack_frame_t) stack_frames;
+
+    //
+    // The value stack and the frame stack are reserved up front (see
+    // ovm_state_new), each followed by a guard page, so calls and returns
+    // only move the top of the stacks and never reallocate. Running out of
+    // either stack traps with "call stack exhausted".
+    ovm_value_t *numbered_values;
+    i32          value_stack_top;
+    i32          value_stack_capacity;
+
+    ovm_stack_frame_t *stack_frames;
+    i32                stack_frame_count;
+    i32                stack_frame_capacity;
+
     bh_arr(ovm_value_t) registers;
 
     ovm_value_t *param_buf;
@@ -162,6 +228,16 @@ struct ovm_state_t {
     // TODO Doc
     ovm_value_t *__frame_values;
 
+    //
+    // Set when execution stopped because of a trap. The stack frames are
+    // left as they were when the trap happened, so a trace can be generated;
+    // use ovm_state_unwind to remove them afterwards.
+    const char *trap_message;
+
+    //
+    // Number of JIT compiled functions currently running on the native stack.
+    i32 jit_depth;
+
     debug_thread_state_t *debug;
 };
 
@@ -169,6 +245,7 @@ ovm_state_t *ovm_state_new(ovm_engine_t *engine, ovm_program_t *program);
 void         ovm_state_delete(ovm_state_t *state);
 void ovm_state_link_external_funcs(ovm_program_t *program, ovm_state_t *state, ovm_linkable_func_t *funcs);
 void ovm_state_register_external_func(ovm_state_t *state, i32 idx, void (*func)(void *, ovm_value_t *, ovm_value_t *), void *data);
+void ovm_state_unwind(ovm_state_t *state, i32 frame_count);
 ovm_value_t ovm_state_register_get(ovm_state_t *state, i32 idx);
 void ovm_state_register_set(ovm_state_t *state, i32 idx, ovm_value_t val);
 
@@ -206,6 +283,14 @@ struct ovm_func_t {
         i32 start_instr;
         i32 external_func_idx;
     };
+
+    //
+    // Used by the JIT. `call_count` is not updated atomically, so it is only
+    // an estimate when several threads call the function.
+    u32   call_count;
+    u32   jit_status;
+    void *jit_code;
+    i64   jit_code_size;
 };
 
 struct ovm_external_func_t {
@@ -227,6 +312,34 @@ ovm_value_t ovm_func_call(ovm_engine_t *engine, ovm_state_t *state, ovm_program_
         i32 param_count, ovm_value_t *params);
 ovm_value_t ovm_run_code(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t *program);
 
+//
+// Baseline JIT
+//
+// Functions that are called often enough are translated instruction by
+// instruction into native code. The native code works directly on the value
+// numbers of the function's stack frame, so the JIT and the interpreter can
+// call each other freely. Only x86-64 is supported; elsewhere, and when
+// OVM_TYPED_VALUES is defined, ovm_jit_compile always fails.
+//
+enum ovm_jit_status_t {
+    OVM_JIT_NONE,
+    OVM_JIT_COMPILING,
+    OVM_JIT_READY,
+    OVM_JIT_FAILED,
+};
+
+typedef ovm_value_t (*ovm_jit_entry_t)(ovm_value_t *values, u8 *memory, ovm_state_t *state);
+typedef ovm_value_t (*ovm_instr_step_t)(ovm_instr_t *instr, ovm_state_t *state, ovm_value_t *values, u8 *memory, ovm_instr_t *code);
+
+#define OVM_JIT_MAX_DEPTH 1024
+
+bool ovm_jit_compile(ovm_program_t *program, ovm_func_t *func);
+void ovm_jit_free(ovm_func_t *func);
+
+// These are provided by vm.c for the generated code.
+ovm_instr_step_t ovm_instr_step_handler(u32 full_instr);
+void             ovm_jit_call(ovm_state_t *state, ovm_instr_t *instr);
+
 //
 // Instruction encoding
 //
@@ -349,13 +462,117 @@ struct ovm_instr_t {
 #define OVMI_TRANSMUTE_F32     0x4a   // %r = *(t *) &%a (reinterpret bytes)
 #define OVMI_TRANSMUTE_F64     0x4b   // %r = *(t *) &%a (reinterpret bytes)
 
-#define OVMI_CMPXCHG           0x4c   // %r = %r == %a ? %b : %r 
+#define OVMI_CMPXCHG           0x4c   // %r = mem[%r], mem[%r] = %b if mem[%r] == %a
 
 #define OVMI_BREAK             0x4d
 
 #define OVMI_MEM_SIZE          0x4e   // %r = <size in bytes of memory>
 #define OVMI_MEM_GROW          0x4f   // %r = <grow memory, return new size in bytes>
 
+//
+// Fused instructions ("superinstructions")
+//
+// These are never emitted directly by the code builder. They are produced by
+// ovm_code_builder_fuse_instructions, which rewrites the first instruction of a
+// common pair in place. The second instruction of the pair is left untouched,
+// so instruction indices, branch offsets and debug locations do not change; the
+// fused handler simply skips over it. Primed names (%r', %a', ...) refer to the
+// operands of that second instruction.
+#define OVMI_IMM_ADD           0x50   // %r' = %a' + i/l
+#define OVMI_ADD_LOAD          0x51   // %r' = mem[%a + %b + b']
+#define OVMI_MOV_MOV           0x52   // %r = %a; %r' = %a'
+#define OVMI_BR_LT             0x53   // br pc + r if %a < %b   (r is relative to the second instruction)
+#define OVMI_BR_LT_S           0x54   // br pc + r if %a < %b
+#define OVMI_BR_LE             0x55   // br pc + r if %a <= %b
+#define OVMI_BR_LE_S           0x56   // br pc + r if %a <= %b
+#define OVMI_BR_EQ             0x57   // br pc + r if %a == %b
+#define OVMI_BR_GE             0x58   // br pc + r if %a >= %b
+#define OVMI_BR_GE_S           0x59   // br pc + r if %a >= %b
+#define OVMI_BR_GT             0x5a   // br pc + r if %a > %b
+#define OVMI_BR_GT_S           0x5b   // br pc + r if %a > %b
+#define OVMI_BR_NE             0x5c   // br pc + r if %a != %b
+
+//
+// Atomic memory instructions
+//
+// These are always flagged with OVMI_ATOMIC. The type of the instruction is
+// the width of the memory access, and the value read from memory is always
+// zero-extended into %r.
+#define OVMI_ATOMIC_LOAD       0x5d   // %r = mem[%a + %b]
+#define OVMI_ATOMIC_STORE      0x5e   // mem[%r + %b] = %a
+#define OVMI_ATOMIC_ADD        0x5f   // %r = mem[%a], mem[%a] += %b
+#define OVMI_ATOMIC_SUB        0x60   // %r = mem[%a], mem[%a] -= %b
+#define OVMI_ATOMIC_AND        0x61   // %r = mem[%a], mem[%a] &= %b
+#define OVMI_ATOMIC_OR         0x62   // %r = mem[%a], mem[%a] |= %b
+#define OVMI_ATOMIC_XOR        0x63   // %r = mem[%a], mem[%a] ^= %b
+#define OVMI_ATOMIC_XCHG       0x64   // %r = mem[%a], mem[%a] = %b
+#define OVMI_ATOMIC_WAIT       0x65   // %r = wait(mem[%r], expected %a, timeout %b)
+#define OVMI_ATOMIC_NOTIFY     0x66   // %r = notify(mem[%a], count %b)
+
+//
+// SIMD instructions
+//
+// A v128 value occupies two consecutive value numbers, so %r, %a and %b
+// name the first of the pair whenever they hold a vector. MOV, LOAD, STORE
+// and RETURN handle vectors when typed with OVM_TYPE_V128. For the
+// instructions below, the type of the instruction is the lane shape
+// (OVM_TYPE_I8 is i8x16, ..., OVM_TYPE_F64 is f64x2), or OVM_TYPE_V128 for
+// the bitwise instructions that do not care about lanes. The unsigned and
+// signed variants follow the same convention as the scalar instructions.
+#define OVMI_V_SPLAT           0x67   // %r = (%a, %a, ...)
+#define OVMI_V_EXTRACT         0x68   // %r = %a[b]
+#define OVMI_V_EXTRACT_S       0x69   // %r = %a[b] (sign extended)
+#define OVMI_V_REPLACE         0x6a   // %r[a] = %b
+#define OVMI_V_SWIZZLE         0x6b   // %r = (%a[%b[0]], %a[%b[1]], ...)
+#define OVMI_V_SHUFFLE         0x6c   // %r = (%a ++ %b)[lanes]  (lanes in the `l` of the next two instructions)
+#define OVMI_V_EQ              0x6d   // %r = %a == %b
+#define OVMI_V_NE              0x6e   // %r = %a != %b
+#define OVMI_V_LT              0x6f   // %r = %a < %b
+#define OVMI_V_LT_S            0x70   // %r = %a < %b
+#define OVMI_V_LE              0x71   // %r = %a <= %b
+#define OVMI_V_LE_S            0x72   // %r = %a <= %b
+#define OVMI_V_GT              0x73   // %r = %a > %b
+#define OVMI_V_GT_S            0x74   // %r = %a > %b
+#define OVMI_V_GE              0x75   // %r = %a >= %b
+#define OVMI_V_GE_S            0x76   // %r = %a >= %b
+#define OVMI_V_NOT             0x77   // %r = ~%a
+#define OVMI_V_AND             0x78   // %r = %a & %b
+#define OVMI_V_ANDNOT          0x79   // %r = %a & ~%b
+#define OVMI_V_OR              0x7a   // %r = %a | %b
+#define OVMI_V_XOR             0x7b   // %r = %a ^ %b
+#define OVMI_V_ABS             0x7c   // %r = |%a|
+#define OVMI_V_NEG             0x7d   // %r = -%a
+#define OVMI_V_ANY_TRUE        0x7e   // %r = %a != 0
+#define OVMI_V_ALL_TRUE        0x7f   // %r = every lane of %a != 0
+#define OVMI_V_BITMASK         0x80   // %r = top bit of every lane of %a
+#define OVMI_V_NARROW          0x81   // %r = saturate(%a ++ %b)  (the lanes of %a and %b are twice as wide as t)
+#define OVMI_V_NARROW_S        0x82   // %r = saturate(%a ++ %b)
+#define OVMI_V_WIDEN_LOW       0x83   // %r = extend(low half of %a)  (the lanes of %a are half as wide as t)
+#define OVMI_V_WIDEN_LOW_S     0x84   // %r = extend(low half of %a)
+#define OVMI_V_WIDEN_HIGH      0x85   // %r = extend(high half of %a)
+#define OVMI_V_WIDEN_HIGH_S    0x86   // %r = extend(high half of %a)
+#define OVMI_V_SHL             0x87   // %r = %a << %b
+#define OVMI_V_SHR             0x88   // %r = %a >> %b
+#define OVMI_V_SAR             0x89   // %r = %a >>> %b
+#define OVMI_V_ADD             0x8a   // %r = %a + %b
+#define OVMI_V_SUB             0x8b   // %r = %a - %b
+#define OVMI_V_ADD_SAT         0x8c   // %r = saturate(%a + %b)
+#define OVMI_V_ADD_SAT_S       0x8d   // %r = saturate(%a + %b)
+#define OVMI_V_SUB_SAT         0x8e   // %r = saturate(%a - %b)
+#define OVMI_V_SUB_SAT_S       0x8f   // %r = saturate(%a - %b)
+#define OVMI_V_MUL             0x90   // %r = %a * %b
+#define OVMI_V_MIN             0x91   // %r = min(%a, %b)
+#define OVMI_V_MIN_S           0x92   // %r = min(%a, %b)
+#define OVMI_V_MAX             0x93   // %r = max(%a, %b)
+#define OVMI_V_MAX_S           0x94   // %r = max(%a, %b)
+#define OVMI_V_AVGR            0x95   // %r = (%a + %b + 1) / 2
+#define OVMI_V_SQRT            0x96   // %r = sqrt(%a)
+#define OVMI_V_DIV             0x97   // %r = %a / %b
+#define OVMI_V_TRUNC_SAT       0x98   // %r = saturate((t) %a)  (from the float lanes of the same width)
+#define OVMI_V_TRUNC_SAT_S     0x99   // %r = saturate((t) %a)
+#define OVMI_V_CONVERT         0x9a   // %r = (t) %a  (from the integer lanes of the same width)
+#define OVMI_V_CONVERT_S       0x9b   // %r = (t) %a
+
 //
 // OVM_TYPED_INSTR(OVMI_ADD, OVM_TYPE_I32) == instruction for adding i32s
 //
@@ -15,11 +15,22 @@ typedef enum label_kind_t label_kind_t;
 struct ovm_code_builder_t {
     bh_arr(i32) execution_stack;
 
+    // The first value number after each slot on the execution stack.
+    // Most slots are one value wide, but v128 values take two.
+    bh_arr(i32) execution_stack_ends;
+
     i32 next_label_idx;
     bh_arr(label_target_t) label_stack;
     bh_arr(branch_patch_t) branch_patches;
 
-    i32 param_count, result_count, local_count;
+    // These are counts of value numbers, not WASM locals.
+    i32 param_count, local_count;
+    u32 result_type;
+
+    // Maps a WASM local index to its first value number. This has
+    // one more entry than there are locals, so the width of local
+    // `i` is the difference between entries `i + 1` and `i`.
+    i32 *local_value_numbers;
 
     ovm_program_t *program;
     i32 start_instr;
@@ -59,7 +70,7 @@ struct branch_patch_t {
     bool targets_else;
 };
 
-ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_builder_t *debug, i32 param_count, i32 result_count, i32 local_count);
+ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_builder_t *debug, i32 param_count, i32 local_count, u32 *local_types, u32 result_type);
 label_target_t     ovm_code_builder_wasm_target_idx(ovm_code_builder_t *builder, i32 idx);
 i32                ovm_code_builder_push_label_target(ovm_code_builder_t *builder, label_kind_t kind);
 void               ovm_code_builder_pop_label_target(ovm_code_builder_t *builder);
@@ -74,8 +85,8 @@ void               ovm_code_builder_add_branch(ovm_code_builder_t *builder, i32
 void               ovm_code_builder_add_cond_branch(ovm_code_builder_t *builder, i32 label_idx, bool branch_if_true, bool targets_else);
 void               ovm_code_builder_add_branch_table(ovm_code_builder_t *builder, i32 count, i32 *label_indicies, i32 default_label_idx);
 void               ovm_code_builder_add_return(ovm_code_builder_t *builder);
-void               ovm_code_builder_add_call(ovm_code_builder_t *builder, i32 func_idx, i32 param_count, bool has_return_value);
-void               ovm_code_builder_add_indirect_call(ovm_code_builder_t *builder, i32 param_count, bool has_return_value);
+void               ovm_code_builder_add_call(ovm_code_builder_t *builder, i32 func_idx, i32 param_count, u32 result_type);
+void               ovm_code_builder_add_indirect_call(ovm_code_builder_t *builder, i32 param_count, u32 result_type);
 void               ovm_code_builder_drop_value(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_local_get(ovm_code_builder_t *builder, i32 local_idx);
 void               ovm_code_builder_add_local_set(ovm_code_builder_t *builder, i32 local_idx);
@@ -86,10 +97,19 @@ void               ovm_code_builder_add_load(ovm_code_builder_t *builder, u32 ov
 void               ovm_code_builder_add_store(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
 void               ovm_code_builder_add_atomic_load(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
 void               ovm_code_builder_add_atomic_store(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
+void               ovm_code_builder_add_atomic_rmw(ovm_code_builder_t *builder, u32 instr, u32 ovm_type, i32 offset);
 void               ovm_code_builder_add_cmpxchg(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
+void               ovm_code_builder_add_atomic_wait(ovm_code_builder_t *builder, u32 ovm_type, i32 offset);
 void               ovm_code_builder_add_memory_copy(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_memory_fill(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_memory_size(ovm_code_builder_t *builder);
 void               ovm_code_builder_add_memory_grow(ovm_code_builder_t *builder);
+void               ovm_code_builder_add_simd_binop(ovm_code_builder_t *builder, u32 instr);
+void               ovm_code_builder_add_simd_unop(ovm_code_builder_t *builder, u32 instr);
+void               ovm_code_builder_add_simd_extract_lane(ovm_code_builder_t *builder, u32 instr, i32 lane);
+void               ovm_code_builder_add_simd_replace_lane(ovm_code_builder_t *builder, u32 ovm_type, i32 lane);
+void               ovm_code_builder_add_simd_shuffle(ovm_code_builder_t *builder, u8 *lanes);
+void               ovm_code_builder_add_simd_bitselect(ovm_code_builder_t *builder);
+void               ovm_code_builder_fuse_instructions(ovm_code_builder_t *builder);
 
 #endif
@@ -7,6 +7,7 @@ void debug_info_init(debug_info_t *info) {
     info->alloc = bh_heap_allocator();
     info->has_debug_info = false;
     bh_arr_new(info->alloc, info->funcs, 16);
+    bh_arr_new(info->alloc, info->local_value_numbers, 16);
     bh_arr_new(info->alloc, info->line_info, 1024);
     bh_arr_new(info->alloc, info->instruction_reducer, 4096);
     bh_arr_new(info->alloc, info->files, 16);
@@ -17,6 +18,11 @@ void debug_info_init(debug_info_t *info) {
 
 void debug_info_free(debug_info_t *info) {
     bh_arr_free(info->funcs);
+
+    bh_arr_each(bh_arr(i32), value_numbers, info->local_value_numbers) {
+        if (*value_numbers) bh_arr_free(*value_numbers);
+    }
+    bh_arr_free(info->local_value_numbers);
     bh_arr_free(info->line_info);
     bh_arr_free(info->instruction_reducer);
 
@@ -217,7 +223,7 @@ void debug_info_import_type_info(debug_info_t *info, u8 *data, u32 len) {
 bool debug_info_lookup_location(debug_info_t *info, u32 instruction, debug_loc_info_t *out) {
     if (!info || !info->has_debug_info) return false;
 
-    if (instruction > (u32) bh_arr_length(info->instruction_reducer)) return false;
+    if (instruction >= (u32) bh_arr_length(info->instruction_reducer)) return false;
     i32 loc = info->instruction_reducer[instruction];
     if (loc < 0) return false;
 
@@ -228,7 +234,7 @@ bool debug_info_lookup_location(debug_info_t *info, u32 instruction, debug_loc_i
 bool debug_info_lookup_file(debug_info_t *info, u32 file_id, debug_file_info_t *out) {
     if (!info || !info->has_debug_info) return false;
 
-    if (file_id > (u32) bh_arr_length(info->files)) return false;
+    if (file_id >= (u32) bh_arr_length(info->files)) return false;
     *out = info->files[file_id];
     return true;
 }
@@ -287,10 +293,32 @@ bool debug_info_lookup_file_by_name(debug_info_t *info, char *name, debug_file_i
     return false;
 }
 
+void debug_info_set_local_value_numbers(debug_info_t *info, u32 func_id, u32 local_count, i32 *value_numbers) {
+    bh_arr(i32) copy = NULL;
+    bh_arr_new(info->alloc, copy, local_count);
+    bh_arr_insert_end(copy, local_count);
+    memcpy(copy, value_numbers, local_count * sizeof(i32));
+
+    while ((u32) bh_arr_length(info->local_value_numbers) <= func_id) {
+        bh_arr_push(info->local_value_numbers, NULL);
+    }
+
+    info->local_value_numbers[func_id] = copy;
+}
+
+u32 debug_info_lookup_local_value_number(debug_info_t *info, u32 func_id, u32 local_idx) {
+    if (func_id >= (u32) bh_arr_length(info->local_value_numbers)) return local_idx;
+
+    bh_arr(i32) value_numbers = info->local_value_numbers[func_id];
+    if (!value_numbers || local_idx >= (u32) bh_arr_length(value_numbers)) return local_idx;
+
+    return value_numbers[local_idx];
+}
+
 bool debug_info_lookup_func(debug_info_t *info, u32 func_id, debug_func_info_t *out) {
     if (!info || !info->has_debug_info) return false;
 
-    if (func_id > (u32) bh_arr_length(info->funcs)) return false;
+    if (func_id >= (u32) bh_arr_length(info->funcs)) return false;
     *out = info->funcs[func_id];
     return true;
 }
\ No newline at end of file
@@ -0,0 +1,183 @@
+
+#include "ovm_debug.h"
+#include "vm.h"
+#include "stb_ds.h"
+
+#include <time.h>
+
+//
+// exit() can be called from anywhere in the program, without the engine
+// ever being deleted. The profile is still written when that happens.
+static debug_profiler_t *exiting_profiler = NULL;
+
+static void debug_profiler_stop_at_exit() {
+    if (exiting_profiler) debug_profiler_stop(exiting_profiler);
+}
+
+void debug_profiler_init(debug_profiler_t *profiler, char *output_path) {
+    memset(profiler, 0, sizeof(*profiler));
+    profiler->alloc = bh_heap_allocator();
+    profiler->output_path = output_path;
+    profiler->info = NULL;
+
+    pthread_mutex_init(&profiler->threads_lock, NULL);
+    bh_arr_new(profiler->alloc, profiler->threads, 4);
+
+    bh_buffer_init(&profiler->stack_buffer, profiler->alloc, 1024);
+    sh_new_strdup(profiler->stacks);
+}
+
+void debug_profiler_register_thread(debug_profiler_t *profiler, ovm_state_t *ovm_state) {
+    pthread_mutex_lock(&profiler->threads_lock);
+    bh_arr_push(profiler->threads, ovm_state);
+    pthread_mutex_unlock(&profiler->threads_lock);
+}
+
+void debug_profiler_unregister_thread(debug_profiler_t *profiler, ovm_state_t *ovm_state) {
+    pthread_mutex_lock(&profiler->threads_lock);
+    bh_arr_each(ovm_state_t *, pstate, profiler->threads) {
+        if (*pstate == ovm_state) {
+            bh_arr_fastdelete(profiler->threads, pstate - profiler->threads);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&profiler->threads_lock);
+}
+
+//
+// Names become part of a line in the output, where ';' separates frames.
+static void debug_profiler_append_name(bh_buffer *buffer, char *name) {
+    for (char *c = name; *c; c++) {
+        bh_buffer_write_byte(buffer, *c == ';' ? ':' : *c);
+    }
+}
+
+//
+// `instr` is where the frame's function is currently executing. For every frame but
+// the innermost, that is the return address of the next frame, which is one past the call.
+static void debug_profiler_append_frame(debug_profiler_t *profiler, ovm_func_t *func, i32 instr) {
+    bh_buffer *buffer = &profiler->stack_buffer;
+
+    if (func->kind == OVM_FUNC_EXTERNAL) {
+        debug_profiler_append_name(buffer, func->name);
+        return;
+    }
+
+    debug_func_info_t func_info;
+    if (debug_info_lookup_func(profiler->info, func->id, &func_info) && func_info.name) {
+        debug_profiler_append_name(buffer, func_info.name);
+    } else {
+        debug_profiler_append_name(buffer, func->name);
+    }
+
+    if (instr <= 0) return;
+
+    debug_loc_info_t loc_info;
+    debug_file_info_t file_info;
+    if (!debug_info_lookup_location(profiler->info, instr - 1, &loc_info)) return;
+    if (!debug_info_lookup_file(profiler->info, loc_info.file_id, &file_info)) return;
+
+    char *filename = file_info.name;
+    for (char *c = file_info.name; *c; c++) {
+        if (*c == '/' || *c == '\\') filename = c + 1;
+    }
+
+    bh_buffer_append(buffer, " (", 2);
+    debug_profiler_append_name(buffer, filename);
+
+    char line[16];
+    i32 line_length = snprintf(line, sizeof(line), ":%d)", loc_info.line);
+    bh_buffer_append(buffer, line, line_length);
+}
+
+static void debug_profiler_sample(debug_profiler_t *profiler, ovm_state_t *state) {
+    i32 frame_count = __atomic_load_n(&state->stack_frame_count, __ATOMIC_RELAXED);
+    i32 pc          = __atomic_load_n(&state->pc, __ATOMIC_RELAXED);
+    if (frame_count <= 0) return;
+
+    bh_buffer *buffer = &profiler->stack_buffer;
+    bh_buffer_clear(buffer);
+
+    fori (f, 0, frame_count) {
+        ovm_stack_frame_t *frame = &state->stack_frames[f];
+
+        //
+        // The frame count is incremented before the frame is filled out, so
+        // the innermost frame can be a frame that was never used before.
+        ovm_func_t *func = __atomic_load_n(&frame->func, __ATOMIC_RELAXED);
+        if (!func) return;
+
+        i32 instr = pc;
+        if (f < frame_count - 1) instr = __atomic_load_n(&state->stack_frames[f + 1].return_address, __ATOMIC_RELAXED);
+
+        if (f > 0) bh_buffer_write_byte(buffer, ';');
+        debug_profiler_append_frame(profiler, func, instr);
+    }
+
+    bh_buffer_write_byte(buffer, 0);
+
+    i64 index = shgeti(profiler->stacks, (char *) buffer->data);
+    if (index < 0) {
+        shput(profiler->stacks, (char *) buffer->data, 1);
+    } else {
+        profiler->stacks[index].value += 1;
+    }
+}
+
+static void *debug_profiler_thread_entry(void *data) {
+    debug_profiler_t *profiler = data;
+
+    struct timespec interval;
+    interval.tv_sec  = 0;
+    interval.tv_nsec = DEBUG_PROFILER_SAMPLE_INTERVAL_US * 1000;
+
+    while (__atomic_load_n(&profiler->running, __ATOMIC_ACQUIRE)) {
+        nanosleep(&interval, NULL);
+
+        //
+        // States unregister themselves before they are deleted, so
+        // holding the lock keeps every sampled state alive.
+        pthread_mutex_lock(&profiler->threads_lock);
+        bh_arr_each(ovm_state_t *, pstate, profiler->threads) {
+            debug_profiler_sample(profiler, *pstate);
+        }
+        pthread_mutex_unlock(&profiler->threads_lock);
+    }
+
+    return NULL;
+}
+
+void debug_profiler_start(debug_profiler_t *profiler) {
+    if (profiler->running) return;
+
+    profiler->running = true;
+    pthread_create(&profiler->sample_thread, NULL, debug_profiler_thread_entry, profiler);
+
+    static bool registered_at_exit = false;
+    if (!registered_at_exit) {
+        registered_at_exit = true;
+        atexit(debug_profiler_stop_at_exit);
+    }
+
+    exiting_profiler = profiler;
+}
+
+void debug_profiler_stop(debug_profiler_t *profiler) {
+    if (!__atomic_exchange_n(&profiler->running, false, __ATOMIC_ACQ_REL)) return;
+
+    pthread_join(profiler->sample_thread, NULL);
+
+    if (exiting_profiler == profiler) exiting_profiler = NULL;
+
+    FILE *file = fopen(profiler->output_path, "w");
+    if (!file) {
+        printf("[ERROR] Failed to open '%s' to write the profile.\n", profiler->output_path);
+        return;
+    }
+
+    fori (i, 0, shlen(profiler->stacks)) {
+        fprintf(file, "%s %llu\n", profiler->stacks[i].key, (unsigned long long) profiler->stacks[i].value);
+    }
+
+    fclose(file);
+}
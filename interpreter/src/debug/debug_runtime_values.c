@@ -17,22 +17,43 @@ static char write_buf[4096];
         bh_buffer_append(&builder->output, write_buf, len); \
     } while (0);
 
-static bool lookup_register_in_frame(ovm_state_t *state, ovm_stack_frame_t *frame, u32 reg, ovm_value_t *out) {
+static ovm_value_t lookup_value_number_in_frame(debug_runtime_value_builder_t *builder, u32 value_number) {
+    ovm_state_t *state = builder->ovm_state;
+    ovm_stack_frame_t *frame = builder->ovm_frame;
 
     u32 val_num_base;
-    if (frame == &bh_arr_last(state->stack_frames)) {
+    if (frame == &state->stack_frames[state->stack_frame_count - 1]) {
         val_num_base = state->value_number_offset;
     } else {
         val_num_base = frame->value_number_base;
     }
 
-    *out = state->numbered_values[val_num_base + reg];
+    return state->numbered_values[val_num_base + value_number];
+}
+
+//
+// `reg` is a WASM local index, which is mapped to the value number
+// the local lives in (see debug_info_lookup_local_value_number).
+static bool lookup_register_in_frame(debug_runtime_value_builder_t *builder, u32 reg, ovm_value_t *out) {
+    u32 value_number = debug_info_lookup_local_value_number(builder->info, builder->func_info.func_id, reg);
+    *out = lookup_value_number_in_frame(builder, value_number);
+    return true;
+}
+
+//
+// v128 locals take two consecutive value numbers.
+static bool lookup_vector_in_frame(debug_runtime_value_builder_t *builder, u32 reg, u8 *out) {
+    u32 value_number = debug_info_lookup_local_value_number(builder->info, builder->func_info.func_id, reg);
+    u64 halves[2];
+    halves[0] = lookup_value_number_in_frame(builder, value_number).u64;
+    halves[1] = lookup_value_number_in_frame(builder, value_number + 1).u64;
+    memcpy(out, halves, sizeof(halves));
     return true;
 }
 
 static bool lookup_stack_pointer(debug_runtime_value_builder_t *builder, u32 *out) {
     ovm_value_t stack_ptr;
-    if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->func_info.stack_ptr_idx, &stack_ptr)) {
+    if (!lookup_register_in_frame(builder, builder->func_info.stack_ptr_idx, &stack_ptr)) {
         return false;
     }
 
@@ -42,6 +63,30 @@ static bool lookup_stack_pointer(debug_runtime_value_builder_t *builder, u32 *ou
 
 static void append_slice_from_memory(debug_runtime_value_builder_t *builder, void *elem_data, u32 count, u32 type_id);
 
+//
+// The lane layout of a vector is only known from the name of its type.
+static void append_vector_from_memory(debug_runtime_value_builder_t *builder, void *base, debug_type_info_t *type) {
+    char *name = type->name ? type->name : "";
+
+    WRITE("(");
+    if (!strcmp(name, "i8x16")) {
+        fori (i, 0, 16) { if (i != 0) WRITE(", "); WRITE_FORMAT("%hhd", ((i8 *) base)[i]); }
+    } else if (!strcmp(name, "i16x8")) {
+        fori (i, 0, 8)  { if (i != 0) WRITE(", "); WRITE_FORMAT("%hd", ((i16 *) base)[i]); }
+    } else if (!strcmp(name, "i32x4")) {
+        fori (i, 0, 4)  { if (i != 0) WRITE(", "); WRITE_FORMAT("%d", ((i32 *) base)[i]); }
+    } else if (!strcmp(name, "i64x2")) {
+        fori (i, 0, 2)  { if (i != 0) WRITE(", "); WRITE_FORMAT("%ld", ((i64 *) base)[i]); }
+    } else if (!strcmp(name, "f32x4")) {
+        fori (i, 0, 4)  { if (i != 0) WRITE(", "); WRITE_FORMAT("%f", ((f32 *) base)[i]); }
+    } else if (!strcmp(name, "f64x2")) {
+        fori (i, 0, 2)  { if (i != 0) WRITE(", "); WRITE_FORMAT("%f", ((f64 *) base)[i]); }
+    } else {
+        fori (i, 0, 4)  { if (i != 0) WRITE(" "); WRITE_FORMAT("0x%08x", ((u32 *) base)[i]); }
+    }
+    WRITE(")");
+}
+
 static void append_value_from_memory_with_type(debug_runtime_value_builder_t *builder, void *base, u32 type_id) {
     debug_type_info_t *type = &builder->info->types[type_id];
 
@@ -92,6 +137,10 @@ static void append_value_from_memory_with_type(debug_runtime_value_builder_t *bu
                     break;
                 }
 
+                case debug_type_primitive_kind_vector:
+                    append_vector_from_memory(builder, base, type);
+                    break;
+
                 default:
                     WRITE("(err)");
             }
@@ -333,9 +382,17 @@ static void append_value_from_register(debug_runtime_value_builder_t *builder, u
     ovm_value_t value;
 
     debug_type_info_t *type = &builder->info->types[type_id];
+    if (type->kind == debug_type_kind_primitive && type->primitive.primitive_kind == debug_type_primitive_kind_vector) {
+        u8 vector[16];
+        if (lookup_vector_in_frame(builder, reg, vector)) {
+            append_value_from_memory_with_type(builder, vector, type_id);
+        }
+
+        return;
+    }
     if (type->kind == debug_type_kind_structure) {
         if (!type->structure.simple) {
-            if (lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+            if (lookup_register_in_frame(builder, builder->base_loc, &value)) {
                 void *base = bh_pointer_add(builder->state->ovm_engine->memory, value.u32);
                 append_value_from_memory_with_type(builder, base, type_id);
             }
@@ -350,7 +407,7 @@ static void append_value_from_register(debug_runtime_value_builder_t *builder, u
 
             WRITE_FORMAT("%s=", type->structure.members[i].name);
 
-            if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, reg + i, &value)) {
+            if (!lookup_register_in_frame(builder, reg + i, &value)) {
                 WRITE("(err)")
                 continue;
             }
@@ -366,8 +423,8 @@ static void append_value_from_register(debug_runtime_value_builder_t *builder, u
         ovm_value_t base_reg;
         ovm_value_t count_reg;
 
-        if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, reg, &base_reg)) return;
-        if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, reg + 1, &count_reg)) return;
+        if (!lookup_register_in_frame(builder, reg, &base_reg)) return;
+        if (!lookup_register_in_frame(builder, reg + 1, &count_reg)) return;
 
         void *elem_data = bh_pointer_add(builder->state->ovm_engine->memory, base_reg.u32);
         u32 count = count_reg.u32;
@@ -376,7 +433,7 @@ static void append_value_from_register(debug_runtime_value_builder_t *builder, u
         return;
     }
 
-    if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, reg, &value)) {
+    if (!lookup_register_in_frame(builder, reg, &value)) {
         WRITE("(err)")
         return;
     }
@@ -408,7 +465,7 @@ static u32 get_subvalues_for_type(debug_runtime_value_builder_t *builder, u32 ty
             u32 count = 0;
             if (builder->base_loc_kind == debug_sym_loc_register) {
                 ovm_value_t value;
-                if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc + 1, &value)) {
+                if (!lookup_register_in_frame(builder, builder->base_loc + 1, &value)) {
                     return 0;
                 }
 
@@ -473,7 +530,7 @@ void debug_runtime_value_build_descend(debug_runtime_value_builder_t *builder, u
 
         if (builder->base_loc_kind == debug_sym_loc_register) {
             ovm_value_t value;
-            if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+            if (!lookup_register_in_frame(builder, builder->base_loc, &value)) {
                 goto bad_case;
             }
 
@@ -513,7 +570,7 @@ void debug_runtime_value_build_descend(debug_runtime_value_builder_t *builder, u
 
             } else {
                 ovm_value_t value;
-                if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+                if (!lookup_register_in_frame(builder, builder->base_loc, &value)) {
                     goto bad_case;
                 }
 
@@ -534,7 +591,7 @@ void debug_runtime_value_build_descend(debug_runtime_value_builder_t *builder, u
 
         if (builder->base_loc_kind == debug_sym_loc_register) {
             ovm_value_t value;
-            if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+            if (!lookup_register_in_frame(builder, builder->base_loc, &value)) {
                 goto bad_case;
             }
 
@@ -553,7 +610,7 @@ void debug_runtime_value_build_descend(debug_runtime_value_builder_t *builder, u
 
         if (builder->base_loc_kind == debug_sym_loc_register) {
             ovm_value_t value;
-            if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+            if (!lookup_register_in_frame(builder, builder->base_loc, &value)) {
                 goto bad_case;
             }
 
@@ -607,7 +664,7 @@ bool debug_runtime_value_build_step(debug_runtime_value_builder_t *builder) {
 
         if (builder->base_loc_kind == debug_sym_loc_register) {
             ovm_value_t value;
-            if (lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+            if (lookup_register_in_frame(builder, builder->base_loc, &value)) {
                 builder->it_loc_kind = debug_sym_loc_global;
                 builder->it_loc = value.u32;
             }
@@ -646,7 +703,7 @@ bool debug_runtime_value_build_step(debug_runtime_value_builder_t *builder) {
 
             } else {
                 ovm_value_t value;
-                if (!lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+                if (!lookup_register_in_frame(builder, builder->base_loc, &value)) {
                     return false;
                 }
 
@@ -677,7 +734,7 @@ bool debug_runtime_value_build_step(debug_runtime_value_builder_t *builder) {
 
         if (builder->base_loc_kind == debug_sym_loc_register) {
             ovm_value_t value;
-            if (lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+            if (lookup_register_in_frame(builder, builder->base_loc, &value)) {
                 builder->base_loc_kind = debug_sym_loc_global;
                 builder->base_loc = value.u32 + sub_type->size * builder->it_index;
             }
@@ -705,7 +762,7 @@ bool debug_runtime_value_build_step(debug_runtime_value_builder_t *builder) {
 
         if (builder->base_loc_kind == debug_sym_loc_register) {
             ovm_value_t value;
-            if (lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->base_loc, &value)) {
+            if (lookup_register_in_frame(builder, builder->base_loc, &value)) {
                 builder->it_loc_kind = debug_sym_loc_global;
                 builder->it_loc = value.u32 + sub_type->size * builder->it_index;
             }
@@ -741,7 +798,7 @@ u32 debug_runtime_value_get_it_addr(debug_runtime_value_builder_t *builder) {
 
         if (type->kind == debug_type_kind_slice) {
             ovm_value_t value;
-            if (lookup_register_in_frame(builder->ovm_state, builder->ovm_frame, builder->it_loc, &value)) {
+            if (lookup_register_in_frame(builder, builder->it_loc, &value)) {
                 return value.u32;
             }
         }
@@ -100,7 +100,7 @@ static u32 get_stack_frame_instruction_pointer(debug_state_t *debug, debug_threa
     ovm_func_t *func = frame->func;
 
     u32 instr;
-    if (frame == &bh_arr_last(thread->ovm_state->stack_frames)) {
+    if (frame == &thread->ovm_state->stack_frames[thread->ovm_state->stack_frame_count - 1]) {
         instr = thread->ovm_state->pc;
     } else {
         instr = (frame + 1)->return_address;
@@ -254,7 +254,7 @@ static DEBUG_COMMAND_HANDLER(debug_command_step) {
 
     if (granularity == 3) {
         ON_THREAD(thread_id) {
-            ovm_stack_frame_t *last_frame = &bh_arr_last((*thread)->ovm_state->stack_frames);
+            ovm_stack_frame_t *last_frame = &(*thread)->ovm_state->stack_frames[(*thread)->ovm_state->stack_frame_count - 1];
             (*thread)->pause_at_next_line = true;
             (*thread)->pause_within = last_frame->func->id;
             (*thread)->extra_frames_since_last_pause = 0;
@@ -264,10 +264,10 @@ static DEBUG_COMMAND_HANDLER(debug_command_step) {
 
     if (granularity == 4) {
         ON_THREAD(thread_id) {
-            if (bh_arr_length((*thread)->ovm_state->stack_frames) == 1) {
+            if ((*thread)->ovm_state->stack_frame_count == 1) {
                 (*thread)->pause_within = -1;
             } else {
-                ovm_stack_frame_t *last_frame = &bh_arr_last((*thread)->ovm_state->stack_frames);
+                ovm_stack_frame_t *last_frame = &(*thread)->ovm_state->stack_frames[(*thread)->ovm_state->stack_frame_count - 1];
                 (*thread)->pause_within = (last_frame - 1)->func->id;
             }
 
@@ -297,12 +297,14 @@ static DEBUG_COMMAND_HANDLER(debug_command_trace) {
         return;
     }
 
-    bh_arr(ovm_stack_frame_t) frames = thread->ovm_state->stack_frames;
+    ovm_stack_frame_t *frames = thread->ovm_state->stack_frames;
+    i32 frame_count = thread->ovm_state->stack_frame_count;
 
     send_response_header(debug, msg_id);
-    send_int(debug, bh_arr_length(frames));
+    send_int(debug, frame_count);
 
-    bh_arr_rev_each(ovm_stack_frame_t, frame, frames) {
+    for (i32 i = frame_count - 1; i >= 0; i--) {
+        ovm_stack_frame_t *frame = &frames[i];
         debug_func_info_t func_info;
         debug_file_info_t file_info;
         debug_loc_info_t  loc_info;
@@ -345,12 +347,13 @@ static DEBUG_COMMAND_HANDLER(debug_command_vars) {
         goto vars_error;
     }
 
-    bh_arr(ovm_stack_frame_t) frames = (*thread)->ovm_state->stack_frames;
-    if (stack_frame >= bh_arr_length(frames)) {
+    ovm_stack_frame_t *frames = (*thread)->ovm_state->stack_frames;
+    i32 frame_count = (*thread)->ovm_state->stack_frame_count;
+    if (stack_frame >= frame_count) {
         goto vars_error;
     }
 
-    ovm_stack_frame_t *frame = &frames[bh_arr_length(frames) - 1 - stack_frame];
+    ovm_stack_frame_t *frame = &frames[frame_count - 1 - stack_frame];
 
     debug_func_info_t func_info;
     debug_file_info_t file_info;
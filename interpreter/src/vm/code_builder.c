@@ -4,17 +4,48 @@
 
 // #define BUILDER_DEBUG
 
+#define LAST_VALUE(b) bh_arr_last((b)->execution_stack)
+
+#define IS_TEMPORARY_VALUE(b, r) (r >= (b->param_count + b->local_count))
+
+//
+// Every slot on the execution stack has a fixed value number, which is
+// the first value number after the locals plus the widths of the slots
+// below it. The value in a slot does not always live in that value number
+// however, as `local.get` pushes the local's value number directly (see
+// ovm_code_builder_add_local_get).
+static inline int STACK_SLOT_BASE(ovm_code_builder_t *b, i32 depth) {
+    if (depth == 0) return b->param_count + b->local_count;
+    return b->execution_stack_ends[depth - 1];
+}
+
+static inline int STACK_SLOT_VALUE(ovm_code_builder_t *b, i32 depth) {
+    i32 value = STACK_SLOT_BASE(b, depth);
+    b->highest_value_number = bh_max(b->highest_value_number, value);
+    return value;
+}
+
+static inline int STACK_SLOT_WIDTH(ovm_code_builder_t *b, i32 depth) {
+    return b->execution_stack_ends[depth] - STACK_SLOT_BASE(b, depth);
+}
+
+static inline i32 POP_VALUE(ovm_code_builder_t *b) {
 #if defined(BUILDER_DEBUG)
-    #define POP_VALUE(b)     (bh_arr_length((b)->execution_stack) == 0 ? (assert(("invalid value pop", 0)), 0) : bh_arr_pop((b)->execution_stack))
-#else
-    #define POP_VALUE(b) bh_arr_pop((b)->execution_stack)
+    assert(("invalid value pop", bh_arr_length(b->execution_stack) > 0));
 #endif
 
-#define PUSH_VALUE(b, r) (bh_arr_push((b)->execution_stack, r))
+    bh_arr_set_length(b->execution_stack_ends, bh_arr_length(b->execution_stack_ends) - 1);
+    return bh_arr_pop(b->execution_stack);
+}
 
-#define LAST_VALUE(b) bh_arr_last((b)->execution_stack)
+static inline void PUSH_VALUE_WITH_WIDTH(ovm_code_builder_t *b, i32 r, i32 width) {
+    i32 end = STACK_SLOT_BASE(b, bh_arr_length(b->execution_stack)) + width;
+    bh_arr_push(b->execution_stack, r);
+    bh_arr_push(b->execution_stack_ends, end);
+}
 
-#define IS_TEMPORARY_VALUE(b, r) (r >= (b->param_count + b->local_count))
+#define PUSH_VALUE(b, r)      PUSH_VALUE_WITH_WIDTH(b, r, 1)
+#define PUSH_WIDE_VALUE(b, r) PUSH_VALUE_WITH_WIDTH(b, r, 2)
 
 static inline int NEXT_VALUE(ovm_code_builder_t *b) {
 #if defined(BUILDER_DEBUG)
@@ -22,25 +53,70 @@ static inline int NEXT_VALUE(ovm_code_builder_t *b) {
     return b->highest_value_number - 1;
 
 #else
-    if (bh_arr_length(b->execution_stack) == 0) {
-        return b->param_count + b->local_count;
-    }
-    
-    b->highest_value_number = bh_max(b->highest_value_number, bh_arr_last(b->execution_stack) + 1);
-    return bh_arr_last(b->execution_stack) + 1;
+    return STACK_SLOT_VALUE(b, bh_arr_length(b->execution_stack));
+#endif
+}
+
+//
+// A v128 value occupies the value number returned and the one after it.
+static inline int NEXT_WIDE_VALUE(ovm_code_builder_t *b) {
+#if defined(BUILDER_DEBUG)
+    b->highest_value_number += 2;
+    return b->highest_value_number - 2;
+
+#else
+    i32 value = NEXT_VALUE(b);
+    b->highest_value_number = bh_max(b->highest_value_number, value + 1);
+    return value;
 #endif
 }
 
-ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_builder_t *debug, i32 param_count, i32 result_count, i32 local_count) {
+//
+// A value number above the top of the execution stack that an instruction
+// sequence can use for an intermediate result. All of the `n` slots above
+// the top are assumed to be one value wide. The frame is grown to include it.
+static inline int SCRATCH_VALUE(ovm_code_builder_t *b, i32 n) {
+    i32 value = STACK_SLOT_VALUE(b, bh_arr_length(b->execution_stack)) + n;
+    b->highest_value_number = bh_max(b->highest_value_number, value + 1);
+    return value;
+}
+
+static inline int LOCAL_VALUE(ovm_code_builder_t *b, i32 local_idx) {
+    return b->local_value_numbers[local_idx];
+}
+
+static inline int LOCAL_WIDTH(ovm_code_builder_t *b, i32 local_idx) {
+    return b->local_value_numbers[local_idx + 1] - b->local_value_numbers[local_idx];
+}
+
+static inline u32 MOV_TYPE_FOR_WIDTH(i32 width) {
+    return width == 2 ? OVM_TYPE_V128 : OVM_TYPE_NONE;
+}
+
+ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_builder_t *debug, i32 param_count, i32 local_count, u32 *local_types, u32 result_type) {
     ovm_code_builder_t builder;
-    builder.param_count = param_count;
-    builder.result_count = result_count;
-    builder.local_count = local_count;
+    builder.result_type = result_type;
     builder.start_instr = bh_arr_length(program->code);
     builder.program = program;
 
+    //
+    // Locals are laid out in order, with the params first. Every local
+    // takes one value number, except for v128 locals which take two.
+    builder.local_value_numbers = bh_alloc_array(bh_heap_allocator(), i32, param_count + local_count + 1);
+    i32 value_number = 0;
+    fori (i, 0, param_count + local_count) {
+        builder.local_value_numbers[i] = value_number;
+        value_number += local_types[i] == OVM_TYPE_V128 ? 2 : 1;
+    }
+
+    builder.local_value_numbers[param_count + local_count] = value_number;
+    builder.param_count = builder.local_value_numbers[param_count];
+    builder.local_count = value_number - builder.param_count;
+
     builder.execution_stack = NULL;
+    builder.execution_stack_ends = NULL;
     bh_arr_new(bh_heap_allocator(), builder.execution_stack, 32);
+    bh_arr_new(bh_heap_allocator(), builder.execution_stack_ends, 32);
 
     builder.next_label_idx = 0;
     builder.label_stack = NULL;
@@ -48,7 +124,7 @@ ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_build
     bh_arr_new(bh_heap_allocator(), builder.label_stack, 32);
     bh_arr_new(bh_heap_allocator(), builder.branch_patches, 32);
 
-    builder.highest_value_number = param_count + local_count;
+    builder.highest_value_number = value_number;
 
     builder.debug_builder = debug;
 
@@ -57,8 +133,10 @@ ovm_code_builder_t ovm_code_builder_new(ovm_program_t *program, debug_info_build
 
 void ovm_code_builder_free(ovm_code_builder_t *builder) {
     bh_arr_free(builder->execution_stack);
+    bh_arr_free(builder->execution_stack_ends);
     bh_arr_free(builder->label_stack);
     bh_arr_free(builder->branch_patches);
+    bh_free(bh_heap_allocator(), builder->local_value_numbers);
 }
 
 label_target_t ovm_code_builder_wasm_target_idx(ovm_code_builder_t *builder, i32 idx) {
@@ -67,7 +145,39 @@ label_target_t ovm_code_builder_wasm_target_idx(ovm_code_builder_t *builder, i32
     return builder->label_stack[walker];
 }
 
+//
+// Copies any value on the execution stack that refers directly to a local
+// into the value number of its stack slot. This has to happen before the
+// local is overwritten, and before any control flow is entered, because
+// the value that was pushed has to stay the same on every path.
+// A local_idx of -1 materializes every local in the bottom `depth` slots.
+static void ovm_code_builder_materialize_locals(ovm_code_builder_t *builder, i32 local_idx, i32 depth) {
+    fori (i, 0, depth) {
+        i32 value = builder->execution_stack[i];
+        if (IS_TEMPORARY_VALUE(builder, value)) continue;
+        if (local_idx >= 0 && value != LOCAL_VALUE(builder, local_idx)) continue;
+
+        ovm_instr_t instr = {0};
+        instr.full_instr = OVM_TYPED_INSTR(OVMI_MOV, MOV_TYPE_FOR_WIDTH(STACK_SLOT_WIDTH(builder, i)));
+        instr.r = STACK_SLOT_VALUE(builder, i);
+        instr.a = value;
+
+        debug_info_builder_emit_location(builder->debug_builder);
+        ovm_program_add_instructions(builder->program, 1, &instr);
+
+        builder->execution_stack[i] = instr.r;
+    }
+}
+
 i32 ovm_code_builder_push_label_target(ovm_code_builder_t *builder, label_kind_t kind) {
+    //
+    // The condition of an `if` is consumed by the branch that immediately
+    // follows, so it does not need to be materialized.
+    i32 depth = bh_arr_length(builder->execution_stack);
+    if (kind == label_kind_if) depth -= 1;
+
+    ovm_code_builder_materialize_locals(builder, -1, depth);
+
     label_target_t target;
     target.kind = kind;
     target.idx = builder->next_label_idx++;
@@ -177,6 +287,25 @@ void ovm_code_builder_add_binop(ovm_code_builder_t *builder, u32 instr) {
 }
 
 void ovm_code_builder_add_imm(ovm_code_builder_t *builder, u32 ovm_type, void *imm) {
+    //
+    // A v128 constant is loaded as two 64-bit halves.
+    if (ovm_type == OVM_TYPE_V128) {
+        ovm_instr_t imm_instrs[2] = {0};
+        imm_instrs[0].full_instr = OVM_TYPED_INSTR(OVMI_IMM, OVM_TYPE_I64);
+        imm_instrs[0].r = NEXT_WIDE_VALUE(builder);
+        memcpy(&imm_instrs[0].l, (u8 *) imm, 8);
+
+        imm_instrs[1].full_instr = OVM_TYPED_INSTR(OVMI_IMM, OVM_TYPE_I64);
+        imm_instrs[1].r = imm_instrs[0].r + 1;
+        memcpy(&imm_instrs[1].l, (u8 *) imm + 8, 8);
+
+        debug_info_builder_emit_location(builder->debug_builder);
+        debug_info_builder_emit_location(builder->debug_builder);
+        ovm_program_add_instructions(builder->program, 2, imm_instrs);
+        PUSH_WIDE_VALUE(builder, imm_instrs[0].r);
+        return;
+    }
+
     ovm_instr_t imm_instr = {0};
     imm_instr.full_instr = OVM_TYPED_INSTR(OVMI_IMM, ovm_type);
     imm_instr.r = NEXT_VALUE(builder);
@@ -313,9 +442,12 @@ void ovm_code_builder_add_branch_table(ovm_code_builder_t *builder, i32 count, i
 void ovm_code_builder_add_return(ovm_code_builder_t *builder) {
     ovm_instr_t instr = {0};
     instr.full_instr = OVM_TYPED_INSTR(OVMI_RETURN, OVM_TYPE_NONE);
+    if (builder->result_type == OVM_TYPE_V128) {
+        instr.full_instr = OVM_TYPED_INSTR(OVMI_RETURN, OVM_TYPE_V128);
+    }
 
     i32 values_on_stack = bh_arr_length(builder->execution_stack);
-    if (values_on_stack > 0 && builder->result_count > 0) {
+    if (values_on_stack > 0 && builder->result_type != OVM_TYPE_NONE) {
         instr.a = POP_VALUE(builder);
     }
 
@@ -323,24 +455,31 @@ void ovm_code_builder_add_return(ovm_code_builder_t *builder) {
     ovm_program_add_instructions(builder->program, 1, &instr);
 }
 
+//
+// A v128 param is passed as two consecutive params, so it ends up in two
+// consecutive value numbers in the callee.
 static void ovm_code_builder_add_params(ovm_code_builder_t *builder, i32 param_count) {
     i32 *flipped_params = alloca(param_count * sizeof(i32));
+    i32 *flipped_widths = alloca(param_count * sizeof(i32));
 
     fori (i, 0, param_count) {
+        flipped_widths[i] = STACK_SLOT_WIDTH(builder, bh_arr_length(builder->execution_stack) - 1);
         flipped_params[i] = POP_VALUE(builder);
     }
 
     fori (i, 0, param_count) {
-        ovm_instr_t param_instr = {0};
-        param_instr.full_instr = OVM_TYPED_INSTR(OVMI_PARAM, OVM_TYPE_NONE);
-        param_instr.a = flipped_params[param_count - 1 - i];
+        fori (j, 0, flipped_widths[param_count - 1 - i]) {
+            ovm_instr_t param_instr = {0};
+            param_instr.full_instr = OVM_TYPED_INSTR(OVMI_PARAM, OVM_TYPE_NONE);
+            param_instr.a = flipped_params[param_count - 1 - i] + j;
 
-        debug_info_builder_emit_location(builder->debug_builder);
-        ovm_program_add_instructions(builder->program, 1, &param_instr);
+            debug_info_builder_emit_location(builder->debug_builder);
+            ovm_program_add_instructions(builder->program, 1, &param_instr);
+        }
     }
 }
 
-void ovm_code_builder_add_call(ovm_code_builder_t *builder, i32 func_idx, i32 param_count, bool has_return_value) {
+void ovm_code_builder_add_call(ovm_code_builder_t *builder, i32 func_idx, i32 param_count, u32 result_type) {
     ovm_code_builder_add_params(builder, param_count);
 
     ovm_instr_t call_instr = {0};
@@ -348,19 +487,23 @@ void ovm_code_builder_add_call(ovm_code_builder_t *builder, i32 func_idx, i32 pa
     call_instr.a = func_idx;
     call_instr.r = -1;
 
-    if (has_return_value) {
+    if (result_type == OVM_TYPE_V128) {
+        call_instr.r = NEXT_WIDE_VALUE(builder);
+    } else if (result_type != OVM_TYPE_NONE) {
         call_instr.r = NEXT_VALUE(builder);
     }
 
     debug_info_builder_emit_location(builder->debug_builder);
     ovm_program_add_instructions(builder->program, 1, &call_instr);
 
-    if (has_return_value) {
+    if (result_type == OVM_TYPE_V128) {
+        PUSH_WIDE_VALUE(builder, call_instr.r);
+    } else if (result_type != OVM_TYPE_NONE) {
         PUSH_VALUE(builder, call_instr.r);
     }
 }
 
-void ovm_code_builder_add_indirect_call(ovm_code_builder_t *builder, i32 param_count, bool has_return_value) {
+void ovm_code_builder_add_indirect_call(ovm_code_builder_t *builder, i32 param_count, u32 result_type) {
     ovm_instr_t call_instrs[2] = {0};
 
     // idxarr %k, table, %j
@@ -375,7 +518,9 @@ void ovm_code_builder_add_indirect_call(ovm_code_builder_t *builder, i32 param_c
 
     ovm_code_builder_add_params(builder, param_count);
 
-    if (has_return_value) {
+    if (result_type == OVM_TYPE_V128) {
+        call_instrs[1].r = NEXT_WIDE_VALUE(builder);
+    } else if (result_type != OVM_TYPE_NONE) {
         call_instrs[1].r = NEXT_VALUE(builder);
     }
 
@@ -383,7 +528,9 @@ void ovm_code_builder_add_indirect_call(ovm_code_builder_t *builder, i32 param_c
     debug_info_builder_emit_location(builder->debug_builder);
     ovm_program_add_instructions(builder->program, 2, call_instrs);
 
-    if (has_return_value) {
+    if (result_type == OVM_TYPE_V128) {
+        PUSH_WIDE_VALUE(builder, call_instrs[1].r);
+    } else if (result_type != OVM_TYPE_NONE) {
         PUSH_VALUE(builder, call_instrs[1].r);
     }
 }
@@ -393,71 +540,106 @@ void ovm_code_builder_drop_value(ovm_code_builder_t *builder) {
 }
 
 void ovm_code_builder_add_local_get(ovm_code_builder_t *builder, i32 local_idx) {
-    ovm_instr_t instr = {0};
-    instr.full_instr = OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_NONE);
-    instr.r = NEXT_VALUE(builder);
-    instr.a = local_idx; // This makes the assumption that the params will be in
-                         // the lower "address space" of the value numbers. This
-                         // will be true for web assembly, because that's how it
-                         // it was spec'd; but in the future for other things,
-                         // this will be incorrect.
+    //
+    // No instruction is emitted for a `local.get`. Instead, the local's value
+    // number is pushed directly, and instructions consuming it read the local
+    // itself. This makes the assumption that the params will be in the lower
+    // "address space" of the value numbers. This will be true for web assembly,
+    // because that's how it was spec'd; but in the future for other things,
+    // this will be incorrect.
+    PUSH_VALUE_WITH_WIDTH(builder, LOCAL_VALUE(builder, local_idx), LOCAL_WIDTH(builder, local_idx));
+}
 
-    debug_info_builder_emit_location(builder->debug_builder);
-    ovm_program_add_instructions(builder->program, 1, &instr);
+//
+// Determines if the result of an instruction can be written to a different
+// value number without changing anything else about the instruction.
+static bool instr_only_writes_result(ovm_instr_t *instr) {
+    if (instr->full_instr & OVMI_ATOMIC) return false;
+
+    u32 op = OVM_INSTR_INSTR(*instr);
+    switch (op) {
+        case OVMI_IMM:
+        case OVMI_MOV:
+        case OVMI_LOAD:
+        case OVMI_REG_GET:
+        case OVMI_IDX_ARR:
+        case OVMI_MEM_SIZE:
+        case OVMI_MEM_GROW:
+            return true;
+
+        case OVMI_CALL:
+        case OVMI_CALLI:
+            return instr->r >= 0;
+
+        //
+        // These read the result value number, or have data stored after them.
+        case OVMI_V_REPLACE:
+        case OVMI_V_SHUFFLE:
+            return false;
+    }
 
-    PUSH_VALUE(builder, instr.r);
+    return (op >= OVMI_ADD && op <= OVMI_SAR)
+        || (op >= OVMI_LT && op <= OVMI_NE)
+        || (op >= OVMI_CLZ && op <= OVMI_TRANSMUTE_F64)
+        || (op >= OVMI_V_SPLAT && op <= OVMI_V_CONVERT_S);
 }
 
-void ovm_code_builder_add_local_set(ovm_code_builder_t *builder, i32 local_idx) {
-    // :PrimitiveOptimization
-    // Perform a simple optimization that an immediate temporary moved to
-    // a local can be optimized as an immediate loaded directly to a local.
-    {
-        ovm_instr_t *last_instr = &bh_arr_last(builder->program->code);
-        if (OVM_INSTR_INSTR(*last_instr) == OVMI_IMM) {
-            if (IS_TEMPORARY_VALUE(builder, last_instr->r) && last_instr->r == LAST_VALUE(builder)) {
-                last_instr->r = local_idx;
-                POP_VALUE(builder);
-                return;
-            }
-        }
+//
+// :PrimitiveOptimization
+// If the value being stored in a local was just computed into a temporary,
+// retarget the instruction that computed it to write into the local instead
+// of emitting a MOV. This is safe because the temporary is consumed here and
+// never read again, and because blocks do not produce values, no branch can
+// land between the producing instruction and this point.
+static bool ovm_code_builder_retarget_last_value(ovm_code_builder_t *builder, i32 local_idx) {
+    if (bh_arr_length(builder->program->code) <= builder->start_instr) return false;
 
-        if (OVM_INSTR_INSTR(*last_instr) == OVMI_REG_GET) {
-            if (IS_TEMPORARY_VALUE(builder, last_instr->r) && last_instr->r == LAST_VALUE(builder)) {
-                last_instr->r = local_idx;
-                POP_VALUE(builder);
-                return;
-            }
-        }
-    }
+    i32 local_value = LOCAL_VALUE(builder, local_idx);
 
-    ovm_instr_t instr = {0};
-    instr.full_instr = OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_NONE);
-    instr.r = local_idx; // This makes the assumption that the params will be in
-                         // the lower "address space" of the value numbers. This
-                         // will be true for web assembly, because that's how it
-                         // it was spec'd; but in the future for other things,
-                         // this will be incorrect.
-    instr.a = POP_VALUE(builder);
+    ovm_instr_t *last_instr = &bh_arr_last(builder->program->code);
+    if (!instr_only_writes_result(last_instr)) return false;
+    if (!IS_TEMPORARY_VALUE(builder, last_instr->r) || last_instr->r != LAST_VALUE(builder)) return false;
 
-    debug_info_builder_emit_location(builder->debug_builder);
-    ovm_program_add_instructions(builder->program, 1, &instr);
+    //
+    // If the local is still on the stack somewhere, its old value has to be
+    // copied out before it is overwritten. That copy would need to happen
+    // before the last instruction, so the MOV is necessary in that case.
+    bh_arr_each(i32, value, builder->execution_stack) {
+        if (*value == local_value) return false;
+    }
+
+    last_instr->r = local_value;
+    return true;
 }
 
-void ovm_code_builder_add_local_tee(ovm_code_builder_t *builder, i32 local_idx) {
+void ovm_code_builder_add_local_set(ovm_code_builder_t *builder, i32 local_idx) {
+    if (ovm_code_builder_retarget_last_value(builder, local_idx)) {
+        POP_VALUE(builder);
+        return;
+    }
+
+    i32 value = POP_VALUE(builder);
+    ovm_code_builder_materialize_locals(builder, local_idx, bh_arr_length(builder->execution_stack));
+
+    i32 local_value = LOCAL_VALUE(builder, local_idx);
+    if (value == local_value) return;
+
     ovm_instr_t instr = {0};
-    instr.full_instr = OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_NONE);
-    instr.r = local_idx; // This makes the assumption that the params will be in
-                         // the lower "address space" of the value numbers. This
-                         // will be true for web assembly, because that's how it
-                         // it was spec'd; but in the future for other things,
-                         // this will be incorrect.
-    instr.a = POP_VALUE(builder);
+    instr.full_instr = OVM_TYPED_INSTR(OVMI_MOV, MOV_TYPE_FOR_WIDTH(LOCAL_WIDTH(builder, local_idx)));
+    instr.r = local_value;
+    instr.a = value;
 
     debug_info_builder_emit_location(builder->debug_builder);
     ovm_program_add_instructions(builder->program, 1, &instr);
+}
 
-    PUSH_VALUE(builder, instr.a);
+void ovm_code_builder_add_local_tee(ovm_code_builder_t *builder, i32 local_idx) {
+    //
+    // The value left on the stack is the local itself. If the local is
+    // set again while the value is still on the stack, it will be copied
+    // out first by ovm_code_builder_materialize_locals.
+    ovm_code_builder_add_local_set(builder, local_idx);
+    PUSH_VALUE_WITH_WIDTH(builder, LOCAL_VALUE(builder, local_idx), LOCAL_WIDTH(builder, local_idx));
 }
 
 void ovm_code_builder_add_register_get(ovm_code_builder_t *builder, i32 reg_idx) {
@@ -476,7 +658,7 @@ void ovm_code_builder_add_register_set(ovm_code_builder_t *builder, i32 reg_idx)
     // :PrimitiveOptimization
     {
         ovm_instr_t *last_instr = &bh_arr_last(builder->program->code);
-        if (OVM_INSTR_INSTR(*last_instr) == OVMI_MOV) {
+        if (last_instr->full_instr == OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_NONE)) {
             if (IS_TEMPORARY_VALUE(builder, last_instr->r) && last_instr->r == LAST_VALUE(builder)) {
                 
                 last_instr->full_instr = OVM_TYPED_INSTR(OVMI_REG_SET, OVM_TYPE_NONE);
@@ -502,12 +684,17 @@ void ovm_code_builder_add_load(ovm_code_builder_t *builder, u32 ovm_type, i32 of
     load_instr.full_instr = OVM_TYPED_INSTR(OVMI_LOAD, ovm_type);
     load_instr.b = offset;
     load_instr.a = POP_VALUE(builder);
-    load_instr.r = NEXT_VALUE(builder);
+
+    if (ovm_type == OVM_TYPE_V128) {
+        load_instr.r = NEXT_WIDE_VALUE(builder);
+        PUSH_WIDE_VALUE(builder, load_instr.r);
+    } else {
+        load_instr.r = NEXT_VALUE(builder);
+        PUSH_VALUE(builder, load_instr.r);
+    }
 
     debug_info_builder_emit_location(builder->debug_builder);
     ovm_program_add_instructions(builder->program, 1, &load_instr);
-
-    PUSH_VALUE(builder, load_instr.r);
 }
 
 void ovm_code_builder_add_store(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
@@ -522,42 +709,58 @@ void ovm_code_builder_add_store(ovm_code_builder_t *builder, u32 ovm_type, i32 o
     return;
 }
 
-void ovm_code_builder_add_cmpxchg(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
+//
+// Used for `cmpxchg` and `wait`, which both take three operands.
+static void ovm_code_builder_add_atomic_with_address_result(ovm_code_builder_t *builder, u32 instr, u32 ovm_type, i32 offset) {
+    //
+    // The address operand of these instructions is also where the result is written,
+    // so the address is always computed into the stack slot the result will
+    // occupy. This also keeps a `local.get` address from being overwritten.
+    i32 value_reg    = POP_VALUE(builder);
+    i32 expected_reg = POP_VALUE(builder);
+    i32 addr_reg     = POP_VALUE(builder);
+    i32 result_reg   = NEXT_VALUE(builder);
+
     if (offset == 0) {
-        ovm_instr_t cmpxchg_instr = {0};
-        cmpxchg_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_CMPXCHG, ovm_type);
-        cmpxchg_instr.b = POP_VALUE(builder);
-        cmpxchg_instr.a = POP_VALUE(builder);
-        cmpxchg_instr.r = POP_VALUE(builder);
+        if (addr_reg != result_reg) {
+            ovm_instr_t mov_instr = {0};
+            mov_instr.full_instr = OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_NONE);
+            mov_instr.r = result_reg;
+            mov_instr.a = addr_reg;
+
+            debug_info_builder_emit_location(builder->debug_builder);
+            ovm_program_add_instructions(builder->program, 1, &mov_instr);
+        }
+
+        ovm_instr_t atomic_instr = {0};
+        atomic_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(instr, ovm_type);
+        atomic_instr.r = result_reg;
+        atomic_instr.a = expected_reg;
+        atomic_instr.b = value_reg;
 
         debug_info_builder_emit_location(builder->debug_builder);
-        ovm_program_add_instructions(builder->program, 1, &cmpxchg_instr);
+        ovm_program_add_instructions(builder->program, 1, &atomic_instr);
 
-        PUSH_VALUE(builder, cmpxchg_instr.r);
+        PUSH_VALUE(builder, atomic_instr.r);
         return;
     }
-    
-    // TODO: explain the ordering here.
 
     ovm_instr_t instrs[3] = {0};
     // imm.i32 %n, offset
+    // The slot above the three operands is free to use.
     instrs[0].full_instr = OVM_TYPED_INSTR(OVMI_IMM, OVM_TYPE_I32);
     instrs[0].i = offset;
-    instrs[0].r = NEXT_VALUE(builder);
+    instrs[0].r = SCRATCH_VALUE(builder, 3);
 
-    int value_reg = POP_VALUE(builder);
-    int expected_reg = POP_VALUE(builder);
-    int addr_reg = POP_VALUE(builder);
-
-    // add.i32 %n, %n, %i
+    // add.i32 %m, %addr, %n
     instrs[1].full_instr = OVM_TYPED_INSTR(OVMI_ADD, OVM_TYPE_I32);
-    instrs[1].r = instrs[0].r;
+    instrs[1].r = result_reg;
     instrs[1].a = addr_reg;
     instrs[1].b = instrs[0].r;
 
-    // cmpxchg.x %m, %n
-    instrs[2].full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_CMPXCHG, ovm_type);
-    instrs[2].r = instrs[1].r;
+    // cmpxchg.x %m, %expected, %value   (or wait.x %m, %expected, %timeout)
+    instrs[2].full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(instr, ovm_type);
+    instrs[2].r = result_reg;
     instrs[2].a = expected_reg;
     instrs[2].b = value_reg;
 
@@ -569,6 +772,14 @@ void ovm_code_builder_add_cmpxchg(ovm_code_builder_t *builder, u32 ovm_type, i32
     PUSH_VALUE(builder, instrs[2].r);
 }
 
+void ovm_code_builder_add_cmpxchg(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
+    ovm_code_builder_add_atomic_with_address_result(builder, OVMI_CMPXCHG, ovm_type, offset);
+}
+
+void ovm_code_builder_add_atomic_wait(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
+    ovm_code_builder_add_atomic_with_address_result(builder, OVMI_ATOMIC_WAIT, ovm_type, offset);
+}
+
 void ovm_code_builder_add_memory_size(ovm_code_builder_t *builder) {
     ovm_instr_t instr = {0};
     instr.full_instr = OVM_TYPED_INSTR(OVMI_MEM_SIZE, OVM_TYPE_NONE);
@@ -618,7 +829,7 @@ void ovm_code_builder_add_memory_fill(ovm_code_builder_t *builder) {
 // CopyNPaste from _add_load
 void ovm_code_builder_add_atomic_load(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
     ovm_instr_t load_instr = {0};
-    load_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_LOAD, ovm_type);
+    load_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_ATOMIC_LOAD, ovm_type);
     load_instr.b = offset;
     load_instr.a = POP_VALUE(builder);
     load_instr.r = NEXT_VALUE(builder);
@@ -633,7 +844,7 @@ void ovm_code_builder_add_atomic_load(ovm_code_builder_t *builder, u32 ovm_type,
 // CopyNPaste from _add_store
 void ovm_code_builder_add_atomic_store(ovm_code_builder_t *builder, u32 ovm_type, i32 offset) {
     ovm_instr_t store_instr = {0};
-    store_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_STORE, ovm_type);
+    store_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(OVMI_ATOMIC_STORE, ovm_type);
     store_instr.b = offset;
     store_instr.a = POP_VALUE(builder);
     store_instr.r = POP_VALUE(builder);
@@ -641,3 +852,312 @@ void ovm_code_builder_add_atomic_store(ovm_code_builder_t *builder, u32 ovm_type
     debug_info_builder_emit_location(builder->debug_builder);
     ovm_program_add_instructions(builder->program, 1, &store_instr);
 }
+
+void ovm_code_builder_add_atomic_rmw(ovm_code_builder_t *builder, u32 instr, u32 ovm_type, i32 offset) {
+    i32 value_reg  = POP_VALUE(builder);
+    i32 addr_reg   = POP_VALUE(builder);
+    i32 result_reg = NEXT_VALUE(builder);
+
+    //
+    // The RMW instructions do not take an offset, so it is added to the
+    // address first, in the slot above the two operands.
+    if (offset != 0) {
+        i32 effective_addr_reg = SCRATCH_VALUE(builder, 2);
+
+        ovm_instr_t instrs[2] = {0};
+        // imm.i32 %n, offset
+        instrs[0].full_instr = OVM_TYPED_INSTR(OVMI_IMM, OVM_TYPE_I32);
+        instrs[0].i = offset;
+        instrs[0].r = effective_addr_reg;
+
+        // add.i32 %n, %addr, %n
+        instrs[1].full_instr = OVM_TYPED_INSTR(OVMI_ADD, OVM_TYPE_I32);
+        instrs[1].r = effective_addr_reg;
+        instrs[1].a = addr_reg;
+        instrs[1].b = effective_addr_reg;
+
+        debug_info_builder_emit_location(builder->debug_builder);
+        debug_info_builder_emit_location(builder->debug_builder);
+        ovm_program_add_instructions(builder->program, 2, instrs);
+
+        addr_reg = effective_addr_reg;
+    }
+
+    ovm_instr_t rmw_instr = {0};
+    rmw_instr.full_instr = OVMI_ATOMIC | OVM_TYPED_INSTR(instr, ovm_type);
+    rmw_instr.r = result_reg;
+    rmw_instr.a = addr_reg;
+    rmw_instr.b = value_reg;
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &rmw_instr);
+
+    PUSH_VALUE(builder, rmw_instr.r);
+}
+
+//
+// SIMD
+//
+// v128 values take two value numbers, so everything that produces one
+// reserves a wide slot on the execution stack. Instructions that reduce a
+// vector to a scalar (any_true, bitmask, ...) go through add_unop.
+//
+
+void ovm_code_builder_add_simd_binop(ovm_code_builder_t *builder, u32 instr) {
+    ovm_instr_t binop = {0};
+    binop.full_instr = instr;
+    binop.b = POP_VALUE(builder);
+    binop.a = POP_VALUE(builder);
+    binop.r = NEXT_WIDE_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &binop);
+    PUSH_WIDE_VALUE(builder, binop.r);
+}
+
+void ovm_code_builder_add_simd_unop(ovm_code_builder_t *builder, u32 instr) {
+    ovm_instr_t unop = {0};
+    unop.full_instr = instr;
+    unop.a = POP_VALUE(builder);
+    unop.r = NEXT_WIDE_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &unop);
+    PUSH_WIDE_VALUE(builder, unop.r);
+}
+
+void ovm_code_builder_add_simd_extract_lane(ovm_code_builder_t *builder, u32 instr, i32 lane) {
+    ovm_instr_t extract = {0};
+    extract.full_instr = instr;
+    extract.a = POP_VALUE(builder);
+    extract.b = lane;
+    extract.r = NEXT_VALUE(builder);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &extract);
+    PUSH_VALUE(builder, extract.r);
+}
+
+//
+// Lanes are replaced in place, so the vector is first copied into its
+// stack slot if it is not already there (i.e. it came from a local).
+void ovm_code_builder_add_simd_replace_lane(ovm_code_builder_t *builder, u32 ovm_type, i32 lane) {
+    i32 value  = POP_VALUE(builder);
+    i32 vector = POP_VALUE(builder);
+    i32 result = NEXT_WIDE_VALUE(builder);
+
+    if (vector != result) {
+        ovm_instr_t mov_instr = {0};
+        mov_instr.full_instr = OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_V128);
+        mov_instr.r = result;
+        mov_instr.a = vector;
+
+        debug_info_builder_emit_location(builder->debug_builder);
+        ovm_program_add_instructions(builder->program, 1, &mov_instr);
+    }
+
+    ovm_instr_t replace = {0};
+    replace.full_instr = OVM_TYPED_INSTR(OVMI_V_REPLACE, ovm_type);
+    replace.r = result;
+    replace.a = lane;
+    replace.b = value;
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 1, &replace);
+    PUSH_WIDE_VALUE(builder, result);
+}
+
+//
+// The 16 lane indices do not fit in the instruction, so they are stored
+// in the immediates of two NOPs that follow it, which the shuffle skips.
+void ovm_code_builder_add_simd_shuffle(ovm_code_builder_t *builder, u8 *lanes) {
+    ovm_instr_t instrs[3] = {0};
+    instrs[0].full_instr = OVM_TYPED_INSTR(OVMI_V_SHUFFLE, OVM_TYPE_I8);
+    instrs[0].b = POP_VALUE(builder);
+    instrs[0].a = POP_VALUE(builder);
+    instrs[0].r = NEXT_WIDE_VALUE(builder);
+
+    instrs[1].full_instr = OVMI_NOP;
+    instrs[2].full_instr = OVMI_NOP;
+    memcpy(&instrs[1].l, &lanes[0], 8);
+    memcpy(&instrs[2].l, &lanes[8], 8);
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    debug_info_builder_emit_location(builder->debug_builder);
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 3, instrs);
+    PUSH_WIDE_VALUE(builder, instrs[0].r);
+}
+
+//
+// bitselect(a, b, c) = (a & c) | (b & ~c), which is computed as
+// b ^ ((a ^ b) & c). The intermediate is kept in the result slot, which
+// is the slot of `a`, so it never overwrites `b` or `c`.
+void ovm_code_builder_add_simd_bitselect(ovm_code_builder_t *builder) {
+    i32 c = POP_VALUE(builder);
+    i32 b = POP_VALUE(builder);
+    i32 a = POP_VALUE(builder);
+    i32 result = NEXT_WIDE_VALUE(builder);
+
+    ovm_instr_t instrs[3] = {0};
+    // xor %r, %a, %b
+    instrs[0].full_instr = OVM_TYPED_INSTR(OVMI_V_XOR, OVM_TYPE_V128);
+    instrs[0].r = result;
+    instrs[0].a = a;
+    instrs[0].b = b;
+
+    // and %r, %r, %c
+    instrs[1].full_instr = OVM_TYPED_INSTR(OVMI_V_AND, OVM_TYPE_V128);
+    instrs[1].r = result;
+    instrs[1].a = result;
+    instrs[1].b = c;
+
+    // xor %r, %b, %r
+    instrs[2].full_instr = OVM_TYPED_INSTR(OVMI_V_XOR, OVM_TYPE_V128);
+    instrs[2].r = result;
+    instrs[2].a = b;
+    instrs[2].b = result;
+
+    debug_info_builder_emit_location(builder->debug_builder);
+    debug_info_builder_emit_location(builder->debug_builder);
+    debug_info_builder_emit_location(builder->debug_builder);
+    ovm_program_add_instructions(builder->program, 3, instrs);
+    PUSH_WIDE_VALUE(builder, result);
+}
+
+//
+// Superinstruction fusion
+//
+// After a function has been completely built (and all of its branches
+// have been patched), common pairs of instructions are rewritten into a
+// single fused instruction that performs the work of both. Only the first
+// instruction of the pair is changed; the second is left in place and
+// skipped at runtime. This keeps every instruction index the same, so
+// branch offsets, branch tables, and the debug info that was emitted for
+// each instruction are all still valid.
+//
+// A pair is only fused when the second instruction can never be jumped to
+// directly, and when the value passed between them is a temporary (which
+// the fused handler does not bother to write).
+//
+
+static void mark_branch_targets(ovm_code_builder_t *builder, i32 start, i32 end, u8 *targets) {
+    ovm_program_t *program = builder->program;
+
+    fori (i, start, end) {
+        ovm_instr_t *instr = &program->code[i];
+
+        switch (OVM_INSTR_INSTR(*instr)) {
+            case OVMI_BR:
+            case OVMI_BR_Z:
+            case OVMI_BR_NZ: {
+                i32 target = i + 1 + instr->a;
+                if (target >= start && target < end) targets[target - start] = 1;
+                break;
+            }
+
+            case OVMI_BRI: {
+                //
+                // Branch tables are always emitted as an `idx_arr` followed by
+                // a `bri`, with the deltas stored in the static integer array.
+                ovm_instr_t *idx_instr = instr - 1;
+                assert(i > start && OVM_INSTR_INSTR(*idx_instr) == OVMI_IDX_ARR);
+
+                ovm_static_integer_array_t arr = program->static_data[idx_instr->a];
+                fori (j, 0, arr.len) {
+                    i32 target = i + 1 + program->static_integers[arr.start_idx + j];
+                    if (target >= start && target < end) targets[target - start] = 1;
+                }
+                break;
+            }
+        }
+    }
+}
+
+static u32 inverted_comparison(u32 instr) {
+    switch (instr) {
+        case OVMI_LT:   return OVMI_GE;
+        case OVMI_LT_S: return OVMI_GE_S;
+        case OVMI_LE:   return OVMI_GT;
+        case OVMI_LE_S: return OVMI_GT_S;
+        case OVMI_EQ:   return OVMI_NE;
+        case OVMI_GE:   return OVMI_LT;
+        case OVMI_GE_S: return OVMI_LT_S;
+        case OVMI_GT:   return OVMI_LE;
+        case OVMI_GT_S: return OVMI_LE_S;
+        case OVMI_NE:   return OVMI_EQ;
+        default: assert(("bad comparison instruction", 0)); return 0;
+    }
+}
+
+static bool try_fuse_pair(ovm_code_builder_t *builder, ovm_instr_t *first, ovm_instr_t *second) {
+    u32 first_instr  = OVM_INSTR_INSTR(*first);
+    u32 second_instr = OVM_INSTR_INSTR(*second);
+    u32 first_type   = OVM_INSTR_TYPE(*first);
+
+    if ((first->full_instr & OVMI_ATOMIC) || (second->full_instr & OVMI_ATOMIC)) return false;
+
+    // imm.x %t, i;  add.x %r, %a, %t
+    if (first_instr == OVMI_IMM && second_instr == OVMI_ADD
+        && (first_type == OVM_TYPE_I32 || first_type == OVM_TYPE_I64)
+        && second->full_instr == OVM_TYPED_INSTR(OVMI_ADD, first_type)
+        && IS_TEMPORARY_VALUE(builder, first->r)
+        && second->b == first->r && second->a != first->r) {
+        first->full_instr = OVM_TYPED_INSTR(OVMI_IMM_ADD, first_type);
+        return true;
+    }
+
+    // add.i32 %t, %a, %b;  load.x %r, [%t + b]
+    if (first_instr == OVMI_ADD && first_type == OVM_TYPE_I32 && second_instr == OVMI_LOAD
+        && IS_TEMPORARY_VALUE(builder, first->r)
+        && second->a == first->r) {
+        first->full_instr = OVM_TYPED_INSTR(OVMI_ADD_LOAD, OVM_INSTR_TYPE(*second));
+        return true;
+    }
+
+    // mov %r, %a;  mov %r', %a'
+    if (first->full_instr == OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_NONE)
+        && second->full_instr == OVM_TYPED_INSTR(OVMI_MOV, OVM_TYPE_NONE)) {
+        first->full_instr = OVM_TYPED_INSTR(OVMI_MOV_MOV, OVM_TYPE_NONE);
+        return true;
+    }
+
+    // cmp.x %t, %a, %b;  br_z/br_nz d, %t
+    //
+    // Only integer comparisons are fused, because the branch-if-zero case
+    // is handled by inverting the comparison, which is not valid for floats.
+    if (first_instr >= OVMI_LT && first_instr <= OVMI_NE
+        && (first_type == OVM_TYPE_I32 || first_type == OVM_TYPE_I64)
+        && (second_instr == OVMI_BR_Z || second_instr == OVMI_BR_NZ)
+        && IS_TEMPORARY_VALUE(builder, first->r)
+        && second->b == first->r) {
+        u32 cmp = first_instr;
+        if (second_instr == OVMI_BR_Z) cmp = inverted_comparison(cmp);
+
+        first->full_instr = OVM_TYPED_INSTR(OVMI_BR_LT + (cmp - OVMI_LT), first_type);
+        first->r = second->a;
+        return true;
+    }
+
+    return false;
+}
+
+void ovm_code_builder_fuse_instructions(ovm_code_builder_t *builder) {
+    i32 start = builder->start_instr;
+    i32 end   = bh_arr_length(builder->program->code);
+    if (end - start < 2) return;
+
+    u8 *targets = bh_alloc(bh_heap_allocator(), end - start);
+    memset(targets, 0, end - start);
+    mark_branch_targets(builder, start, end, targets);
+
+    for (i32 i = start; i < end - 1; i++) {
+        if (targets[i + 1 - start]) continue;
+
+        if (try_fuse_pair(builder, &builder->program->code[i], &builder->program->code[i + 1])) {
+            i++;
+        }
+    }
+
+    bh_free(bh_heap_allocator(), targets);
+}
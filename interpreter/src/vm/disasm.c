@@ -9,6 +9,7 @@ enum instr_format_kind_t {
 
     instr_format_rab,
     instr_format_ra,
+    instr_format_r,
     instr_format_a,
 
     instr_format_imm,
@@ -25,6 +26,14 @@ enum instr_format_kind_t {
 
     instr_format_call,
     instr_format_calli,
+
+    instr_format_imm_add,
+    instr_format_add_load,
+    instr_format_mov_mov,
+    instr_format_br_cmp,
+
+    instr_format_extract,
+    instr_format_replace,
 };
 
 typedef struct instr_format_t {
@@ -122,7 +131,90 @@ static instr_format_t instr_formats[] = {
     { "transmute_f32", instr_format_ra },
     { "transmute_f64", instr_format_ra },
 
-    { "cmpxchg", instr_format_rab }
+    { "cmpxchg", instr_format_rab },
+
+    { "break", instr_format_none },
+    { "mem_size", instr_format_r },
+    { "mem_grow", instr_format_ra },
+
+    { "imm_add", instr_format_imm_add },
+    { "add_load", instr_format_add_load },
+    { "mov_mov", instr_format_mov_mov },
+    { "br_lt", instr_format_br_cmp },
+    { "br_lt_s", instr_format_br_cmp },
+    { "br_le", instr_format_br_cmp },
+    { "br_le_s", instr_format_br_cmp },
+    { "br_eq", instr_format_br_cmp },
+    { "br_ge", instr_format_br_cmp },
+    { "br_ge_s", instr_format_br_cmp },
+    { "br_gt", instr_format_br_cmp },
+    { "br_gt_s", instr_format_br_cmp },
+    { "br_ne", instr_format_br_cmp },
+
+    { "atomic_load", instr_format_load },
+    { "atomic_store", instr_format_store },
+    { "atomic_add", instr_format_rab },
+    { "atomic_sub", instr_format_rab },
+    { "atomic_and", instr_format_rab },
+    { "atomic_or", instr_format_rab },
+    { "atomic_xor", instr_format_rab },
+    { "atomic_xchg", instr_format_rab },
+    { "atomic_wait", instr_format_rab },
+    { "atomic_notify", instr_format_rab },
+
+    { "v_splat", instr_format_ra },
+    { "v_extract", instr_format_extract },
+    { "v_extract_s", instr_format_extract },
+    { "v_replace", instr_format_replace },
+    { "v_swizzle", instr_format_rab },
+    { "v_shuffle", instr_format_rab },
+    { "v_eq", instr_format_rab },
+    { "v_ne", instr_format_rab },
+    { "v_lt", instr_format_rab },
+    { "v_lt_s", instr_format_rab },
+    { "v_le", instr_format_rab },
+    { "v_le_s", instr_format_rab },
+    { "v_gt", instr_format_rab },
+    { "v_gt_s", instr_format_rab },
+    { "v_ge", instr_format_rab },
+    { "v_ge_s", instr_format_rab },
+    { "v_not", instr_format_ra },
+    { "v_and", instr_format_rab },
+    { "v_andnot", instr_format_rab },
+    { "v_or", instr_format_rab },
+    { "v_xor", instr_format_rab },
+    { "v_abs", instr_format_ra },
+    { "v_neg", instr_format_ra },
+    { "v_any_true", instr_format_ra },
+    { "v_all_true", instr_format_ra },
+    { "v_bitmask", instr_format_ra },
+    { "v_narrow", instr_format_rab },
+    { "v_narrow_s", instr_format_rab },
+    { "v_widen_low", instr_format_ra },
+    { "v_widen_low_s", instr_format_ra },
+    { "v_widen_high", instr_format_ra },
+    { "v_widen_high_s", instr_format_ra },
+    { "v_shl", instr_format_rab },
+    { "v_shr", instr_format_rab },
+    { "v_sar", instr_format_rab },
+    { "v_add", instr_format_rab },
+    { "v_sub", instr_format_rab },
+    { "v_add_sat", instr_format_rab },
+    { "v_add_sat_s", instr_format_rab },
+    { "v_sub_sat", instr_format_rab },
+    { "v_sub_sat_s", instr_format_rab },
+    { "v_mul", instr_format_rab },
+    { "v_min", instr_format_rab },
+    { "v_min_s", instr_format_rab },
+    { "v_max", instr_format_rab },
+    { "v_max_s", instr_format_rab },
+    { "v_avgr", instr_format_rab },
+    { "v_sqrt", instr_format_ra },
+    { "v_div", instr_format_rab },
+    { "v_trunc_sat", instr_format_ra },
+    { "v_trunc_sat_s", instr_format_ra },
+    { "v_convert", instr_format_ra },
+    { "v_convert_s", instr_format_ra },
 };
 
 void ovm_disassemble(ovm_program_t *program, u32 instr_addr, bh_buffer *instr_text) {
@@ -147,6 +239,7 @@ void ovm_disassemble(ovm_program_t *program, u32 instr_addr, bh_buffer *instr_te
     switch (format->kind) {
         case instr_format_rab: formatted = snprintf(buf, 255, "%%%d, %%%d, %%%d", instr->r, instr->a, instr->b); break;
         case instr_format_ra:  formatted = snprintf(buf, 255, "%%%d, %%%d", instr->r, instr->a); break;
+        case instr_format_r:   formatted = snprintf(buf, 255, "%%%d", instr->r); break;
         case instr_format_a:   formatted = snprintf(buf, 255, "%%%d", instr->a); break;
 
         case instr_format_imm:
@@ -185,6 +278,24 @@ void ovm_disassemble(ovm_program_t *program, u32 instr_addr, bh_buffer *instr_te
                 formatted = snprintf(buf, 255, "%%%d", instr->a);
             }
             break;
+
+        //
+        // Fused instructions also print the operands they take from
+        // the instruction that follows them.
+        case instr_format_imm_add:
+            if (OVM_INSTR_TYPE(*instr) == OVM_TYPE_I64) {
+                formatted = snprintf(buf, 255, "%%%d, %%%d, %ld", instr[1].r, instr[1].a, instr->l);
+            } else {
+                formatted = snprintf(buf, 255, "%%%d, %%%d, %d", instr[1].r, instr[1].a, instr->i);
+            }
+            break;
+
+        case instr_format_add_load: formatted = snprintf(buf, 255, "%%%d, [%%%d + %%%d + %d]", instr[1].r, instr->a, instr->b, instr[1].b); break;
+        case instr_format_mov_mov:  formatted = snprintf(buf, 255, "%%%d, %%%d; %%%d, %%%d", instr->r, instr->a, instr[1].r, instr[1].a); break;
+        case instr_format_br_cmp:   formatted = snprintf(buf, 255, "%d, %%%d, %%%d", instr_addr + instr->r + 2, instr->a, instr->b); break;
+
+        case instr_format_extract: formatted = snprintf(buf, 255, "%%%d, %%%d[%d]", instr->r, instr->a, instr->b); break;
+        case instr_format_replace: formatted = snprintf(buf, 255, "%%%d[%d], %%%d", instr->r, instr->a, instr->b); break;
     }
 
     if (formatted > 0) {
@@ -0,0 +1,854 @@
+//
+// Baseline JIT
+//
+// This is a template JIT: every OVM instruction of a function is translated on
+// its own into a fixed sequence of x86-64 instructions. Nothing is kept in
+// registers between instructions; every operand is loaded from and stored back
+// into its value number in the function's stack frame, exactly where the
+// interpreter would have put it. This means the generated code never has to
+// translate its state back for the interpreter, and it can be left at any
+// call, return or trap.
+//
+// Only the common instructions have a template. Everything else calls the
+// single step version of the interpreter's handler for the instruction (see
+// OVMI_SINGLE_STEP in vm_instrs.h), so there is only one implementation of
+// the rarer and more complicated instructions.
+//
+// While generated code runs, these registers are reserved:
+//
+//     rbx   the value numbers of the frame
+//     r12   the base of linear memory
+//     r13   the ovm_state_t
+//
+// Generated functions have the signature of ovm_jit_entry_t.
+//
+
+#define _GNU_SOURCE
+
+#include "vm.h"
+
+#include <sys/mman.h>
+
+#if defined(__x86_64__) && !defined(OVM_TYPED_VALUES)
+
+enum x64_reg_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8,  R9,  R10, R11, R12, R13, R14, R15,
+
+    // Registers used by the generated code. See above.
+    VALUES = RBX,
+    MEMORY = R12,
+    STATE  = R13,
+};
+
+#define XMM0 0
+#define XMM1 1
+
+typedef struct jit_fixup_t {
+    i32 offset;       // Offset of the rel32 to patch
+    i32 target_instr; // Instruction index relative to the start of the function, or -1 for the trap exit
+} jit_fixup_t;
+
+typedef struct jit_t {
+    ovm_program_t *program;
+    i32 start, end;
+
+    bh_buffer code;
+
+    // Offset of the code for every instruction in the function.
+    i32 *labels;
+
+    bh_arr(jit_fixup_t) fixups;
+
+    // Offsets of the rel32 of every `lea` that loads the address of the branch table.
+    bh_arr(i32) table_fixups;
+} jit_t;
+
+#define SLOT(n) ((i32) (n) * (i32) sizeof(ovm_value_t))
+
+
+//
+// Encoding
+//
+
+static inline void emit_byte(jit_t *jit, u8 byte) {
+    bh_buffer_write_byte(&jit->code, byte);
+}
+
+static inline void emit_u32(jit_t *jit, u32 i) {
+    bh_buffer_write_u32(&jit->code, i);
+}
+
+static inline void emit_u64(jit_t *jit, u64 i) {
+    bh_buffer_write_u64(&jit->code, i);
+}
+
+//
+// `opcode` holds up to three opcode bytes, with the first byte in the highest
+// position that is used. `prefix` is a mandatory prefix (0x66, 0xF2, 0xF3) or 0.
+static void emit_opcode(jit_t *jit, u8 prefix, u8 rex, u32 opcode) {
+    if (prefix) emit_byte(jit, prefix);
+    if (rex != 0x40) emit_byte(jit, rex);
+
+    if (opcode > 0xffff) emit_byte(jit, (opcode >> 16) & 0xff);
+    if (opcode > 0xff)   emit_byte(jit, (opcode >> 8) & 0xff);
+    emit_byte(jit, opcode & 0xff);
+}
+
+//
+// Emits an instruction with a memory operand [base + index * scale + disp].
+// A displacement of 32 bits is always used, which avoids the special cases of
+// RBP and R13 as the base register. Pass -1 as `index` when there is none.
+static void emit_mem(jit_t *jit, u8 prefix, bool w, u32 opcode, i32 reg, i32 base, i32 index, i32 scale, i32 disp) {
+    u8 rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (base >> 3);
+    if (index >= 0) rex |= ((index >> 3) & 1) << 1;
+
+    emit_opcode(jit, prefix, rex, opcode);
+
+    if (index < 0 && (base & 7) != RSP) {
+        emit_byte(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+    } else {
+        u8 ss = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+        emit_byte(jit, 0x80 | ((reg & 7) << 3) | 4);
+        emit_byte(jit, (ss << 6) | (((index < 0 ? RSP : index) & 7) << 3) | (base & 7));
+    }
+
+    emit_u32(jit, disp);
+}
+
+// Emits an instruction with two register operands.
+static void emit_rr(jit_t *jit, u8 prefix, bool w, u32 opcode, i32 reg, i32 rm) {
+    u8 rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | (rm >> 3);
+    emit_opcode(jit, prefix, rex, opcode);
+    emit_byte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+#define emit_slot(jit, prefix, w, opcode, reg, slot) \
+    emit_mem(jit, prefix, w, opcode, reg, VALUES, -1, 1, SLOT(slot))
+
+static void emit_mov_imm64(jit_t *jit, i32 reg, u64 imm) {
+    emit_byte(jit, 0x48 | (reg >> 3));
+    emit_byte(jit, 0xB8 + (reg & 7));
+    emit_u64(jit, imm);
+}
+
+static void emit_call_abs(jit_t *jit, void *func) {
+    emit_mov_imm64(jit, RAX, (u64) func);
+    emit_rr(jit, 0, 0, 0xFF, 2, RAX);                // call rax
+}
+
+// jmp/jcc rel32 to an instruction of the function, or to the trap exit.
+static void emit_jump(jit_t *jit, u8 cc, i32 target_instr) {
+    if (cc) {
+        emit_byte(jit, 0x0F);
+        emit_byte(jit, cc);
+    } else {
+        emit_byte(jit, 0xE9);
+    }
+
+    jit_fixup_t fixup = { jit->code.length, target_instr };
+    bh_arr_push(jit->fixups, fixup);
+    emit_u32(jit, 0);
+}
+
+#define CC_B   0x82
+#define CC_AE  0x83
+#define CC_E   0x84
+#define CC_NE  0x85
+#define CC_BE  0x86
+#define CC_A   0x87
+#define CC_P   0x8A
+#define CC_NP  0x8B
+#define CC_L   0x8C
+#define CC_GE  0x8D
+#define CC_LE  0x8E
+#define CC_G   0x8F
+
+#define TRAP_EXIT -1
+
+static void emit_epilogue(jit_t *jit) {
+    emit_byte(jit, 0x41); emit_byte(jit, 0x58 + (R13 & 7));  // pop r13
+    emit_byte(jit, 0x41); emit_byte(jit, 0x58 + (R12 & 7));  // pop r12
+    emit_byte(jit, 0x58 + RBX);                              // pop rbx
+    emit_byte(jit, 0xC3);                                    // ret
+}
+
+static void emit_prologue(jit_t *jit) {
+    emit_byte(jit, 0x50 + RBX);                              // push rbx
+    emit_byte(jit, 0x41); emit_byte(jit, 0x50 + (R12 & 7));  // push r12
+    emit_byte(jit, 0x41); emit_byte(jit, 0x50 + (R13 & 7));  // push r13 (the stack is now aligned for calls)
+
+    emit_rr(jit, 0, 1, 0x89, RDI, VALUES);
+    emit_rr(jit, 0, 1, 0x89, RSI, MEMORY);
+    emit_rr(jit, 0, 1, 0x89, RDX, STATE);
+}
+
+//
+// Linear memory can move whenever OVM code grows it, or the host is called.
+static void emit_reload_memory(jit_t *jit) {
+    emit_mem(jit, 0, 1, 0x8B, RAX, STATE, -1, 1, offsetof(ovm_state_t, engine));
+    emit_mem(jit, 0, 1, 0x8B, MEMORY, RAX, -1, 1, offsetof(ovm_engine_t, memory));
+}
+
+static void emit_check_trap(jit_t *jit) {
+    emit_mem(jit, 0, 1, 0x83, 7, STATE, -1, 1, offsetof(ovm_state_t, trap_message)); // cmp qword [trap_message], 0
+    emit_byte(jit, 0);
+    emit_jump(jit, CC_NE, TRAP_EXIT);
+}
+
+static void emit_step(jit_t *jit, ovm_instr_t *instr) {
+    emit_mov_imm64(jit, RDI, (u64) instr);
+    emit_rr(jit, 0, 1, 0x89, STATE, RSI);
+    emit_rr(jit, 0, 1, 0x89, VALUES, RDX);
+    emit_rr(jit, 0, 1, 0x89, MEMORY, RCX);
+    emit_mov_imm64(jit, R8, (u64) jit->program->code);
+    emit_call_abs(jit, ovm_instr_step_handler(instr->full_instr));
+    emit_reload_memory(jit);
+}
+
+
+//
+// Loads and stores of value numbers and linear memory, by OVM type.
+//
+
+static void emit_load_slot(jit_t *jit, i32 reg, i32 slot, u32 type) {
+    switch (type) {
+        case OVM_TYPE_I8:  emit_slot(jit, 0, 0, 0x0FB6, reg, slot); break; // movzx r32, byte
+        case OVM_TYPE_I16: emit_slot(jit, 0, 0, 0x0FB7, reg, slot); break; // movzx r32, word
+        case OVM_TYPE_I32:
+        case OVM_TYPE_F32: emit_slot(jit, 0, 0, 0x8B, reg, slot); break;
+        default:           emit_slot(jit, 0, 1, 0x8B, reg, slot); break;
+    }
+}
+
+//
+// Only the bytes of the type are written, just like the interpreter does.
+static void emit_store_slot(jit_t *jit, i32 slot, i32 reg, u32 type) {
+    switch (type) {
+        case OVM_TYPE_I8:  emit_slot(jit, 0, 0, 0x88, reg, slot); break;
+        case OVM_TYPE_I16: emit_slot(jit, 0x66, 0, 0x89, reg, slot); break;
+        case OVM_TYPE_I32:
+        case OVM_TYPE_F32: emit_slot(jit, 0, 0, 0x89, reg, slot); break;
+        default:           emit_slot(jit, 0, 1, 0x89, reg, slot); break;
+    }
+}
+
+// Leaves the 32-bit address %a + offset in RAX.
+static void emit_address(jit_t *jit, i32 slot, i32 offset) {
+    emit_slot(jit, 0, 0, 0x8B, RAX, slot);
+    if (offset != 0) {
+        emit_byte(jit, 0x05);                          // add eax, imm32
+        emit_u32(jit, offset);
+    }
+}
+
+//
+// The interpreter's handlers raise an exception for an access to address 0
+// (see OVMI_EXCEPTION_HOOK in vm_instrs.h). With the address in RAX, a null
+// access is handed to the handler of `instr`, so both behave the same. The
+// code emitted after this is skipped for a null access, up to the matching
+// call to emit_null_check_end.
+static i32 emit_null_check(jit_t *jit, ovm_instr_t *instr) {
+    emit_rr(jit, 0, 0, 0x85, RAX, RAX);                // test eax, eax
+    emit_byte(jit, 0x75);                              // jnz rel8 to the access
+    i32 patch = jit->code.length;
+    emit_byte(jit, 0);
+
+    emit_step(jit, instr);
+    emit_check_trap(jit);
+
+    emit_byte(jit, 0xEB);                              // jmp rel8 over the access
+    i32 skip = jit->code.length;
+    emit_byte(jit, 0);
+
+    jit->code.data[patch] = (u8) (jit->code.length - patch - 1);
+    return skip;
+}
+
+static void emit_null_check_end(jit_t *jit, i32 skip) {
+    jit->code.data[skip] = (u8) (jit->code.length - skip - 1);
+}
+
+static void emit_load_memory(jit_t *jit, i32 reg, u32 type) {
+    switch (type) {
+        case OVM_TYPE_I8:  emit_mem(jit, 0, 0, 0x0FB6, reg, MEMORY, RAX, 1, 0); break;
+        case OVM_TYPE_I16: emit_mem(jit, 0, 0, 0x0FB7, reg, MEMORY, RAX, 1, 0); break;
+        case OVM_TYPE_I32:
+        case OVM_TYPE_F32: emit_mem(jit, 0, 0, 0x8B, reg, MEMORY, RAX, 1, 0); break;
+        default:           emit_mem(jit, 0, 1, 0x8B, reg, MEMORY, RAX, 1, 0); break;
+    }
+}
+
+static void emit_store_memory(jit_t *jit, i32 reg, u32 type) {
+    switch (type) {
+        case OVM_TYPE_I8:  emit_mem(jit, 0, 0, 0x88, reg, MEMORY, RAX, 1, 0); break;
+        case OVM_TYPE_I16: emit_mem(jit, 0x66, 0, 0x89, reg, MEMORY, RAX, 1, 0); break;
+        case OVM_TYPE_I32:
+        case OVM_TYPE_F32: emit_mem(jit, 0, 0, 0x89, reg, MEMORY, RAX, 1, 0); break;
+        default:           emit_mem(jit, 0, 1, 0x89, reg, MEMORY, RAX, 1, 0); break;
+    }
+}
+
+#define IS_FLOAT(t) ((t) == OVM_TYPE_F32 || (t) == OVM_TYPE_F64)
+#define IS_WIDE(t)  ((t) == OVM_TYPE_I64 || (t) == OVM_TYPE_F64)
+#define SSE_PREFIX(t) ((t) == OVM_TYPE_F32 ? 0xF3 : 0xF2)
+
+
+//
+// Instruction templates
+//
+
+static bool emit_binop(jit_t *jit, ovm_instr_t *instr, u32 op, u32 type) {
+    bool w = IS_WIDE(type);
+
+    if (IS_FLOAT(type)) {
+        u32 opcode;
+        switch (op) {
+            case OVMI_ADD:   opcode = 0x0F58; break;
+            case OVMI_SUB:   opcode = 0x0F5C; break;
+            case OVMI_MUL:   opcode = 0x0F59; break;
+            case OVMI_DIV:
+            case OVMI_DIV_S: opcode = 0x0F5E; break;
+            case OVMI_MIN:   opcode = 0x0F5D; break; // Same as bh_min, even for NaNs and zeros.
+            case OVMI_MAX:   opcode = 0x0F5F; break;
+            default: return false;
+        }
+
+        emit_slot(jit, SSE_PREFIX(type), 0, 0x0F10, XMM0, instr->a);
+        emit_slot(jit, SSE_PREFIX(type), 0, opcode, XMM0, instr->b);
+        emit_slot(jit, SSE_PREFIX(type), 0, 0x0F11, XMM0, instr->r);
+        return true;
+    }
+
+    switch (op) {
+        case OVMI_ADD: case OVMI_SUB: case OVMI_MUL:
+        case OVMI_AND: case OVMI_OR:  case OVMI_XOR: {
+            u32 opcode = 0;
+            switch (op) {
+                case OVMI_ADD: opcode = 0x03; break;
+                case OVMI_SUB: opcode = 0x2B; break;
+                case OVMI_MUL: opcode = 0x0FAF; break;
+                case OVMI_AND: opcode = 0x23; break;
+                case OVMI_OR:  opcode = 0x0B; break;
+                case OVMI_XOR: opcode = 0x33; break;
+            }
+
+            emit_slot(jit, 0, w, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, w, opcode, RAX, instr->b);
+            emit_slot(jit, 0, w, 0x89, RAX, instr->r);
+            return true;
+        }
+
+        case OVMI_DIV: case OVMI_DIV_S: case OVMI_REM: case OVMI_REM_S: {
+            bool is_signed = op == OVMI_DIV_S || op == OVMI_REM_S;
+
+            emit_slot(jit, 0, w, 0x8B, RAX, instr->a);
+            if (is_signed) {
+                if (w) emit_byte(jit, 0x48);
+                emit_byte(jit, 0x99);                                    // cdq / cqo
+            } else {
+                emit_rr(jit, 0, 0, 0x31, RDX, RDX);                      // xor edx, edx
+            }
+
+            emit_slot(jit, 0, w, 0xF7, is_signed ? 7 : 6, instr->b);     // idiv / div
+            emit_slot(jit, 0, w, 0x89, (op == OVMI_DIV || op == OVMI_DIV_S) ? RAX : RDX, instr->r);
+            return true;
+        }
+
+        case OVMI_SHL: case OVMI_SHR: case OVMI_SAR: case OVMI_ROTL: case OVMI_ROTR: {
+            i32 ext = 0;
+            switch (op) {
+                case OVMI_SHL:  ext = 4; break;
+                case OVMI_SHR:  ext = 5; break;
+                case OVMI_SAR:  ext = 7; break;
+                case OVMI_ROTL: ext = 0; break;
+                case OVMI_ROTR: ext = 1; break;
+            }
+
+            emit_slot(jit, 0, w, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, 0, 0x8B, RCX, instr->b);
+            emit_rr(jit, 0, w, 0xD3, ext, RAX);                          // op rax, cl
+            emit_slot(jit, 0, w, 0x89, RAX, instr->r);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void emit_setcc_result(jit_t *jit, u8 cc, i32 r) {
+    emit_rr(jit, 0, 0, 0x0F00 | (cc + 0x10), 0, RAX);            // setcc al
+    emit_rr(jit, 0, 0, 0x0FB6, RAX, RAX);                        // movzx eax, al
+    emit_slot(jit, 0, 0, 0x89, RAX, r);
+}
+
+static u8 integer_condition(u32 op) {
+    switch (op) {
+        case OVMI_LT:   return CC_B;
+        case OVMI_LT_S: return CC_L;
+        case OVMI_LE:   return CC_BE;
+        case OVMI_LE_S: return CC_LE;
+        case OVMI_EQ:   return CC_E;
+        case OVMI_GE:   return CC_AE;
+        case OVMI_GE_S: return CC_GE;
+        case OVMI_GT:   return CC_A;
+        case OVMI_GT_S: return CC_G;
+        case OVMI_NE:   return CC_NE;
+        default: return 0;
+    }
+}
+
+static void emit_compare(jit_t *jit, ovm_instr_t *instr, u32 op, u32 type) {
+    if (!IS_FLOAT(type)) {
+        emit_slot(jit, 0, IS_WIDE(type), 0x8B, RAX, instr->a);
+        emit_slot(jit, 0, IS_WIDE(type), 0x3B, RAX, instr->b);   // cmp rax, %b
+        emit_setcc_result(jit, integer_condition(op), instr->r);
+        return;
+    }
+
+    //
+    // ucomiss/ucomisd set CF and ZF like an unsigned comparison, and set all
+    // of CF, ZF and PF when either operand is NaN. Comparing with the operands
+    // swapped means only "above" conditions are needed, which are false for NaN.
+    u8 prefix = type == OVM_TYPE_F64 ? 0x66 : 0;
+    u32 movs = type == OVM_TYPE_F64 ? 0xF2 : 0xF3;
+    bool swapped = op == OVMI_LT || op == OVMI_LT_S || op == OVMI_LE || op == OVMI_LE_S;
+
+    emit_slot(jit, movs, 0, 0x0F10, XMM0, swapped ? instr->b : instr->a);
+    emit_slot(jit, prefix, 0, 0x0F2E, XMM0, swapped ? instr->a : instr->b);
+
+    switch (op) {
+        case OVMI_EQ:
+        case OVMI_NE: {
+            bool eq = op == OVMI_EQ;
+            emit_rr(jit, 0, 0, 0x0F00 | ((eq ? CC_E : CC_NE) + 0x10), 0, RAX);
+            emit_rr(jit, 0, 0, 0x0F00 | ((eq ? CC_NP : CC_P) + 0x10), 0, RCX);
+            emit_rr(jit, 0, 0, eq ? 0x20 : 0x08, RCX, RAX);              // and/or al, cl
+            emit_rr(jit, 0, 0, 0x0FB6, RAX, RAX);
+            emit_slot(jit, 0, 0, 0x89, RAX, instr->r);
+            break;
+        }
+
+        case OVMI_LT: case OVMI_LT_S: case OVMI_GT: case OVMI_GT_S:
+            emit_setcc_result(jit, CC_A, instr->r);
+            break;
+
+        default:
+            emit_setcc_result(jit, CC_AE, instr->r);
+            break;
+    }
+}
+
+static void emit_conditional_branch(jit_t *jit, i32 cond_slot, bool if_zero, i32 target) {
+    emit_slot(jit, 0, 0, 0x8B, RAX, cond_slot);
+    emit_rr(jit, 0, 0, 0x85, RAX, RAX);                          // test eax, eax
+    emit_jump(jit, if_zero ? CC_E : CC_NE, target);
+}
+
+//
+// Jumps to `pc + %a`, where `pc` is an instruction index relative to the
+// start of the function, using the table of instruction offsets that is
+// placed after the code.
+static void emit_indirect_branch(jit_t *jit, i32 pc, i32 offset_slot) {
+    emit_slot(jit, 0, 0, 0x8B, RAX, offset_slot);
+    emit_byte(jit, 0x05); emit_u32(jit, pc);                     // add eax, pc
+    emit_rr(jit, 0, 1, 0x63, RAX, RAX);                          // movsxd rax, eax
+
+    emit_byte(jit, 0x48); emit_byte(jit, 0x8D); emit_byte(jit, 0x0D); // lea rcx, [rip + table]
+    bh_arr_push(jit->table_fixups, jit->code.length);
+    emit_u32(jit, 0);
+
+    emit_mem(jit, 0, 1, 0x63, RDX, RCX, RAX, 4, 0);              // movsxd rdx, dword [rcx + rax * 4]
+    emit_rr(jit, 0, 1, 0x01, RCX, RDX);                          // add rdx, rcx
+    emit_rr(jit, 0, 0, 0xFF, 4, RDX);                            // jmp rdx
+}
+
+static bool emit_cvt(jit_t *jit, ovm_instr_t *instr, u32 op, u32 type) {
+    if (op > OVMI_CVT_I64_S || IS_FLOAT(type)) return false;
+
+    u32 source = OVM_TYPE_I8 + (op - OVMI_CVT_I8) / 2;
+    bool is_signed = (op - OVMI_CVT_I8) & 1;
+
+    switch (source) {
+        case OVM_TYPE_I8:  emit_slot(jit, 0, 1, is_signed ? 0x0FBE : 0x0FB6, RAX, instr->a); break;
+        case OVM_TYPE_I16: emit_slot(jit, 0, 1, is_signed ? 0x0FBF : 0x0FB7, RAX, instr->a); break;
+        case OVM_TYPE_I32: emit_slot(jit, 0, is_signed, is_signed ? 0x63 : 0x8B, RAX, instr->a); break;
+        case OVM_TYPE_I64: emit_slot(jit, 0, 1, 0x8B, RAX, instr->a); break;
+    }
+
+    emit_slot(jit, 0, 1, 0x89, RAX, instr->r);
+    return true;
+}
+
+//
+// Returns false if the instruction cannot be compiled. `*skip` is set when the
+// instruction also covers the one after it.
+static bool emit_instr(jit_t *jit, i32 i, bool *skip) {
+    ovm_instr_t *instr = &jit->program->code[i];
+    u32 op   = OVM_INSTR_INSTR(*instr);
+    u32 type = OVM_INSTR_TYPE(*instr);
+    i32 pc   = i - jit->start;
+
+    *skip = false;
+
+    if (instr->full_instr & OVMI_ATOMIC) goto step;
+
+    switch (op) {
+        case OVMI_NOP: return true;
+
+        case OVMI_ADD: case OVMI_SUB: case OVMI_MUL: case OVMI_DIV: case OVMI_DIV_S:
+        case OVMI_REM: case OVMI_REM_S: case OVMI_AND: case OVMI_OR: case OVMI_XOR:
+        case OVMI_SHL: case OVMI_SHR: case OVMI_SAR: case OVMI_ROTL: case OVMI_ROTR:
+        case OVMI_MIN: case OVMI_MAX:
+            if (emit_binop(jit, instr, op, type)) return true;
+            goto step;
+
+        case OVMI_IMM:
+            if (IS_WIDE(type)) {
+                emit_mov_imm64(jit, RAX, instr->l);
+            } else {
+                emit_byte(jit, 0xB8 + RAX); emit_u32(jit, instr->i); // mov eax, imm32 (clears the upper half)
+            }
+
+            emit_slot(jit, 0, 1, 0x89, RAX, instr->r);
+            return true;
+
+        case OVMI_MOV:
+            if (type != OVM_TYPE_NONE) goto step;
+            emit_slot(jit, 0, 1, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, 1, 0x89, RAX, instr->r);
+            return true;
+
+        case OVMI_LOAD: {
+            if (type == OVM_TYPE_V128) goto step;
+            emit_address(jit, instr->a, instr->b);
+            i32 null_check = emit_null_check(jit, instr);
+            emit_load_memory(jit, RCX, type);
+            emit_store_slot(jit, instr->r, RCX, type);
+            emit_null_check_end(jit, null_check);
+            return true;
+        }
+
+        case OVMI_STORE: {
+            if (type == OVM_TYPE_V128) goto step;
+            emit_address(jit, instr->r, instr->b);
+            i32 null_check = emit_null_check(jit, instr);
+            emit_load_slot(jit, RCX, instr->a, type);
+            emit_store_memory(jit, RCX, type);
+            emit_null_check_end(jit, null_check);
+            return true;
+        }
+
+        case OVMI_REG_GET:
+            emit_mem(jit, 0, 1, 0x8B, RAX, STATE, -1, 1, offsetof(ovm_state_t, registers));
+            emit_mem(jit, 0, 1, 0x8B, RCX, RAX, -1, 1, SLOT(instr->a));
+            emit_slot(jit, 0, 1, 0x89, RCX, instr->r);
+            return true;
+
+        case OVMI_REG_SET:
+            emit_mem(jit, 0, 1, 0x8B, RAX, STATE, -1, 1, offsetof(ovm_state_t, registers));
+            emit_slot(jit, 0, 1, 0x8B, RCX, instr->a);
+            emit_mem(jit, 0, 1, 0x89, RCX, RAX, -1, 1, SLOT(instr->r));
+            return true;
+
+        case OVMI_LT: case OVMI_LT_S: case OVMI_LE: case OVMI_LE_S: case OVMI_EQ:
+        case OVMI_GE: case OVMI_GE_S: case OVMI_GT: case OVMI_GT_S: case OVMI_NE:
+            emit_compare(jit, instr, op, type);
+            return true;
+
+        case OVMI_PARAM:
+            emit_mem(jit, 0, 0, 0x8B, RAX, STATE, -1, 1, offsetof(ovm_state_t, param_count));
+            emit_mem(jit, 0, 1, 0x8B, RCX, STATE, -1, 1, offsetof(ovm_state_t, param_buf));
+            emit_slot(jit, 0, 1, 0x8B, RDX, instr->a);
+            emit_mem(jit, 0, 1, 0x89, RDX, RCX, RAX, 8, 0);
+            emit_rr(jit, 0, 0, 0x83, 0, RAX); emit_byte(jit, 1);          // add eax, 1
+            emit_mem(jit, 0, 0, 0x89, RAX, STATE, -1, 1, offsetof(ovm_state_t, param_count));
+            return true;
+
+        case OVMI_RETURN:
+            //
+            // The native calling convention only has room for an 8-byte result.
+            if (type == OVM_TYPE_V128) return false;
+            emit_slot(jit, 0, 1, 0x8B, RAX, instr->a);
+            emit_epilogue(jit);
+            return true;
+
+        case OVMI_CALL:
+        case OVMI_CALLI:
+            emit_rr(jit, 0, 1, 0x89, STATE, RDI);
+            emit_mov_imm64(jit, RSI, (u64) instr);
+            emit_call_abs(jit, ovm_jit_call);
+            emit_reload_memory(jit);
+            emit_check_trap(jit);
+            return true;
+
+        case OVMI_BR:    emit_jump(jit, 0, pc + 1 + instr->a); return true;
+        case OVMI_BR_Z:  emit_conditional_branch(jit, instr->b, true,  pc + 1 + instr->a); return true;
+        case OVMI_BR_NZ: emit_conditional_branch(jit, instr->b, false, pc + 1 + instr->a); return true;
+
+        case OVMI_BRI:
+            emit_indirect_branch(jit, pc + 1, instr->a);
+            return true;
+
+        case OVMI_BRI_Z:
+        case OVMI_BRI_NZ: {
+            emit_slot(jit, 0, 0, 0x8B, RAX, instr->b);
+            emit_rr(jit, 0, 0, 0x85, RAX, RAX);
+            emit_byte(jit, op == OVMI_BRI_Z ? 0x75 : 0x74);           // jnz/jz rel8 over the branch
+            i32 patch = jit->code.length;
+            emit_byte(jit, 0);
+            emit_indirect_branch(jit, pc + 1, instr->a);
+            jit->code.data[patch] = (u8) (jit->code.length - patch - 1);
+            return true;
+        }
+
+        case OVMI_CVT_I8: case OVMI_CVT_I8_S: case OVMI_CVT_I16: case OVMI_CVT_I16_S:
+        case OVMI_CVT_I32: case OVMI_CVT_I32_S: case OVMI_CVT_I64: case OVMI_CVT_I64_S:
+            if (emit_cvt(jit, instr, op, type)) return true;
+            goto step;
+
+        case OVMI_TRANSMUTE_I32: case OVMI_TRANSMUTE_F32:
+            emit_slot(jit, 0, 0, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, 1, 0x89, RAX, instr->r);
+            return true;
+
+        case OVMI_TRANSMUTE_I64: case OVMI_TRANSMUTE_F64:
+            emit_slot(jit, 0, 1, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, 1, 0x89, RAX, instr->r);
+            return true;
+
+        case OVMI_SQRT:
+            emit_slot(jit, SSE_PREFIX(type), 0, 0x0F51, XMM0, instr->a);
+            emit_slot(jit, SSE_PREFIX(type), 0, 0x0F11, XMM0, instr->r);
+            return true;
+
+        case OVMI_NEG:
+            if (type == OVM_TYPE_F32) {
+                emit_slot(jit, 0, 0, 0x8B, RAX, instr->a);
+                emit_byte(jit, 0x35); emit_u32(jit, 0x80000000);      // xor eax, sign bit
+                emit_slot(jit, 0, 0, 0x89, RAX, instr->r);
+            } else {
+                emit_slot(jit, 0, 1, 0x8B, RAX, instr->a);
+                emit_rr(jit, 0, 1, 0x0FBA, 7, RAX); emit_byte(jit, 63); // btc rax, 63
+                emit_slot(jit, 0, 1, 0x89, RAX, instr->r);
+            }
+            return true;
+
+        //
+        // Fused instructions. The second instruction of the pair can never be
+        // jumped to, so no code is generated for it.
+        case OVMI_IMM_ADD: {
+            ovm_instr_t *next = instr + 1;
+            bool w = type == OVM_TYPE_I64;
+            emit_slot(jit, 0, w, 0x8B, RAX, next->a);
+            if (w) {
+                emit_mov_imm64(jit, RCX, instr->l);
+                emit_rr(jit, 0, 1, 0x01, RCX, RAX);                    // add rax, rcx
+            } else {
+                emit_byte(jit, 0x05); emit_u32(jit, instr->i);         // add eax, imm32
+            }
+            emit_slot(jit, 0, w, 0x89, RAX, next->r);
+            *skip = true;
+            return true;
+        }
+
+        case OVMI_ADD_LOAD: {
+            ovm_instr_t *next = instr + 1;
+            *skip = true;
+            if (type == OVM_TYPE_V128) goto step;
+
+            emit_slot(jit, 0, 0, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, 0, 0x03, RAX, instr->b);
+            if (next->b != 0) {
+                emit_byte(jit, 0x05); emit_u32(jit, next->b);
+            }
+            i32 null_check = emit_null_check(jit, instr);
+            emit_load_memory(jit, RCX, type);
+            emit_store_slot(jit, next->r, RCX, type);
+            emit_null_check_end(jit, null_check);
+            return true;
+        }
+
+        case OVMI_MOV_MOV: {
+            ovm_instr_t *next = instr + 1;
+            emit_slot(jit, 0, 1, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, 1, 0x89, RAX, instr->r);
+            emit_slot(jit, 0, 1, 0x8B, RAX, next->a);
+            emit_slot(jit, 0, 1, 0x89, RAX, next->r);
+            *skip = true;
+            return true;
+        }
+
+        case OVMI_BR_LT: case OVMI_BR_LT_S: case OVMI_BR_LE: case OVMI_BR_LE_S: case OVMI_BR_EQ:
+        case OVMI_BR_GE: case OVMI_BR_GE_S: case OVMI_BR_GT: case OVMI_BR_GT_S: case OVMI_BR_NE: {
+            bool w = type == OVM_TYPE_I64;
+            emit_slot(jit, 0, w, 0x8B, RAX, instr->a);
+            emit_slot(jit, 0, w, 0x3B, RAX, instr->b);
+            emit_jump(jit, integer_condition(OVMI_LT + (op - OVMI_BR_LT)), pc + 2 + instr->r);
+            *skip = true;
+            return true;
+        }
+
+        //
+        // `unreachable`. The handler sets the trap message.
+        case OVMI_BREAK:
+            emit_step(jit, instr);
+            emit_jump(jit, 0, TRAP_EXIT);
+            return true;
+
+        // These trap when the range is out of bounds.
+        case OVMI_COPY:
+        case OVMI_FILL:
+            emit_step(jit, instr);
+            emit_check_trap(jit);
+            return true;
+
+        default:
+            goto step;
+    }
+
+  step:
+    if (!ovm_instr_step_handler(instr->full_instr)) return false;
+    emit_step(jit, instr);
+
+    // The handlers of fused instructions do the work of both instructions.
+    if (op >= OVMI_IMM_ADD && op <= OVMI_BR_NE) *skip = true;
+    return true;
+}
+
+//
+// Returns the index of the instruction after the last one of `func`.
+static i32 find_func_end(ovm_program_t *program, ovm_func_t *func) {
+    i32 end = bh_arr_length(program->code);
+    bh_arr_each(ovm_func_t, other, program->funcs) {
+        if (other->kind != OVM_FUNC_INTERNAL) continue;
+        if (other->start_instr > func->start_instr && other->start_instr < end) {
+            end = other->start_instr;
+        }
+    }
+
+    return end;
+}
+
+static bool compile_func(ovm_program_t *program, ovm_func_t *func) {
+    jit_t jit = {0};
+    jit.program = program;
+    jit.start = func->start_instr;
+    jit.end = find_func_end(program, func);
+
+    bh_allocator alloc = bh_heap_allocator();
+    bh_buffer_init(&jit.code, alloc, 1024);
+    bh_arr_new(alloc, jit.fixups, 64);
+    bh_arr_new(alloc, jit.table_fixups, 4);
+    jit.labels = bh_alloc_array(alloc, i32, jit.end - jit.start);
+
+    bool success = true;
+    emit_prologue(&jit);
+
+    for (i32 i = jit.start; i < jit.end; i++) {
+        jit.labels[i - jit.start] = jit.code.length;
+
+        bool skip;
+        if (!emit_instr(&jit, i, &skip)) {
+            success = false;
+            break;
+        }
+
+        if (skip && i + 1 < jit.end) {
+            i++;
+            jit.labels[i - jit.start] = jit.code.length;
+        }
+    }
+
+    if (!success) goto done;
+
+    i32 trap_exit = jit.code.length;
+    emit_rr(&jit, 0, 0, 0x31, RAX, RAX);                          // xor eax, eax
+    emit_epilogue(&jit);
+
+    bh_arr_each(jit_fixup_t, fixup, jit.fixups) {
+        i32 target;
+        if (fixup->target_instr == TRAP_EXIT) {
+            target = trap_exit;
+        } else {
+            assert(fixup->target_instr >= 0 && fixup->target_instr < jit.end - jit.start);
+            target = jit.labels[fixup->target_instr];
+        }
+
+        *(i32 *) &jit.code.data[fixup->offset] = target - (fixup->offset + 4);
+    }
+
+    //
+    // The branch table holds the offset of every instruction from the table.
+    bh_buffer_align(&jit.code, 4);
+    i32 table = jit.code.length;
+    fori (i, 0, jit.end - jit.start) {
+        emit_u32(&jit, jit.labels[i] - table);
+    }
+
+    bh_arr_each(i32, fixup, jit.table_fixups) {
+        *(i32 *) &jit.code.data[*fixup] = table - (*fixup + 4);
+    }
+
+    i64 page_size = sysconf(_SC_PAGESIZE);
+    i64 size = jit.code.length;
+    bh_align(size, page_size);
+
+    u8 *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        success = false;
+        goto done;
+    }
+
+    memcpy(code, jit.code.data, jit.code.length);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        success = false;
+        goto done;
+    }
+
+    func->jit_code_size = size;
+    __atomic_store_n(&func->jit_code, code, __ATOMIC_RELEASE);
+
+  done:
+    bh_buffer_free(&jit.code);
+    bh_arr_free(jit.fixups);
+    bh_arr_free(jit.table_fixups);
+    bh_free(alloc, jit.labels);
+    return success;
+}
+
+bool ovm_jit_compile(ovm_program_t *program, ovm_func_t *func) {
+    if (func->kind != OVM_FUNC_INTERNAL) return false;
+
+    //
+    // Only one thread compiles a function. The others keep interpreting it
+    // until the code is ready.
+    u32 expected = OVM_JIT_NONE;
+    if (!__atomic_compare_exchange_n(&func->jit_status, &expected, OVM_JIT_COMPILING,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    bool success = compile_func(program, func);
+    __atomic_store_n(&func->jit_status, success ? OVM_JIT_READY : OVM_JIT_FAILED, __ATOMIC_RELEASE);
+    return success;
+}
+
+void ovm_jit_free(ovm_func_t *func) {
+    if (func->jit_code) {
+        munmap(func->jit_code, func->jit_code_size);
+        func->jit_code = NULL;
+    }
+}
+
+#else
+
+bool ovm_jit_compile(ovm_program_t *program, ovm_func_t *func) {
+    return false;
+}
+
+void ovm_jit_free(ovm_func_t *func) {
+}
+
+#endif
@@ -1,5 +1,10 @@
 #include "vm.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 //
 // I'm very lazy and silly, so this code make the drastic assumption that the
 // endianness of the machine that the file was built on and the machine the
@@ -124,3 +129,179 @@ void ovm_state_link_external_funcs(ovm_program_t *program, ovm_state_t *state, o
         }
     }
 }
+
+
+//
+// Program cache
+//
+// The cache file is the program's arrays written out as they are in memory,
+// behind a header that says what they were built from. The same caveat about
+// endianness as above applies, but cache files are never meant to leave the
+// machine they were written on.
+//
+// Instruction encodings change between builds of OVM, so the build is part of
+// the header as well.
+//
+
+#define OVM_CACHE_MAGIC   "OVMC"
+#define OVM_CACHE_VERSION 1
+
+typedef struct ovm_cache_header_t {
+    char magic[4];
+    u32  version;
+    u64  key;
+    u64  build;
+    u32  instr_size;
+
+    i32  register_count;
+    i32  func_count;
+    i32  code_count;
+    i32  static_integer_count;
+    i32  static_data_count;
+} ovm_cache_header_t;
+
+typedef struct ovm_cache_func_t {
+    i32 kind;
+    i32 id;
+    i32 param_count;
+    i32 value_number_count;
+    i32 start_instr_or_external_idx;
+    i32 name_length;
+} ovm_cache_func_t;
+
+static u64 ovm__cache_build_id() {
+    const char *build = __DATE__ " " __TIME__;
+
+    u64 hash = 5381;
+    while (*build) hash = (hash << 5) + hash + *build++;
+    return hash;
+}
+
+bool ovm_program_save_to_cache(ovm_program_t *program, char *filename, u64 key) {
+    ovm_cache_header_t header = {0};
+    memcpy(header.magic, OVM_CACHE_MAGIC, 4);
+    header.version = OVM_CACHE_VERSION;
+    header.key = key;
+    header.build = ovm__cache_build_id();
+    header.instr_size = sizeof(ovm_instr_t);
+    header.register_count = program->register_count;
+    header.func_count = bh_arr_length(program->funcs);
+    header.code_count = bh_arr_length(program->code);
+    header.static_integer_count = bh_arr_length(program->static_integers);
+    header.static_data_count = bh_arr_length(program->static_data);
+
+    bh_buffer buffer;
+    bh_buffer_init(&buffer, bh_heap_allocator(), sizeof(header) + header.code_count * sizeof(ovm_instr_t));
+    bh_buffer_append(&buffer, &header, sizeof(header));
+
+    bh_arr_each(ovm_func_t, func, program->funcs) {
+        ovm_cache_func_t entry;
+        entry.kind = func->kind;
+        entry.id = func->id;
+        entry.param_count = func->param_count;
+        entry.value_number_count = func->value_number_count;
+        entry.start_instr_or_external_idx = func->kind == OVM_FUNC_INTERNAL ? func->start_instr : func->external_func_idx;
+        entry.name_length = func->name ? strlen(func->name) : 0;
+
+        bh_buffer_append(&buffer, &entry, sizeof(entry));
+        bh_buffer_append(&buffer, func->name, entry.name_length);
+    }
+
+    bh_buffer_append(&buffer, program->code, header.code_count * sizeof(ovm_instr_t));
+    bh_buffer_append(&buffer, program->static_integers, header.static_integer_count * sizeof(i32));
+    bh_buffer_append(&buffer, program->static_data, header.static_data_count * sizeof(ovm_static_integer_array_t));
+
+    //
+    // The file is written under a temporary name and renamed into place, so
+    // that another process loading the same program never sees half of it.
+    char *temp_filename = bh_aprintf(bh_heap_allocator(), "%s.%d.tmp", filename, getpid());
+
+    bool success = false;
+    bh_file file;
+    if (bh_file_create(&file, temp_filename) == BH_FILE_ERROR_NONE) {
+        success = bh_file_write(&file, buffer.data, buffer.length);
+        bh_file_close(&file);
+
+        success = success && rename(temp_filename, filename) == 0;
+        if (!success) remove(temp_filename);
+    }
+
+    bh_free(bh_heap_allocator(), temp_filename);
+    bh_buffer_free(&buffer);
+    return success;
+}
+
+bool ovm_program_load_from_cache(ovm_program_t *program, char *filename, u64 key) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (i64) sizeof(ovm_cache_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    u8 *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    bool success = false;
+    u8 *end = data + st.st_size;
+
+    ovm_cache_header_t header;
+    memcpy(&header, data, sizeof(header));
+    u8 *cursor = data + sizeof(header);
+
+    if (strncmp(header.magic, OVM_CACHE_MAGIC, 4)
+        || header.version != OVM_CACHE_VERSION
+        || header.key != key
+        || header.build != ovm__cache_build_id()
+        || header.instr_size != sizeof(ovm_instr_t)) {
+        goto done;
+    }
+
+    fori (i, 0, header.func_count) {
+        ovm_cache_func_t entry;
+        if (cursor + sizeof(entry) > end) goto done;
+        memcpy(&entry, cursor, sizeof(entry));
+        cursor += sizeof(entry);
+
+        if (cursor + entry.name_length > end) goto done;
+        char *name = bh_alloc_array(program->store->arena_allocator, char, entry.name_length + 1);
+        memcpy(name, cursor, entry.name_length);
+        name[entry.name_length] = '\0';
+        cursor += entry.name_length;
+
+        if (entry.kind == OVM_FUNC_INTERNAL) {
+            ovm_program_register_func(program, name, entry.start_instr_or_external_idx, entry.param_count, entry.value_number_count);
+        } else {
+            ovm_program_register_external_func(program, name, entry.param_count, entry.start_instr_or_external_idx);
+        }
+
+        // Registering numbers functions in order, so this holds unless the file is damaged.
+        if (bh_arr_last(program->funcs).id != entry.id) goto done;
+    }
+
+    i64 code_size = header.code_count * sizeof(ovm_instr_t);
+    i64 ints_size = header.static_integer_count * sizeof(i32);
+    i64 data_size = header.static_data_count * sizeof(ovm_static_integer_array_t);
+    if (cursor + code_size + ints_size + data_size != end) goto done;
+
+    bh_arr_insert_end(program->code, header.code_count);
+    memcpy(program->code, cursor, code_size);
+    cursor += code_size;
+
+    bh_arr_insert_end(program->static_integers, header.static_integer_count);
+    memcpy(program->static_integers, cursor, ints_size);
+    cursor += ints_size;
+
+    bh_arr_insert_end(program->static_data, header.static_data_count);
+    memcpy(program->static_data, cursor, data_size);
+
+    program->register_count = header.register_count;
+    success = true;
+
+  done:
+    munmap(data, st.st_size);
+    return success;
+}
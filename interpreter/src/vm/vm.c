@@ -3,9 +3,13 @@
 #include "vm.h"
 
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <x86intrin.h>
 #include <math.h> // REMOVE THIS!!!  only needed for sqrt
 #include <pthread.h>
+#include <signal.h>
+#include <setjmp.h>
 
 #ifdef OVM_DEBUG
 #define ovm_assert(c) assert((c))
@@ -15,12 +19,16 @@
 
 
 static inline void ovm_print_val(ovm_value_t val) {
+#if defined(OVM_TYPED_VALUES)
     switch (val.type) {
         case OVM_TYPE_I32: printf("i32[%d]", val.i32); break;
         case OVM_TYPE_I64: printf("i64[%ld]", val.i64); break;
         case OVM_TYPE_F32: printf("f32[%f]", val.f32); break;
         case OVM_TYPE_F64: printf("f64[%lf]", val.f64); break;
     }
+#else
+    printf("[%lx]", val.u64);
+#endif
 }
 
 
@@ -63,6 +71,10 @@ ovm_program_t *ovm_program_new(ovm_store_t *store) {
 }
 
 void ovm_program_delete(ovm_program_t *program) {
+    bh_arr_each(ovm_func_t, func, program->funcs) {
+        ovm_jit_free(func);
+    }
+
     bh_arr_free(program->funcs);
     bh_arr_free(program->code);
     bh_arr_free(program->static_integers);
@@ -101,6 +113,10 @@ int ovm_program_register_func(ovm_program_t *program, char *name, i32 instr, i32
     func.start_instr = instr;
     func.param_count = param_count;
     func.value_number_count = value_number_count;
+    func.call_count = 0;
+    func.jit_status = OVM_JIT_NONE;
+    func.jit_code = NULL;
+    func.jit_code_size = 0;
 
     bh_arr_push(program->funcs, func);
     return func.id;
@@ -114,6 +130,10 @@ int ovm_program_register_external_func(ovm_program_t *program, char *name, i32 p
     func.param_count = param_count;
     func.external_func_idx = external_func_idx;
     func.value_number_count = param_count;
+    func.call_count = 0;
+    func.jit_status = OVM_JIT_NONE;
+    func.jit_code = NULL;
+    func.jit_code_size = 0;
 
     bh_arr_push(program->funcs, func);
     return func.id;
@@ -126,6 +146,10 @@ void ovm_program_begin_func(ovm_program_t *program, char *name, i32 param_count,
     func.start_instr = bh_arr_length(program->code);
     func.param_count = param_count;
     func.value_number_count = value_number_count;
+    func.call_count = 0;
+    func.jit_status = OVM_JIT_NONE;
+    func.jit_code = NULL;
+    func.jit_code_size = 0;
 
     bh_arr_push(program->funcs, func);
 }
@@ -137,6 +161,66 @@ void ovm_program_add_instructions(ovm_program_t *program, i32 instr_count, ovm_i
 }
 
 
+//
+// Out of bounds memory accesses
+//
+// Every call from the host into OVM code registers itself with its thread
+// (see ovm_func_call). When an access faults inside the reservation of the
+// engine's memory, the fault handler jumps back to the innermost call, which
+// returns with a trap. The stack frames are left in place for the trace.
+//
+typedef struct ovm_memory_trap_t ovm_memory_trap_t;
+struct ovm_memory_trap_t {
+    sigjmp_buf jump;
+    ovm_engine_t *engine;
+    ovm_memory_trap_t *outer;
+};
+
+static __thread ovm_memory_trap_t *ovm__memory_trap;
+
+static struct sigaction ovm__previous_fault_action;
+static pthread_once_t   ovm__fault_handler_once = PTHREAD_ONCE_INIT;
+
+static void ovm__fault_handler(int sig, siginfo_t *info, void *context) {
+    ovm_memory_trap_t *trap = ovm__memory_trap;
+    if (trap && trap->engine->memory) {
+        u8 *addr   = info->si_addr;
+        u8 *memory = trap->engine->memory;
+        if (addr >= memory && addr < memory + OVM_MEMORY_RESERVATION) {
+            siglongjmp(trap->jump, 1);
+        }
+    }
+
+    //
+    // This fault has nothing to do with OVM, so it goes to the previous
+    // handler. This handler stays installed for the faults that follow.
+    struct sigaction *previous = &ovm__previous_fault_action;
+    if (previous->sa_flags & SA_SIGINFO) {
+        previous->sa_sigaction(sig, info, context);
+        return;
+    }
+
+    if (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN) {
+        previous->sa_handler(sig);
+        return;
+    }
+
+    //
+    // A fault cannot be ignored, so both mean the default action. Returning runs
+    // the faulting instruction again, which then terminates the process.
+    signal(SIGSEGV, SIG_DFL);
+}
+
+static void ovm__install_fault_handler() {
+    struct sigaction action = {0};
+    action.sa_sigaction = ovm__fault_handler;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER; // SA_NODEFER, as the handler jumps out without restoring the signal mask.
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGSEGV, &action, &ovm__previous_fault_action);
+}
+
+
 //
 // Engine
 ovm_engine_t *ovm_engine_new(ovm_store_t *store) {
@@ -146,19 +230,21 @@ ovm_engine_t *ovm_engine_new(ovm_store_t *store) {
     engine->memory_size = 0;
     engine->memory = NULL;
     engine->debug = NULL;
-    pthread_mutex_init(&engine->atomic_mutex, NULL);
+    engine->profiler = NULL;
+    engine->max_call_depth = OVM_DEFAULT_MAX_CALL_DEPTH;
+    engine->value_stack_size = OVM_DEFAULT_VALUE_STACK_SIZE;
+    engine->jit_threshold = OVM_DEFAULT_JIT_THRESHOLD;
 
     //
-    // HACK: This should not be necessary, but because moving the memory around
-    // causes issues with other standard libraries (like STBTT and STBI), it is
-    // better to allocate a large amount here and avoid needing to reallocate.
-    // A solution should be possible, because other runtimes like Wasmer support
-    // this.
-    i64 attempt_to_allocate = 1ull << 32;
-    while (!ovm_engine_memory_ensure_capacity(engine, attempt_to_allocate)) {
-        attempt_to_allocate /= 2;
+    // None of the reservation is backed by physical pages until it is made
+    // accessible and touched.
+    void *memory = mmap(NULL, OVM_MEMORY_RESERVATION, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory != MAP_FAILED) {
+        engine->memory = memory;
     }
 
+    pthread_once(&ovm__fault_handler_once, ovm__install_fault_handler);
+
     return engine;
 }
 
@@ -166,7 +252,7 @@ void ovm_engine_delete(ovm_engine_t *engine) {
     ovm_store_t *store = engine->store;
 
     if (engine->memory) {
-        munmap(engine->memory, engine->memory_size);
+        munmap(engine->memory, OVM_MEMORY_RESERVATION);
     }
     
     bh_free(store->heap_allocator, engine);
@@ -174,25 +260,17 @@ void ovm_engine_delete(ovm_engine_t *engine) {
 
 bool ovm_engine_memory_ensure_capacity(ovm_engine_t *engine, i64 minimum_size) {
     if (engine->memory_size >= minimum_size) return true;
+    if (engine->memory == NULL || minimum_size > OVM_MEMORY_RESERVATION - OVM_MEMORY_GUARD_SIZE) return false;
 
-    void *new_addr;
-
-    if (engine->memory == NULL) {
-        new_addr = mmap(NULL, minimum_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    } else {
-        new_addr = mremap(engine->memory, engine->memory_size, minimum_size, MREMAP_MAYMOVE);
-    }
-
-    if (new_addr == MAP_FAILED) {
-        // Something went wrong...
-        // At this point the program should probably horifically crash.
+    i64 page_size = sysconf(_SC_PAGESIZE);
+    i64 accessible_size = minimum_size;
+    bh_align(accessible_size, page_size);
 
+    if (mprotect(engine->memory, accessible_size, PROT_READ | PROT_WRITE) != 0) {
         return false;
     }
 
     engine->memory_size = minimum_size;
-    engine->memory = new_addr;
-
     return true;
 }
 
@@ -209,47 +287,91 @@ void ovm_engine_memory_copy(ovm_engine_t *engine, i64 target, void *data, i64 si
 //
 // State
 //
+
+//
+// Reserves `size` bytes for one of the stacks of a state, followed by a guard
+// page. The memory is only backed by physical pages once it is touched.
+static i64 ovm__stack_reservation_size(i64 size) {
+    i64 page_size = sysconf(_SC_PAGESIZE);
+    bh_align(size, page_size);
+    return size + page_size;
+}
+
+static void *ovm__reserve_stack(i64 size) {
+    i64 reserved = ovm__stack_reservation_size(size);
+    u8 *stack = mmap(NULL, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) return NULL;
+
+    i64 page_size = sysconf(_SC_PAGESIZE);
+    mprotect(stack + reserved - page_size, page_size, PROT_NONE);
+    return stack;
+}
+
 // This takes in a program because it needs to know how many registers to allocate.
 // Should there be another mechanism for this? or is this the most concise way?
 ovm_state_t *ovm_state_new(ovm_engine_t *engine, ovm_program_t *program) {
     ovm_store_t *store = engine->store;
-    ovm_state_t *state = bh_alloc_item(store->arena_allocator, ovm_state_t);
+    ovm_state_t *state = bh_alloc_item(store->heap_allocator, ovm_state_t);
 
     state->store = store;
     state->engine = engine;
     state->program = program;
     state->pc = 0;
     state->value_number_offset = 0;
+    state->trap_message = NULL;
+    state->jit_depth = 0;
+
+    state->value_stack_capacity = engine->value_stack_size / sizeof(ovm_value_t);
+    state->value_stack_top = 0;
+    state->numbered_values = ovm__reserve_stack(state->value_stack_capacity * sizeof(ovm_value_t));
+
+    state->stack_frame_capacity = engine->max_call_depth;
+    state->stack_frame_count = 0;
+    state->stack_frames = ovm__reserve_stack(state->stack_frame_capacity * sizeof(ovm_stack_frame_t));
+
+    assert(state->numbered_values && state->stack_frames);
+    state->__frame_values = state->numbered_values;
 
-    state->numbered_values = NULL;
-    state->stack_frames = NULL;
     state->registers = NULL;
-    bh_arr_new(store->heap_allocator, state->numbered_values, 128);
-    bh_arr_new(store->heap_allocator, state->stack_frames, 32);
     bh_arr_new(store->heap_allocator, state->registers, program->register_count);
     bh_arr_insert_end(state->registers, program->register_count);
 
-    state->param_buf = bh_alloc_array(store->arena_allocator, ovm_value_t, OVM_MAX_PARAM_COUNT);
+    state->param_buf = bh_alloc_array(store->heap_allocator, ovm_value_t, OVM_MAX_PARAM_COUNT);
     state->param_count = 0;
 
     state->external_funcs = NULL;
     bh_arr_new(store->heap_allocator, state->external_funcs, 8);
 
+    state->debug = NULL;
     if (engine->debug) {
         u32 thread_id = debug_host_register_thread(engine->debug, state);
         state->debug = debug_host_lookup_thread(engine->debug, thread_id);
     }
 
+    if (engine->profiler) {
+        debug_profiler_register_thread(engine->profiler, state);
+    }
+
     return state;
 }
 
 void ovm_state_delete(ovm_state_t *state) {
     ovm_store_t *store = state->store;
 
-    bh_arr_free(state->numbered_values);
-    bh_arr_free(state->stack_frames);
+    if (state->engine->profiler) {
+        debug_profiler_unregister_thread(state->engine->profiler, state);
+    }
+
+    munmap(state->numbered_values, ovm__stack_reservation_size(state->value_stack_capacity * sizeof(ovm_value_t)));
+    munmap(state->stack_frames, ovm__stack_reservation_size(state->stack_frame_capacity * sizeof(ovm_stack_frame_t)));
     bh_arr_free(state->registers);
     bh_arr_free(state->external_funcs);
+
+    // The debugger keeps a pointer to every state it has seen.
+    if (!state->debug) {
+        bh_free(store->heap_allocator, state->param_buf);
+        bh_free(store->heap_allocator, state);
+    }
 }
 
 void ovm_state_register_external_func(ovm_state_t *state, i32 idx, void (*func)(void *, ovm_value_t *, ovm_value_t *), void *data) {
@@ -275,24 +397,32 @@ void ovm_state_register_set(ovm_state_t *state, i32 idx, ovm_value_t val) {
 //
 // Function calling
 
-static void ovm__func_setup_stack_frame(ovm_state_t *state, ovm_func_t *func, i32 result_number) {
+//
+// Returns false, and sets the trap message of the state, if either of the
+// stacks would overflow.
+static inline bool ovm__func_setup_stack_frame(ovm_state_t *state, ovm_func_t *func, i32 result_number) {
+    if (state->stack_frame_count >= state->stack_frame_capacity
+        || state->value_stack_top + func->value_number_count > state->value_stack_capacity) {
+        state->trap_message = "call stack exhausted";
+        return false;
+    }
+
     //
     // Push a stack frame
-    ovm_stack_frame_t frame;
-    frame.func = func;
-    frame.value_number_count = func->value_number_count;
-    frame.value_number_base  = bh_arr_length(state->numbered_values);
-    frame.return_address = state->pc;
-    frame.return_number_value = result_number;
-    bh_arr_push(state->stack_frames, frame);
+    ovm_stack_frame_t *frame = &state->stack_frames[state->stack_frame_count++];
+    frame->func = func;
+    frame->value_number_count = func->value_number_count;
+    frame->value_number_base  = state->value_stack_top;
+    frame->return_address = state->pc;
+    frame->return_number_value = result_number;
 
     //
     // Move the base pointer to the value numbers.
-    state->value_number_offset = frame.value_number_base;
+    state->value_number_offset = frame->value_number_base;
 
     //
     // Setup value numbers
-    bh_arr_insert_end(state->numbered_values, func->value_number_count);
+    state->value_stack_top += func->value_number_count;
 
     state->__frame_values = &state->numbered_values[state->value_number_offset];
 
@@ -301,16 +431,18 @@ static void ovm__func_setup_stack_frame(ovm_state_t *state, ovm_func_t *func, i3
     if (state->debug) {
         state->debug->extra_frames_since_last_pause++;
     }
+
+    return true;
 }
 
-static ovm_stack_frame_t ovm__func_teardown_stack_frame(ovm_state_t *state) {
-    ovm_stack_frame_t frame = bh_arr_pop(state->stack_frames);
-    bh_arr_fastdeleten(state->numbered_values, frame.value_number_count);
+static inline ovm_stack_frame_t ovm__func_teardown_stack_frame(ovm_state_t *state) {
+    ovm_stack_frame_t frame = state->stack_frames[--state->stack_frame_count];
+    state->value_stack_top -= frame.value_number_count;
 
-    if (bh_arr_length(state->stack_frames) == 0) {
+    if (state->stack_frame_count == 0) {
         state->value_number_offset = 0;
     } else {
-        state->value_number_offset = bh_arr_last(state->stack_frames).value_number_base;
+        state->value_number_offset = state->stack_frames[state->stack_frame_count - 1].value_number_base;
     }
 
     state->__frame_values = &state->numbered_values[state->value_number_offset];
@@ -325,32 +457,146 @@ static ovm_stack_frame_t ovm__func_teardown_stack_frame(ovm_state_t *state) {
     return frame;
 }
 
+//
+// Removes the stack frames left behind by a trap, down to `frame_count` frames.
+void ovm_state_unwind(ovm_state_t *state, i32 frame_count) {
+    while (state->stack_frame_count > frame_count) {
+        ovm__func_teardown_stack_frame(state);
+    }
+}
+
+//
+// Runs `func` as native code, if the JIT has compiled it or if this call makes
+// it hot enough to be compiled. The stack frame for the call must already be
+// set up, with the parameters in place. When this returns true, the function
+// has run: its result is in `*result`, and its stack frame has been torn down
+// unless it trapped.
+static inline bool ovm__jit_run(ovm_state_t *state, ovm_func_t *func, ovm_value_t *result) {
+    ovm_jit_entry_t code = __atomic_load_n(&func->jit_code, __ATOMIC_ACQUIRE);
+    if (!code) {
+        //
+        // Functions are never compiled while a debugger is attached, so
+        // only this path has to check for it.
+        i32 threshold = state->engine->jit_threshold;
+        if (threshold <= 0 || state->debug) return false;
+
+        u32 count = func->call_count + 1;
+        func->call_count = count;
+        if (count < (u32) threshold || func->jit_status != OVM_JIT_NONE) return false;
+
+        if (!ovm_jit_compile(state->program, func)) return false;
+        code = func->jit_code;
+    }
+
+    //
+    // Every native call uses the native stack, so deep recursion is left
+    // to the interpreter, which reports running out of stack properly.
+    if (state->jit_depth >= OVM_JIT_MAX_DEPTH) return false;
+
+    state->jit_depth++;
+    *result = code(state->__frame_values, state->engine->memory, state);
+    state->jit_depth--;
+
+    if (!state->trap_message) {
+        ovm_stack_frame_t frame = ovm__func_teardown_stack_frame(state);
+        state->pc = frame.return_address;
+    }
+
+    return true;
+}
+
+void ovm_jit_call(ovm_state_t *state, ovm_instr_t *instr) {
+    ovm_value_t *values = state->__frame_values;
+
+    i32 fidx = instr->a;
+    if (OVM_INSTR_INSTR(*instr) == OVMI_CALLI) fidx = values[instr->a].i32;
+
+    ovm_func_t *func = &state->program->funcs[fidx];
+    i32 extra_params = state->param_count - func->param_count;
+    ovm_assert(extra_params >= 0);
+
+    //
+    // A negative return address makes the interpreter return to here when
+    // the function returns, instead of continuing in the caller.
+    state->pc = -1;
+    if (!ovm__func_setup_stack_frame(state, func, instr->r)) return;
+
+    state->param_count -= func->param_count;
+
+    if (func->kind == OVM_FUNC_EXTERNAL) {
+        ovm_external_func_t external_func = state->external_funcs[func->external_func_idx];
+        external_func.native_func(external_func.userdata, &state->param_buf[extra_params], &state->__tmp_value);
+        if (state->trap_message) return;
+
+        ovm__func_teardown_stack_frame(state);
+        if (instr->r >= 0) values[instr->r] = state->__tmp_value;
+        return;
+    }
+
+    memcpy(state->__frame_values, &state->param_buf[extra_params], func->param_count * sizeof(ovm_value_t));
+
+    if (ovm__jit_run(state, func, &state->__tmp_value)) {
+        if (!state->trap_message && instr->r >= 0) values[instr->r] = state->__tmp_value;
+        return;
+    }
+
+    state->pc = func->start_instr;
+    ovm_run_code(state->engine, state, state->program);
+}
+
 ovm_value_t ovm_func_call(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t *program, i32 func_idx, i32 param_count, ovm_value_t *params) {
     ovm_func_t *func = &program->funcs[func_idx];
     ovm_assert(func->value_number_count >= func->param_count);
 
+    state->trap_message = NULL;
+
     switch (func->kind) {
         case OVM_FUNC_INTERNAL: {
-            ovm__func_setup_stack_frame(state, func, 0);
+            if (!ovm__func_setup_stack_frame(state, func, 0)) {
+                return (ovm_value_t) {};
+            }
 
             fori (i, 0, param_count) {
                 state->numbered_values[i + state->value_number_offset] = params[i];
             }
 
-            state->pc = func->start_instr;
-            ovm_value_t result = ovm_run_code(engine, state, program);
+            ovm_memory_trap_t memory_trap;
+            memory_trap.engine = engine;
+            memory_trap.outer = ovm__memory_trap;
+            i32 jit_depth = state->jit_depth;
+
+            if (sigsetjmp(memory_trap.jump, 0)) {
+                ovm__memory_trap = memory_trap.outer;
+                state->jit_depth = jit_depth;
+                state->trap_message = "out of bounds memory access";
+                return (ovm_value_t) {};
+            }
+
+            ovm__memory_trap = &memory_trap;
+
+            ovm_value_t result;
+            if (!ovm__jit_run(state, func, &result)) {
+                state->pc = func->start_instr;
+                result = ovm_run_code(engine, state, program);
+            }
 
+            ovm__memory_trap = memory_trap.outer;
             return result;
         }
 
         case OVM_FUNC_EXTERNAL: {
-            ovm__func_setup_stack_frame(state, func, 0);
+            if (!ovm__func_setup_stack_frame(state, func, 0)) {
+                return (ovm_value_t) {};
+            }
 
             ovm_value_t result = {0};
             ovm_external_func_t external_func = state->external_funcs[func->external_func_idx];
             external_func.native_func(external_func.userdata, params, &result);
 
-            ovm__func_teardown_stack_frame(state);
+            if (!state->trap_message) {
+                ovm__func_teardown_stack_frame(state);
+            }
+
             return result;
         }
 
@@ -400,6 +646,134 @@ static inline double __ovm_copysign(a, b) double a, b; {
     return -a;
 }
 
+//
+// memory.atomic.wait and memory.atomic.notify are implemented with futexes
+// keyed on the address in linear memory. Futexes are always 32 bits wide, so a
+// 64-bit wait compares the full value first, then sleeps on the low half. A
+// spurious wake up is allowed by WASM, so this is still correct.
+static i32 __ovm_atomic_wait(void *addr, u64 expected, bool wide, i64 timeout) {
+    u64 current = wide ? __atomic_load_n((u64 *) addr, __ATOMIC_SEQ_CST)
+                       : __atomic_load_n((u32 *) addr, __ATOMIC_SEQ_CST);
+    if (!wide) expected = (u32) expected;
+    if (current != expected) return 1; // "not-equal"
+
+    struct timespec deadline, ts, *tsp = NULL;
+    if (timeout >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += timeout / 1000000000;
+        deadline.tv_nsec += timeout % 1000000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    while (1) {
+        //
+        // A signal can interrupt the wait at any time, so the remaining
+        // time is computed from the deadline every time the wait starts.
+        if (timeout >= 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+            ts.tv_sec  = deadline.tv_sec  - now.tv_sec;
+            ts.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (ts.tv_nsec < 0) {
+                ts.tv_sec  -= 1;
+                ts.tv_nsec += 1000000000;
+            }
+
+            if (ts.tv_sec < 0) return 2; // "timed-out"
+            tsp = &ts;
+        }
+
+        long res = syscall(SYS_futex, (u32 *) addr, FUTEX_WAIT_PRIVATE, (u32) expected, tsp, NULL, 0);
+        if (res == 0)           return 0; // "ok"
+        if (errno == EAGAIN)    return 1; // "not-equal"
+        if (errno == ETIMEDOUT) return 2; // "timed-out"
+        if (errno != EINTR)     return 0;
+
+        //
+        // Interrupted by a signal, not woken by a notify. The futex only
+        // looks at the low half of a 64-bit value, so that is compared again.
+        if (wide && __atomic_load_n((u64 *) addr, __ATOMIC_SEQ_CST) != expected) return 1;
+    }
+}
+
+static i32 __ovm_atomic_notify(void *addr, u32 count) {
+    long res = syscall(SYS_futex, (u32 *) addr, FUTEX_WAKE_PRIVATE, (i32) bh_min(count, (u32) INT32_MAX), NULL, NULL, 0);
+    return res < 0 ? 0 : (i32) res;
+}
+
+//
+// SIMD
+//
+// A v128 value is stored in two consecutive value numbers. The lanes are
+// operated on with GCC's vector extensions, which compile to SSE2 on x86-64.
+// The instructions without a direct vector extension form use SSE intrinsics,
+// with a lane-by-lane fallback when they need more than SSE2 and OVM was not
+// compiled for a CPU that has it.
+typedef i8  __ovm_i8x16 __attribute__((vector_size(16)));
+typedef u8  __ovm_u8x16 __attribute__((vector_size(16)));
+typedef i16 __ovm_i16x8 __attribute__((vector_size(16)));
+typedef u16 __ovm_u16x8 __attribute__((vector_size(16)));
+typedef i32 __ovm_i32x4 __attribute__((vector_size(16)));
+typedef u32 __ovm_u32x4 __attribute__((vector_size(16)));
+typedef i64 __ovm_i64x2 __attribute__((vector_size(16)));
+typedef u64 __ovm_u64x2 __attribute__((vector_size(16)));
+typedef f32 __ovm_f32x4 __attribute__((vector_size(16)));
+typedef f64 __ovm_f64x2 __attribute__((vector_size(16)));
+
+typedef union ovm_v128_t {
+    __ovm_i8x16 i8;
+    __ovm_u8x16 u8;
+    __ovm_i16x8 i16;
+    __ovm_u16x8 u16;
+    __ovm_i32x4 i32;
+    __ovm_u32x4 u32;
+    __ovm_i64x2 i64;
+    __ovm_u64x2 u64;
+    __ovm_f32x4 f32;
+    __ovm_f64x2 f64;
+    __m128i     m;
+} ovm_v128_t;
+
+static inline ovm_v128_t __ovm_v128_get(ovm_value_t *values, i32 r) {
+    ovm_v128_t v;
+#if defined(OVM_TYPED_VALUES)
+    v.u64[0] = values[r].u64;
+    v.u64[1] = values[r + 1].u64;
+#else
+    memcpy(&v, &values[r], sizeof(v));
+#endif
+    return v;
+}
+
+static inline void __ovm_v128_set(ovm_value_t *values, i32 r, ovm_v128_t v) {
+#if defined(OVM_TYPED_VALUES)
+    values[r].u64     = v.u64[0];
+    values[r + 1].u64 = v.u64[1];
+    values[r].type     = OVM_TYPE_V128;
+    values[r + 1].type = OVM_TYPE_V128;
+#else
+    memcpy(&values[r], &v, sizeof(v));
+#endif
+}
+
+//
+// OVM is built with -Ofast, which lets GCC turn vector float division into
+// an approximate reciprocal and a multiply. WASM requires exact division,
+// so the division instructions are written out where GCC cannot change them.
+static inline __ovm_f32x4 __ovm_v_div_f32(__ovm_f32x4 a, __ovm_f32x4 b) {
+    __asm__ ("divps %1, %0" : "+x" (a) : "x" (b));
+    return a;
+}
+
+static inline __ovm_f64x2 __ovm_v_div_f64(__ovm_f64x2 a, __ovm_f64x2 b) {
+    __asm__ ("divpd %1, %0" : "+x" (a) : "x" (b));
+    return a;
+}
+
 static void __ovm_trigger_exception(ovm_state_t *state) {
     if (state->debug) {
         state->debug->state = debug_state_pausing;
@@ -427,7 +801,7 @@ static void __ovm_debug_hook(ovm_engine_t *engine, ovm_state_t *state) {
     }
 
     if (state->debug->pause_at_next_line) {
-        if (state->debug->pause_within == -1 || state->debug->pause_within == bh_arr_last(state->stack_frames).func->id) {
+        if (state->debug->pause_within == -1 || state->debug->pause_within == state->stack_frames[state->stack_frame_count - 1].func->id) {
 
             debug_loc_info_t l1, l2;
             debug_info_lookup_location(engine->debug->info, state->pc - 1, &l1);
@@ -466,14 +840,29 @@ static void __ovm_debug_hook(ovm_engine_t *engine, ovm_state_t *state) {
 #define OVMI_DISPATCH_NAME ovmi_dispatch
 #define OVMI_DEBUG_HOOK ((void)0)
 #define OVMI_EXCEPTION_HOOK ((void)0)
+#define OVMI_USE_JIT 1
 #include "./vm_instrs.h"
 
 #define OVMI_FUNC_NAME(n) ovmi_exec_debug_##n
 #define OVMI_DISPATCH_NAME ovmi_debug_dispatch
 #define OVMI_DEBUG_HOOK __ovm_debug_hook(state->engine, state)
 #define OVMI_EXCEPTION_HOOK __ovm_trigger_exception(state)
+#define OVMI_USE_JIT 0
 #include "./vm_instrs.h"
 
+#define OVMI_SINGLE_STEP
+#define OVMI_FUNC_NAME(n) ovmi_step_##n
+#define OVMI_DISPATCH_NAME ovmi_step_dispatch
+#define OVMI_DEBUG_HOOK ((void)0)
+#define OVMI_EXCEPTION_HOOK ((void)0)
+#define OVMI_USE_JIT 0
+#include "./vm_instrs.h"
+#undef OVMI_SINGLE_STEP
+
+ovm_instr_step_t ovm_instr_step_handler(u32 full_instr) {
+    return ovmi_step_dispatch[full_instr & OVM_INSTR_MASK];
+}
+
 ovm_value_t ovm_run_code(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t *program) {
     ovm_assert(engine);
     ovm_assert(state);
@@ -485,7 +874,9 @@ ovm_value_t ovm_run_code(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t
     ovm_instr_t *code = program->code;
     u8 *memory = engine->memory;
     ovm_value_t *values = state->__frame_values;
-    ovm_instr_t *instr = &code[state->pc];
+    //
+    // Handlers expect `pc` to already be past their instruction, like NEXT_OP leaves it.
+    ovm_instr_t *instr = &code[state->pc++];
 
     return exec_table[instr->full_instr & 0x7ff](instr, state, values, memory, code);
 }
@@ -493,8 +884,8 @@ ovm_value_t ovm_run_code(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t
 
 void ovm_print_stack_trace(ovm_engine_t *engine, ovm_state_t *state, ovm_program_t *program) {
     int i = 0;
-    bh_arr_rev_each(ovm_stack_frame_t, frame, state->stack_frames) {
-        ovm_func_t *func = frame->func;
+    for (i32 f = state->stack_frame_count - 1; f >= 0; f--) {
+        ovm_func_t *func = state->stack_frames[f].func;
         printf("[%03d] %s\n", i++, func->name);
     }
 }
@@ -24,10 +24,22 @@
 #define OVMI_INSTR_EXEC(name) \
     static OVMI_INSTR_PROTO(OVMI_FUNC_NAME(name))
 
+//
+// When OVMI_SINGLE_STEP is defined, every handler returns after running its
+// instruction instead of continuing with the next one. The JIT calls these
+// for the instructions it does not generate code for itself (see jit.c).
+// Handlers that can move linear memory reload `memory` for the next
+// instruction, which a single step never runs.
+#if defined(OVMI_SINGLE_STEP)
+#define NEXT_OP \
+    (void) memory; \
+    return ((ovm_value_t) {0});
+#else
 #define NEXT_OP \
     OVMI_DEBUG_HOOK; \
     instr = &code[state->pc++]; \
     return OVMI_DISPATCH_NAME[instr->full_instr & OVM_INSTR_MASK](instr, state, values, memory, code);
+#endif
 
 #define VAL(loc) values[loc]
 
@@ -77,7 +89,7 @@ OVMI_INSTR_EXEC(nop) {
 #define OVM_OP(t, op, ctype) \
     ovm_assert(VAL(instr->a).type == t && VAL(instr->b).type == t); \
     VAL(instr->r).ctype = VAL(instr->a).ctype op VAL(instr->b).ctype; \
-    VAL(instr->r).type = t;
+    OVM_SET_TYPE(VAL(instr->r), t);
 
 OVM_OP_EXEC(add, +)
 OVM_OP_EXEC(sub, -)
@@ -98,7 +110,7 @@ OVM_OP_INTEGER_EXEC(sar, >>)
 #define OVM_OP(t, func, ctype) \
     ovm_assert(VAL(instr->a).type == t && VAL(instr->b).type == t); \
     VAL(instr->r).ctype = func( VAL(instr->a).ctype, VAL(instr->b).ctype ); \
-    VAL(instr->r).type = t;
+    OVM_SET_TYPE(VAL(instr->r), t);
 
 OVMI_INSTR_EXEC(rotl_i32) { OVM_OP(OVM_TYPE_I32, __rold, u32); NEXT_OP; }
 OVMI_INSTR_EXEC(rotl_i64) { OVM_OP(OVM_TYPE_I64, __rolq, u64); NEXT_OP; }
@@ -114,7 +126,7 @@ OVM_OP_FLOAT_EXEC(copysign, __ovm_copysign)
 
 #define OVM_OP(t, op, ctype) \
     ovm_assert(VAL(instr->a).type == t); \
-    VAL(instr->r).type = t; \
+    OVM_SET_TYPE(VAL(instr->r), t); \
     VAL(instr->r).ctype = (ctype) op (VAL(instr->a).ctype);
 
 OVMI_INSTR_EXEC(clz_i32) { OVM_OP(OVM_TYPE_I32, __builtin_clz, u32);   NEXT_OP; }
@@ -137,7 +149,7 @@ OVM_OP_FLOAT_EXEC(sqrt,    sqrt)
 
 #define OVM_OP(t, op, ctype) \
     ovm_assert(VAL(instr->a).type == t && VAL(instr->b).type == t); \
-    VAL(instr->r).type = OVM_TYPE_I32; \
+    OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32); \
     VAL(instr->r).i32 = ((VAL(instr->a).ctype op VAL(instr->b).ctype)) ? 1 : 0;
 
 OVM_OP_EXEC(eq, ==)
@@ -160,7 +172,7 @@ OVM_OP_EXEC(ge_s, >=)
 //
 
 #define OVM_IMM(t, dtype, stype) \
-    VAL(instr->r).type = t; \
+    OVM_SET_TYPE(VAL(instr->r), t); \
     VAL(instr->r).u64 = 0; \
     VAL(instr->r).dtype = instr->stype;
 
@@ -183,7 +195,7 @@ OVMI_INSTR_EXEC(mov) {
         u32 dest = VAL(instr->a).u32 + (u32) instr->b; \
         if (dest == 0) OVMI_EXCEPTION_HOOK; \
         VAL(instr->r).stype = * (stype *) &memory[dest]; \
-        VAL(instr->r).type = type_; \
+        OVM_SET_TYPE(VAL(instr->r), type_); \
         NEXT_OP; \
     }
 
@@ -215,6 +227,15 @@ OVM_STORE(f64, OVM_TYPE_F64, f64)
 
 #undef OVM_STORE
 
+//
+// Unlike single loads and stores, these can reach past the guard region
+// after linear memory, so they are checked up front.
+#define OVM_CHECK_RANGE(start, count) \
+    if ((u64) (start) + (count) > (u64) state->engine->memory_size) { \
+        state->trap_message = "out of bounds memory access"; \
+        return ((ovm_value_t) {0}); \
+    }
+
 OVMI_INSTR_EXEC(copy) {
     u32 dest  = VAL(instr->r).u32;
     u32 src   = VAL(instr->a).u32;
@@ -222,23 +243,28 @@ OVMI_INSTR_EXEC(copy) {
 
     if (!dest || !src) OVMI_EXCEPTION_HOOK;
 
+    OVM_CHECK_RANGE(dest, count);
+    OVM_CHECK_RANGE(src, count);
     memmove(&memory[dest], &memory[src], count);
 
     NEXT_OP;
 }
 
 OVMI_INSTR_EXEC(fill) {
-    i32 dest  = VAL(instr->r).i32;
+    u32 dest  = VAL(instr->r).u32;
     u8  byte  = VAL(instr->a).u8;
-    i32 count = VAL(instr->b).i32;
+    u32 count = VAL(instr->b).u32;
 
     if (!dest) OVMI_EXCEPTION_HOOK;
 
+    OVM_CHECK_RANGE(dest, count);
     memset(&memory[dest], byte, count);
 
     NEXT_OP;
 }
 
+#undef OVM_CHECK_RANGE
+
 OVMI_INSTR_EXEC(reg_get) {
     VAL(instr->r) = state->registers[instr->a];
 
@@ -256,7 +282,7 @@ OVMI_INSTR_EXEC(idx_arr) {
     ovm_assert(VAL(instr->b).u32 < (u32) data_elem.len);
 
     VAL(instr->r).i32 = state->program->static_integers[data_elem.start_idx + VAL(instr->b).u32];
-    VAL(instr->r).type = OVM_TYPE_I32;
+    OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32);
 
     NEXT_OP;
 }
@@ -280,11 +306,11 @@ OVMI_INSTR_EXEC(return) {
     state->pc = frame.return_address;
     values = state->__frame_values;
 
-    if (bh_arr_length(state->stack_frames) == 0) {
+    if (state->stack_frame_count == 0) {
         return val;
     }
 
-    ovm_func_t *new_func = bh_arr_last(state->stack_frames).func;
+    ovm_func_t *new_func = state->stack_frames[state->stack_frame_count - 1].func;
     if (new_func->kind == OVM_FUNC_EXTERNAL) {
         return val;
     }
@@ -293,8 +319,14 @@ OVMI_INSTR_EXEC(return) {
         VAL(frame.return_number_value) = val;
     }
 
+    //
+    // The function was called from JIT compiled code, which carries on by itself.
+    if (frame.return_address < 0) {
+        return val;
+    }
+
 #ifdef OVM_VERBOSE
-    printf("Returning from %s to %s: ", frame.func->name, bh_arr_last(state->stack_frames).func->name);
+    printf("Returning from %s to %s: ", frame.func->name, state->stack_frames[state->stack_frame_count - 1].func->name);
     ovm_print_val(val);
     printf("\n\n");
 #endif
@@ -308,16 +340,36 @@ OVMI_INSTR_EXEC(return) {
     ovm_func_t *func = &state->program->funcs[fidx]; \
     i32 extra_params = state->param_count - func->param_count; \
     ovm_assert(extra_params >= 0); \
-    ovm__func_setup_stack_frame(state, func, instr->r); \
+    if (!ovm__func_setup_stack_frame(state, func, instr->r)) { \
+        OVMI_EXCEPTION_HOOK; \
+        return ((ovm_value_t) {0}); \
+    } \
     state->param_count -= func->param_count; \
     if (func->kind == OVM_FUNC_INTERNAL) { \
         values = state->__frame_values; \
         memcpy(&VAL(0), &state->param_buf[extra_params], func->param_count * sizeof(ovm_value_t)); \
-        state->pc = func->start_instr; \
+\
+        if (OVMI_USE_JIT && ovm__jit_run(state, func, &state->__tmp_value)) { \
+            if (state->trap_message) { \
+                return ((ovm_value_t) {0}); \
+            } \
+\
+            values = state->__frame_values; \
+            memory = state->engine->memory; \
+            if (instr->r >= 0) { \
+                VAL(instr->r) = state->__tmp_value; \
+            } \
+        } else { \
+            state->pc = func->start_instr; \
+        } \
     } else { \
         ovm_external_func_t external_func = state->external_funcs[func->external_func_idx]; \
         external_func.native_func(external_func.userdata, &state->param_buf[extra_params], &state->__tmp_value); \
         memory = state->engine->memory; \
+\
+        if (state->trap_message) { \
+            return ((ovm_value_t) {0}); \
+        } \
 \
         ovm__func_teardown_stack_frame(state); \
 \
@@ -360,7 +412,7 @@ OVMI_INSTR_EXEC(bri_z)  { if (VAL(instr->b).i32 == 0) state->pc += VAL(instr->a)
 #define OVM_CVT(n1, n2, stype, dtype, otype, ctype) \
     OVMI_INSTR_EXEC(cvt_##n1##_##n2) { \
         state->__tmp_value.dtype = (ctype) VAL(instr->a).stype; \
-        state->__tmp_value.type = otype; \
+        OVM_SET_TYPE(state->__tmp_value, otype); \
         VAL(instr->r) = state->__tmp_value; \
         NEXT_OP; \
     }
@@ -421,7 +473,7 @@ OVM_CVT(f64_s, f32, f64, f32, OVM_TYPE_F32, f32);
     OVMI_INSTR_EXEC(transmute_##n1##_##n2) { \
         ovm_value_t tmp_val; \
         tmp_val.dtype = *(ctype *) &VAL(instr->a).stype; \
-        tmp_val.type = otype; \
+        OVM_SET_TYPE(tmp_val, otype); \
         VAL(instr->r) = tmp_val; \
         NEXT_OP; \
     }
@@ -435,29 +487,109 @@ OVM_CVT(f64, i64, f64, u64, OVM_TYPE_I64, u64);
 
 
 //
-// Compare exchange
+// Atomics
+//
+// These use the compiler's __atomic builtins, so they are lock-free for every
+// width on the platforms OVM supports. WASM atomics are sequentially consistent.
 //
 
-#define CMPXCHG(otype, ctype) \
-    OVMI_INSTR_EXEC(cmpxchg_##ctype) { \
-        pthread_mutex_lock(&state->engine->atomic_mutex); \
-        if (VAL(instr->r).u32 == 0) OVMI_EXCEPTION_HOOK; \
-        ctype *addr = (ctype *) &memory[VAL(instr->r).u32]; \
- \
-        VAL(instr->r).u64 = 0; \
-        VAL(instr->r).type = otype; \
-        VAL(instr->r).ctype = *addr; \
+#define OVM_ATOMIC_LOAD(otype, type_, stype) \
+    OVMI_INSTR_EXEC(atomic_load_##otype) { \
+        u32 dest = VAL(instr->a).u32 + (u32) instr->b; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        VAL(instr->r).u64 = __atomic_load_n((stype *) &memory[dest], __ATOMIC_SEQ_CST); \
+        OVM_SET_TYPE(VAL(instr->r), type_); \
+        NEXT_OP; \
+    }
+
+OVM_ATOMIC_LOAD(i8,  OVM_TYPE_I8,  u8)
+OVM_ATOMIC_LOAD(i16, OVM_TYPE_I16, u16)
+OVM_ATOMIC_LOAD(i32, OVM_TYPE_I32, u32)
+OVM_ATOMIC_LOAD(i64, OVM_TYPE_I64, u64)
+
+#undef OVM_ATOMIC_LOAD
+
+#define OVM_ATOMIC_STORE(otype, type_, stype) \
+    OVMI_INSTR_EXEC(atomic_store_##otype) { \
+        u32 dest = VAL(instr->r).u32 + (u32) instr->b; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        __atomic_store_n((stype *) &memory[dest], (stype) VAL(instr->a).u64, __ATOMIC_SEQ_CST); \
+        NEXT_OP; \
+    }
+
+OVM_ATOMIC_STORE(i8,  OVM_TYPE_I8,  u8)
+OVM_ATOMIC_STORE(i16, OVM_TYPE_I16, u16)
+OVM_ATOMIC_STORE(i32, OVM_TYPE_I32, u32)
+OVM_ATOMIC_STORE(i64, OVM_TYPE_I64, u64)
+
+#undef OVM_ATOMIC_STORE
+
+#define OVM_ATOMIC_RMW(name, builtin, otype, type_, stype) \
+    OVMI_INSTR_EXEC(atomic_##name##_##otype) { \
+        u32 dest = VAL(instr->a).u32; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        VAL(instr->r).u64 = builtin((stype *) &memory[dest], (stype) VAL(instr->b).u64, __ATOMIC_SEQ_CST); \
+        OVM_SET_TYPE(VAL(instr->r), type_); \
+        NEXT_OP; \
+    }
+
+#define OVM_ATOMIC_RMW_ALL(name, builtin) \
+    OVM_ATOMIC_RMW(name, builtin, i8,  OVM_TYPE_I8,  u8) \
+    OVM_ATOMIC_RMW(name, builtin, i16, OVM_TYPE_I16, u16) \
+    OVM_ATOMIC_RMW(name, builtin, i32, OVM_TYPE_I32, u32) \
+    OVM_ATOMIC_RMW(name, builtin, i64, OVM_TYPE_I64, u64)
+
+OVM_ATOMIC_RMW_ALL(add,  __atomic_fetch_add)
+OVM_ATOMIC_RMW_ALL(sub,  __atomic_fetch_sub)
+OVM_ATOMIC_RMW_ALL(and,  __atomic_fetch_and)
+OVM_ATOMIC_RMW_ALL(or,   __atomic_fetch_or)
+OVM_ATOMIC_RMW_ALL(xor,  __atomic_fetch_xor)
+OVM_ATOMIC_RMW_ALL(xchg, __atomic_exchange_n)
+
+#undef OVM_ATOMIC_RMW_ALL
+#undef OVM_ATOMIC_RMW
+
+#define OVM_ATOMIC_WAIT(otype, wide) \
+    OVMI_INSTR_EXEC(atomic_wait_##otype) { \
+        u32 dest = VAL(instr->r).u32; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        VAL(instr->r).u64 = (u32) __ovm_atomic_wait(&memory[dest], VAL(instr->a).u64, wide, VAL(instr->b).i64); \
+        OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32); \
+        NEXT_OP; \
+    }
+
+OVM_ATOMIC_WAIT(i32, false)
+OVM_ATOMIC_WAIT(i64, true)
+
+#undef OVM_ATOMIC_WAIT
+
+OVMI_INSTR_EXEC(atomic_notify) {
+    u32 dest = VAL(instr->a).u32;
+    if (dest == 0) OVMI_EXCEPTION_HOOK;
+    VAL(instr->r).u64 = (u32) __ovm_atomic_notify(&memory[dest], VAL(instr->b).u32);
+    OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32);
+    NEXT_OP;
+}
+
+#define CMPXCHG(otype, type_, stype) \
+    OVMI_INSTR_EXEC(cmpxchg_##otype) { \
+        u32 dest = VAL(instr->r).u32; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
  \
-        if (*addr == VAL(instr->a).ctype) { \
-            *addr = VAL(instr->b).ctype ; \
-        } \
+        /* On failure, the builtin writes the current value into `expected`. */ \
+        stype expected = (stype) VAL(instr->a).u64; \
+        __atomic_compare_exchange_n((stype *) &memory[dest], &expected, (stype) VAL(instr->b).u64, \
+                false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); \
  \
-        pthread_mutex_unlock(&state->engine->atomic_mutex); \
+        VAL(instr->r).u64 = expected; \
+        OVM_SET_TYPE(VAL(instr->r), type_); \
         NEXT_OP; \
     }
 
-CMPXCHG(OVM_TYPE_I32, i32)
-CMPXCHG(OVM_TYPE_I64, i64)
+CMPXCHG(i8,  OVM_TYPE_I8,  u8)
+CMPXCHG(i16, OVM_TYPE_I16, u16)
+CMPXCHG(i32, OVM_TYPE_I32, u32)
+CMPXCHG(i64, OVM_TYPE_I64, u64)
 
 #undef CMPXCHG
 
@@ -468,13 +600,13 @@ CMPXCHG(OVM_TYPE_I64, i64)
 
 OVMI_INSTR_EXEC(mem_size) {
     VAL(instr->r).u32 = (u32) (state->engine->memory_size / 65536);
-    VAL(instr->r).type = OVM_TYPE_I32;
+    OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32);
     NEXT_OP;
 }
 
 OVMI_INSTR_EXEC(mem_grow) {
     ovm_assert(VAL(instr->a).type == OVM_TYPE_I32);
-    VAL(instr->r).type = OVM_TYPE_I32;
+    OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32);
     VAL(instr->r).u32 = (u32) (state->engine->memory_size / 65536);
 
     if (!ovm_engine_memory_ensure_capacity(state->engine,
@@ -487,8 +619,593 @@ OVMI_INSTR_EXEC(mem_grow) {
 }
 
 
+//
+// SIMD
+//
+// See the comment above ovm_v128_t in vm.c. Every handler reads its vector
+// operands into locals first, so the result can alias an operand.
+//
+
+#define V_GET(loc)    __ovm_v128_get(values, (loc))
+#define V_SET(loc, v) __ovm_v128_set(values, (loc), (v))
+
+OVMI_INSTR_EXEC(mov_v128) {
+    V_SET(instr->r, V_GET(instr->a));
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(load_v128) {
+    ovm_assert(VAL(instr->a).type == OVM_TYPE_I32);
+    u32 dest = VAL(instr->a).u32 + (u32) instr->b;
+    if (dest == 0) OVMI_EXCEPTION_HOOK;
+
+    ovm_v128_t v;
+    memcpy(&v, &memory[dest], sizeof(v));
+    V_SET(instr->r, v);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(store_v128) {
+    ovm_assert(VAL(instr->r).type == OVM_TYPE_I32);
+    u32 dest = VAL(instr->r).u32 + (u32) instr->b;
+    if (dest == 0) OVMI_EXCEPTION_HOOK;
+
+    ovm_v128_t v = V_GET(instr->a);
+    memcpy(&memory[dest], &v, sizeof(v));
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(return_v128) {
+    ovm_v128_t val = V_GET(instr->a);
+    ovm_stack_frame_t frame = ovm__func_teardown_stack_frame(state);
+    state->pc = frame.return_address;
+    values = state->__frame_values;
+
+    //
+    // Vectors cannot be passed across the boundary to the host.
+    if (state->stack_frame_count == 0) {
+        return ((ovm_value_t) {0});
+    }
+
+    ovm_func_t *new_func = state->stack_frames[state->stack_frame_count - 1].func;
+    if (new_func->kind == OVM_FUNC_EXTERNAL) {
+        return ((ovm_value_t) {0});
+    }
+
+    if (frame.return_number_value >= 0) {
+        V_SET(frame.return_number_value, val);
+    }
+
+    if (frame.return_address < 0) {
+        return ((ovm_value_t) {0});
+    }
+
+    NEXT_OP;
+}
+
+#define OVM_V_SPLAT(otype, field, count) \
+    OVMI_INSTR_EXEC(v_splat_##otype) { \
+        ovm_v128_t r; \
+        fori (i, 0, count) r.field[i] = VAL(instr->a).field; \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_V_SPLAT(i8,  u8,  16)
+OVM_V_SPLAT(i16, u16, 8)
+OVM_V_SPLAT(i32, u32, 4)
+OVM_V_SPLAT(i64, u64, 2)
+OVM_V_SPLAT(f32, f32, 4)
+OVM_V_SPLAT(f64, f64, 2)
+
+#undef OVM_V_SPLAT
+
+#define OVM_V_EXTRACT(name, otype, field, dtype, count, type_) \
+    OVMI_INSTR_EXEC(name##_##otype) { \
+        ovm_v128_t a = V_GET(instr->a); \
+        VAL(instr->r).u64 = 0; \
+        VAL(instr->r).dtype = a.field[instr->b & (count - 1)]; \
+        OVM_SET_TYPE(VAL(instr->r), type_); \
+        NEXT_OP; \
+    }
+
+OVM_V_EXTRACT(v_extract,   i8,  u8,  u32, 16, OVM_TYPE_I32)
+OVM_V_EXTRACT(v_extract,   i16, u16, u32, 8,  OVM_TYPE_I32)
+OVM_V_EXTRACT(v_extract,   i32, u32, u32, 4,  OVM_TYPE_I32)
+OVM_V_EXTRACT(v_extract,   i64, u64, u64, 2,  OVM_TYPE_I64)
+OVM_V_EXTRACT(v_extract,   f32, f32, f32, 4,  OVM_TYPE_F32)
+OVM_V_EXTRACT(v_extract,   f64, f64, f64, 2,  OVM_TYPE_F64)
+OVM_V_EXTRACT(v_extract_s, i8,  i8,  i32, 16, OVM_TYPE_I32)
+OVM_V_EXTRACT(v_extract_s, i16, i16, i32, 8,  OVM_TYPE_I32)
+
+#undef OVM_V_EXTRACT
+
+#define OVM_V_REPLACE(otype, field, count) \
+    OVMI_INSTR_EXEC(v_replace_##otype) { \
+        ovm_v128_t r = V_GET(instr->r); \
+        r.field[instr->a & (count - 1)] = VAL(instr->b).field; \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_V_REPLACE(i8,  u8,  16)
+OVM_V_REPLACE(i16, u16, 8)
+OVM_V_REPLACE(i32, u32, 4)
+OVM_V_REPLACE(i64, u64, 2)
+OVM_V_REPLACE(f32, f32, 4)
+OVM_V_REPLACE(f64, f64, 2)
+
+#undef OVM_V_REPLACE
+
+OVMI_INSTR_EXEC(v_swizzle_i8) {
+    ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), r;
+
+#if defined(__SSSE3__)
+    // Saturating the indices to 0x70 and above sets the top bit of every
+    // index that is out of range, which makes pshufb select zero for it.
+    r.m = _mm_shuffle_epi8(a.m, _mm_adds_epu8(b.m, _mm_set1_epi8(0x70)));
+#else
+    fori (i, 0, 16) r.u8[i] = b.u8[i] < 16 ? a.u8[b.u8[i]] : 0;
+#endif
+
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+//
+// The 16 lane indices are stored in the two instructions that follow,
+// which are never executed.
+OVMI_INSTR_EXEC(v_shuffle_i8) {
+    ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), r;
+
+    u8 lanes[16];
+    memcpy(&lanes[0], &instr[1].l, 8);
+    memcpy(&lanes[8], &instr[2].l, 8);
+
+    fori (i, 0, 16) {
+        u8 lane = lanes[i] & 31;
+        r.u8[i] = lane < 16 ? a.u8[lane] : b.u8[lane - 16];
+    }
+
+    V_SET(instr->r, r);
+    state->pc += 2;
+    NEXT_OP;
+}
+
+//
+// Lane-wise binary operations. The comparisons produce lanes of all ones or
+// all zeros, which is what GCC's vector comparisons produce as well.
+#define OVM_V_OP(name, otype, rfield, field, op) \
+    OVMI_INSTR_EXEC(name##_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), r; \
+        r.rfield = a.field op b.field; \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+#define OVM_V_OP_EXEC(name, op) \
+    OVM_V_OP(name, i8,  u8,  u8,  op) \
+    OVM_V_OP(name, i16, u16, u16, op) \
+    OVM_V_OP(name, i32, u32, u32, op) \
+    OVM_V_OP(name, i64, u64, u64, op) \
+    OVM_V_OP(name, f32, f32, f32, op) \
+    OVM_V_OP(name, f64, f64, f64, op)
+
+#define OVM_V_CMP_EXEC(name, op) \
+    OVM_V_OP(name, i8,  i8,  u8,  op) \
+    OVM_V_OP(name, i16, i16, u16, op) \
+    OVM_V_OP(name, i32, i32, u32, op) \
+    OVM_V_OP(name, i64, i64, u64, op) \
+    OVM_V_OP(name, f32, i32, f32, op) \
+    OVM_V_OP(name, f64, i64, f64, op)
+
+#define OVM_V_CMP_SIGNED_EXEC(name, op) \
+    OVM_V_OP(name, i8,  i8,  i8,  op) \
+    OVM_V_OP(name, i16, i16, i16, op) \
+    OVM_V_OP(name, i32, i32, i32, op) \
+    OVM_V_OP(name, i64, i64, i64, op)
+
+OVM_V_OP_EXEC(v_add, +)
+OVM_V_OP_EXEC(v_sub, -)
+OVM_V_OP_EXEC(v_mul, *)
+OVMI_INSTR_EXEC(v_div_f32) {
+    ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), r;
+    r.f32 = __ovm_v_div_f32(a.f32, b.f32);
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(v_div_f64) {
+    ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), r;
+    r.f64 = __ovm_v_div_f64(a.f64, b.f64);
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVM_V_CMP_EXEC(v_eq, ==)
+OVM_V_CMP_EXEC(v_ne, !=)
+OVM_V_CMP_EXEC(v_lt, <)
+OVM_V_CMP_EXEC(v_le, <=)
+OVM_V_CMP_EXEC(v_gt, >)
+OVM_V_CMP_EXEC(v_ge, >=)
+OVM_V_CMP_SIGNED_EXEC(v_lt_s, <)
+OVM_V_CMP_SIGNED_EXEC(v_le_s, <=)
+OVM_V_CMP_SIGNED_EXEC(v_gt_s, >)
+OVM_V_CMP_SIGNED_EXEC(v_ge_s, >=)
+
+OVM_V_OP(v_and, v128, u64, u64, &)
+OVM_V_OP(v_or,  v128, u64, u64, |)
+OVM_V_OP(v_xor, v128, u64, u64, ^)
+OVM_V_OP(v_andnot, v128, u64, u64, & ~)
+
+#undef OVM_V_CMP_SIGNED_EXEC
+#undef OVM_V_CMP_EXEC
+#undef OVM_V_OP_EXEC
+#undef OVM_V_OP
+
+//
+// min and max select between the operands with a comparison mask. For floats
+// this matches the scalar instructions (see bh_min / bh_max).
+#define OVM_V_SELECT(name, otype, mfield, field, op) \
+    OVMI_INSTR_EXEC(name##_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), m, r; \
+        m.mfield = a.field op b.field; \
+        r.u64 = (a.u64 & m.u64) | (b.u64 & ~m.u64); \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+#define OVM_V_SELECT_EXEC(name, op) \
+    OVM_V_SELECT(name, i8,  i8,  u8,  op) \
+    OVM_V_SELECT(name, i16, i16, u16, op) \
+    OVM_V_SELECT(name, i32, i32, u32, op) \
+    OVM_V_SELECT(name, i64, i64, u64, op) \
+    OVM_V_SELECT(name, f32, i32, f32, op) \
+    OVM_V_SELECT(name, f64, i64, f64, op)
+
+#define OVM_V_SELECT_SIGNED_EXEC(name, op) \
+    OVM_V_SELECT(name, i8,  i8,  i8,  op) \
+    OVM_V_SELECT(name, i16, i16, i16, op) \
+    OVM_V_SELECT(name, i32, i32, i32, op) \
+    OVM_V_SELECT(name, i64, i64, i64, op)
+
+OVM_V_SELECT_EXEC(v_min, <)
+OVM_V_SELECT_EXEC(v_max, >)
+OVM_V_SELECT_SIGNED_EXEC(v_min_s, <)
+OVM_V_SELECT_SIGNED_EXEC(v_max_s, >)
+
+#undef OVM_V_SELECT_SIGNED_EXEC
+#undef OVM_V_SELECT_EXEC
+#undef OVM_V_SELECT
+
+//
+// The shift amount is taken modulo the lane width.
+#define OVM_V_SHIFT(name, otype, field, op, bits) \
+    OVMI_INSTR_EXEC(name##_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), r; \
+        r.field = a.field op (VAL(instr->b).u32 & (bits - 1)); \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_V_SHIFT(v_shl, i8,  u8,  <<, 8)
+OVM_V_SHIFT(v_shl, i16, u16, <<, 16)
+OVM_V_SHIFT(v_shl, i32, u32, <<, 32)
+OVM_V_SHIFT(v_shl, i64, u64, <<, 64)
+OVM_V_SHIFT(v_shr, i8,  u8,  >>, 8)
+OVM_V_SHIFT(v_shr, i16, u16, >>, 16)
+OVM_V_SHIFT(v_shr, i32, u32, >>, 32)
+OVM_V_SHIFT(v_shr, i64, u64, >>, 64)
+OVM_V_SHIFT(v_sar, i8,  i8,  >>, 8)
+OVM_V_SHIFT(v_sar, i16, i16, >>, 16)
+OVM_V_SHIFT(v_sar, i32, i32, >>, 32)
+OVM_V_SHIFT(v_sar, i64, i64, >>, 64)
+
+#undef OVM_V_SHIFT
+
+//
+// Instructions that map directly onto a single SSE2 intrinsic.
+#define OVM_V_SSE2(name, otype, intrinsic) \
+    OVMI_INSTR_EXEC(name##_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), r; \
+        r.m = intrinsic(a.m, b.m); \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_V_SSE2(v_add_sat,   i8,  _mm_adds_epu8)
+OVM_V_SSE2(v_add_sat,   i16, _mm_adds_epu16)
+OVM_V_SSE2(v_add_sat_s, i8,  _mm_adds_epi8)
+OVM_V_SSE2(v_add_sat_s, i16, _mm_adds_epi16)
+OVM_V_SSE2(v_sub_sat,   i8,  _mm_subs_epu8)
+OVM_V_SSE2(v_sub_sat,   i16, _mm_subs_epu16)
+OVM_V_SSE2(v_sub_sat_s, i8,  _mm_subs_epi8)
+OVM_V_SSE2(v_sub_sat_s, i16, _mm_subs_epi16)
+OVM_V_SSE2(v_avgr,      i8,  _mm_avg_epu8)
+OVM_V_SSE2(v_avgr,      i16, _mm_avg_epu16)
+OVM_V_SSE2(v_narrow,    i8,  _mm_packus_epi16)
+OVM_V_SSE2(v_narrow_s,  i8,  _mm_packs_epi16)
+OVM_V_SSE2(v_narrow_s,  i16, _mm_packs_epi32)
+
+#undef OVM_V_SSE2
+
+OVMI_INSTR_EXEC(v_narrow_i16) {
+    ovm_v128_t a = V_GET(instr->a), b = V_GET(instr->b), r;
+
+#if defined(__SSE4_1__)
+    r.m = _mm_packus_epi32(a.m, b.m);
+#else
+    fori (i, 0, 8) {
+        i32 x = i < 4 ? a.i32[i] : b.i32[i - 4];
+        r.u16[i] = x < 0 ? 0 : (x > 0xffff ? 0xffff : x);
+    }
+#endif
+
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+//
+// Widening interleaves the lanes with zeros, or with copies of themselves
+// that are then shifted back down to sign extend them.
+#define OVM_V_WIDEN(name, otype, unpack, shift, bits) \
+    OVMI_INSTR_EXEC(name##_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), r; \
+        r.m = unpack(a.m, _mm_setzero_si128()); \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    } \
+    OVMI_INSTR_EXEC(name##_s_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), r; \
+        r.m = shift(unpack(a.m, a.m), bits); \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_V_WIDEN(v_widen_low,  i16, _mm_unpacklo_epi8,  _mm_srai_epi16, 8)
+OVM_V_WIDEN(v_widen_low,  i32, _mm_unpacklo_epi16, _mm_srai_epi32, 16)
+OVM_V_WIDEN(v_widen_high, i16, _mm_unpackhi_epi8,  _mm_srai_epi16, 8)
+OVM_V_WIDEN(v_widen_high, i32, _mm_unpackhi_epi16, _mm_srai_epi32, 16)
+
+#undef OVM_V_WIDEN
+
+OVMI_INSTR_EXEC(v_not_v128) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    r.u64 = ~a.u64;
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+//
+// Integer abs is done on the unsigned lanes, so the most negative value
+// wraps around to itself like WASM expects.
+#define OVM_V_ABS_INT(otype, field, ufield, bits) \
+    OVMI_INSTR_EXEC(v_abs_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), m, r; \
+        m.field = a.field >> (bits - 1); \
+        r.ufield = (a.ufield ^ m.ufield) - m.ufield; \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_V_ABS_INT(i8,  i8,  u8,  8)
+OVM_V_ABS_INT(i16, i16, u16, 16)
+OVM_V_ABS_INT(i32, i32, u32, 32)
+OVM_V_ABS_INT(i64, i64, u64, 64)
+
+#undef OVM_V_ABS_INT
+
+OVMI_INSTR_EXEC(v_abs_f32) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    r.u32 = a.u32 & 0x7fffffffu;
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(v_abs_f64) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    r.u64 = a.u64 & 0x7fffffffffffffffull;
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+#define OVM_V_UNOP(name, otype, field, op) \
+    OVMI_INSTR_EXEC(name##_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), r; \
+        r.field = op a.field; \
+        V_SET(instr->r, r); \
+        NEXT_OP; \
+    }
+
+OVM_V_UNOP(v_neg, i8,  u8,  -)
+OVM_V_UNOP(v_neg, i16, u16, -)
+OVM_V_UNOP(v_neg, i32, u32, -)
+OVM_V_UNOP(v_neg, i64, u64, -)
+OVM_V_UNOP(v_neg, f32, f32, -)
+OVM_V_UNOP(v_neg, f64, f64, -)
+
+#undef OVM_V_UNOP
+
+OVMI_INSTR_EXEC(v_sqrt_f32) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    r.m = _mm_castps_si128(_mm_sqrt_ps(_mm_castsi128_ps(a.m)));
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(v_sqrt_f64) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    r.m = _mm_castpd_si128(_mm_sqrt_pd(_mm_castsi128_pd(a.m)));
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(v_any_true_v128) {
+    ovm_v128_t a = V_GET(instr->a);
+    VAL(instr->r).u64 = (a.u64[0] | a.u64[1]) != 0;
+    OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32);
+    NEXT_OP;
+}
+
+#define OVM_V_ALL_TRUE(otype, field) \
+    OVMI_INSTR_EXEC(v_all_true_##otype) { \
+        ovm_v128_t a = V_GET(instr->a), zeros; \
+        zeros.field = a.field == 0; \
+        VAL(instr->r).u64 = (zeros.u64[0] | zeros.u64[1]) == 0; \
+        OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32); \
+        NEXT_OP; \
+    }
+
+OVM_V_ALL_TRUE(i8,  i8)
+OVM_V_ALL_TRUE(i16, i16)
+OVM_V_ALL_TRUE(i32, i32)
+OVM_V_ALL_TRUE(i64, i64)
+
+#undef OVM_V_ALL_TRUE
+
+#define OVM_V_BITMASK(otype, expr) \
+    OVMI_INSTR_EXEC(v_bitmask_##otype) { \
+        ovm_v128_t a = V_GET(instr->a); \
+        VAL(instr->r).u64 = (u32) (expr); \
+        OVM_SET_TYPE(VAL(instr->r), OVM_TYPE_I32); \
+        NEXT_OP; \
+    }
+
+OVM_V_BITMASK(i8,  _mm_movemask_epi8(a.m))
+OVM_V_BITMASK(i16, _mm_movemask_epi8(_mm_packs_epi16(a.m, _mm_setzero_si128())))
+OVM_V_BITMASK(i32, _mm_movemask_ps(_mm_castsi128_ps(a.m)))
+OVM_V_BITMASK(i64, _mm_movemask_pd(_mm_castsi128_pd(a.m)))
+
+#undef OVM_V_BITMASK
+
+//
+// Float to integer conversions saturate, and NaN becomes 0.
+OVMI_INSTR_EXEC(v_trunc_sat_i32) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    fori (i, 0, 4) {
+        f32 x = a.f32[i];
+        r.u32[i] = (x != x || x <= -1.0f) ? 0
+                 : x >= 4294967296.0f     ? 0xffffffffu
+                 : (u32) x;
+    }
+
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(v_trunc_sat_s_i32) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    fori (i, 0, 4) {
+        f32 x = a.f32[i];
+        r.i32[i] = (x != x)               ? 0
+                 : x <= -2147483648.0f    ? INT32_MIN
+                 : x >= 2147483648.0f     ? INT32_MAX
+                 : (i32) x;
+    }
+
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(v_convert_f32) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    fori (i, 0, 4) r.f32[i] = (f32) a.u32[i];
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(v_convert_s_f32) {
+    ovm_v128_t a = V_GET(instr->a), r;
+    r.m = _mm_castps_si128(_mm_cvtepi32_ps(a.m));
+    V_SET(instr->r, r);
+    NEXT_OP;
+}
+
+#undef V_GET
+#undef V_SET
+
+
+//
+// Fused instructions
+//
+// Each of these covers the instruction after it as well, so they all
+// advance the program counter one extra time. The temporary value that
+// would have been passed between the two instructions is not written,
+// because the code builder never reads a temporary after consuming it.
+//
+
+#define OVM_IMM_ADD(t, ctype, stype) \
+    ovm_assert(VAL(instr[1].a).type == t); \
+    VAL(instr[1].r).ctype = VAL(instr[1].a).ctype + (ctype) instr->stype; \
+    OVM_SET_TYPE(VAL(instr[1].r), t); \
+    state->pc++;
+
+OVMI_INSTR_EXEC(imm_add_i32) { OVM_IMM_ADD(OVM_TYPE_I32, u32, i); NEXT_OP; }
+OVMI_INSTR_EXEC(imm_add_i64) { OVM_IMM_ADD(OVM_TYPE_I64, u64, l); NEXT_OP; }
+
+#undef OVM_IMM_ADD
+
+#define OVM_ADD_LOAD(otype, type_, stype) \
+    OVMI_INSTR_EXEC(add_load_##otype) { \
+        ovm_assert(VAL(instr->a).type == OVM_TYPE_I32 && VAL(instr->b).type == OVM_TYPE_I32); \
+        u32 dest = VAL(instr->a).u32 + VAL(instr->b).u32 + (u32) instr[1].b; \
+        if (dest == 0) OVMI_EXCEPTION_HOOK; \
+        VAL(instr[1].r).stype = * (stype *) &memory[dest]; \
+        OVM_SET_TYPE(VAL(instr[1].r), type_); \
+        state->pc++; \
+        NEXT_OP; \
+    }
+
+OVM_ADD_LOAD(i8,  OVM_TYPE_I8,  u8)
+OVM_ADD_LOAD(i16, OVM_TYPE_I16, u16)
+OVM_ADD_LOAD(i32, OVM_TYPE_I32, u32)
+OVM_ADD_LOAD(i64, OVM_TYPE_I64, u64)
+OVM_ADD_LOAD(f32, OVM_TYPE_F32, f32)
+OVM_ADD_LOAD(f64, OVM_TYPE_F64, f64)
+
+#undef OVM_ADD_LOAD
+
+OVMI_INSTR_EXEC(add_load_v128) {
+    ovm_assert(VAL(instr->a).type == OVM_TYPE_I32 && VAL(instr->b).type == OVM_TYPE_I32);
+    u32 dest = VAL(instr->a).u32 + VAL(instr->b).u32 + (u32) instr[1].b;
+    if (dest == 0) OVMI_EXCEPTION_HOOK;
+
+    ovm_v128_t v;
+    memcpy(&v, &memory[dest], sizeof(v));
+    __ovm_v128_set(values, instr[1].r, v);
+    state->pc++;
+    NEXT_OP;
+}
+
+OVMI_INSTR_EXEC(mov_mov) {
+    VAL(instr->r) = VAL(instr->a);
+    VAL(instr[1].r) = VAL(instr[1].a);
+    state->pc++;
+    NEXT_OP;
+}
+
+#define OVM_OP(t, op, ctype) \
+    ovm_assert(VAL(instr->a).type == t && VAL(instr->b).type == t); \
+    state->pc++; \
+    if (VAL(instr->a).ctype op VAL(instr->b).ctype) state->pc += instr->r;
+
+OVM_OP_INTEGER_UNSIGNED_EXEC(br_lt, <)
+OVM_OP_INTEGER_EXEC(br_lt_s, <)
+OVM_OP_INTEGER_UNSIGNED_EXEC(br_le, <=)
+OVM_OP_INTEGER_EXEC(br_le_s, <=)
+OVM_OP_INTEGER_EXEC(br_eq, ==)
+OVM_OP_INTEGER_UNSIGNED_EXEC(br_ge, >=)
+OVM_OP_INTEGER_EXEC(br_ge_s, >=)
+OVM_OP_INTEGER_UNSIGNED_EXEC(br_gt, >)
+OVM_OP_INTEGER_EXEC(br_gt_s, >)
+OVM_OP_INTEGER_EXEC(br_ne, !=)
+
+#undef OVM_OP
+
+
 OVMI_INSTR_EXEC(illegal) {
     OVMI_EXCEPTION_HOOK;
+    state->trap_message = "unreachable instruction executed";
     return ((ovm_value_t) {0});
 }
 
@@ -499,11 +1216,17 @@ OVMI_INSTR_EXEC(illegal) {
 #define D(n) OVMI_FUNC_NAME(n)
 
 #define IROW_UNTYPED(name) D(name), NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-#define IROW_TYPED(name)   NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), D(name##_f32), D(name##_f64), NULL,
+#define IROW_TYPED(name)   NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), D(name##_f32), D(name##_f64), D(name##_v128),
 #define IROW_PARTIAL(name) NULL, NULL, NULL, D(name##_i32), D(name##_i64), D(name##_f32), D(name##_f64), NULL,
 #define IROW_INT(name)     NULL, NULL, NULL, D(name##_i32), D(name##_i64), NULL, NULL, NULL,
 #define IROW_FLOAT(name)   NULL, NULL, NULL, NULL, NULL, D(name##_f32), D(name##_f64), NULL,
 #define IROW_SAME(name)    D(name),D(name),D(name),D(name),D(name),D(name),D(name),NULL,
+#define IROW_ATOMIC(name)  NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), NULL, NULL, NULL,
+#define IROW_LANES(name)   NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), D(name##_f32), D(name##_f64), NULL,
+#define IROW_LANES_INT(name) NULL, D(name##_i8), D(name##_i16), D(name##_i32), D(name##_i64), NULL, NULL, NULL,
+#define IROW_LANES_SMALL(name) NULL, D(name##_i8), D(name##_i16), NULL, NULL, NULL, NULL, NULL,
+#define IROW_WIDEN(name)   NULL, NULL, D(name##_i16), D(name##_i32), NULL, NULL, NULL, NULL,
+#define IROW_V128(name)    NULL, NULL, NULL, NULL, NULL, NULL, NULL, D(name##_v128),
 
 static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
     IROW_UNTYPED(nop) // 0x00
@@ -523,7 +1246,7 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
     IROW_SAME(illegal)
     IROW_SAME(illegal)
     IROW_PARTIAL(imm) // 0x10
-    IROW_UNTYPED(mov)
+    D(mov), NULL, NULL, NULL, NULL, NULL, NULL, D(mov_v128),
     IROW_TYPED(load)
     IROW_TYPED(store)
     IROW_UNTYPED(copy)
@@ -542,7 +1265,7 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
     IROW_PARTIAL(gt_s)
     IROW_PARTIAL(ne)
     IROW_UNTYPED(param)
-    IROW_UNTYPED(return)
+    D(return), NULL, NULL, NULL, NULL, NULL, NULL, D(return_v128),
     IROW_UNTYPED(call)
     IROW_UNTYPED(calli)
     IROW_UNTYPED(br)
@@ -582,10 +1305,86 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
     NULL, NULL, NULL, NULL, D(transmute_i64_f64), NULL, NULL, NULL,
     NULL, NULL, NULL, NULL, NULL, D(transmute_f32_i32), NULL, NULL,
     NULL, NULL, NULL, NULL, NULL, NULL, D(transmute_f64_i64), NULL,
-    IROW_INT(cmpxchg)
+    IROW_ATOMIC(cmpxchg)
     IROW_SAME(illegal)
     IROW_UNTYPED(mem_size)
     IROW_UNTYPED(mem_grow)
+    IROW_INT(imm_add) // 0x50
+    IROW_TYPED(add_load)
+    IROW_UNTYPED(mov_mov)
+    IROW_INT(br_lt)
+    IROW_INT(br_lt_s)
+    IROW_INT(br_le)
+    IROW_INT(br_le_s)
+    IROW_INT(br_eq)
+    IROW_INT(br_ge)
+    IROW_INT(br_ge_s)
+    IROW_INT(br_gt)
+    IROW_INT(br_gt_s)
+    IROW_INT(br_ne)
+    IROW_ATOMIC(atomic_load)
+    IROW_ATOMIC(atomic_store)
+    IROW_ATOMIC(atomic_add)
+    IROW_ATOMIC(atomic_sub)  // 0x60
+    IROW_ATOMIC(atomic_and)
+    IROW_ATOMIC(atomic_or)
+    IROW_ATOMIC(atomic_xor)
+    IROW_ATOMIC(atomic_xchg)
+    IROW_INT(atomic_wait)
+    IROW_UNTYPED(atomic_notify)
+    IROW_LANES(v_splat)
+    IROW_LANES(v_extract)
+    IROW_LANES_SMALL(v_extract_s)
+    IROW_LANES(v_replace)
+    NULL, D(v_swizzle_i8), NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, D(v_shuffle_i8), NULL, NULL, NULL, NULL, NULL, NULL,
+    IROW_LANES(v_eq)
+    IROW_LANES(v_ne)
+    IROW_LANES(v_lt)  // 0x6f
+    IROW_LANES_INT(v_lt_s)
+    IROW_LANES(v_le)
+    IROW_LANES_INT(v_le_s)
+    IROW_LANES(v_gt)
+    IROW_LANES_INT(v_gt_s)
+    IROW_LANES(v_ge)
+    IROW_LANES_INT(v_ge_s)
+    IROW_V128(v_not)
+    IROW_V128(v_and)
+    IROW_V128(v_andnot)
+    IROW_V128(v_or)
+    IROW_V128(v_xor)
+    IROW_LANES(v_abs)
+    IROW_LANES(v_neg)
+    IROW_V128(v_any_true)
+    IROW_LANES_INT(v_all_true)  // 0x7f
+    IROW_LANES_INT(v_bitmask)
+    IROW_LANES_SMALL(v_narrow)
+    IROW_LANES_SMALL(v_narrow_s)
+    IROW_WIDEN(v_widen_low)
+    IROW_WIDEN(v_widen_low_s)
+    IROW_WIDEN(v_widen_high)
+    IROW_WIDEN(v_widen_high_s)
+    IROW_LANES_INT(v_shl)
+    IROW_LANES_INT(v_shr)
+    IROW_LANES_INT(v_sar)
+    IROW_LANES(v_add)
+    IROW_LANES(v_sub)
+    IROW_LANES_SMALL(v_add_sat)
+    IROW_LANES_SMALL(v_add_sat_s)
+    IROW_LANES_SMALL(v_sub_sat)
+    IROW_LANES_SMALL(v_sub_sat_s)
+    IROW_LANES(v_mul)  // 0x90
+    IROW_LANES(v_min)
+    IROW_LANES_INT(v_min_s)
+    IROW_LANES(v_max)
+    IROW_LANES_INT(v_max_s)
+    IROW_LANES_SMALL(v_avgr)
+    IROW_FLOAT(v_sqrt)
+    IROW_FLOAT(v_div)
+    NULL, NULL, NULL, D(v_trunc_sat_i32), NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, D(v_trunc_sat_s_i32), NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, D(v_convert_f32), NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, D(v_convert_s_f32), NULL, NULL,
 };
 
 #undef D
@@ -595,6 +1394,12 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
 #undef IROW_INT
 #undef IROW_FLOAT
 #undef IROW_SAME
+#undef IROW_ATOMIC
+#undef IROW_LANES
+#undef IROW_LANES_INT
+#undef IROW_LANES_SMALL
+#undef IROW_WIDEN
+#undef IROW_V128
 
 #undef OVM_OP_EXEC
 #undef OVM_OP_UNSIGNED_EXEC
@@ -610,4 +1415,5 @@ static ovmi_instr_exec_t OVMI_DISPATCH_NAME[] = {
 #undef OVMI_DISPATCH_NAME
 #undef OVMI_DEBUG_HOOK
 #undef OVMI_EXCEPTION_HOOK
+#undef OVMI_USE_JIT
 
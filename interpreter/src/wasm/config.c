@@ -5,6 +5,11 @@ wasm_config_t *wasm_config_new() {
     wasm_config_t *config = malloc(sizeof(*config));
     config->debug_enabled = false;
     config->listen_path   = "/tmp/ovm-debug.0000";
+    config->max_call_depth   = OVM_DEFAULT_MAX_CALL_DEPTH;
+    config->value_stack_size = OVM_DEFAULT_VALUE_STACK_SIZE;
+    config->jit_threshold    = OVM_DEFAULT_JIT_THRESHOLD;
+    config->program_cache_dir = NULL;
+    config->profile_output    = NULL;
     return config;
 }
 
@@ -20,3 +25,22 @@ void wasm_config_set_listen_path(wasm_config_t *config, char *listen_path) {
     config->listen_path = listen_path;
 }
 
+void wasm_config_set_max_call_depth(wasm_config_t *config, int max_call_depth) {
+    config->max_call_depth = max_call_depth;
+}
+
+void wasm_config_set_value_stack_size(wasm_config_t *config, long long value_stack_size) {
+    config->value_stack_size = value_stack_size;
+}
+
+void wasm_config_set_jit_threshold(wasm_config_t *config, int jit_threshold) {
+    config->jit_threshold = jit_threshold;
+}
+
+void wasm_config_set_program_cache_dir(wasm_config_t *config, char *program_cache_dir) {
+    config->program_cache_dir = program_cache_dir;
+}
+
+void wasm_config_set_profile_output(wasm_config_t *config, char *profile_output) {
+    config->profile_output = profile_output;
+}
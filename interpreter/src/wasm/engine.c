@@ -13,10 +13,17 @@ wasm_engine_t *wasm_engine_new_with_config(wasm_config_t *config) {
     wasm_engine_t *engine = bh_alloc_item(store->heap_allocator, wasm_engine_t);
     engine->config = config;
     engine->store = store;
+    engine->running_calls = 0;
     
     ovm_engine_t *ovm_engine = ovm_engine_new(store);
     engine->engine = ovm_engine;
 
+    if (config) {
+        ovm_engine->max_call_depth   = config->max_call_depth;
+        ovm_engine->value_stack_size = config->value_stack_size;
+        ovm_engine->jit_threshold    = config->jit_threshold;
+    }
+
     if (config && config->debug_enabled) {
         // This should maybe be moved elsewhere?
         debug_state_t *debug  = bh_alloc_item(store->heap_allocator, debug_state_t);
@@ -28,10 +35,35 @@ wasm_engine_t *wasm_engine_new_with_config(wasm_config_t *config) {
         debug_host_start(engine->engine->debug);
     }
 
+    if (config && config->profile_output) {
+        debug_profiler_t *profiler = bh_alloc_item(store->heap_allocator, debug_profiler_t);
+        engine->engine->profiler = profiler;
+
+        debug_profiler_init(profiler, config->profile_output);
+        debug_profiler_start(profiler);
+
+        //
+        // JIT compiled code does not keep the program counter up to date,
+        // which would hide where the hottest functions spend their time.
+        ovm_engine->jit_threshold = 0;
+    }
+
     return engine;
 }
 
 void wasm_engine_delete(wasm_engine_t *engine) {
+    //
+    // The profile is written when the program is done, even
+    // if other threads keep the engine from being deleted.
+    if (engine->engine->profiler) {
+        debug_profiler_stop(engine->engine->profiler);
+    }
+
+    //
+    // Another thread is still running, and its state and memory
+    // belong to the engine. They are left to the process exiting.
+    if (__atomic_load_n(&engine->running_calls, __ATOMIC_ACQUIRE) > 0) return;
+
     if (engine->engine->debug) {
         debug_host_stop(engine->engine->debug);
     }
@@ -10,6 +10,7 @@ wasm_func_t *wasm_func_new(wasm_store_t *store, const wasm_functype_t *type, was
     func->inner.func.env = NULL;
     func->inner.func.func_ptr = (void (*)()) callback;
     func->inner.func.finalizer = NULL;
+    func->inner.func.direct_func_ptr = NULL;
 
     return func;
 }
@@ -24,6 +25,16 @@ wasm_func_t *wasm_func_new_with_env(wasm_store_t *store, const wasm_functype_t *
     func->inner.func.env = env;
     func->inner.func.func_ptr = (void (*)()) callback;
     func->inner.func.finalizer = finalizer;
+    func->inner.func.direct_func_ptr = NULL;
+
+    return func;
+}
+
+wasm_func_t *wasm_func_new_direct(wasm_store_t *store, const wasm_functype_t *type,
+    wasm_func_callback_t callback, wasm_func_direct_callback_t direct_callback) {
+
+    wasm_func_t *func = wasm_func_new(store, type, callback);
+    func->inner.func.direct_func_ptr = direct_callback;
 
     return func;
 }
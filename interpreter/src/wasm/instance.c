@@ -4,11 +4,11 @@
 #include "vm.h"
 #include <alloca.h>
 
-static_assert(sizeof(ovm_value_t) == sizeof(wasm_val_t));
-
 typedef struct wasm_ovm_binding wasm_ovm_binding;
 struct wasm_ovm_binding {
     int func_idx;
+    wasm_valkind_t result_kind;
+    wasm_store_t  *store;
     ovm_engine_t  *engine;
     ovm_state_t   *state;
     ovm_program_t *program;
@@ -26,69 +26,41 @@ struct ovm_wasm_binding {
     (o).u64 = 0;\
     switch ((w).kind) { \
         case WASM_I32: \
-            (o).type = OVM_TYPE_I32; \
+            OVM_SET_TYPE(o, OVM_TYPE_I32); \
             (o).i32  = (w).of.i32; \
             break; \
  \
         case WASM_I64: \
-            (o).type = OVM_TYPE_I64; \
+            OVM_SET_TYPE(o, OVM_TYPE_I64); \
             (o).i64  = (w).of.i64; \
             break; \
  \
         case WASM_F32: \
-            (o).type = OVM_TYPE_F32; \
+            OVM_SET_TYPE(o, OVM_TYPE_F32); \
             (o).f32  = (w).of.f32; \
             break; \
  \
         case WASM_F64: \
-            (o).type = OVM_TYPE_F64; \
+            OVM_SET_TYPE(o, OVM_TYPE_F64); \
             (o).f64  = (w).of.f64; \
             break; \
  \
         default: assert(("invalid wasm value type for conversion", 0)); \
     } }
 
+//
+// OVM values do not carry their type, so the kind of the WASM value
+// must already be set to the type expected by the function signature.
 #define OVM_TO_WASM(o, w) { \
-    (w).of.i64 = 0;\
-    switch ((o).type) { \
-        case OVM_TYPE_NONE: \
-            (w).kind = WASM_I32; \
-            (w).of.i32 = 0; \
-            break; \
- \
-        case OVM_TYPE_I8: \
-            (w).kind = WASM_I32; \
-            (w).of.i32 = (i32) (o).i8; \
-            break; \
- \
-        case OVM_TYPE_I16: \
-            (w).kind = WASM_I32; \
-            (w).of.i32 = (i32) (o).i16; \
-            break; \
- \
-        case OVM_TYPE_I32: \
-            (w).kind = WASM_I32; \
-            (w).of.i32 = (i32) (o).i32; \
-            break; \
- \
-        case OVM_TYPE_I64: \
-            (w).kind = WASM_I64; \
-            (w).of.i64 = (o).i64; \
-            break; \
- \
-        case OVM_TYPE_F32: \
-            (w).kind = WASM_F32; \
-            (w).of.f32 = (o).f32; \
-            break; \
- \
-        case OVM_TYPE_F64: \
-            (w).kind = WASM_F64; \
-            (w).of.f64 = (o).f64; \
-            break; \
+    switch ((w).kind) { \
+        case WASM_I32: (w).of.i64 = 0; (w).of.i32 = (o).i32; break; \
+        case WASM_I64: (w).of.i64 = (o).i64; break; \
+        case WASM_F32: (w).of.i64 = 0; (w).of.f32 = (o).f32; break; \
+        case WASM_F64: (w).of.f64 = (o).f64; break; \
  \
         default: \
-            printf("INVALID: %d\n", (o).type); \
-            assert(("invalid ovm value type for conversion", 0)); \
+            printf("INVALID: %d\n", (w).kind); \
+            assert(("invalid wasm value type for conversion", 0)); \
     } }
 
 static wasm_trap_t *wasm_to_ovm_func_call_binding(void *vbinding, const wasm_val_vec_t *args, wasm_val_vec_t *res) {
@@ -99,19 +71,48 @@ static wasm_trap_t *wasm_to_ovm_func_call_binding(void *vbinding, const wasm_val
         WASM_TO_OVM(args->data[i], vals[i]);
     }
 
-    ovm_value_t ovm_res = ovm_func_call(binding->engine, binding->state, binding->program, binding->func_idx, args->size, vals);
-    if (!res || res->size == 0) return NULL;
+    ovm_state_t *state = binding->state;
+    i32 frame_count = state->stack_frame_count;
 
-    OVM_TO_WASM(ovm_res, res->data[0]);
+    wasm_engine_t *engine = binding->store->engine;
+    __atomic_fetch_add(&engine->running_calls, 1, __ATOMIC_ACQUIRE);
 
-    return NULL;
+    ovm_value_t ovm_res = ovm_func_call(binding->engine, state, binding->program, binding->func_idx, args->size, vals);
+    wasm_trap_t *trap = NULL;
+
+    //
+    // The trap message is left set after unwinding, so if this call was made from
+    // a native function that was called by OVM code, the outer call stops as well.
+    if (state->trap_message) {
+        wasm_message_t msg;
+        wasm_name_new_from_string(&msg, state->trap_message);
+
+        trap = wasm_trap_new(binding->store, &msg);
+        ovm_state_unwind(state, frame_count);
+
+    } else if (res && res->size > 0) {
+        res->data[0].kind = binding->result_kind;
+        OVM_TO_WASM(ovm_res, res->data[0]);
+    }
+
+    // Nothing owned by the engine may be touched after this.
+    __atomic_fetch_sub(&engine->running_calls, 1, __ATOMIC_RELEASE);
+    return trap;
 }
 
 static void ovm_to_wasm_func_call_binding(void *env, ovm_value_t* params, ovm_value_t *res) {
     ovm_wasm_binding *binding = (ovm_wasm_binding *) env;
 
+    //
+    // Bindings are shared by every thread's instance, so the
+    // parameters are converted into a buffer local to this call.
+    wasm_val_vec_t wasm_params;
+    wasm_params.data = alloca(sizeof(wasm_val_t) * binding->param_count);
+    wasm_params.size = binding->param_count;
+
     fori (i, 0, binding->param_count) {
-        OVM_TO_WASM(params[i], binding->param_buffer.data[i]);
+        wasm_params.data[i].kind = binding->param_buffer.data[i].kind;
+        OVM_TO_WASM(params[i], wasm_params.data[i]);
     }
 
     wasm_val_t return_value;
@@ -119,7 +120,7 @@ static void ovm_to_wasm_func_call_binding(void *env, ovm_value_t* params, ovm_va
     wasm_results.data = &return_value;
     wasm_results.size = binding->result_count;
 
-    wasm_trap_t *trap = wasm_func_call(binding->func, &binding->param_buffer, &wasm_results);
+    wasm_trap_t *trap = wasm_func_call(binding->func, &wasm_params, &wasm_results);
     assert(!trap);
 
     if (binding->result_count > 0) {
@@ -128,14 +129,38 @@ static void ovm_to_wasm_func_call_binding(void *env, ovm_value_t* params, ovm_va
     }
 }
 
+typedef struct ovm_direct_binding ovm_direct_binding;
+struct ovm_direct_binding {
+    int param_count;
+    wasm_valkind_t result_kind;
+    ovm_engine_t *engine;
+    wasm_func_direct_callback_t func;
+};
+
+//
+// Direct functions take the same raw slots OVM uses, so nothing has to be converted.
+static void ovm_direct_func_call_binding(void *env, ovm_value_t* params, ovm_value_t *res) {
+    ovm_direct_binding *binding = (ovm_direct_binding *) env;
+
+#if defined(OVM_TYPED_VALUES)
+    u64 *raw_params = alloca(sizeof(u64) * binding->param_count);
+    fori (i, 0, binding->param_count) raw_params[i] = params[i].u64;
+
+    wasm_val_t result;
+    result.kind = binding->result_kind;
+    result.of.i64 = 0;
+    binding->func((OnyxValue *) raw_params, (OnyxValue *) &result.of.i64, (char *) binding->engine->memory);
+
+    WASM_TO_OVM(result, *res);
+#else
+    res->u64 = 0;
+    binding->func((OnyxValue *) params, (OnyxValue *) res, (char *) binding->engine->memory);
+#endif
+}
+
 static void wasm_memory_init(void *env, ovm_value_t* params, ovm_value_t *res) {
     wasm_instance_t *instr = (wasm_instance_t *) env;
 
-    assert(params[0].type == OVM_TYPE_I32);
-    assert(params[1].type == OVM_TYPE_I32);
-    assert(params[2].type == OVM_TYPE_I32);
-    assert(params[3].type == OVM_TYPE_I32);
-
     ovm_engine_memory_copy(instr->store->engine->engine, params[0].i32, instr->module->data_entries[params[3].i32].data, params[2].i32);
 }
 
@@ -164,6 +189,17 @@ static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t
                 wasm_func_t *func = wasm_extern_as_func(imports->data[i]);
                 bh_arr_push(instance->funcs, func);
 
+                if (func->inner.func.direct_func_ptr) {
+                    ovm_direct_binding *binding = bh_alloc(ovm_store->arena_allocator, sizeof(*binding));
+                    binding->param_count = functype->params.size;
+                    binding->result_kind = functype->results.size > 0 ? functype->results.data[0]->kind : WASM_I32;
+                    binding->engine      = ovm_engine;
+                    binding->func        = func->inner.func.direct_func_ptr;
+
+                    ovm_state_register_external_func(ovm_state, importtype->external_func_idx, ovm_direct_func_call_binding, binding);
+                    break;
+                }
+
                 ovm_wasm_binding *binding = bh_alloc(ovm_store->arena_allocator, sizeof(*binding));
                 binding->param_count  = functype->params.size;
                 binding->result_count = functype->results.size;
@@ -171,6 +207,10 @@ static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t
                 binding->param_buffer.data = bh_alloc(ovm_store->arena_allocator, sizeof(wasm_val_t) * binding->param_count);
                 binding->param_buffer.size = binding->param_count; 
 
+                fori (j, 0, binding->param_count) {
+                    binding->param_buffer.data[j].kind = functype->params.data[j]->kind;
+                }
+
                 ovm_state_register_external_func(ovm_state, importtype->external_func_idx, ovm_to_wasm_func_call_binding, binding);
                 break;
             }
@@ -216,10 +256,16 @@ static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t
     // Create function objects
     fori (i, 0, (int) instance->module->functypes.size) {
         wasm_ovm_binding *binding = bh_alloc(instance->store->engine->store->arena_allocator, sizeof(*binding));
+        binding->store    = instance->store;
         binding->engine   = ovm_engine;
         binding->func_idx = bh_arr_length(instance->funcs);
         binding->program  = ovm_program;
         binding->state    = ovm_state;
+
+        wasm_functype_t *functype = instance->module->functypes.data[i];
+        binding->result_kind = functype->type.func.results.size > 0
+            ? functype->type.func.results.data[0]->kind
+            : WASM_I32;
         
         wasm_func_t *func = wasm_func_new_with_env(instance->store, instance->module->functypes.data[i], 
             wasm_to_ovm_func_call_binding, binding, NULL);
@@ -265,6 +311,13 @@ static void prepare_instance(wasm_instance_t *instance, const wasm_extern_vec_t
     }
 
 
+    //
+    // Linear memory only becomes accessible as it grows, so the initial
+    // size has to be in place before any data is copied into it.
+    assert(bh_arr_length(instance->memories) == 1);
+    i64 memory_size = (i64) instance->memories[0]->inner.type->memory.limits.min * MEMORY_PAGE_SIZE;
+    ovm_engine_memory_ensure_capacity(ovm_engine, memory_size);
+
     //
     // Initialize all non-passive data segments
     fori (i, 0, (int) instance->module->data_count) {
@@ -312,6 +365,7 @@ wasm_instance_t *wasm_instance_new(wasm_store_t *store, const wasm_module_t *mod
     wasm_instance_t *instance = bh_alloc(store->engine->store->heap_allocator, sizeof(*instance));
     instance->store = store;
     instance->module = module;
+    instance->parent = NULL;
 
     if (store->instance) {
         bh_printf("A WASM store should only be used for a single instance!\n");
@@ -333,16 +387,122 @@ wasm_instance_t *wasm_instance_new(wasm_store_t *store, const wasm_module_t *mod
 
     prepare_instance(instance, imports);
 
-    assert(bh_arr_length(instance->memories) == 1);
-    u32 memory_size = (instance->memories[0]->inner.type->memory.limits.min) * MEMORY_PAGE_SIZE;
-    ovm_engine_memory_ensure_capacity(store->engine->engine, memory_size);
-
     if (trap) *trap = NULL;
 
     return instance;
 }
 
+//
+// Functions and globals are normally allocated in the engine's arena, but thread
+// instances come and go with their threads, so their copies live on the heap.
+static wasm_func_t *thread_func_new(wasm_instance_t *instance, const wasm_func_t *parent_func) {
+    bh_allocator heap = instance->store->engine->store->heap_allocator;
+
+    wasm_ovm_binding *binding = bh_alloc(heap, sizeof(*binding));
+    *binding = *(wasm_ovm_binding *) parent_func->inner.func.env;
+    binding->store = instance->store;
+    binding->state = instance->state;
+
+    wasm_func_t *func = bh_alloc(heap, sizeof(*func));
+    *func = *parent_func;
+    func->inner.func.env = binding;
+
+    return func;
+}
+
+static wasm_global_t *thread_global_new(wasm_instance_t *instance, const wasm_global_t *parent_global) {
+    wasm_global_t *global = bh_alloc(instance->store->engine->store->heap_allocator, sizeof(*global));
+    *global = *parent_global;
+    global->inner.global.state = instance->state;
+
+    return global;
+}
+
+wasm_instance_t *wasm_instance_new_thread(wasm_store_t *store, const wasm_instance_t *parent) {
+    if (store->instance) {
+        bh_printf("A WASM store should only be used for a single instance!\n");
+        return NULL;
+    }
+
+    bh_allocator heap = store->engine->store->heap_allocator;
+
+    wasm_instance_t *instance = bh_alloc(heap, sizeof(*instance));
+    memset(instance, 0, sizeof(*instance));
+    instance->store  = store;
+    instance->module = parent->module;
+    instance->parent = parent;
+    store->instance  = instance;
+
+    // Released by wasm_instance_delete, see running_calls.
+    __atomic_fetch_add(&store->engine->running_calls, 1, __ATOMIC_ACQUIRE);
+
+    instance->state = ovm_state_new(store->engine->engine, parent->module->program);
+
+    bh_arr_each(ovm_external_func_t, external_func, parent->state->external_funcs) {
+        ovm_state_register_external_func(instance->state, external_func - parent->state->external_funcs,
+            external_func->native_func, external_func->userdata);
+    }
+
+    bh_arr_each(wasm_global_t *, global, parent->globals) {
+        ovm_value_t val = {0};
+        WASM_TO_OVM((*global)->inner.global.initial_value, val);
+        ovm_state_register_set(instance->state, (*global)->inner.global.register_index, val);
+    }
+
+    //
+    // `funcs` and `globals` only hold the copies made here, so they can be freed
+    // with the instance. Everything else is exported straight from the parent.
+    bh_arr_new(heap, instance->funcs, 4);
+    bh_arr_new(heap, instance->globals, 4);
+
+    wasm_extern_vec_new_uninitialized(&instance->exports, parent->exports.size);
+    fori (i, 0, (int) parent->exports.size) {
+        wasm_extern_t *parent_export = parent->exports.data[i];
+
+        switch (parent_export->type->kind) {
+            case WASM_EXTERN_FUNC: {
+                wasm_func_t *parent_func = wasm_extern_as_func(parent_export);
+                if (parent_func->inner.func.func_ptr != (void (*)()) wasm_to_ovm_func_call_binding) {
+                    instance->exports.data[i] = parent_export;
+                    break;
+                }
+
+                wasm_func_t *func = thread_func_new(instance, parent_func);
+                bh_arr_push(instance->funcs, func);
+                instance->exports.data[i] = wasm_func_as_extern(func);
+                break;
+            }
+
+            case WASM_EXTERN_GLOBAL: {
+                wasm_global_t *global = thread_global_new(instance, wasm_extern_as_global(parent_export));
+                bh_arr_push(instance->globals, global);
+                instance->exports.data[i] = wasm_global_as_extern(global);
+                break;
+            }
+
+            default:
+                instance->exports.data[i] = parent_export;
+                break;
+        }
+    }
+
+    return instance;
+}
+
 void wasm_instance_delete(wasm_instance_t *instance) {
+    if (instance->parent) {
+        bh_allocator heap = instance->store->engine->store->heap_allocator;
+
+        bh_arr_each(wasm_func_t *, func, instance->funcs) {
+            bh_free(heap, (*func)->inner.func.env);
+            bh_free(heap, *func);
+        }
+
+        bh_arr_each(wasm_global_t *, global, instance->globals) {
+            bh_free(heap, *global);
+        }
+    }
+
     bh_arr_free(instance->funcs);
     bh_arr_free(instance->memories);
     bh_arr_free(instance->globals);
@@ -350,7 +510,13 @@ void wasm_instance_delete(wasm_instance_t *instance) {
 
     wasm_extern_vec_delete(&instance->exports);
     ovm_state_delete(instance->state);
-    bh_free(instance->store->engine->store->heap_allocator, instance);
+
+    wasm_engine_t *engine = instance->store->engine;
+    bool is_thread = instance->parent != NULL;
+    bh_free(engine->store->heap_allocator, instance);
+
+    // Nothing owned by the engine may be touched after this.
+    if (is_thread) __atomic_fetch_sub(&engine->running_calls, 1, __ATOMIC_RELEASE);
 }
 
 void wasm_instance_exports(const wasm_instance_t *instance, wasm_extern_vec_t *out) {
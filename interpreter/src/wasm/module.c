@@ -6,10 +6,45 @@
 
 #include "./module_parsing.h"
 
+//
+// Programs are cached by a hash of the binary they were built from (FNV-1a).
+static u64 module_hash_binary(const wasm_byte_vec_t *binary) {
+    u64 hash = 0xcbf29ce484222325ull;
+    fori (i, 0, (i64) binary->size) {
+        hash ^= (u8) binary->data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static char *module_cache_filename(char *cache_dir, u64 key) {
+    bh_path_create_directories(cache_dir);
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+    return bh_aprintf(bh_heap_allocator(), "%s/%s.ovmc", cache_dir, name);
+}
+
 static bool module_build(wasm_module_t *module, const wasm_byte_vec_t *binary) {
     wasm_engine_t *engine = module->store->engine;
     module->program = ovm_program_new(engine->store);
 
+    u64 cache_key = 0;
+    char *cache_filename = NULL;
+    bool cached = false;
+
+    //
+    // The debugger and the profiler need the debug info made while
+    // building, and the debugger unfused code, so the cache is not
+    // used with either of them.
+    wasm_config_t *config = engine->config;
+    if (config && config->program_cache_dir && !engine->engine->debug && !engine->engine->profiler) {
+        cache_key = module_hash_binary(binary);
+        cache_filename = module_cache_filename(config->program_cache_dir, cache_key);
+        cached = ovm_program_load_from_cache(module->program, cache_filename, cache_key);
+    }
+
     build_context ctx;
     ctx.binary  = *binary;
     ctx.offset  = 8;  // Skip the magic bytes and version
@@ -17,6 +52,15 @@ static bool module_build(wasm_module_t *module, const wasm_byte_vec_t *binary) {
     ctx.program = module->program;
     ctx.store   = engine->store;
     ctx.next_external_func_idx = 0;
+    ctx.skip_code = cached;
+
+    //
+    // The rest of the module still has to be parsed when the program
+    // was cached. What would have been added to the program goes to
+    // a throwaway one instead.
+    if (cached) {
+        ctx.program = ovm_program_new(engine->store);
+    }
 
     debug_info_builder_init(&ctx.debug_builder, &module->debug_info);
     sh_new_arena(module->custom_sections);
@@ -25,10 +69,20 @@ static bool module_build(wasm_module_t *module, const wasm_byte_vec_t *binary) {
         parse_section(&ctx);
     }
 
+    if (cached) {
+        ovm_program_delete(ctx.program);
+    }
+
     // TODO: This is not correct when the module imports a global.
     // But Onyx does not do this, so I don't care at the moment.
     module->program->register_count = module->globaltypes.size;
 
+    if (cache_filename && !cached) {
+        ovm_program_save_to_cache(module->program, cache_filename, cache_key);
+    }
+
+    if (cache_filename) bh_free(bh_heap_allocator(), cache_filename);
+
     #if 0
         printf("Program instruction count: %d\n", bh_arr_length(module->program->code));
     #endif
@@ -80,11 +134,18 @@ wasm_module_t *wasm_module_new(wasm_store_t *store, const wasm_byte_vec_t *binar
         store->engine->engine->debug->info = &module->debug_info;
     }
 
+    if (store->engine->engine->profiler) {
+        store->engine->engine->profiler->info = &module->debug_info;
+    }
+
     bool success = module_build(module, binary); 
     return module;
 }
 
 void wasm_module_delete(wasm_module_t *module) {
+    // See wasm_engine_delete.
+    if (__atomic_load_n(&module->store->engine->running_calls, __ATOMIC_ACQUIRE) > 0) return;
+
     ovm_program_delete(module->program);
 }
 
@@ -20,6 +20,9 @@ struct build_context {
 
     int func_table_arr_idx;
     int next_external_func_idx;
+
+    // Set when the program was loaded from the cache, so the code does not need building.
+    bool skip_code;
     
     debug_info_builder_t debug_builder;
 
@@ -52,13 +55,29 @@ static inline wasm_valkind_t parse_valtype(build_context *ctx) {
         case 0x7e: return WASM_I64;
         case 0x7d: return WASM_F32;
         case 0x7c: return WASM_F64;
-        case 0x7b: assert(("SIMD values are not currently supported", 0));
+        case 0x7b: return WASM_V128;
         case 0x70: return WASM_FUNCREF;
         case 0x6F: return WASM_ANYREF;
         default:   assert(("Invalid valtype.", 0));
     }
 }
 
+static inline u32 ovm_type_from_valkind(wasm_valkind_t kind) {
+    switch (kind) {
+        case WASM_I32:  return OVM_TYPE_I32;
+        case WASM_I64:  return OVM_TYPE_I64;
+        case WASM_F32:  return OVM_TYPE_F32;
+        case WASM_F64:  return OVM_TYPE_F64;
+        case WASM_V128: return OVM_TYPE_V128;
+        default:        return OVM_TYPE_I32;
+    }
+}
+
+static inline u32 ovm_result_type_of(wasm_functype_t *functype) {
+    if (functype->type.func.results.size == 0) return OVM_TYPE_NONE;
+    return ovm_type_from_valkind(functype->type.func.results.data[0]->kind);
+}
+
 static void parse_custom_section(build_context *ctx) {
     unsigned int section_size = uleb128_to_uint(ctx->binary.data, &ctx->offset);
     unsigned int end_of_section = ctx->offset + section_size;
@@ -426,7 +445,7 @@ static void parse_fc_instruction(build_context *ctx) {
             assert(CONSUME_BYTE(ctx) == 0x00);
 
             ovm_code_builder_add_imm(&ctx->builder, OVM_TYPE_I32, &dataidx);
-            ovm_code_builder_add_call(&ctx->builder, ctx->module->memory_init_idx, 4, false);
+            ovm_code_builder_add_call(&ctx->builder, ctx->module->memory_init_idx, 4, OVM_TYPE_NONE);
             break;
         }
 
@@ -449,10 +468,250 @@ static void parse_fc_instruction(build_context *ctx) {
     }
 }
 
+//
+// SIMD instructions. These use the opcode numbering from the SIMD proposal
+// that the compiler emits (see WI_V128_LOAD and friends in wasm_emit.h).
+static void parse_fd_instruction(build_context *ctx) {
+    int instr_num = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+
+#define V_BINOP(instr, type) ovm_code_builder_add_simd_binop(&ctx->builder, OVM_TYPED_INSTR(instr, type))
+#define V_UNOP(instr, type)  ovm_code_builder_add_simd_unop(&ctx->builder, OVM_TYPED_INSTR(instr, type))
+#define V_REDUCE(instr, type) ovm_code_builder_add_unop(&ctx->builder, OVM_TYPED_INSTR(instr, type))
+
+    switch (instr_num) {
+        case 0: {
+            int alignment = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            int offset    = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            ovm_code_builder_add_load(&ctx->builder, OVM_TYPE_V128, offset);
+            break;
+        }
+
+        case 11: {
+            int alignment = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            int offset    = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            ovm_code_builder_add_store(&ctx->builder, OVM_TYPE_V128, offset);
+            break;
+        }
+
+        case 12: {
+            ovm_code_builder_add_imm(&ctx->builder, OVM_TYPE_V128, &ctx->binary.data[ctx->offset]);
+            ctx->offset += 16;
+            break;
+        }
+
+        case 13: {
+            ovm_code_builder_add_simd_shuffle(&ctx->builder, &ctx->binary.data[ctx->offset]);
+            ctx->offset += 16;
+            break;
+        }
+
+        case 14: V_BINOP(OVMI_V_SWIZZLE, OVM_TYPE_I8); break;
+        case 15: V_UNOP(OVMI_V_SPLAT, OVM_TYPE_I8);  break;
+        case 16: V_UNOP(OVMI_V_SPLAT, OVM_TYPE_I16); break;
+        case 17: V_UNOP(OVMI_V_SPLAT, OVM_TYPE_I32); break;
+        case 18: V_UNOP(OVMI_V_SPLAT, OVM_TYPE_I64); break;
+        case 19: V_UNOP(OVMI_V_SPLAT, OVM_TYPE_F32); break;
+        case 20: V_UNOP(OVMI_V_SPLAT, OVM_TYPE_F64); break;
+
+#define LANE_CASE(num, instr, type, replace) \
+        case num: { \
+            int lane = CONSUME_BYTE(ctx); \
+            if (replace) ovm_code_builder_add_simd_replace_lane(&ctx->builder, type, lane); \
+            else         ovm_code_builder_add_simd_extract_lane(&ctx->builder, OVM_TYPED_INSTR(instr, type), lane); \
+            break; \
+        }
+
+        LANE_CASE(21, OVMI_V_EXTRACT_S, OVM_TYPE_I8,  false)
+        LANE_CASE(22, OVMI_V_EXTRACT,   OVM_TYPE_I8,  false)
+        LANE_CASE(23, OVMI_V_REPLACE,   OVM_TYPE_I8,  true)
+        LANE_CASE(24, OVMI_V_EXTRACT_S, OVM_TYPE_I16, false)
+        LANE_CASE(25, OVMI_V_EXTRACT,   OVM_TYPE_I16, false)
+        LANE_CASE(26, OVMI_V_REPLACE,   OVM_TYPE_I16, true)
+        LANE_CASE(27, OVMI_V_EXTRACT,   OVM_TYPE_I32, false)
+        LANE_CASE(28, OVMI_V_REPLACE,   OVM_TYPE_I32, true)
+        LANE_CASE(29, OVMI_V_EXTRACT,   OVM_TYPE_I64, false)
+        LANE_CASE(30, OVMI_V_REPLACE,   OVM_TYPE_I64, true)
+        LANE_CASE(31, OVMI_V_EXTRACT,   OVM_TYPE_F32, false)
+        LANE_CASE(32, OVMI_V_REPLACE,   OVM_TYPE_F32, true)
+        LANE_CASE(33, OVMI_V_EXTRACT,   OVM_TYPE_F64, false)
+        LANE_CASE(34, OVMI_V_REPLACE,   OVM_TYPE_F64, true)
+
+#undef LANE_CASE
+
+#define INT_COMPARE_CASES(base, type) \
+        case base + 0: V_BINOP(OVMI_V_EQ,   type); break; \
+        case base + 1: V_BINOP(OVMI_V_NE,   type); break; \
+        case base + 2: V_BINOP(OVMI_V_LT_S, type); break; \
+        case base + 3: V_BINOP(OVMI_V_LT,   type); break; \
+        case base + 4: V_BINOP(OVMI_V_GT_S, type); break; \
+        case base + 5: V_BINOP(OVMI_V_GT,   type); break; \
+        case base + 6: V_BINOP(OVMI_V_LE_S, type); break; \
+        case base + 7: V_BINOP(OVMI_V_LE,   type); break; \
+        case base + 8: V_BINOP(OVMI_V_GE_S, type); break; \
+        case base + 9: V_BINOP(OVMI_V_GE,   type); break;
+
+#define FLOAT_COMPARE_CASES(base, type) \
+        case base + 0: V_BINOP(OVMI_V_EQ, type); break; \
+        case base + 1: V_BINOP(OVMI_V_NE, type); break; \
+        case base + 2: V_BINOP(OVMI_V_LT, type); break; \
+        case base + 3: V_BINOP(OVMI_V_GT, type); break; \
+        case base + 4: V_BINOP(OVMI_V_LE, type); break; \
+        case base + 5: V_BINOP(OVMI_V_GE, type); break;
+
+        INT_COMPARE_CASES(35, OVM_TYPE_I8)
+        INT_COMPARE_CASES(45, OVM_TYPE_I16)
+        INT_COMPARE_CASES(55, OVM_TYPE_I32)
+        FLOAT_COMPARE_CASES(65, OVM_TYPE_F32)
+        FLOAT_COMPARE_CASES(71, OVM_TYPE_F64)
+
+#undef FLOAT_COMPARE_CASES
+#undef INT_COMPARE_CASES
+
+        case 77: V_UNOP(OVMI_V_NOT, OVM_TYPE_V128); break;
+        case 78: V_BINOP(OVMI_V_AND, OVM_TYPE_V128); break;
+        case 79: V_BINOP(OVMI_V_ANDNOT, OVM_TYPE_V128); break;
+        case 80: V_BINOP(OVMI_V_OR, OVM_TYPE_V128); break;
+        case 81: V_BINOP(OVMI_V_XOR, OVM_TYPE_V128); break;
+        case 82: ovm_code_builder_add_simd_bitselect(&ctx->builder); break;
+
+        case 96:  V_UNOP(OVMI_V_ABS, OVM_TYPE_I8); break;
+        case 97:  V_UNOP(OVMI_V_NEG, OVM_TYPE_I8); break;
+        case 98:  V_REDUCE(OVMI_V_ANY_TRUE, OVM_TYPE_V128); break;
+        case 99:  V_REDUCE(OVMI_V_ALL_TRUE, OVM_TYPE_I8); break;
+        case 100: V_REDUCE(OVMI_V_BITMASK, OVM_TYPE_I8); break;
+        case 101: V_BINOP(OVMI_V_NARROW_S, OVM_TYPE_I8); break;
+        case 102: V_BINOP(OVMI_V_NARROW, OVM_TYPE_I8); break;
+        case 107: V_BINOP(OVMI_V_SHL, OVM_TYPE_I8); break;
+        case 108: V_BINOP(OVMI_V_SAR, OVM_TYPE_I8); break;
+        case 109: V_BINOP(OVMI_V_SHR, OVM_TYPE_I8); break;
+        case 110: V_BINOP(OVMI_V_ADD, OVM_TYPE_I8); break;
+        case 111: V_BINOP(OVMI_V_ADD_SAT_S, OVM_TYPE_I8); break;
+        case 112: V_BINOP(OVMI_V_ADD_SAT, OVM_TYPE_I8); break;
+        case 113: V_BINOP(OVMI_V_SUB, OVM_TYPE_I8); break;
+        case 114: V_BINOP(OVMI_V_SUB_SAT_S, OVM_TYPE_I8); break;
+        case 115: V_BINOP(OVMI_V_SUB_SAT, OVM_TYPE_I8); break;
+        case 118: V_BINOP(OVMI_V_MIN_S, OVM_TYPE_I8); break;
+        case 119: V_BINOP(OVMI_V_MIN, OVM_TYPE_I8); break;
+        case 120: V_BINOP(OVMI_V_MAX_S, OVM_TYPE_I8); break;
+        case 121: V_BINOP(OVMI_V_MAX, OVM_TYPE_I8); break;
+        case 123: V_BINOP(OVMI_V_AVGR, OVM_TYPE_I8); break;
+
+        case 128: V_UNOP(OVMI_V_ABS, OVM_TYPE_I16); break;
+        case 129: V_UNOP(OVMI_V_NEG, OVM_TYPE_I16); break;
+        case 130: V_REDUCE(OVMI_V_ANY_TRUE, OVM_TYPE_V128); break;
+        case 131: V_REDUCE(OVMI_V_ALL_TRUE, OVM_TYPE_I16); break;
+        case 132: V_REDUCE(OVMI_V_BITMASK, OVM_TYPE_I16); break;
+        case 133: V_BINOP(OVMI_V_NARROW_S, OVM_TYPE_I16); break;
+        case 134: V_BINOP(OVMI_V_NARROW, OVM_TYPE_I16); break;
+        case 135: V_UNOP(OVMI_V_WIDEN_LOW_S, OVM_TYPE_I16); break;
+        case 136: V_UNOP(OVMI_V_WIDEN_HIGH_S, OVM_TYPE_I16); break;
+        case 137: V_UNOP(OVMI_V_WIDEN_LOW, OVM_TYPE_I16); break;
+        case 138: V_UNOP(OVMI_V_WIDEN_HIGH, OVM_TYPE_I16); break;
+        case 139: V_BINOP(OVMI_V_SHL, OVM_TYPE_I16); break;
+        case 140: V_BINOP(OVMI_V_SAR, OVM_TYPE_I16); break;
+        case 141: V_BINOP(OVMI_V_SHR, OVM_TYPE_I16); break;
+        case 142: V_BINOP(OVMI_V_ADD, OVM_TYPE_I16); break;
+        case 143: V_BINOP(OVMI_V_ADD_SAT_S, OVM_TYPE_I16); break;
+        case 144: V_BINOP(OVMI_V_ADD_SAT, OVM_TYPE_I16); break;
+        case 145: V_BINOP(OVMI_V_SUB, OVM_TYPE_I16); break;
+        case 146: V_BINOP(OVMI_V_SUB_SAT_S, OVM_TYPE_I16); break;
+        case 147: V_BINOP(OVMI_V_SUB_SAT, OVM_TYPE_I16); break;
+        case 149: V_BINOP(OVMI_V_MUL, OVM_TYPE_I16); break;
+        case 150: V_BINOP(OVMI_V_MIN_S, OVM_TYPE_I16); break;
+        case 151: V_BINOP(OVMI_V_MIN, OVM_TYPE_I16); break;
+        case 152: V_BINOP(OVMI_V_MAX_S, OVM_TYPE_I16); break;
+        case 153: V_BINOP(OVMI_V_MAX, OVM_TYPE_I16); break;
+        case 155: V_BINOP(OVMI_V_AVGR, OVM_TYPE_I16); break;
+
+        case 160: V_UNOP(OVMI_V_ABS, OVM_TYPE_I32); break;
+        case 161: V_UNOP(OVMI_V_NEG, OVM_TYPE_I32); break;
+        case 162: V_REDUCE(OVMI_V_ANY_TRUE, OVM_TYPE_V128); break;
+        case 163: V_REDUCE(OVMI_V_ALL_TRUE, OVM_TYPE_I32); break;
+        case 164: V_REDUCE(OVMI_V_BITMASK, OVM_TYPE_I32); break;
+        case 167: V_UNOP(OVMI_V_WIDEN_LOW_S, OVM_TYPE_I32); break;
+        case 168: V_UNOP(OVMI_V_WIDEN_HIGH_S, OVM_TYPE_I32); break;
+        case 169: V_UNOP(OVMI_V_WIDEN_LOW, OVM_TYPE_I32); break;
+        case 170: V_UNOP(OVMI_V_WIDEN_HIGH, OVM_TYPE_I32); break;
+        case 171: V_BINOP(OVMI_V_SHL, OVM_TYPE_I32); break;
+        case 172: V_BINOP(OVMI_V_SAR, OVM_TYPE_I32); break;
+        case 173: V_BINOP(OVMI_V_SHR, OVM_TYPE_I32); break;
+        case 174: V_BINOP(OVMI_V_ADD, OVM_TYPE_I32); break;
+        case 177: V_BINOP(OVMI_V_SUB, OVM_TYPE_I32); break;
+        case 181: V_BINOP(OVMI_V_MUL, OVM_TYPE_I32); break;
+        case 182: V_BINOP(OVMI_V_MIN_S, OVM_TYPE_I32); break;
+        case 183: V_BINOP(OVMI_V_MIN, OVM_TYPE_I32); break;
+        case 184: V_BINOP(OVMI_V_MAX_S, OVM_TYPE_I32); break;
+        case 185: V_BINOP(OVMI_V_MAX, OVM_TYPE_I32); break;
+
+        case 193: V_UNOP(OVMI_V_NEG, OVM_TYPE_I64); break;
+        case 203: V_BINOP(OVMI_V_SHL, OVM_TYPE_I64); break;
+        case 204: V_BINOP(OVMI_V_SAR, OVM_TYPE_I64); break;
+        case 205: V_BINOP(OVMI_V_SHR, OVM_TYPE_I64); break;
+        case 206: V_BINOP(OVMI_V_ADD, OVM_TYPE_I64); break;
+        case 209: V_BINOP(OVMI_V_SUB, OVM_TYPE_I64); break;
+        case 213: V_BINOP(OVMI_V_MUL, OVM_TYPE_I64); break;
+
+#define FLOAT_ARITH_CASES(base, type) \
+        case base + 0: V_UNOP(OVMI_V_ABS,  type); break; \
+        case base + 1: V_UNOP(OVMI_V_NEG,  type); break; \
+        case base + 3: V_UNOP(OVMI_V_SQRT, type); break; \
+        case base + 4: V_BINOP(OVMI_V_ADD, type); break; \
+        case base + 5: V_BINOP(OVMI_V_SUB, type); break; \
+        case base + 6: V_BINOP(OVMI_V_MUL, type); break; \
+        case base + 7: V_BINOP(OVMI_V_DIV, type); break; \
+        case base + 8: V_BINOP(OVMI_V_MIN, type); break; \
+        case base + 9: V_BINOP(OVMI_V_MAX, type); break;
+
+        FLOAT_ARITH_CASES(224, OVM_TYPE_F32)
+        FLOAT_ARITH_CASES(236, OVM_TYPE_F64)
+
+#undef FLOAT_ARITH_CASES
+
+        case 248: V_UNOP(OVMI_V_TRUNC_SAT_S, OVM_TYPE_I32); break;
+        case 249: V_UNOP(OVMI_V_TRUNC_SAT, OVM_TYPE_I32); break;
+        case 250: V_UNOP(OVMI_V_CONVERT_S, OVM_TYPE_F32); break;
+        case 251: V_UNOP(OVMI_V_CONVERT, OVM_TYPE_F32); break;
+
+        default: assert(("UNHANDLED FD INSTRUCTION", 0));
+    }
+
+#undef V_REDUCE
+#undef V_UNOP
+#undef V_BINOP
+}
+
 static void parse_fe_instruction(build_context *ctx) {
     int instr_num = uleb128_to_uint(ctx->binary.data, &ctx->offset);
 
     switch (instr_num) {
+        case 0x00: {
+            int alignment = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            int offset    = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            ovm_code_builder_add_atomic_rmw(&ctx->builder, OVMI_ATOMIC_NOTIFY, OVM_TYPE_NONE, offset);
+            break;
+        }
+
+        case 0x01: {
+            int alignment = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            int offset    = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            ovm_code_builder_add_atomic_wait(&ctx->builder, OVM_TYPE_I32, offset);
+            break;
+        }
+
+        case 0x02: {
+            int alignment = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            int offset    = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+            ovm_code_builder_add_atomic_wait(&ctx->builder, OVM_TYPE_I64, offset);
+            break;
+        }
+
+        case 0x03: {
+            // Every atomic instruction is sequentially consistent already,
+            // so a fence does not have to do anything.
+            assert(CONSUME_BYTE(ctx) == 0x00);
+            ovm_code_builder_add_nop(&ctx->builder);
+            break;
+        }
 
 #define LOAD_CASE(num, type) \
         case num : { \
@@ -490,6 +749,33 @@ static void parse_fe_instruction(build_context *ctx) {
 
 #undef STORE_CASE
 
+#define RMW_CASE(num, instr, type) \
+        case num : { \
+            int alignment = uleb128_to_uint(ctx->binary.data, &ctx->offset); \
+            int offset    = uleb128_to_uint(ctx->binary.data, &ctx->offset); \
+            ovm_code_builder_add_atomic_rmw(&ctx->builder, instr, type, offset); \
+            break; \
+        }
+
+#define RMW_CASES(base, instr) \
+        RMW_CASE(base + 0, instr, OVM_TYPE_I32) \
+        RMW_CASE(base + 1, instr, OVM_TYPE_I64) \
+        RMW_CASE(base + 2, instr, OVM_TYPE_I8) \
+        RMW_CASE(base + 3, instr, OVM_TYPE_I16) \
+        RMW_CASE(base + 4, instr, OVM_TYPE_I8) \
+        RMW_CASE(base + 5, instr, OVM_TYPE_I16) \
+        RMW_CASE(base + 6, instr, OVM_TYPE_I32)
+
+        RMW_CASES(0x1E, OVMI_ATOMIC_ADD)
+        RMW_CASES(0x25, OVMI_ATOMIC_SUB)
+        RMW_CASES(0x2C, OVMI_ATOMIC_AND)
+        RMW_CASES(0x33, OVMI_ATOMIC_OR)
+        RMW_CASES(0x3A, OVMI_ATOMIC_XOR)
+        RMW_CASES(0x41, OVMI_ATOMIC_XCHG)
+
+#undef RMW_CASES
+#undef RMW_CASE
+
 #define CMPXCHG_CASE(num, type) \
         case num : { \
             int alignment = uleb128_to_uint(ctx->binary.data, &ctx->offset); \
@@ -610,7 +896,7 @@ static void parse_instruction(build_context *ctx) {
             wasm_functype_t *functype = wasm_module_index_functype(ctx->module, func_idx);
             int param_count = functype->type.func.params.size;
 
-            ovm_code_builder_add_call(&ctx->builder, func_idx, param_count, functype->type.func.results.size != 0);
+            ovm_code_builder_add_call(&ctx->builder, func_idx, param_count, ovm_result_type_of(functype));
             break;
         }
 
@@ -621,7 +907,7 @@ static void parse_instruction(build_context *ctx) {
 
             wasm_functype_t *functype = ctx->module->type_section.data[type_idx];
             int param_count = functype->type.func.params.size;
-            ovm_code_builder_add_indirect_call(&ctx->builder, param_count, functype->type.func.results.size != 0);
+            ovm_code_builder_add_indirect_call(&ctx->builder, param_count, ovm_result_type_of(functype));
             break;
         }
 
@@ -899,6 +1185,7 @@ static void parse_instruction(build_context *ctx) {
         case 0xC4: ovm_code_builder_add_unop (&ctx->builder, OVM_TYPED_INSTR(OVMI_CVT_I32_S, OVM_TYPE_I64)); break;
 
         case 0xFC: parse_fc_instruction(ctx); break;
+        case 0xFD: parse_fd_instruction(ctx); break;
         case 0xFE: parse_fe_instruction(ctx); break;
 
         default: assert(("UNHANDLED INSTRUCTION", 0));
@@ -913,6 +1200,7 @@ static void parse_expression(build_context *ctx) {
 
 static void parse_code_section(build_context *ctx) {
     unsigned int section_size = uleb128_to_uint(ctx->binary.data, &ctx->offset);
+    unsigned int code_start = ctx->offset;
     unsigned int code_count = uleb128_to_uint(ctx->binary.data, &ctx->offset);
     assert(ctx->module->functypes.size == code_count);
 
@@ -921,38 +1209,70 @@ static void parse_code_section(build_context *ctx) {
     // HACK HACK HACK THIS IS SUCH A BAD WAY OF DOING THIS
     ctx->module->memory_init_idx = bh_arr_length(ctx->program->funcs) + code_count;
 
+    if (ctx->skip_code) {
+        ctx->offset = code_start + section_size;
+        return;
+    }
+
     fori (i, 0, (int) code_count) {
         unsigned int code_size = uleb128_to_uint(ctx->binary.data, &ctx->offset);
         unsigned int local_sections_count = uleb128_to_uint(ctx->binary.data, &ctx->offset);
 
+        wasm_functype_t *functype = ctx->module->functypes.data[i];
+        i32 param_count = functype->type.func.params.size;
+
+        //
+        // The builder needs the type of every local (params included),
+        // because v128 locals take up two value numbers.
+        bh_arr(u32) local_types = NULL;
+        bh_arr_new(bh_heap_allocator(), local_types, param_count);
+        fori (p, 0, param_count) {
+            bh_arr_push(local_types, ovm_type_from_valkind(functype->type.func.params.data[p]->kind));
+        }
+
         unsigned int total_locals = 0;
         fori (j, 0, (int) local_sections_count) {
             unsigned int local_count = uleb128_to_uint(ctx->binary.data, &ctx->offset);
             wasm_valkind_t valtype = parse_valtype(ctx);
 
+            fori (k, 0, (int) local_count) bh_arr_push(local_types, ovm_type_from_valkind(valtype));
             total_locals += local_count;
         }
 
         // Set up a lot of stuff...
 
         i32 func_idx = bh_arr_length(ctx->program->funcs);
-        i32 param_count  = ctx->module->functypes.data[i]->type.func.params.size;
-        i32 result_count = ctx->module->functypes.data[i]->type.func.results.size;
 
         debug_info_builder_begin_func(&ctx->debug_builder, func_idx);
 
-        ctx->builder = ovm_code_builder_new(ctx->program, &ctx->debug_builder, param_count, result_count, total_locals);
+        ctx->builder = ovm_code_builder_new(ctx->program, &ctx->debug_builder, param_count, total_locals, local_types, ovm_result_type_of(functype));
         ctx->builder.func_table_arr_idx = ctx->func_table_arr_idx;
 
         ovm_code_builder_push_label_target(&ctx->builder, label_kind_func);
         parse_expression(ctx);
         ovm_code_builder_add_return(&ctx->builder);
 
+        //
+        // Fused instructions cover two instruction slots, which would make
+        // stepping and breakpoints in the debugger behave strangely.
+        if (!ctx->module->store->engine->engine->debug) {
+            ovm_code_builder_fuse_instructions(&ctx->builder);
+        }
+
+        //
+        // The debugger refers to locals by their WASM index, so it needs
+        // to know where they were placed if any of them are v128s.
+        i32 local_total = param_count + total_locals;
+        if (ctx->builder.local_value_numbers[local_total] != local_total) {
+            debug_info_set_local_value_numbers(ctx->debug_builder.info, func_idx, local_total + 1, ctx->builder.local_value_numbers);
+        }
+
         char *func_name = bh_aprintf(bh_heap_allocator(), "wasm_loaded_%d", func_idx);
         ovm_program_register_func(ctx->program, func_name, ctx->builder.start_instr, ctx->builder.param_count, ctx->builder.highest_value_number + 1);
 
         ovm_code_builder_free(&ctx->builder);
         debug_info_builder_end_func(&ctx->debug_builder);
+        bh_arr_free(local_types);
     }
 
     ovm_program_register_external_func(ctx->program, "__internal_wasm_memory_init", 4, ctx->module->memory_init_external_idx);
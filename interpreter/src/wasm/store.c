@@ -3,12 +3,14 @@
 #include "vm.h"
 
 wasm_store_t *wasm_store_new(wasm_engine_t *engine) {
-    wasm_store_t *store = bh_alloc(engine->store->arena_allocator, sizeof(wasm_store_t));
+    wasm_store_t *store = bh_alloc(bh_heap_allocator(), sizeof(wasm_store_t));
     store->engine = engine;
     store->instance = NULL;
     return store;
 }
 
 void wasm_store_delete(wasm_store_t *store) {
+    // Not freed through the engine, which may already be gone when a thread's store is deleted.
+    bh_free(bh_heap_allocator(), store);
 }
 
@@ -9,8 +9,8 @@ wasm_trap_t *wasm_trap_new(wasm_store_t *store, const wasm_message_t *msg) {
 
     //
     // Generate frames
-    bh_arr(ovm_stack_frame_t) ovm_frames = store->instance->state->stack_frames;
-    int frame_count = bh_arr_length(ovm_frames);
+    ovm_stack_frame_t *ovm_frames = store->instance->state->stack_frames;
+    int frame_count = store->instance->state->stack_frame_count;
 
     wasm_frame_vec_new_uninitialized(&trap->frames, frame_count);
 
@@ -37,6 +37,5 @@ wasm_frame_t *wasm_trap_origin(const wasm_trap_t *trap) {
 }
 
 void wasm_trap_trace(const wasm_trap_t *trap, wasm_frame_vec_t *frames) {
-    frames->size = 0;
-    frames->data = NULL;
+    wasm_frame_vec_copy(frames, &trap->frames);
 }
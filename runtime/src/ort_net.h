@@ -250,14 +250,12 @@ ONYX_DEF(__net_shutdown, (WASM_I32, WASM_I32), ()) {
     #endif
 }
 
-ONYX_DEF(__net_send, (WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+ONYX_DEF_DIRECT(__net_send, (WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
     #ifdef _BH_LINUX
     // TODO: The flags at the end should be controllable.
-    int sent = send(params->data[0].of.i32, ONYX_PTR(params->data[1].of.i32), params->data[2].of.i32, MSG_NOSIGNAL);
-    results->data[0] = WASM_I32_VAL(sent);
+    int sent = send(params[0].i32, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, MSG_NOSIGNAL);
+    results[0].i32 = sent;
     #endif
-    
-    return NULL;
 }
 
 ONYX_DEF(__net_sendto, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
@@ -279,22 +277,20 @@ ONYX_DEF(__net_sendto, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
     return NULL;
 }
 
-ONYX_DEF(__net_recv, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
-    *(i32 *) ONYX_PTR(params->data[3].of.i32) = 0;
+ONYX_DEF_DIRECT(__net_recv, (WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
+    *(i32 *) ONYX_DIRECT_PTR(params[3].i32) = 0;
 
     #ifdef _BH_LINUX
     // TODO: The flags at the end should be controllable.
-    int received = recv(params->data[0].of.i32, ONYX_PTR(params->data[1].of.i32), params->data[2].of.i32, 0);
-    results->data[0] = WASM_I32_VAL(received);
+    int received = recv(params[0].i32, ONYX_DIRECT_PTR(params[1].i32), params[2].i32, 0);
+    results[0].i32 = received;
 
     if (received < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            *(i32 *) ONYX_PTR(params->data[3].of.i32) = 1;
+            *(i32 *) ONYX_DIRECT_PTR(params[3].i32) = 1;
         }
     }
     #endif
-
-    return NULL;
 }
 
 ONYX_DEF(__net_recvfrom, (WASM_I32, WASM_I32, WASM_I32, WASM_I32, WASM_I32), (WASM_I32)) {
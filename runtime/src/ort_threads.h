@@ -32,13 +32,24 @@ static i32 onyx_run_thread(void *data) {
 
     wasm_store_t *wasm_store = runtime->wasm_store_new(runtime->wasm_engine);
 
-    wasm_trap_t* traps = NULL;
-    thread->instance = runtime->wasm_instance_new(wasm_store, runtime->wasm_module, &runtime->wasm_imports, &traps);
+    //
+    // When the runtime supports it, the thread shares the main instance and
+    // only gets its own registers and stacks, which is much cheaper than
+    // instantiating the module again.
+    wasm_instance_t *instance;
+    if (runtime->wasm_instance_new_thread) {
+        instance = runtime->wasm_instance_new_thread(wasm_store, runtime->wasm_instance);
+    } else {
+        wasm_trap_t* traps = NULL;
+        instance = runtime->wasm_instance_new(wasm_store, runtime->wasm_module, &runtime->wasm_imports, &traps);
+    }
+
+    thread->instance = instance;
 
-    wasm_extern_t* start_extern = runtime->wasm_extern_lookup_by_name(runtime->wasm_module, thread->instance, "_thread_start");
+    wasm_extern_t* start_extern = runtime->wasm_extern_lookup_by_name(runtime->wasm_module, instance, "_thread_start");
     wasm_func_t*   start_func   = runtime->wasm_extern_as_func(start_extern);
 
-    wasm_extern_t* exit_extern = runtime->wasm_extern_lookup_by_name(runtime->wasm_module, thread->instance, "_thread_exit");
+    wasm_extern_t* exit_extern = runtime->wasm_extern_lookup_by_name(runtime->wasm_module, instance, "_thread_exit");
     wasm_func_t*   exit_func   = runtime->wasm_extern_as_func(exit_extern);
 
     wasm_trap_t* trap=NULL;
@@ -69,6 +80,10 @@ static i32 onyx_run_thread(void *data) {
         trap = runtime->wasm_func_call(exit_func, &args_array, &results);
     }
 
+    if (runtime->wasm_instance_new_thread) {
+        runtime->wasm_instance_delete(instance);
+    }
+
     runtime->wasm_store_delete(wasm_store);
 
     return 0;
@@ -63,6 +63,12 @@ typedef void* ptr;
 typedef float f32;
 typedef double f64;
 
+#if defined(_MSC_VER)
+    #define BH_THREAD_LOCAL __declspec(thread)
+#else
+    #define BH_THREAD_LOCAL __thread
+#endif
+
 
 
 
@@ -432,6 +438,7 @@ b32 bh_file_remove(char const* filename);
 char* bh_path_get_full_name(char const* filename, bh_allocator a);
 char* bh_path_get_parent(char const* filename, bh_allocator a);
 char* bh_path_convert_separators(char* path);
+b32 bh_path_create_directories(char const* path);
 
 // This function returns a volatile pointer. Do not store it without copying!
 // `included_folders` is bh_arr(const char *).
@@ -762,15 +769,17 @@ typedef u64 bh_imap_entry_t;
 
 typedef struct bh__imap_lookup_result {
     i64 hash_index;
-    i64 entry_prev;
     i64 entry_index;
 } bh__imap_lookup_result;
 
 typedef struct bh__imap_entry {
     bh_imap_entry_t key, value;
-    i64 next;
 } bh__imap_entry;
 
+// The map is an open-addressed (linear probing) table of indices into a
+// dense entries array. Iterating over `entries` visits every key/value pair
+// in insertion order, provided nothing has been deleted. The index table is
+// always a power of two long and doubles once it is more than half full.
 typedef struct bh_imap {
     bh_allocator allocator;
 
@@ -1331,7 +1340,7 @@ BH_ALLOCATOR_PROC(bh_scratch_allocator_proc) {
 // CONVERSION FUNCTIONS IMPLEMENTATION
 //-------------------------------------------------------------------------------------
 u8* uint_to_uleb128(u64 n, i32* output_length) {
-    static u8 buffer[16];
+    static BH_THREAD_LOCAL u8 buffer[16];
 
     *output_length = 0;
     u8* output = buffer;
@@ -1350,7 +1359,7 @@ u8* uint_to_uleb128(u64 n, i32* output_length) {
 
 // Converts a signed integer to the signed LEB128 format
 u8* int_to_leb128(i64 n, i32* output_length) {
-    static u8 buffer[16];
+    static BH_THREAD_LOCAL u8 buffer[16];
 
     *output_length = 0;
     u8* output = buffer;
@@ -1376,7 +1385,7 @@ u8* int_to_leb128(i64 n, i32* output_length) {
 // NOTE: This assumes the underlying implementation of float on the host
 // system is already IEEE-754. This is safe to assume in most cases.
 u8* float_to_ieee754(f32 f, b32 reverse) {
-    static u8 buffer[4];
+    static BH_THREAD_LOCAL u8 buffer[4];
 
     u8* fmem = (u8*) &f;
     if (reverse) {
@@ -1395,7 +1404,7 @@ u8* float_to_ieee754(f32 f, b32 reverse) {
 }
 
 u8* double_to_ieee754(f64 f, b32 reverse) {
-    static u8 buffer[8];
+    static BH_THREAD_LOCAL u8 buffer[8];
 
     u8* fmem = (u8*) &f;
     if (reverse) {
@@ -1955,6 +1964,30 @@ char* bh_path_convert_separators(char* path) {
     return path;
 }
 
+//
+// Creates the directory and every parent of it that does not exist, like `mkdir -p`.
+b32 bh_path_create_directories(char const* path) {
+    char buffer[512];
+    i32 len = strlen(path);
+    if (len == 0 || len >= (i32) sizeof(buffer)) return 0;
+    memcpy(buffer, path, len + 1);
+
+    fori (i, 1, len + 1) {
+        char c = buffer[i];
+        if (c != '/' && c != '\\' && c != '\0') continue;
+
+        buffer[i] = '\0';
+#if defined(_BH_WINDOWS)
+        CreateDirectoryA(buffer);
+#elif defined(_BH_LINUX)
+        mkdir(buffer, 0755);
+#endif
+        buffer[i] = c;
+    }
+
+    return bh_file_exists(path);
+}
+
 
 bh_dir bh_dir_open(char* path) {
 #ifdef _BH_WINDOWS
@@ -2123,7 +2156,7 @@ char* bh_bprintf(char const *fmt, ...) {
 }
 
 char* bh_bprintf_va(char const *fmt, va_list va) {
-    static char buffer[4096];
+    static BH_THREAD_LOCAL char buffer[4096];
     isize len = bh_snprintf_va(buffer, sizeof(buffer), fmt, va);
     buffer[len - 1] = 0;
     return buffer;
@@ -2139,7 +2172,7 @@ char* bh_aprintf(bh_allocator alloc, const char* fmt, ...) {
 }
 
 char* bh_aprintf_va(bh_allocator alloc, const char* fmt, va_list va) {
-    static char buffer[4096];
+    static BH_THREAD_LOCAL char buffer[4096];
     isize len = bh_snprintf_va(buffer, sizeof(buffer), fmt, va);
     char* res = bh_alloc(alloc, len);
     memcpy(res, buffer, len);
@@ -2415,9 +2448,12 @@ BH_DEF void bh_buffer_write_string(bh_buffer* buffer, char *str) {
 void bh_buffer_align(bh_buffer* buffer, u32 alignment) {
     if (buffer->length % alignment != 0) {
         u32 difference = alignment - (buffer->length % alignment);
-        buffer->length += difference;
+        bh_buffer_grow(buffer, buffer->length + difference);
 
-        bh_buffer_grow(buffer, buffer->length);
+        // NOTE: The padding is zeroed so the contents do not depend on
+        // whatever was in the memory before.
+        memset(buffer->data + buffer->length, 0, difference);
+        buffer->length += difference;
     }
 }
 
@@ -2815,16 +2851,35 @@ step_to_next:
 // IMAP IMPLEMENTATION
 //-------------------------------------------------------------------------------------
 #ifndef BH_NO_IMAP
+static inline u64 bh__imap_hash(bh_imap_entry_t key) {
+    // Keys are mostly pointers and small ids, so the low bits alone are
+    // useless. This is the 64-bit finalizer from MurmurHash3.
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+static void bh__imap_alloc_hashes(bh_imap* imap, i64 slot_count) {
+    imap->hashes = NULL;
+    bh_arr_new(imap->allocator, imap->hashes, slot_count);
+    bh_arr_set_length(imap->hashes, slot_count);
+    fori(i, 0, slot_count) imap->hashes[i] = -1;
+}
+
 void bh_imap_init(bh_imap* imap, bh_allocator alloc, i32 hash_count) {
     imap->allocator = alloc;
 
     imap->hashes  = NULL;
     imap->entries = NULL;
 
-    bh_arr_new(alloc, imap->hashes, hash_count);
-    bh_arr_new(alloc, imap->entries, 4);
+    i64 slot_count = 8;
+    while (slot_count < hash_count) slot_count <<= 1;
 
-    fori(count, 0, hash_count) bh_arr_push(imap->hashes, -1);
+    bh__imap_alloc_hashes(imap, slot_count);
+    bh_arr_new(alloc, imap->entries, 4);
 }
 
 void bh_imap_free(bh_imap* imap) {
@@ -2836,25 +2891,40 @@ void bh_imap_free(bh_imap* imap) {
 }
 
 bh__imap_lookup_result bh__imap_lookup(bh_imap* imap, bh_imap_entry_t key) {
-    bh__imap_lookup_result lr = { -1, -1, -1 };
+    bh__imap_lookup_result lr = { -1, -1 };
 
-    u64 hash = 0xcbf29ce484222325ull ^ key;
-    u64 n = bh_arr_capacity(imap->hashes);
+    u64 mask = bh_arr_length(imap->hashes) - 1;
+    u64 slot = bh__imap_hash(key) & mask;
 
-    lr.hash_index  = hash % n;
-    lr.entry_index = imap->hashes[lr.hash_index];
-    while (lr.entry_index >= 0) {
-        if (imap->entries[lr.entry_index].key == key) {
+    while (imap->hashes[slot] >= 0) {
+        if (imap->entries[imap->hashes[slot]].key == key) {
+            lr.hash_index  = slot;
+            lr.entry_index = imap->hashes[slot];
             return lr;
         }
 
-        lr.entry_prev  = lr.entry_index;
-        lr.entry_index = imap->entries[lr.entry_index].next;
+        slot = (slot + 1) & mask;
     }
 
+    // Not found; hash_index is the empty slot the key would go in.
+    lr.hash_index = slot;
     return lr;
 }
 
+static void bh__imap_grow(bh_imap* imap) {
+    i64 slot_count = bh_arr_length(imap->hashes) * 2;
+    bh_arr_free(imap->hashes);
+    bh__imap_alloc_hashes(imap, slot_count);
+
+    u64 mask = slot_count - 1;
+    bh_arr_each(bh__imap_entry, entry, imap->entries) {
+        u64 slot = bh__imap_hash(entry->key) & mask;
+        while (imap->hashes[slot] >= 0) slot = (slot + 1) & mask;
+
+        imap->hashes[slot] = entry - imap->entries;
+    }
+}
+
 void bh_imap_put(bh_imap* imap, bh_imap_entry_t key, bh_imap_entry_t value) {
     bh__imap_lookup_result lr = bh__imap_lookup(imap, key);
 
@@ -2866,10 +2936,13 @@ void bh_imap_put(bh_imap* imap, bh_imap_entry_t key, bh_imap_entry_t value) {
     bh__imap_entry entry;
     entry.key = key;
     entry.value = value;
-    entry.next = imap->hashes[lr.hash_index];
     bh_arr_push(imap->entries, entry);
 
     imap->hashes[lr.hash_index] = bh_arr_length(imap->entries) - 1;
+
+    if (bh_arr_length(imap->entries) * 2 > bh_arr_length(imap->hashes)) {
+        bh__imap_grow(imap);
+    }
 }
 
 b32 bh_imap_has(bh_imap* imap, bh_imap_entry_t key) {
@@ -2890,11 +2963,21 @@ void bh_imap_delete(bh_imap* imap, bh_imap_entry_t key) {
     bh__imap_lookup_result lr = bh__imap_lookup(imap, key);
     if (lr.entry_index < 0) return;
 
-    if (lr.entry_prev < 0) {
-        imap->hashes[lr.hash_index] = imap->entries[lr.entry_index].next;
-    } else {
-        imap->entries[lr.entry_prev].next = imap->entries[lr.entry_index].next;
+    // Backward-shift deletion: pull later members of the probe run into
+    // the hole so lookups never need tombstones.
+    u64 mask = bh_arr_length(imap->hashes) - 1;
+    u64 hole = lr.hash_index;
+    u64 slot = (hole + 1) & mask;
+    while (imap->hashes[slot] >= 0) {
+        u64 home = bh__imap_hash(imap->entries[imap->hashes[slot]].key) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            imap->hashes[hole] = imap->hashes[slot];
+            hole = slot;
+        }
+
+        slot = (slot + 1) & mask;
     }
+    imap->hashes[hole] = -1;
 
     // If it's that last thing in the array, just pop off the end
     if (lr.entry_index == bh_arr_length(imap->entries) - 1) {
@@ -2902,13 +2985,11 @@ void bh_imap_delete(bh_imap* imap, bh_imap_entry_t key) {
         return;
     }
 
+    // Otherwise the last entry moves into the freed spot, and the slot
+    // that pointed at it has to follow.
     bh_arr_fastdelete(imap->entries, lr.entry_index);
-    bh__imap_lookup_result last = bh__imap_lookup(imap, imap->entries[lr.entry_index].key);
-    if (last.entry_prev >= 0) {
-        imap->entries[last.entry_prev].next = lr.entry_index;
-    } else {
-        imap->hashes[last.hash_index] = lr.entry_index;
-    }
+    bh__imap_lookup_result moved = bh__imap_lookup(imap, imap->entries[lr.entry_index].key);
+    imap->hashes[moved.hash_index] = lr.entry_index;
 }
 
 void bh_imap_clear(bh_imap* imap) {
@@ -1,5 +1,6 @@
 
 #include "wasm.h"
+#include "ovm_extensions.h"
 
 #if defined(_WIN32) || defined(_WIN64)
     #define ONYX_EXPORT extern __declspec(dllexport)
@@ -34,6 +35,10 @@ typedef struct OnyxRuntime {
     void (*onyx_print_trap)(wasm_trap_t* trap);
     wasm_store_t *(*wasm_store_new)(wasm_engine_t *engine);
     void (*wasm_store_delete)(wasm_store_t *store);
+
+    // Only provided by runtimes that can share one instance between threads. NULL otherwise.
+    wasm_instance_t* (*wasm_instance_new_thread)(wasm_store_t *store, const wasm_instance_t *instance);
+    void (*wasm_instance_delete)(wasm_instance_t *instance);
 } OnyxRuntime;
 
 OnyxRuntime* runtime;
@@ -43,6 +48,10 @@ typedef struct WasmValkindBuffer {
     wasm_valkind_t types[20];
 } WasmValkindBuffer;
 
+//
+// Functions defined with ONYX_DEF_DIRECT. See OnyxValue in ovm_extensions.h.
+typedef wasm_func_direct_callback_t OnyxDirectFunc;
+
 typedef struct WasmFuncDefinition {
     char* module_name;
     char* import_name;
@@ -50,6 +59,9 @@ typedef struct WasmFuncDefinition {
 
     WasmValkindBuffer *params;
     WasmValkindBuffer *results;
+
+    // Only set by ONYX_DEF_DIRECT. The runtime calls this instead of `func` when it can.
+    OnyxDirectFunc direct_func;
 } WasmFuncDefinition;
 
 #define STRINGIFY1(a) #a
@@ -60,6 +72,7 @@ typedef struct WasmFuncDefinition {
 #define ONYX_LINK_NAME_GEN(m) CONCAT2(onyx_library, m)
 #define ONYX_FUNC_NAME(m, n) CONCAT3(__onyx_internal, m, n)
 #define ONYX_DEF_NAME(m, n) CONCAT3(__onyx_internal_def, m, n)
+#define ONYX_DIRECT_NAME(m, n) CONCAT3(__onyx_internal_direct, m, n)
 #define ONYX_PARAM_NAME(m, n) CONCAT3(__onyx_internal_param_buffer, m, n)
 #define ONYX_RESULT_NAME(m, n) CONCAT3(__onyx_internal_result_buffer, m, n)
 #define ONYX_IMPORT_NAME(m, n) STRINGIFY1(m) "_" #n
@@ -75,6 +88,35 @@ typedef struct WasmFuncDefinition {
     \
     static wasm_trap_t* ONYX_FUNC_NAME(ONYX_LIBRARY_NAME, name)(const wasm_val_vec_t* params, wasm_val_vec_t* results)
 
+//
+// Like ONYX_DEF, but the function is given the arguments as raw slots, and the base
+// of linear memory to resolve pointers with (see ONYX_DIRECT_PTR). The WASM API does
+// not have to convert every argument and result, so these calls are much cheaper
+// when the runtime supports them. When it does not (i.e. Wasmer), the function is
+// called through a wrapper that does the conversion instead.
+#define ONYX_DEF_DIRECT(name, params_types, result_types) \
+    static void ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name)(OnyxValue *params, OnyxValue *results, char *memory); \
+    static wasm_trap_t* ONYX_FUNC_NAME(ONYX_LIBRARY_NAME, name)(const wasm_val_vec_t* params, wasm_val_vec_t* results); \
+    static struct WasmValkindBuffer  ONYX_PARAM_NAME(ONYX_LIBRARY_NAME, name) = _VALS params_types; \
+    static struct WasmValkindBuffer  ONYX_RESULT_NAME(ONYX_LIBRARY_NAME, name) = _VALS result_types; \
+    static struct WasmFuncDefinition ONYX_DEF_NAME(ONYX_LIBRARY_NAME, name) = { STRINGIFY2(ONYX_LIBRARY_NAME), #name, ONYX_FUNC_NAME(ONYX_LIBRARY_NAME, name), & ONYX_PARAM_NAME(ONYX_LIBRARY_NAME, name), & ONYX_RESULT_NAME(ONYX_LIBRARY_NAME, name), ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name) }; \
+    \
+    static wasm_trap_t* ONYX_FUNC_NAME(ONYX_LIBRARY_NAME, name)(const wasm_val_vec_t* params, wasm_val_vec_t* results) { \
+        OnyxValue direct_params[20]; \
+        OnyxValue direct_result = { 0 }; \
+        for (unsigned int i = 0; i < params->size; i++) memcpy(&direct_params[i], &params->data[i].of, sizeof(OnyxValue)); \
+        \
+        ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name)(direct_params, &direct_result, runtime->wasm_memory_data(runtime->wasm_memory)); \
+        \
+        if (results->size > 0) { \
+            results->data[0].kind = ONYX_RESULT_NAME(ONYX_LIBRARY_NAME, name).types[0]; \
+            memcpy(&results->data[0].of, &direct_result, sizeof(OnyxValue)); \
+        } \
+        return NULL; \
+    } \
+    \
+    static void ONYX_DIRECT_NAME(ONYX_LIBRARY_NAME, name)(OnyxValue *params, OnyxValue *results, char *memory)
+
 #define ONYX_FUNC(name) & ONYX_DEF_NAME(ONYX_LIBRARY_NAME, name),
 #define ONYX_LIBRARY \
     extern struct WasmFuncDefinition *ONYX_MODULE_NAME_GEN(ONYX_LIBRARY_NAME)[]; \
@@ -100,3 +142,4 @@ typedef struct WasmFuncDefinition {
 #endif
 
 #define ONYX_PTR(p) ((void*) (p != 0 ? (runtime->wasm_memory_data(runtime->wasm_memory) + p) : NULL))
+#define ONYX_DIRECT_PTR(p) ((void*) (p != 0 ? (memory + p) : NULL))
@@ -0,0 +1,39 @@
+#ifndef OVM_EXTENSIONS_H
+#define OVM_EXTENSIONS_H
+
+//
+// Functions OVM provides on top of the WASM C API. They are declared once
+// here, for OVM itself and for the code that calls them when it is built
+// against OVM (see USE_OVM_DEBUGGER).
+//
+
+#include "wasm.h"
+
+//
+// The argument and result slots of a direct function. Every slot is 8 bytes,
+// whatever the type in it, which is the same layout OVM uses for its values.
+typedef union OnyxValue {
+    int       i32;
+    long long i64;
+    float     f32;
+    double    f64;
+} OnyxValue;
+
+//
+// A host function that takes its arguments and result as raw slots, and the
+// base of linear memory. OVM calls these without going through wasm_val_t.
+typedef void (*wasm_func_direct_callback_t)(OnyxValue *params, OnyxValue *results, char *memory);
+
+//
+// `callback` is still used when the function is called with wasm_func_call.
+wasm_func_t *wasm_func_new_direct(wasm_store_t *store, const wasm_functype_t *type,
+    wasm_func_callback_t callback, wasm_func_direct_callback_t direct_callback);
+
+//
+// Makes an instance for running `instance` on another thread. Only the OVM state
+// (registers and stacks) and the exported functions and globals are new; the
+// program, memory, tables and imports are shared, and the data segments are not
+// copied into memory again. `store` must not have an instance yet.
+wasm_instance_t *wasm_instance_new_thread(wasm_store_t *store, const wasm_instance_t *instance);
+
+#endif
@@ -436,6 +436,7 @@ CREDITS
 #define shputs      stbds_shputs
 #define shget       stbds_shget
 #define shgeti      stbds_shgeti
+#define shgeti_ts   stbds_shgeti_ts
 #define shgets      stbds_shgets
 #define shgetp      stbds_shgetp
 #define shgetp_null stbds_shgetp_null
@@ -623,6 +624,11 @@ extern void * stbds_shmode_func(size_t elemsize, int mode);
      ((t) = stbds_hmget_key_wrapper((t), sizeof *(t), (void*) (k), sizeof (t)->key, STBDS_HM_STRING), \
       stbds_temp((t)-1))
 
+// NOTE: Unlike stbds_shgeti, this does not write to the table (or to `t`),
+// so it can be used by many threads at once. A NULL table has no entries.
+#define stbds_shgeti_ts(t,k,temp) \
+     ((t) ? (stbds_hmget_key_ts_wrapper((t), sizeof *(t), (void*) (k), sizeof (t)->key, &(temp), STBDS_HM_STRING), (temp)) : -1)
+
 #define stbds_pshgeti(t,k) \
      ((t) = stbds_hmget_key_wrapper((t), sizeof *(t), (void*) (k), sizeof (*(t))->key, STBDS_HM_PTR_TO_STRING), \
       stbds_temp((t)-1))
@@ -846,7 +852,11 @@ typedef struct
 #define STBDS_HASH_EMPTY      0
 #define STBDS_HASH_DELETED    1
 
-static size_t stbds_hash_seed=0x31415926;
+#ifndef STBDS_THREAD_LOCAL
+#define STBDS_THREAD_LOCAL
+#endif
+
+static STBDS_THREAD_LOCAL size_t stbds_hash_seed=0x31415926;
 
 void stbds_rand_seed(size_t seed)
 {